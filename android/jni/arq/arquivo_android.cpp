@@ -62,6 +62,13 @@ void LeArquivoAsset(tipo_e tipo, const std::string& nome_arquivo, std::string* d
   }
 }
 
+std::unique_ptr<ArquivoMapeado> MapeiaArquivoAsset(tipo_e tipo, const std::string& nome_arquivo) {
+  // Assets podem estar comprimidos no apk: le para um buffer.
+  std::string dados;
+  LeArquivoAsset(tipo, nome_arquivo, &dados);
+  return ArquivoMapeado::DeBuffer(std::move(dados));
+}
+
 const std::vector<std::string> ConteudoDiretorioAsset(tipo_e tipo) {
   std::vector<std::string> ret;
   std::string caminho_asset(Diretorio(tipo));
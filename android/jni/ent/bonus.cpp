@@ -0,0 +1 @@
+../../../ent/bonus.cpp
\ No newline at end of file
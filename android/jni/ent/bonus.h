@@ -0,0 +1 @@
+../../../ent/bonus.h
\ No newline at end of file
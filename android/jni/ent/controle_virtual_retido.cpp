@@ -0,0 +1 @@
+../../../ent/controle_virtual_retido.cpp
\ No newline at end of file
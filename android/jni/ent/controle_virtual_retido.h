@@ -0,0 +1 @@
+../../../ent/controle_virtual_retido.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../ent/escalonador.cpp
\ No newline at end of file
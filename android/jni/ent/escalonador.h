@@ -0,0 +1 @@
+../../../ent/escalonador.h
\ No newline at end of file
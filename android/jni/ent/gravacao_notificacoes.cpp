@@ -0,0 +1 @@
+../../../ent/gravacao_notificacoes.cpp
\ No newline at end of file
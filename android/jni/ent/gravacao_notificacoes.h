@@ -0,0 +1 @@
+../../../ent/gravacao_notificacoes.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../ent/interesse_clientes.cpp
\ No newline at end of file
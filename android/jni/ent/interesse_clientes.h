@@ -0,0 +1 @@
+../../../ent/interesse_clientes.h
\ No newline at end of file
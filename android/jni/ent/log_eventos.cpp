@@ -0,0 +1 @@
+../../../ent/log_eventos.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../ent/log_eventos.h
\ No newline at end of file
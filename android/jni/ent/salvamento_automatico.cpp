@@ -0,0 +1 @@
+../../../ent/salvamento_automatico.cpp
\ No newline at end of file
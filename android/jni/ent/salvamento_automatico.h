@@ -0,0 +1 @@
+../../../ent/salvamento_automatico.h
\ No newline at end of file
@@ -191,6 +191,7 @@ void Java_com_matferib_Tabuleiro_TabuleiroActivity_nativeCreate(
   g_sincronizador.reset(new net::Sincronizador(g_servico_io.get()));
   g_cliente.reset(new net::Cliente(g_sincronizador.get(), g_central.get()));
   g_servidor.reset(new net::Servidor(g_sincronizador.get(), g_central.get()));
+  g_servidor->AlteraFiltroInteresse(g_tabuleiro->MutableInteresseClientes());
   g_receptor.reset(new ReceptorErro);
   g_central->RegistraReceptor(g_receptor.get());
   g_teclado_mouse.reset(new ifg::TratadorTecladoMouse(g_central.get(), g_tabuleiro.get()));
@@ -366,8 +367,7 @@ void Java_com_matferib_Tabuleiro_TabuleiroRenderer_nativeTimer(JNIEnv* env, jobj
 #if !USAR_QT
   g_interface_android->setEnvThisz(env, thiz);
 #endif
-  auto n = ntf::NovaNotificacao(ntf::TN_TEMPORIZADOR);
-  g_central->AdicionaNotificacao(n.release());
+  g_central->AdicionaNotificacao(ntf::NovaNotificacao(ntf::TN_TEMPORIZADOR, g_central->ArenaCiclo()));
   g_central->Notifica();
 }
 
@@ -0,0 +1 @@
+../../../log/perfil.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../log/perfil.h
\ No newline at end of file
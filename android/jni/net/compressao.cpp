@@ -0,0 +1 @@
+../../../net/compressao.cpp
\ No newline at end of file
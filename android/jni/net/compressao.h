@@ -0,0 +1 @@
+../../../net/compressao.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../net/fila_envio.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../net/fila_envio.h
\ No newline at end of file
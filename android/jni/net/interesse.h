@@ -0,0 +1 @@
+../../../net/interesse.h
\ No newline at end of file
@@ -3,13 +3,28 @@
 #endif
 
 #include <boost/filesystem.hpp>
+#include <chrono>
+#include <cstdint>
 #include <cstdlib>
 #include <fstream>
+#include <mutex>
 #include <stdexcept>
+#include <unordered_map>
+#include <google/protobuf/io/gzip_stream.h>
 #include <google/protobuf/io/zero_copy_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include <google/protobuf/message.h>
 #include <google/protobuf/text_format.h>
 #include <stdexcept>
+#if __linux__
+#include <sys/inotify.h>
+#endif
+#if !WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "arq/arquivo.h"
 #include "log/log.h"
@@ -23,6 +38,8 @@ namespace plat {
 
 // Le arquivos readonly.
 void LeArquivoAsset(tipo_e tipo, const std::string& nome_arquivo, std::string* dados);
+// Mapeia arquivos readonly, ou le para um buffer se a plataforma nao os tiver como arquivos normais.
+std::unique_ptr<ArquivoMapeado> MapeiaArquivoAsset(tipo_e tipo, const std::string& nome_arquivo);
 
 // Diretorio de dados de aplicacao do usuario, incluindo / terminal.
 const std::string DiretorioAppsUsuario();
@@ -93,27 +110,124 @@ void CriaDiretoriosUsuario() {
   }
 }
 
-void EscreveArquivoNormal(const std::string& nome_arquivo, const std::string& dados) {
+namespace {
+
+#if WIN32
+void EscreveESincroniza(const std::string& nome_arquivo, const std::string& dados) {
   std::ofstream arquivo(nome_arquivo, std::ios::out | std::ios::binary);
   if (!arquivo) {
     throw std::logic_error(std::string("Arquivo invalido para escrita: ") + nome_arquivo);
   }
   arquivo.write(dados.data(), dados.size());
   arquivo.close();
+  if (!arquivo) {
+    throw std::logic_error(std::string("Falha escrevendo arquivo: ") + nome_arquivo);
+  }
+}
+
+void SincronizaDiretorio(const std::string& diretorio) {}
+#else
+// Escreve os dados e so retorna depois de estarem no disco (fsync).
+void EscreveESincroniza(const std::string& nome_arquivo, const std::string& dados) {
+  int fd = open(nome_arquivo.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw std::logic_error(std::string("Arquivo invalido para escrita: ") + nome_arquivo);
+  }
+  size_t escritos = 0;
+  while (escritos < dados.size()) {
+    ssize_t n = write(fd, dados.data() + escritos, dados.size() - escritos);
+    if (n < 0) {
+      close(fd);
+      throw std::logic_error(std::string("Falha escrevendo arquivo: ") + nome_arquivo);
+    }
+    escritos += n;
+  }
+  const bool sincronizado = fsync(fd) == 0;
+  if (close(fd) != 0 || !sincronizado) {
+    throw std::logic_error(std::string("Falha sincronizando arquivo: ") + nome_arquivo);
+  }
+}
+
+// Para o rename sobreviver a uma queda de energia, a entrada do diretorio tambem precisa ir para o disco.
+void SincronizaDiretorio(const std::string& diretorio) {
+  int fd = open(diretorio.empty() ? "." : diretorio.c_str(), O_RDONLY);
+  if (fd < 0) return;
+  fsync(fd);
+  close(fd);
+}
+#endif
+
+}  // namespace
+
+void EscreveArquivoNormal(const std::string& nome_arquivo, const std::string& dados) {
+  // Escreve em um temporario e renomeia por cima: se o programa cair no meio, o arquivo anterior continua intacto.
+  const std::string temporario = nome_arquivo + ".tmp";
+  try {
+    EscreveESincroniza(temporario, dados);
+    boost::filesystem::rename(temporario, nome_arquivo);
+  } catch (const std::exception& e) {
+    boost::system::error_code ec;
+    boost::filesystem::remove(temporario, ec);
+    LOG(ERROR) << "Falha escrevendo '" << nome_arquivo << "': " << e.what();
+    throw std::logic_error(std::string("Falha escrevendo arquivo: ") + nome_arquivo);
+  }
+  SincronizaDiretorio(boost::filesystem::path(nome_arquivo).parent_path().string());
 }
 
 void LeArquivoNormal(const std::string& nome_arquivo, std::string* dados) {
-  std::ifstream arquivo(nome_arquivo, std::ios::in | std::ios::binary);
+  std::ifstream arquivo(nome_arquivo, std::ios::in | std::ios::binary | std::ios::ate);
   if (!arquivo) {
     throw std::logic_error(std::string("Arquivo invalido: ") + nome_arquivo);
   }
-  dados->assign(std::istreambuf_iterator<char>(arquivo), std::istreambuf_iterator<char>());
+  // Le de uma vez pelo tamanho, em vez de iterar o streambuf byte a byte.
+  const std::streamoff tamanho = arquivo.tellg();
+  if (tamanho < 0) {
+    throw std::logic_error(std::string("Arquivo invalido: ") + nome_arquivo);
+  }
+  dados->resize(tamanho);
+  arquivo.seekg(0);
+  if (!arquivo.read(dados->data(), tamanho)) {
+    throw std::logic_error(std::string("Falha lendo arquivo: ") + nome_arquivo);
+  }
+}
+
+std::unique_ptr<ArquivoMapeado> MapeiaArquivoNormal(const std::string& nome_arquivo) {
+#if WIN32
+  std::string dados;
+  LeArquivoNormal(nome_arquivo, &dados);
+  return ArquivoMapeado::DeBuffer(std::move(dados));
+#else
+  int fd = open(nome_arquivo.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::logic_error(std::string("Arquivo invalido: ") + nome_arquivo);
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+    close(fd);
+    throw std::logic_error(std::string("Arquivo invalido: ") + nome_arquivo);
+  }
+  if (info.st_size == 0) {
+    // mmap nao aceita tamanho zero.
+    close(fd);
+    return ArquivoMapeado::DeBuffer("");
+  }
+  void* mapeamento = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // O mapeamento continua valido depois do close.
+  close(fd);
+  if (mapeamento == MAP_FAILED) {
+    throw std::logic_error(std::string("Falha mapeando arquivo: ") + nome_arquivo);
+  }
+  return ArquivoMapeado::DeMapeamento(mapeamento, info.st_size);
+#endif
 }
 
 const std::vector<std::string> ConteudoDiretorioNormal(const std::string& diretorio) {
   std::vector<std::string> ret;
   for (boost::filesystem::directory_iterator it(diretorio); it != boost::filesystem::directory_iterator(); ++it) {
-    ret.push_back(it->path().filename().string());
+    std::string nome = it->path().filename().string();
+    // Temporarios de EscreveArquivoNormal.
+    if (nome.size() > 4 && nome.compare(nome.size() - 4, 4, ".tmp") == 0) continue;
+    ret.push_back(std::move(nome));
   }
   return ret;
 }
@@ -132,17 +246,195 @@ const std::string Diretorio(tipo_e tipo) {
   }
 }
 
+namespace {
+
+// Sem inotify, a listagem em cache expira depois deste tempo.
+constexpr std::chrono::seconds kValidadeListagem(5);
+
+struct EntradaListagem {
+  Listagem listagem;
+  std::chrono::steady_clock::time_point criacao;
+  // Descritor do inotify observando o diretorio, ou -1.
+  int observador = -1;
+};
+
+struct CacheArquivos {
+  std::mutex mutex;
+  std::unordered_map<int, EntradaListagem> listagens;
+  std::unordered_map<std::string, MetadadosArquivo> metadados;
+  int fd_inotify = -1;
+};
+
+CacheArquivos& Cache() {
+  static CacheArquivos cache;
+  return cache;
+}
+
+#if __linux__
+// Invalida as listagens dos diretorios que mudaram. Nao bloqueia.
+void ProcessaEventosInotify(CacheArquivos* cache) {
+  if (cache->fd_inotify < 0) return;
+  alignas(inotify_event) char buffer[4096];
+  while (true) {
+    ssize_t n = read(cache->fd_inotify, buffer, sizeof(buffer));
+    if (n <= 0) break;
+    for (char* p = buffer; p < buffer + n; ) {
+      const auto* evento = reinterpret_cast<const inotify_event*>(p);
+      // O mesmo diretorio pode servir a mais de um tipo (TIPO_TABULEIRO e TIPO_TABULEIRO_ESTATICO, por exemplo).
+      for (auto& [tipo, entrada] : cache->listagens) {
+        if (entrada.observador != evento->wd) continue;
+        entrada.listagem.reset();
+        if (evento->mask & IN_IGNORED) {
+          // Diretorio removido: volta a depender da validade.
+          entrada.observador = -1;
+        }
+      }
+      p += sizeof(inotify_event) + evento->len;
+    }
+  }
+}
+
+int ObservaDiretorio(CacheArquivos* cache, const std::string& diretorio) {
+  if (cache->fd_inotify < 0) {
+    cache->fd_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (cache->fd_inotify < 0) return -1;
+  }
+  return inotify_add_watch(
+      cache->fd_inotify, diretorio.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF);
+}
+#else
+void ProcessaEventosInotify(CacheArquivos* cache) {}
+int ObservaDiretorio(CacheArquivos* cache, const std::string& diretorio) { return -1; }
+#endif
+
+// Data de modificacao em nanossegundos desde a epoca, com a resolucao do sistema de arquivos.
+bool ModificacaoNs(const std::string& caminho, int64_t* modificacao) {
+#if __linux__ || __APPLE__
+  struct stat st;
+  if (stat(caminho.c_str(), &st) != 0) return false;
+#if __APPLE__
+  const auto& ts = st.st_mtimespec;
+#else
+  const auto& ts = st.st_mtim;
+#endif
+  *modificacao = static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+  return true;
+#else
+  boost::system::error_code ec;
+  const int64_t segundos = boost::filesystem::last_write_time(caminho, ec);
+  if (ec) return false;
+  *modificacao = segundos * 1000000000LL;
+  return true;
+#endif
+}
+
+// Arquivos modificados ha menos que isso nao entram no cache: com resolucao grossa (segundos, em alguns sistemas de
+// arquivos), uma reescrita do mesmo tamanho ainda no mesmo instante nao mudaria a data.
+constexpr int64_t kModificacaoRecenteNs = 1000000000LL;
+
+}  // namespace
+
+Listagem ConteudoDiretorioCompartilhado(tipo_e tipo) {
+  auto& cache = Cache();
+  std::lock_guard<std::mutex> trava(cache.mutex);
+  ProcessaEventosInotify(&cache);
+  auto& entrada = cache.listagens[tipo];
+  const auto agora = std::chrono::steady_clock::now();
+  if (entrada.listagem != nullptr && (entrada.observador >= 0 || agora - entrada.criacao < kValidadeListagem)) {
+    return entrada.listagem;
+  }
+  // Observa antes de listar: uma mudanca durante a listagem invalida a entrada no proximo acesso.
+  if (entrada.observador < 0 && !interno::EhAsset(tipo)) {
+    entrada.observador = ObservaDiretorio(&cache, Diretorio(tipo));
+  }
+  auto listagem = std::make_shared<std::vector<std::string>>(
+      interno::EhAsset(tipo) ? plat::ConteudoDiretorioAsset(tipo) : interno::ConteudoDiretorioNormal(Diretorio(tipo)));
+  entrada.listagem = std::move(listagem);
+  entrada.criacao = agora;
+  return entrada.listagem;
+}
+
+void InvalidaCacheDiretorio(tipo_e tipo) {
+  auto& cache = Cache();
+  std::lock_guard<std::mutex> trava(cache.mutex);
+  auto it = cache.listagens.find(tipo);
+  if (it != cache.listagens.end()) {
+    it->second.listagem.reset();
+  }
+}
+
 const std::vector<std::string> ConteudoDiretorio(tipo_e tipo, std::function<bool(const std::string&)> filtro) {
+  Listagem listagem = ConteudoDiretorioCompartilhado(tipo);
   std::vector<std::string> ret;
-  if (interno::EhAsset(tipo)) {
-    ret = plat::ConteudoDiretorioAsset(tipo);
-  } else {
-    ret = interno::ConteudoDiretorioNormal(Diretorio(tipo));
+  ret.reserve(listagem->size());
+  for (const auto& nome : *listagem) {
+    if (!filtro(nome)) {
+      ret.push_back(nome);
+    }
   }
-  ret.erase(std::remove_if(ret.begin(), ret.end(), filtro), ret.end());
   return ret;
 }
 
+uint64_t HashConteudo(std::string_view dados) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char c : dados) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+MetadadosArquivo Metadados(tipo_e tipo, const std::string& nome_arquivo) {
+  const std::string caminho = interno::CaminhoArquivo(tipo, nome_arquivo);
+  boost::system::error_code ec_tamanho;
+  const uint64_t tamanho = boost::filesystem::file_size(caminho, ec_tamanho);
+  int64_t modificacao = 0;
+  // Assets que nao sao arquivos normais (android) nao mudam: o cache vale para sempre.
+  const bool sem_stat = ec_tamanho || !ModificacaoNs(caminho, &modificacao);
+  if (sem_stat && !interno::EhAsset(tipo)) {
+    throw std::logic_error(std::string("Arquivo invalido: ") + caminho);
+  }
+  const int64_t agora = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  const bool recente = !sem_stat && agora - modificacao < kModificacaoRecenteNs;
+  auto& cache = Cache();
+  if (!recente) {
+    std::lock_guard<std::mutex> trava(cache.mutex);
+    auto it = cache.metadados.find(caminho);
+    if (it != cache.metadados.end() &&
+        (sem_stat || (it->second.tamanho == tamanho && it->second.modificacao == modificacao))) {
+      return it->second;
+    }
+  }
+  auto arquivo = MapeiaArquivo(tipo, nome_arquivo);
+  MetadadosArquivo metadados;
+  metadados.tamanho = arquivo->tamanho();
+  metadados.modificacao = sem_stat ? 0 : modificacao;
+  metadados.hash = HashConteudo(arquivo->Visao());
+  std::lock_guard<std::mutex> trava(cache.mutex);
+  if (recente) {
+    cache.metadados.erase(caminho);
+  } else {
+    cache.metadados[caminho] = metadados;
+  }
+  return metadados;
+}
+
+bool ConteudoIgual(tipo_e tipo, const std::string& nome_arquivo, std::string_view dados) {
+  if (!interno::EhAsset(tipo)) {
+    // Evita o hash quando o tamanho ja difere.
+    boost::system::error_code ec;
+    const uint64_t tamanho = boost::filesystem::file_size(interno::CaminhoArquivo(tipo, nome_arquivo), ec);
+    if (ec || tamanho != dados.size()) return false;
+  }
+  try {
+    const MetadadosArquivo metadados = Metadados(tipo, nome_arquivo);
+    return metadados.tamanho == dados.size() && metadados.hash == HashConteudo(dados);
+  } catch (const std::exception&) {
+    return false;
+  }
+}
+
 // Escrita: funciona para todas as plataformas, desde que a funcao caminho arquivo funcione.
 void EscreveArquivo(tipo_e tipo, const std::string& nome_arquivo, const std::string& dados) {
   if (interno::EhAsset(tipo)) {
@@ -150,6 +442,11 @@ void EscreveArquivo(tipo_e tipo, const std::string& nome_arquivo, const std::str
   }
   std::string caminho_arquivo(interno::CaminhoArquivo(tipo, nome_arquivo));
   interno::EscreveArquivoNormal(caminho_arquivo, dados);
+  InvalidaCacheDiretorio(tipo);
+  // A data de modificacao pode ter resolucao de segundos: uma reescrita com o mesmo tamanho passaria despercebida.
+  auto& cache = Cache();
+  std::lock_guard<std::mutex> trava(cache.mutex);
+  cache.metadados.erase(caminho_arquivo);
 }
 
 void EscreveArquivoAsciiProto(tipo_e tipo, const std::string& nome_arquivo, const google::protobuf::Message& mensagem) {
@@ -165,6 +462,45 @@ void EscreveArquivoBinProto(tipo_e tipo, const std::string& nome_arquivo, const
   EscreveArquivo(tipo, nome_arquivo, mensagem.SerializeAsString());
 }
 
+void EscreveArquivoBinProtoComprimido(
+    tipo_e tipo, const std::string& nome_arquivo, const google::protobuf::Message& mensagem) {
+  std::string dados;
+  {
+    google::protobuf::io::StringOutputStream saida(&dados);
+    google::protobuf::io::GzipOutputStream gzip(&saida);
+    if (!mensagem.SerializeToZeroCopyStream(&gzip) || !gzip.Close()) {
+      throw std::logic_error(std::string("Falha ao comprimir proto para ") + nome_arquivo);
+    }
+  }
+  EscreveArquivo(tipo, nome_arquivo, dados);
+}
+
+ArquivoMapeado::~ArquivoMapeado() {
+#if !WIN32
+  if (mapeamento_ != nullptr) {
+    munmap(mapeamento_, tamanho_);
+  }
+#endif
+}
+
+// static
+std::unique_ptr<ArquivoMapeado> ArquivoMapeado::DeBuffer(std::string buffer) {
+  std::unique_ptr<ArquivoMapeado> arquivo(new ArquivoMapeado);
+  arquivo->buffer_ = std::move(buffer);
+  arquivo->dados_ = arquivo->buffer_.data();
+  arquivo->tamanho_ = arquivo->buffer_.size();
+  return arquivo;
+}
+
+// static
+std::unique_ptr<ArquivoMapeado> ArquivoMapeado::DeMapeamento(void* mapeamento, size_t tamanho) {
+  std::unique_ptr<ArquivoMapeado> arquivo(new ArquivoMapeado);
+  arquivo->mapeamento_ = mapeamento;
+  arquivo->dados_ = static_cast<const char*>(mapeamento);
+  arquivo->tamanho_ = tamanho;
+  return arquivo;
+}
+
 // Leitura: a parte de assets eh especifica de plataforma. Caminho arquivo tem que funcionar tambem.
 void LeArquivo(tipo_e tipo, const std::string& nome_arquivo, std::string* dados) {
   if (interno::EhAsset(tipo)) {
@@ -174,6 +510,13 @@ void LeArquivo(tipo_e tipo, const std::string& nome_arquivo, std::string* dados)
   }
 }
 
+std::unique_ptr<ArquivoMapeado> MapeiaArquivo(tipo_e tipo, const std::string& nome_arquivo) {
+  if (interno::EhAsset(tipo)) {
+    return plat::MapeiaArquivoAsset(tipo, nome_arquivo);
+  }
+  return interno::MapeiaArquivoNormal(interno::CaminhoArquivo(tipo, nome_arquivo));
+}
+
 // Esse log handler imprime filename como o fonte que esta processando o arquivo e nao o arquivo sendo lido :(
 //void LogHandler(google::protobuf::LogLevel level, const char* filename, int line, const std::string& message);
 
@@ -193,19 +536,26 @@ struct ScopedLogHandler {
 std::string ScopedLogHandler::g_nome_arquivo;
 
 void LeArquivoAsciiProto(tipo_e tipo, const std::string& nome_arquivo, google::protobuf::Message* mensagem) {
-  std::string dados;
-  LeArquivo(tipo, nome_arquivo, &dados);
+  auto arquivo = MapeiaArquivo(tipo, nome_arquivo);
+  google::protobuf::io::ArrayInputStream entrada(arquivo->dados(), arquivo->tamanho());
 
   ScopedLogHandler slh(nome_arquivo);
-  google::protobuf::TextFormat::ParseFromString(dados, mensagem);
+  google::protobuf::TextFormat::Parse(&entrada, mensagem);
 }
 
 void LeArquivoBinProto(tipo_e tipo, const std::string& nome_arquivo, google::protobuf::Message* mensagem) {
-  std::string dados;
-  LeArquivo(tipo, nome_arquivo, &dados);
+  auto arquivo = MapeiaArquivo(tipo, nome_arquivo);
+  const unsigned char* dados = arquivo->dados();
+  google::protobuf::io::ArrayInputStream entrada(dados, arquivo->tamanho());
 
   ScopedLogHandler slh(nome_arquivo);
-  mensagem->ParseFromString(dados);
+  // Cabecalho gzip. Nenhum proto binario comeca assim (seria o campo 3 com wire type 7, que nao existe).
+  if (arquivo->tamanho() >= 2 && dados[0] == 0x1f && dados[1] == 0x8b) {
+    google::protobuf::io::GzipInputStream gzip(&entrada, google::protobuf::io::GzipInputStream::GZIP);
+    mensagem->ParseFromZeroCopyStream(&gzip);
+    return;
+  }
+  mensagem->ParseFromZeroCopyStream(&entrada);
 }
 
 //void LogHandler(google::protobuf::LogLevel level, const char* filename, int line, const std::string& message) {
@@ -1,8 +1,11 @@
 #ifndef ARQ_ARQUIVO_H
 #define ARQ_ARQUIVO_H
 
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #if ANDROID
@@ -61,18 +64,74 @@ void Inicializa(const std::string& x_path);
 // Retorna conteudo de um diretorio. Se o filtro for passado, aqueles que retornarem true serao filtrados (removidos).
 const std::vector<std::string> ConteudoDiretorio(tipo_e tipo, std::function<bool(const std::string&)> filtro = [] (const std::string&) { return false; });
 
+/** Listagem de diretorio compartilhada e imutavel, mantida em cache por tipo. No linux, o diretorio eh observado por
+* inotify e so eh listado de novo apos alguma mudanca nele. Nas outras plataformas, a listagem expira em alguns
+* segundos. Escritas por EscreveArquivo invalidam o cache do tipo na hora.
+*/
+using Listagem = std::shared_ptr<const std::vector<std::string>>;
+Listagem ConteudoDiretorioCompartilhado(tipo_e tipo);
+void InvalidaCacheDiretorio(tipo_e tipo);
+
+struct MetadadosArquivo {
+  uint64_t tamanho = 0;
+  // Nanossegundos desde a epoca, na resolucao do sistema de arquivos.
+  int64_t modificacao = 0;
+  // Ver HashConteudo.
+  uint64_t hash = 0;
+};
+// Metadados de um arquivo, em cache. O hash so eh recalculado se o tamanho ou a data de modificacao mudarem, ou se o
+// arquivo foi modificado ha menos de um segundo.
+// @throws std::logic_error caso o arquivo nao exista.
+MetadadosArquivo Metadados(tipo_e tipo, const std::string& nome_arquivo);
+// Hash do conteudo de arquivos (FNV-1a de 64 bits), estavel entre plataformas.
+uint64_t HashConteudo(std::string_view dados);
+// Retorna se o arquivo existe com exatamente este conteudo, comparando tamanho e hash dos metadados.
+bool ConteudoIgual(tipo_e tipo, const std::string& nome_arquivo, std::string_view dados);
+
 // Retorna o diretorio do tipo passado, sem a "/" final.
 const std::string Diretorio(tipo_e tipo);
 
-// Interface de escrita.
+// Interface de escrita. A escrita eh atomica: os dados vao para um temporario, que substitui o arquivo ao final.
 // @throws std::logic_error caso nao consiga escrever arquivo.
 void EscreveArquivo(tipo_e tipo, const std::string& nome_arquivo, const std::string& dados);
 void EscreveArquivoAsciiProto(tipo_e tipo, const std::string& nome_arquivo, const google::protobuf::Message& mensagem);
 void EscreveArquivoBinProto(tipo_e tipo, const std::string& nome_arquivo, const google::protobuf::Message& mensagem);
+// Como EscreveArquivoBinProto, comprimido com gzip. LeArquivoBinProto reconhece o formato.
+void EscreveArquivoBinProtoComprimido(
+    tipo_e tipo, const std::string& nome_arquivo, const google::protobuf::Message& mensagem);
+
+/** Conteudo somente leitura de um arquivo. Arquivos normais sao mapeados em memoria (sem copia); assets de android e
+* ios, e arquivos no windows, sao lidos para um buffer interno. Os dados sao validos enquanto o objeto existir.
+*/
+class ArquivoMapeado {
+ public:
+  ~ArquivoMapeado();
+  ArquivoMapeado(const ArquivoMapeado&) = delete;
+  ArquivoMapeado& operator=(const ArquivoMapeado&) = delete;
+
+  const unsigned char* dados() const { return reinterpret_cast<const unsigned char*>(dados_); }
+  size_t tamanho() const { return tamanho_; }
+  std::string_view Visao() const { return std::string_view(dados_, tamanho_); }
+
+  // Para as implementacoes de plataforma.
+  static std::unique_ptr<ArquivoMapeado> DeBuffer(std::string buffer);
+  static std::unique_ptr<ArquivoMapeado> DeMapeamento(void* mapeamento, size_t tamanho);
+
+ private:
+  ArquivoMapeado() = default;
+
+  std::string buffer_;
+  void* mapeamento_ = nullptr;
+  const char* dados_ = nullptr;
+  size_t tamanho_ = 0;
+};
 
 // Interface de leitura.
 // @throws ParseProtoException caso nao consiga ler o arquivo.
 void LeArquivo(tipo_e tipo, const std::string& nome_arquivo, std::string* dados);
+// Como LeArquivo, sem copiar o conteudo quando possivel. Ver ArquivoMapeado.
+// @throws std::logic_error caso nao consiga ler o arquivo.
+std::unique_ptr<ArquivoMapeado> MapeiaArquivo(tipo_e tipo, const std::string& nome_arquivo);
 void LeArquivoAsciiProto(tipo_e tipo, const std::string& nome_arquivo, google::protobuf::Message* mensagem);
 void LeArquivoBinProto(tipo_e tipo, const std::string& nome_arquivo, google::protobuf::Message* mensagem);
 
@@ -87,10 +146,12 @@ bool EhAsset(tipo_e tipo);
 const std::string CaminhoArquivo(tipo_e tipo, const std::string& arquivo);
 // Cria a estrutura de diretorios para conteudo do usuario.
 void CriaDiretoriosUsuario();
-// Escreve um arquivo com caminho completo.
+// Escreve um arquivo com caminho completo, atomicamente (temporario + fsync + rename).
 void EscreveArquivoNormal(const std::string& nome_arquivo, const std::string& dados);
 // Le um arquivo dado o caminho completo.
 void LeArquivoNormal(const std::string& nome_arquivo, std::string* dados);
+// Mapeia um arquivo dado o caminho completo (no windows, le para um buffer).
+std::unique_ptr<ArquivoMapeado> MapeiaArquivoNormal(const std::string& nome_arquivo);
 // Lista o conteudo de um diretorio.
 const std::vector<std::string> ConteudoDiretorioNormal(const std::string& diretorio);
 
@@ -94,6 +94,10 @@ void LeArquivoAsset(tipo_e tipo, const std::string& nome_arquivo, std::string* d
   interno::LeArquivoNormal(caminho_asset, dados);
 }
 
+std::unique_ptr<ArquivoMapeado> MapeiaArquivoAsset(tipo_e tipo, const std::string& nome_arquivo) {
+  return interno::MapeiaArquivoNormal(interno::CaminhoArquivo(tipo, nome_arquivo));
+}
+
 const std::vector<std::string> ConteudoDiretorioAsset(tipo_e tipo) {
   return interno::ConteudoDiretorioNormal(Diretorio(tipo));
 }
@@ -1,6 +1,10 @@
 #include <algorithm>
 #include <cmath>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
 
 //#define VLOG_NIVEL 2
 #include "absl/strings/str_format.h"
@@ -16,6 +20,7 @@
 #include "ntf/notificacao.h"
 #include "ntf/notificacao.pb.h"
 #include "log/log.h"
+#include "log/perfil.h"
 #include "som/som.h"
 #include "tex/texturas.h"
 
@@ -63,6 +68,89 @@ bool TemDeltaAcao(const AcaoProto& acao_proto) {
   return acao_proto.has_delta_pontos_vida();
 }
 
+void CorProto(const Cor& cor, bool com_alfa, float saida[4]) {
+  saida[0] = cor.r();
+  saida[1] = cor.g();
+  saida[2] = cor.b();
+  saida[3] = com_alfa ? cor.a() : 1.0f;
+}
+
+// Pool das acoes: blocos de tamanho fixo por classe de tamanho (multiplos de kGranularidade), reservados em pedacos de
+// kBlocosPorPedaco. Os blocos liberados voltam para a lista da classe e nunca sao devolvidos ao sistema.
+class PoolAcoes {
+ public:
+  void* Aloca(std::size_t tamanho) {
+    const std::size_t classe = Classe(tamanho);
+    if (classe >= kNumClasses) {
+      return ::operator new(tamanho);
+    }
+    std::lock_guard<std::mutex> trava(mutex_);
+    auto& livres = livres_[classe];
+    if (livres.empty()) {
+      const std::size_t tamanho_bloco = (classe + 1) * kGranularidade;
+      pedacos_.emplace_back(new char[tamanho_bloco * kBlocosPorPedaco]);
+      for (int i = kBlocosPorPedaco - 1; i >= 0; --i) {
+        livres.push_back(pedacos_.back().get() + i * tamanho_bloco);
+      }
+      estatisticas_.blocos_reservados += kBlocosPorPedaco;
+    }
+    void* p = livres.back();
+    livres.pop_back();
+    ++estatisticas_.alocacoes;
+    ++estatisticas_.blocos_em_uso;
+    return p;
+  }
+
+  void Libera(void* p, std::size_t tamanho) {
+    if (p == nullptr) return;
+    const std::size_t classe = Classe(tamanho);
+    if (classe >= kNumClasses) {
+      ::operator delete(p);
+      return;
+    }
+    std::lock_guard<std::mutex> trava(mutex_);
+    livres_[classe].push_back(static_cast<char*>(p));
+    --estatisticas_.blocos_em_uso;
+  }
+
+  EstatisticasPoolAcoes LeEstatisticas() const {
+    std::lock_guard<std::mutex> trava(mutex_);
+    return estatisticas_;
+  }
+
+ private:
+  static constexpr std::size_t kGranularidade = 64;
+  static constexpr std::size_t kNumClasses = 64;
+  static constexpr int kBlocosPorPedaco = 32;
+  static std::size_t Classe(std::size_t tamanho) { return tamanho == 0 ? 0 : (tamanho - 1) / kGranularidade; }
+
+  mutable std::mutex mutex_;
+  std::vector<char*> livres_[kNumClasses];
+  std::vector<std::unique_ptr<char[]>> pedacos_;
+  EstatisticasPoolAcoes estatisticas_;
+};
+
+PoolAcoes& Pool() {
+  // Nunca destruido: acoes podem ser liberadas durante a destruicao de objetos estaticos.
+  static PoolAcoes* pool = new PoolAcoes;
+  return *pool;
+}
+
+// Geometrias das acoes para o desenho em lote, indexadas por GeometriaAcao. Gravadas por Acao::IniciaGl.
+std::vector<gl::VboGravado>& VbosGeometriaAcao() {
+  static std::vector<gl::VboGravado> vbos;
+  return vbos;
+}
+
+const gl::VboGravado& VboGeometriaAcao(GeometriaAcao geometria) {
+  if (VbosGeometriaAcao().empty()) {
+    // Sem Tabuleiro::IniciaGL (por exemplo, em testes).
+    Acao::IniciaGl();
+  }
+  const int indice = (geometria >= ACAO_GEO_CUBO && geometria <= ACAO_GEO_CILINDRO) ? geometria : ACAO_GEO_ESFERA;
+  return VbosGeometriaAcao()[indice];
+}
+
 // Verifica se a coordenada passou do ponto de destino.
 bool Passou(float antes, float depois, float destino) {
   return (antes < destino) ? depois > destino : depois < destino;
@@ -82,7 +170,7 @@ class AcaoSinalizacao : public Acao {
     if (!acao_proto_.has_pos_tabuleiro()) {
       estado_ = -1.0f;
     }
-    if (!vbo_.Gravado()) {
+    if (!vbo_.Gravado() && (tabuleiro_ == nullptr || !tabuleiro_->SemGrafico())) {
       const float coordenadas[] = {
         // Primeiro triangulo.
         COS_30 * 0.3f, SEN_30 * 0.2f,
@@ -301,6 +389,9 @@ class AcaoDeltaPontosVida : public Acao {
       return;
     }
     VLOG(2) << "String delta: " << string_delta_ << ", string texto: " << string_texto_;
+    // Convertidas uma vez: com muitos numeros na tela, a conversao a cada quadro pesa.
+    string_delta_desenho_ = StringSemUtf8(string_delta_);
+    string_texto_desenho_ = StringSemUtf8(string_texto_);
     num_linhas_ = 1 + std::count(string_texto_.begin(), string_texto_.end(), '\n');
     duracao_total_ms_ = std::max<int>(5000, acao_proto_.has_duracao_s() ? acao_proto_.duracao_s() * 1000 : DURACAO_UMA_LINHA_MS * num_linhas_);
     faltam_ms_ = duracao_total_ms_;
@@ -365,11 +456,11 @@ class AcaoDeltaPontosVida : public Acao {
     gl::DesabilitaEscopo salva_oclusao(gl::OclusaoLigada, gl::Oclusao);
     if (pos_2d_.has_x()) {
       if (gl::PosicaoRasterAbsoluta(pos_2d_.x(), pos_2d_.y())) {
-        gl::DesenhaString(StringSemUtf8(string_delta_));
+        gl::DesenhaString(string_delta_desenho_);
       }
     } else {
       if (gl::PosicaoRaster(0.0f, 0.0f, 0.0f)) {
-        gl::DesenhaString(StringSemUtf8(string_delta_));
+        gl::DesenhaString(string_delta_desenho_);
       }
     }
   }
@@ -379,11 +470,11 @@ class AcaoDeltaPontosVida : public Acao {
     gl::DesabilitaEscopo salva_oclusao(gl::OclusaoLigada, gl::Oclusao);
     if (pos_2d_.has_x()) {
       if (gl::PosicaoRasterAbsoluta(pos_2d_.x(), pos_2d_.y())) {
-        gl::DesenhaString(StringSemUtf8(string_texto_));
+        gl::DesenhaString(string_texto_desenho_);
       }
     } else {
       if (gl::PosicaoRaster(0.0f, 0.0f, 0.0f)) {
-        gl::DesenhaString(StringSemUtf8(string_texto_), /*inverte_vertical=*/true);
+        gl::DesenhaString(string_texto_desenho_, /*inverte_vertical=*/true);
       }
     }
   }
@@ -394,6 +485,9 @@ class AcaoDeltaPontosVida : public Acao {
   int delta_acao_ = 0;
   std::string string_texto_;
   std::string string_delta_;
+  // Versoes sem UTF-8, para DesenhaString.
+  std::string string_texto_desenho_;
+  std::string string_delta_desenho_;
   int duracao_total_ms_ = 0;
   Posicao pos_;
   Posicao pos_2d_;
@@ -434,27 +528,26 @@ class AcaoDispersao : public Acao {
   }
 
   void DesenhaSeNaoFinalizada(ParametrosDesenho* pd) const override {
-    MudaCorProtoAlfa(acao_proto_.cor());
-    gl::MatrizEscopo salva_matriz;
-    const Posicao& pos_tabuleiro = acao_proto_.pos_tabuleiro();
+    DesenhaGeometriaLote();
+  }
+
+  bool SuportaLote() const override { return true; }
 
+  bool GeometriaLote(Matrix4* modelagem, float cor[4], bool* sem_luz) const override {
     if (acao_proto_.geometria() == ACAO_GEO_CONE) {
       Entidade* entidade_origem = tabuleiro_->BuscaEntidade(acao_proto_.id_entidade_origem());
       if (entidade_origem == nullptr) {
-        return;
+        return false;
       }
       // Posicao da acao eh a ponta do cone. Computa tudo considerando nivel do solo, depois faz translacao pro nivel da acao.
-      const auto& pos_origem = entidade_origem->PosicaoAcao();
-      Vector3 v_origem(pos_origem.x(), pos_origem.y(), pos_origem.z());
-      Vector3 v_destino(pos_tabuleiro.x(), pos_tabuleiro.y(), pos_tabuleiro.z());
-      gl::MultiplicaMatriz(MatrizCone(acao_proto_, pos_origem, efeito_).get());
+      *modelagem = MatrizCone(acao_proto_, entidade_origem->PosicaoAcao(), efeito_);
     } else {
-      const Posicao& pos = acao_proto_.has_pos_entidade() ? acao_proto_.pos_entidade() : pos_tabuleiro;
-      gl::Translada(pos.x(), pos.y(), pos.z());
-      gl::Escala(efeito_, efeito_, efeito_);
+      const Posicao& pos = acao_proto_.has_pos_entidade() ? acao_proto_.pos_entidade() : acao_proto_.pos_tabuleiro();
+      *modelagem = Matrix4().scale(efeito_, efeito_, efeito_).translate(pos.x(), pos.y(), pos.z());
     }
-    gl::DesabilitaEscopo luz(GL_LIGHTING);
-    DesenhaGeometriaAcao();
+    CorProto(acao_proto_.cor(), /*com_alfa=*/true, cor);
+    *sem_luz = true;
+    return true;
   }
 
   void AtualizaAposAtraso(int intervalo_ms, const Olho& camera) override {
@@ -534,31 +627,29 @@ class AcaoProjetilArea: public Acao {
   }
 
   void DesenhaSeNaoFinalizada(ParametrosDesenho* pd) const override {
-    MudaCorProtoAlfa(acao_proto_.cor());
-    gl::MatrizEscopo salva_matriz;
+    DesenhaGeometriaLote();
+  }
+
+  bool SuportaLote() const override { return true; }
 
+  bool GeometriaLote(Matrix4* modelagem, float cor[4], bool* sem_luz) const override {
     switch (estagio_) {
-      case INICIAL: {
-      }
-      break;
       case VOO: {
-        gl::MatrizEscopo salva_matriz;
-        MudaCorProto(acao_proto_.cor());
-        gl::Translada(pos_.x(), pos_.y(), pos_.z());
-        gl::Escala(acao_proto_.escala().x(), acao_proto_.escala().y(), acao_proto_.escala().z());
-        DesenhaGeometriaAcao();
+        const auto& escala = acao_proto_.escala();
+        *modelagem = Matrix4().scale(escala.x(), escala.y(), escala.z()).translate(pos_.x(), pos_.y(), pos_.z());
+        CorProto(acao_proto_.cor(), /*com_alfa=*/false, cor);
+        *sem_luz = false;
+        return true;
       }
-      break;
       case ATINGIU_ALVO: {
-        const Posicao& pos_tabuleiro = acao_proto_.pos_tabuleiro();
-        const Posicao& pos = acao_proto_.has_pos_entidade() ? acao_proto_.pos_entidade() : pos_tabuleiro;
-        gl::Translada(pos.x(), pos.y(), pos.z());
-        gl::Escala(efeito_q_, efeito_q_, efeito_q_);
-        gl::DesabilitaEscopo luz(GL_LIGHTING);
-        DesenhaGeometriaAcao();
+        const Posicao& pos = acao_proto_.has_pos_entidade() ? acao_proto_.pos_entidade() : acao_proto_.pos_tabuleiro();
+        *modelagem = Matrix4().scale(efeito_q_, efeito_q_, efeito_q_).translate(pos.x(), pos.y(), pos.z());
+        CorProto(acao_proto_.cor(), /*com_alfa=*/true, cor);
+        *sem_luz = true;
+        return true;
       }
-      break;
-      default: ;
+      default:
+        return false;
     }
   }
 
@@ -726,17 +817,24 @@ class AcaoProjetil : public Acao {
   }
 
   void DesenhaSeNaoFinalizada(ParametrosDesenho* pd) const override {
+    DesenhaGeometriaLote();
+  }
+
+  bool SuportaLote() const override { return true; }
+
+  bool GeometriaLote(Matrix4* modelagem, float cor[4], bool* sem_luz) const override {
     if (estagio_ == ATINGIU_ALVO) {
-      return;
+      return false;
     }
     // TODO desenha impacto.
-    gl::MatrizEscopo salva_matriz;
-    MudaCorProto(acao_proto_.cor());
-    gl::Translada(pos_.x(), pos_.y(), pos_.z());
+    const auto& escala = acao_proto_.escala();
     // Roda pro vetor de direcao.
-    gl::Roda(VetorParaRotacaoGraus(dx_, dy_), 0, 0, 1.0f);
-    gl::Escala(acao_proto_.escala().x(), acao_proto_.escala().y(), acao_proto_.escala().z());
-    DesenhaGeometriaAcao();
+    *modelagem = Matrix4().scale(escala.x(), escala.y(), escala.z())
+                          .rotateZ(VetorParaRotacaoGraus(dx_, dy_))
+                          .translate(pos_.x(), pos_.y(), pos_.z());
+    CorProto(acao_proto_.cor(), /*com_alfa=*/false, cor);
+    *sem_luz = false;
+    return true;
   }
 
   bool Finalizada() const override {
@@ -1104,17 +1202,25 @@ class AcaoFeitico : public Acao {
   }
 
   void DesenhaSeNaoFinalizada(ParametrosDesenho* pd) const override {
+    DesenhaGeometriaLote();
+  }
+
+  bool SuportaLote() const override { return true; }
+
+  bool GeometriaLote(Matrix4* modelagem, float cor[4], bool* sem_luz) const override {
     auto* e = tabuleiro_->BuscaEntidade(desenhando_origem_ ? acao_proto_.id_entidade_origem() : acao_proto_.por_entidade(0).id());
     if (e == nullptr) {
-      return;
+      return false;
     }
     const Posicao& pos = e->PosicaoAcao();
-    MudaCorProto(acao_proto_.cor());
-    gl::Translada(pos.x() + acao_proto_.translacao().x(),
-                  pos.y() + acao_proto_.translacao().y(),
-                  pos.z() + acao_proto_.translacao().z());
-    gl::Escala(acao_proto_.escala().x() * raio_, acao_proto_.escala().y() * raio_, acao_proto_.escala().z() * raio_);
-    DesenhaGeometriaAcao();
+    const auto& escala = acao_proto_.escala();
+    *modelagem = Matrix4().scale(escala.x() * raio_, escala.y() * raio_, escala.z() * raio_)
+                          .translate(pos.x() + acao_proto_.translacao().x(),
+                                     pos.y() + acao_proto_.translacao().y(),
+                                     pos.z() + acao_proto_.translacao().z());
+    CorProto(acao_proto_.cor(), /*com_alfa=*/false, cor);
+    *sem_luz = false;
+    return true;
   }
 
   void AtualizaAposAtraso(int intervalo_ms, const Olho& camera) override {
@@ -1174,6 +1280,30 @@ class AcaoCriacaoEntidade : public Acao {
 
 }  // namespace
 
+// static
+void Acao::IniciaGl() {
+  auto& vbos = VbosGeometriaAcao();
+  vbos.resize(ACAO_GEO_CILINDRO + 1);
+  for (int i = 0; i < static_cast<int>(vbos.size()); ++i) {
+    auto& vbo = vbos[i];
+    vbo.Desgrava();
+    // Mesmas geometrias de Acao::DesenhaGeometriaAcao.
+    switch (i) {
+      case ACAO_GEO_CUBO:
+        vbo.Grava(GL_TRIANGLES, gl::VboCuboSolido(1.0f));
+        break;
+      case ACAO_GEO_CONE:
+        vbo.Grava(GL_TRIANGLES, gl::VboConeSolido(0.5f, 1.0f, 10, 3));
+        break;
+      case ACAO_GEO_CILINDRO:
+        vbo.Grava(GL_TRIANGLES, gl::VboCilindroSolido(1.0f, 2.0f, 10, 3));
+        break;
+      default:
+        vbo.Grava(GL_TRIANGLES, gl::VboEsferaSolida(1.0f, 10, 10));
+    }
+  }
+}
+
 // Acao.
 Acao::Acao(const Tabelas& tabelas, const AcaoProto& acao_proto, Tabuleiro* tabuleiro, tex::Texturas* texturas, const m3d::Modelos3d* modelos3d, ntf::CentralNotificacoes* central)
     : tabelas_(tabelas), acao_proto_(acao_proto), tabuleiro_(tabuleiro), texturas_(texturas), m3d_(modelos3d), central_(central) {
@@ -1279,12 +1409,70 @@ void Acao::DesenhaComum(ParametrosDesenho* pd, std::function<void(ParametrosDese
     gl::Habilita(GL_TEXTURE_2D);
     gl::LigacaoComTextura(GL_TEXTURE_2D, id_textura);
   }
-  std::unique_ptr<gl::DesabilitaEscopo> luz_escopo(acao_proto_.ignora_luz() ? new gl::DesabilitaEscopo(GL_LIGHTING): nullptr);
-  std::unique_ptr<gl::DesabilitaEscopo> cull_escopo(acao_proto_.dois_lados() ? new gl::DesabilitaEscopo(GL_CULL_FACE): nullptr);
+  std::optional<gl::DesabilitaEscopo> luz_escopo;
+  if (acao_proto_.ignora_luz()) luz_escopo.emplace(GL_LIGHTING);
+  std::optional<gl::DesabilitaEscopo> cull_escopo;
+  if (acao_proto_.dois_lados()) cull_escopo.emplace(GL_CULL_FACE);
   f_desenho(pd);
   gl::Desabilita(GL_TEXTURE_2D);
 }
 
+bool Acao::AdicionaAoLote(ParametrosDesenho* pd, bool translucido, LotesAcoes* lotes) const {
+  // Mesmos testes de Desenha, DesenhaTranslucido e DesenhaComum.
+  if ((acao_proto_.cor().a() < 1.0f) != translucido) {
+    return true;
+  }
+  if (atraso_s_ > 0 || Finalizada()) {
+    return true;
+  }
+  if (!SuportaLote()) {
+    return false;
+  }
+  if (IdCenario() != pd->pos_olho().id_cenario()) {
+    return true;
+  }
+  Matrix4 modelagem;
+  float cor[4];
+  bool sem_luz = false;
+  if (!GeometriaLote(&modelagem, cor, &sem_luz)) {
+    return true;
+  }
+  sem_luz |= acao_proto_.ignora_luz();
+  const GLuint textura = acao_proto_.info_textura().id().empty() ? GL_INVALID_VALUE : texturas_->Textura(acao_proto_.info_textura().id());
+  if (acao_proto_.geometria() == ACAO_GEO_MODELO_3D) {
+    const auto* modelo = m3d_->Modelo(acao_proto_.modelo_3d().id());
+    if (modelo != nullptr) {
+      lotes->Adiciona(modelo->vbos_gravados, textura, sem_luz, acao_proto_.dois_lados(), modelagem, cor);
+    }
+  } else {
+    lotes->Adiciona(VboGeometriaAcao(acao_proto_.geometria()), textura, sem_luz, acao_proto_.dois_lados(), modelagem, cor);
+  }
+  return true;
+}
+
+void Acao::DesenhaGeometriaLote() const {
+  Matrix4 modelagem;
+  float cor[4];
+  bool sem_luz = false;
+  if (!GeometriaLote(&modelagem, cor, &sem_luz)) {
+    return;
+  }
+  gl::MatrizEscopo salva_matriz;
+  MudaCorAlfa(cor);
+  gl::MultiplicaMatriz(modelagem.get());
+  std::optional<gl::DesabilitaEscopo> luz_escopo;
+  if (sem_luz) luz_escopo.emplace(GL_LIGHTING);
+  DesenhaGeometriaAcao();
+}
+
+void* Acao::operator new(std::size_t tamanho) {
+  return Pool().Aloca(tamanho);
+}
+
+void Acao::operator delete(void* p, std::size_t tamanho) {
+  Pool().Libera(p, tamanho);
+}
+
 void Acao::Desenha(ParametrosDesenho* pd) const {
   if (acao_proto_.cor().a() < 1.0f) {
     return;
@@ -1856,6 +2044,50 @@ Acao* NovaAcao(const Tabelas& tabelas, const AcaoProto& acao_proto, Tabuleiro* t
   }
 }
 
+EstatisticasPoolAcoes LeEstatisticasPoolAcoes() {
+  return Pool().LeEstatisticas();
+}
+
+void LotesAcoes::Inicia() {
+  for (auto& lote : lotes_) {
+    lote.Inicia();
+  }
+}
+
+void LotesAcoes::Adiciona(
+    const gl::VboGravado& vbo, unsigned int textura, bool sem_luz, bool dois_lados, const Matrix4& modelagem, const float cor[4]) {
+  lotes_[Indice(sem_luz, dois_lados)].Adiciona(vbo, textura, modelagem, cor);
+}
+
+void LotesAcoes::Adiciona(
+    const gl::VbosGravados& vbos, unsigned int textura, bool sem_luz, bool dois_lados, const Matrix4& modelagem, const float cor[4]) {
+  lotes_[Indice(sem_luz, dois_lados)].Adiciona(vbos, textura, modelagem, cor);
+}
+
+void LotesAcoes::Desenha() const {
+  PERFIL_ZONA("LotesAcoes::Desenha");
+  for (int i = 0; i < 4; ++i) {
+    if (lotes_[i].NumInstancias() == 0) continue;
+    std::optional<gl::DesabilitaEscopo> luz_escopo;
+    if (i & 1) luz_escopo.emplace(GL_LIGHTING);
+    std::optional<gl::DesabilitaEscopo> cull_escopo;
+    if (i & 2) cull_escopo.emplace(GL_CULL_FACE);
+    lotes_[i].Desenha();
+  }
+}
+
+int LotesAcoes::NumLotes() const {
+  int num = 0;
+  for (const auto& lote : lotes_) num += lote.NumLotes();
+  return num;
+}
+
+int LotesAcoes::NumInstancias() const {
+  int num = 0;
+  for (const auto& lote : lotes_) num += lote.NumInstancias();
+  return num;
+}
+
 const std::string& TextoAcao(const AcaoProto& acao_proto) {
   if (TemAlgumDestino(acao_proto) && acao_proto.por_entidade(0).has_texto()) {
     return acao_proto.por_entidade(0).texto();
@@ -1,10 +1,15 @@
 #ifndef ENT_ACOES_H
 #define ENT_ACOES_H
 
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include "ent/acoes.pb.h"
+#include "ent/entidade.h"
 #include "ent/tabelas.h"
 #include "ent/tabuleiro.pb.h"
+#include "gltab/gl_vbo.h"
+#include "matrix/matrices.h"
 
 namespace ntf {
 class CentralNotificacoes;
@@ -19,20 +24,52 @@ class Modelos3d;
 
 namespace ent {
 
-class Entidade;
-class EntidadeProto;
 class Tabuleiro;
 
+/** Lotes de instancias das acoes desenhadas apenas pela geometria do proto (ver Acao::AdicionaAoLote).
+* Como LotesInstancias, mas separando os estados que as acoes alteram: luz e descarte de faces.
+* Uso, a cada quadro: Inicia, AdicionaAoLote para cada acao, Desenha.
+*/
+class LotesAcoes {
+ public:
+  void Inicia();
+  // textura pode ser GL_INVALID_VALUE.
+  void Adiciona(const gl::VboGravado& vbo, unsigned int textura, bool sem_luz, bool dois_lados, const Matrix4& modelagem, const float cor[4]);
+  void Adiciona(const gl::VbosGravados& vbos, unsigned int textura, bool sem_luz, bool dois_lados, const Matrix4& modelagem, const float cor[4]);
+  void Desenha() const;
+  int NumLotes() const;
+  int NumInstancias() const;
+
+ private:
+  static int Indice(bool sem_luz, bool dois_lados) { return (sem_luz ? 1 : 0) + (dois_lados ? 2 : 0); }
+
+  // Por estado: 1 sem luz, 2 dois lados.
+  LotesInstancias lotes_[4];
+};
+
 class Acao {
  public:
   Acao(const Tabelas& tabelas, const AcaoProto& acao_proto, Tabuleiro* tabuleiro, tex::Texturas* texturas, const m3d::Modelos3d* modelos3d, ntf::CentralNotificacoes* central);
   virtual ~Acao();
 
+  // As acoes vem de um pool (ver LeEstatisticasPoolAcoes): em combates, muitas sao criadas e destruidas por rodada.
+  static void* operator new(std::size_t tamanho);
+  static void operator delete(void* p, std::size_t tamanho);
+
+  // Grava os VBOs compartilhados pelo desenho em lote das acoes. Chamado por Tabuleiro::IniciaGL, inclusive apos perda
+  // de contexto, como Entidade::IniciaGl.
+  static void IniciaGl();
+
   void Atualiza(int intervalo_ms, const Olho& camera);
 
   // Desenha a acao.
   void Desenha(ParametrosDesenho* pd) const;
   void DesenhaTranslucido(ParametrosDesenho* pd) const;
+  /** Se a acao for desenhada apenas pela geometria do proto, adiciona sua instancia aos lotes e retorna true. Tambem
+  * retorna true se nao houver o que desenhar neste passo (solido ou translucido). Caso contrario, retorna false e a acao
+  * deve ser desenhada por Desenha ou DesenhaTranslucido.
+  */
+  bool AdicionaAoLote(ParametrosDesenho* pd, bool translucido, LotesAcoes* lotes) const;
   // Retorna onde a acao sera desenhada.
   int IdCenario() const;
 
@@ -68,6 +105,13 @@ class Acao {
   void TocaSomSucessoOuFracasso(const Olho& camera) const;
   void DesenhaGeometriaAcao() const;
   virtual void DesenhaSeNaoFinalizada(ParametrosDesenho* pd) const {}
+  // Para acoes cujo desenho eh apenas DesenhaGeometriaAcao: retorna true se suportar o desenho em lote.
+  virtual bool SuportaLote() const { return false; }
+  // Matriz de modelagem (relativa a do tabuleiro), cor e luz da geometria no quadro corrente, como em
+  // DesenhaSeNaoFinalizada. Retorna false se nao houver nada a desenhar.
+  virtual bool GeometriaLote(Matrix4* modelagem, float cor[4], bool* sem_luz) const { return false; }
+  // Desenho individual do que GeometriaLote retorna.
+  void DesenhaGeometriaLote() const;
   virtual void DesenhaTranslucidoSeNaoFinalizada(ParametrosDesenho* pd) const { DesenhaSeNaoFinalizada(pd); }
   // Funcao auxiliar para atualizar alvo. Deve ser chamada manualmente por cada subclasse.
   virtual void AtualizaAposAtraso(int intervalo_ms, const Olho& camera) = 0;
@@ -120,6 +164,16 @@ class Acao {
   void DesenhaComum(ParametrosDesenho* pd, std::function<void(ParametrosDesenho*)> f_desenho) const;
 };
 
+/** Estatisticas do pool de alocacao das acoes. */
+struct EstatisticasPoolAcoes {
+  // Total de acoes alocadas pelo pool.
+  int64_t alocacoes = 0;
+  // Blocos reservados (em uso ou livres). Nao diminui: os blocos liberados sao reaproveitados.
+  int blocos_reservados = 0;
+  int blocos_em_uso = 0;
+};
+EstatisticasPoolAcoes LeEstatisticasPoolAcoes();
+
 // Cria uma nova acao no tabuleiro.
 Acao* NovaAcao(const Tabelas& tabelas, const AcaoProto& acao_proto, Tabuleiro* tabuleiro, tex::Texturas* texturas, const m3d::Modelos3d* modelos3d, ntf::CentralNotificacoes* central);
 
@@ -0,0 +1,24 @@
+#include "ent/bonus.h"
+
+namespace ent {
+
+// Retorna se os bonus sao cumulativos.
+bool BonusCumulativo(TipoBonus tipo) {
+  switch (tipo) {
+    case TB_CIRCUNSTANCIA:
+    case TB_CLASSE:
+    case TB_ESQUIVA:
+    case TB_FAMILIAR:
+    case TB_NIVEIS_NEGATIVOS:
+    case TB_NIVEL:
+    case TB_RACIAL:
+    case TB_TEMPLATE:
+    case TB_TALENTO:
+    case TB_SEM_NOME:
+    case TB_SINERGIA:
+      return true;
+    default: return false;
+  }
+}
+
+}  // namespace ent
@@ -0,0 +1,52 @@
+#ifndef ENT_BONUS_H
+#define ENT_BONUS_H
+
+#include <algorithm>
+
+#include "ent/comum.pb.h"
+
+namespace ent {
+
+// Retorna se os bonus sao cumulativos.
+bool BonusCumulativo(TipoBonus tipo);
+
+/** Total de um tipo de bonus pelas regras de acumulo.
+* Tipos cumulativos somam origens diferentes; dentro da mesma origem vale o maior bonus e a maior penalidade.
+* Tipos nao cumulativos somam apenas o maior bonus e a maior penalidade, independente de origem.
+* valor(i) retorna o valor da origem i e mesma_origem(i, j) se as origens i e j sao iguais. Nao aloca memoria.
+*/
+template <class Valor, class MesmaOrigem>
+int TotalBonusIndividual(bool cumulativo, int num_origens, Valor valor, MesmaOrigem mesma_origem) {
+  int total = 0;
+  if (cumulativo) {
+    for (int i = 0; i < num_origens; ++i) {
+      const bool positivo = valor(i) >= 0;
+      auto mesma_chave = [&](int j) { return (valor(j) >= 0) == positivo && mesma_origem(i, j); };
+      // Cada chave (origem, sinal) eh contabilizada na primeira ocorrencia.
+      bool ja_contabilizada = false;
+      for (int j = 0; j < i && !ja_contabilizada; ++j) {
+        ja_contabilizada = mesma_chave(j);
+      }
+      if (ja_contabilizada) continue;
+      int melhor = valor(i);
+      for (int j = i + 1; j < num_origens; ++j) {
+        if (!mesma_chave(j)) continue;
+        melhor = positivo ? std::max(melhor, valor(j)) : std::min(melhor, valor(j));
+      }
+      total += melhor;
+    }
+    return total;
+  }
+  int maior = 0;
+  int menor = 0;
+  for (int i = 0; i < num_origens; ++i) {
+    maior = std::max(maior, valor(i));
+    menor = std::min(menor, valor(i));
+  }
+  // Atencao, menor é negativo, entao aqui deve ser soma.
+  return maior + menor;
+}
+
+}  // namespace ent
+
+#endif  // ENT_BONUS_H
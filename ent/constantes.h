@@ -20,6 +20,8 @@
 /** Altura da posicao da acao, mais baixo que o objeto. */
 #define FATOR_ALTURA 0.6f
 #define ALTURA_ACAO (ALTURA * FATOR_ALTURA)
+/** Lado, em quadrados, de cada pedaco do terreno. Cada pedaco tem seus proprios VBOs. */
+#define TAMANHO_PEDACO_TERRENO 16
 /** Numero de faces do cone. */
 #define NUM_FACES 8
 /** Numero de divisoes do eixo Z do cone. */
@@ -39,6 +41,8 @@
 #define ARQUIVO_MODELOS_NAO_SRD "modelos_nao_srd.asciiproto"
 #define ARQUIVO_MODELOS_HOMEBREW "modelos_homebrew.asciiproto"
 #define ARQUIVO_ACOES "acoes.asciiproto"
+#define ARQUIVO_SALVAMENTO_AUTOMATICO "salvamento_automatico.binproto"
+#define ARQUIVO_WATCHDOG "tabuleiro_watchdog.binproto"
 
 // Constantes para picking do tabuleiro. Limite: TODO
 #define OBJ_INVALIDO 0
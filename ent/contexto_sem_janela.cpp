@@ -0,0 +1,52 @@
+#include "ent/contexto_sem_janela.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "gltab/gl.h"
+#include "log/log.h"
+
+namespace ent {
+
+bool CriaContextoSemJanela(int largura, int altura) {
+  EGLDisplay display = EGL_NO_DISPLAY;
+  auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (get_platform_display != nullptr) {
+    display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+  }
+  if (display == EGL_NO_DISPLAY) {
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+  EGLint maior, menor;
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, &maior, &menor)) {
+    LOG(ERROR) << "Falha iniciando EGL";
+    return false;
+  }
+  const EGLint atributos_config[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+    EGL_DEPTH_SIZE, 24, EGL_STENCIL_SIZE, 8,
+    EGL_NONE };
+  EGLConfig config;
+  EGLint num_configs = 0;
+  if (!eglChooseConfig(display, atributos_config, &config, 1, &num_configs) || num_configs == 0) {
+    LOG(ERROR) << "Nenhuma configuracao EGL com pbuffer";
+    return false;
+  }
+  const EGLint atributos_superficie[] = { EGL_WIDTH, largura, EGL_HEIGHT, altura, EGL_NONE };
+  EGLSurface superficie = eglCreatePbufferSurface(display, config, atributos_superficie);
+  if (superficie == EGL_NO_SURFACE || !eglBindAPI(EGL_OPENGL_API)) {
+    LOG(ERROR) << "Falha criando superficie pbuffer";
+    return false;
+  }
+  EGLContext contexto = eglCreateContext(display, config, EGL_NO_CONTEXT, nullptr);
+  if (contexto == EGL_NO_CONTEXT || !eglMakeCurrent(display, superficie, superficie, contexto)) {
+    LOG(ERROR) << "Falha criando contexto EGL";
+    return false;
+  }
+  LOG(INFO) << "Renderizador: " << reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+  return true;
+}
+
+}  // namespace ent
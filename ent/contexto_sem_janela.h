@@ -0,0 +1,13 @@
+#ifndef ENT_CONTEXTO_SEM_JANELA_H
+#define ENT_CONTEXTO_SEM_JANELA_H
+
+namespace ent {
+
+// Cria e torna corrente um contexto OpenGL de compatibilidade com uma superficie pbuffer de largura x altura, sem janela.
+// Usa EGL, que funciona sem servidor grafico (Mesa llvmpipe em maquinas sem GPU). Apenas linux.
+// Retorna false se nao houver como criar o contexto.
+bool CriaContextoSemJanela(int largura, int altura);
+
+}  // namespace ent
+
+#endif  // ENT_CONTEXTO_SEM_JANELA_H
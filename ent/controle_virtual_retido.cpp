@@ -0,0 +1,136 @@
+#include "ent/controle_virtual_retido.h"
+
+#include <unordered_map>
+#include <utility>
+
+#include "gltab/gl.h"
+#include "log/log.h"
+
+namespace ent {
+
+bool LeiauteControleVirtual::operator==(const LeiauteControleVirtual& rhs) const {
+  return largura == rhs.largura && altura == rhs.altura &&
+         largura_fonte == rhs.largura_fonte && altura_fonte == rhs.altura_fonte && escala == rhs.escala &&
+         modo_debug == rhs.modo_debug && visao_mestre == rhs.visao_mestre;
+}
+
+bool EstadoBotaoControleVirtual::operator==(const EstadoBotaoControleVirtual& rhs) const {
+  return db == rhs.db && pressionado == rhs.pressionado && id_textura == rhs.id_textura &&
+         cor[0] == rhs.cor[0] && cor[1] == rhs.cor[1] && cor[2] == rhs.cor[2] &&
+         slider == rhs.slider && rotulo == rhs.rotulo;
+}
+
+int ControleVirtualRetido::Atualiza(
+    const LeiauteControleVirtual& leiaute, std::vector<EstadoBotaoControleVirtual>* estados,
+    const GeraGeometria& gera_geometria) {
+  if (leiaute != leiaute_) {
+    leiaute_ = leiaute;
+    botoes_.clear();
+  }
+  // Botoes do quadro anterior, pelo DadosBotao. Os ponteiros sao estaveis enquanto o controle nao for recarregado.
+  std::unordered_map<const DadosBotao*, BotaoRetido*> anteriores;
+  for (auto& botao : botoes_) {
+    anteriores[botao.estado.db] = &botao;
+  }
+  bool mesma_sequencia = estados->size() == botoes_.size();
+  int refeitos = 0;
+  std::vector<BotaoRetido> novos(estados->size());
+  for (size_t i = 0; i < estados->size(); ++i) {
+    auto& estado = (*estados)[i];
+    BotaoRetido& novo = novos[i];
+    if (mesma_sequencia && botoes_[i].estado.db != estado.db) {
+      mesma_sequencia = false;
+    }
+    auto it = anteriores.find(estado.db);
+    if (it != anteriores.end() && it->second->estado == estado) {
+      novo = std::move(*it->second);
+      continue;
+    }
+    novo.estado = std::move(estado);
+    novo.id = novo.estado.db->id();
+    gera_geometria(leiaute_, &novo);
+    ++refeitos;
+  }
+  botoes_.swap(novos);
+  if (refeitos > 0 || !mesma_sequencia) {
+    lotes_sujos_ = true;
+  }
+  return refeitos;
+}
+
+void ControleVirtualRetido::GravaLotes() {
+  gl::VbosNaoGravados fundos;
+  gl::VbosNaoGravados marcadores;
+  gl::VbosNaoGravados rotulos;
+  for (auto& botao : botoes_) {
+    if (botao.id_textura == GL_INVALID_VALUE && botao.fundo.NumVertices() > 0) {
+      fundos.Concatena(botao.fundo);
+    }
+    if (botao.marcador.NumVertices() > 0) {
+      marcadores.Concatena(botao.marcador);
+    }
+    gl::VbosNaoGravados rotulo;
+    rotulo.CopiaDe(botao.rotulo);
+    rotulos.Concatena(&rotulo);
+  }
+  lote_fundos_.Grava(fundos);
+  lote_marcadores_.Grava(marcadores);
+  lote_rotulos_.Grava(rotulos, GL_POINTS);
+  lotes_sujos_ = false;
+}
+
+void ControleVirtualRetido::Desenha(bool desenha_texturas) {
+  if (lotes_sujos_) {
+    GravaLotes();
+  }
+  lote_fundos_.Desenha();
+  for (const auto& botao : botoes_) {
+    if (botao.id_textura == GL_INVALID_VALUE || botao.fundo.NumVertices() == 0) continue;
+    if (desenha_texturas) {
+      gl::Habilita(GL_TEXTURE_2D);
+      gl::LigacaoComTextura(GL_TEXTURE_2D, botao.id_textura);
+    }
+    gl::DesenhaVboNaoGravado(botao.fundo);
+    gl::LigacaoComTextura(GL_TEXTURE_2D, 0);
+    gl::Desabilita(GL_TEXTURE_2D);
+  }
+  lote_marcadores_.Desenha();
+  if (!lote_rotulos_.Vazio()) {
+#if !USAR_OPENGL_ES
+    // Como em gl::DesenhaString: multisampling pode fazer os pontos sumirem.
+    gl::DesabilitaEscopo salva_sampling(GL_MULTISAMPLE);
+#endif
+    gl::TamanhoPonto(leiaute_.escala);
+    lote_rotulos_.Desenha();
+  }
+}
+
+void ControleVirtualRetido::DesenhaParaPicking() const {
+  for (const auto& botao : botoes_) {
+    if (!botao.selecionavel) continue;
+    gl::CarregaNome(botao.id);
+    gl::Retangulo(botao.retangulo[0], botao.retangulo[1], botao.retangulo[2], botao.retangulo[3]);
+  }
+}
+
+std::optional<int> ControleVirtualRetido::IdBotaoEm(int x, int y) const {
+  for (auto it = botoes_.rbegin(); it != botoes_.rend(); ++it) {
+    const auto& botao = *it;
+    if (!botao.selecionavel) continue;
+    if (x >= botao.retangulo[0] && x <= botao.retangulo[2] && y >= botao.retangulo[1] && y <= botao.retangulo[3]) {
+      return botao.id;
+    }
+  }
+  return std::nullopt;
+}
+
+void ControleVirtualRetido::Limpa() {
+  botoes_.clear();
+  leiaute_ = LeiauteControleVirtual();
+  lote_fundos_.Desgrava();
+  lote_marcadores_.Desgrava();
+  lote_rotulos_.Desgrava();
+  lotes_sujos_ = true;
+}
+
+}  // namespace ent
@@ -0,0 +1,106 @@
+#ifndef ENT_CONTROLE_VIRTUAL_RETIDO_H
+#define ENT_CONTROLE_VIRTUAL_RETIDO_H
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "ent/controle_virtual.pb.h"
+#include "gltab/gl_vbo.h"
+
+namespace ent {
+
+// O que afeta a geometria de todos os botoes. Se mudar, todos sao refeitos.
+struct LeiauteControleVirtual {
+  // Tamanho do viewport.
+  int largura = 0;
+  int altura = 0;
+  // Tamanho base da fonte e escala, como retornados por gl::TamanhoFonte.
+  int largura_fonte = 0;
+  int altura_fonte = 0;
+  float escala = 1.0f;
+  bool modo_debug = false;
+  bool visao_mestre = false;
+
+  bool operator==(const LeiauteControleVirtual& rhs) const;
+  bool operator!=(const LeiauteControleVirtual& rhs) const { return !(*this == rhs); }
+};
+
+// Estado compacto de um botao em um quadro. A geometria do botao so eh refeita quando ele muda.
+struct EstadoBotaoControleVirtual {
+  const DadosBotao* db = nullptr;
+  bool pressionado = false;
+  unsigned int id_textura = GL_INVALID_VALUE;
+  // Cor de fundo, ja ajustada para o estado pressionado.
+  float cor[3] = { 0.0f, 0.0f, 0.0f };
+  // Posicao do marcador, para sliders.
+  float slider = 0.0f;
+  // Vazio para botoes sem rotulo (ou com textura).
+  std::string rotulo;
+
+  bool operator==(const EstadoBotaoControleVirtual& rhs) const;
+  bool operator!=(const EstadoBotaoControleVirtual& rhs) const { return !(*this == rhs); }
+};
+
+// Botao com a geometria pronta, em coordenadas de janela (origem embaixo a esquerda).
+struct BotaoRetido {
+  // Estado com o qual a geometria foi gerada.
+  EstadoBotaoControleVirtual estado;
+  int id = 0;
+  // Retangulo de picking: xi, yi, xf, yf. Apenas se selecionavel.
+  float retangulo[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  bool selecionavel = false;
+  // Textura do fundo. Botoes sem textura vao para o lote de fundos.
+  unsigned int id_textura = GL_INVALID_VALUE;
+  // Vazios quando nao ha o que desenhar (por exemplo, botoes apenas de picking).
+  gl::VboNaoGravado fundo;
+  gl::VboNaoGravado marcador;
+  // Rotulo como pontos, no mesmo formato de gl::DesenhaString.
+  gl::VbosNaoGravados rotulo;
+};
+
+/** Camada retida do controle virtual. A cada quadro recebe o estado compacto dos botoes visiveis e compara com o do
+* quadro anterior: apenas botoes novos ou alterados tem a geometria refeita (pela funcao de geracao), e os lotes de
+* desenho so sao regravados se algo mudou. Assim, um quadro sem mudancas desenha o painel com poucas chamadas.
+* O picking dos botoes eh uma busca nos retangulos do ultimo quadro, sem desenho de selecao.
+*/
+class ControleVirtualRetido {
+ public:
+  // Preenche a geometria do botao a partir de botao->estado.
+  using GeraGeometria = std::function<void(const LeiauteControleVirtual& leiaute, BotaoRetido* botao)>;
+
+  /** Atualiza os botoes com o estado do quadro corrente, na ordem de desenho. Se o leiaute mudar, todos sao refeitos.
+  * @return numero de botoes cuja geometria foi refeita.
+  */
+  int Atualiza(const LeiauteControleVirtual& leiaute, std::vector<EstadoBotaoControleVirtual>* estados,
+               const GeraGeometria& gera_geometria);
+
+  // Desenha o painel: fundos, botoes com textura, marcadores e rotulos. Regrava os lotes se necessario.
+  void Desenha(bool desenha_texturas);
+  // Desenha os retangulos dos botoes selecionaveis com seus nomes, para o picking por desenho.
+  void DesenhaParaPicking() const;
+
+  // Botao selecionavel em (x, y), coordenadas de janela. Em caso de sobreposicao, vale o desenhado por ultimo.
+  std::optional<int> IdBotaoEm(int x, int y) const;
+
+  // Descarta os botoes e lotes (por exemplo, apos perda do contexto grafico ou recarga do controle).
+  void Limpa();
+
+  bool Vazio() const { return botoes_.empty(); }
+  const std::vector<BotaoRetido>& Botoes() const { return botoes_; }
+
+ private:
+  void GravaLotes();
+
+  LeiauteControleVirtual leiaute_;
+  std::vector<BotaoRetido> botoes_;
+  bool lotes_sujos_ = true;
+  gl::VbosGravados lote_fundos_;
+  gl::VbosGravados lote_marcadores_;
+  gl::VbosGravados lote_rotulos_;
+};
+
+}  // namespace ent
+
+#endif  // ENT_CONTROLE_VIRTUAL_RETIDO_H
@@ -0,0 +1,159 @@
+/** @file ent/desenho_benchmark.cpp Benchmark de desenho do tabuleiro sem janela.
+* Usa um contexto EGL com pbuffer (ver contexto_sem_janela.h).
+* Compara o desenho instanciado das entidades com o desenho de uma chamada por entidade.
+*/
+
+#include <boost/timer/timer.hpp>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ent/constantes.h"
+#include "ent/contexto_sem_janela.h"
+#include "ent/tabelas.h"
+#include "ent/tabuleiro.h"
+#include "gltab/gl.h"
+#include "log/log.h"
+#include "log/perfil.h"
+#include "m3d/m3d.h"
+#include "ntf/notificacao.h"
+#include "tex/texturas.h"
+
+namespace ent {
+namespace {
+
+constexpr int kTamJanela = 512;
+constexpr int kLadoExercito = 30;
+constexpr int kNumQuadros = 30;
+
+// Um exercito de peoes iguais, a maioria com a mesma cor, em um quadrado de lado kLadoExercito.
+std::unique_ptr<ntf::Notificacao> TabuleiroExercito() {
+  auto n = ntf::NovaNotificacao(ntf::TN_DESERIALIZAR_TABULEIRO);
+  auto* tabuleiro = n->mutable_tabuleiro();
+  tabuleiro->set_largura(kLadoExercito + 10);
+  tabuleiro->set_altura(kLadoExercito + 10);
+  int id = 1;
+  for (int x = 0; x < kLadoExercito; ++x) {
+    for (int y = 0; y < kLadoExercito; ++y) {
+      auto* e = tabuleiro->add_entidade();
+      e->set_id(id++);
+      e->set_tipo(TE_ENTIDADE);
+      e->mutable_pos()->set_x((x - kLadoExercito / 2) * TAMANHO_LADO_QUADRADO);
+      e->mutable_pos()->set_y((y - kLadoExercito / 2) * TAMANHO_LADO_QUADRADO);
+      e->mutable_cor()->set_r(x % 10 == 0 ? 1.0f : 0.2f);
+      e->mutable_cor()->set_g(0.6f);
+      e->mutable_cor()->set_b(0.2f);
+      e->mutable_cor()->set_a(1.0f);
+    }
+  }
+  return n;
+}
+
+// Tempo medio de uma zona do perfilador, em ms.
+double MediaZonaMs(const std::string& nome) {
+  for (const auto& ez : perfil::Estatisticas()) {
+    if (ez.nome == nome) return ez.media_ns / 1e6;
+  }
+  return 0.0;
+}
+
+std::vector<uint8_t> LeQuadro() {
+  std::vector<uint8_t> pixels(kTamJanela * kTamJanela * 4);
+  glReadPixels(0, 0, kTamJanela, kTamJanela, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+  return pixels;
+}
+
+// Pixels com alguma componente diferindo mais que a tolerancia.
+int PixelsDiferentes(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+  constexpr int kTolerancia = 2;
+  int diferentes = 0;
+  for (unsigned int i = 0; i < a.size(); i += 4) {
+    for (int c = 0; c < 3; ++c) {
+      if (std::abs(a[i + c] - b[i + c]) > kTolerancia) {
+        ++diferentes;
+        break;
+      }
+    }
+  }
+  return diferentes;
+}
+
+void BenchmarkDesenhoEntidades() {
+  ntf::CentralNotificacoes central;
+  const Tabelas tabelas(&central);
+  tex::Texturas texturas(&central);
+  m3d::Modelos3d modelos(&central);
+  OpcoesProto opcoes;
+  opcoes.set_iluminacao_por_pixel(true);
+  Tabuleiro tabuleiro(opcoes, tabelas, &texturas, &modelos, &central);
+  gl::IniciaGl(gl::TL_POR_PIXEL);
+  tabuleiro.IniciaGL();
+  tabuleiro.TrataRedimensionaJanela(kTamJanela, kTamJanela);
+  tabuleiro.TrataNotificacao(*TabuleiroExercito());
+  central.Notifica();
+  const int num_entidades = kLadoExercito * kLadoExercito;
+
+  perfil::Liga(true);
+  std::vector<uint8_t> quadro_por_entidade;
+  for (bool instanciado : {false, true}) {
+    tabuleiro.AlteraDesenhoInstanciado(instanciado);
+    // Aquecimento: compila shaders e configura os VAOs.
+    tabuleiro.Desenha();
+    glFinish();
+    perfil::Limpa();
+    boost::timer::cpu_timer timer;
+    for (int i = 0; i < kNumQuadros; ++i) {
+      tabuleiro.Desenha();
+      glFinish();
+    }
+    timer.stop();
+    const double ms_por_quadro = timer.elapsed().wall / 1e6 / kNumQuadros;
+    std::cout << (instanciado ? "Desenho instanciado" : "Desenho por entidade") << ": " << num_entidades
+              << " entidades, " << ms_por_quadro << "ms por quadro, "
+              << MediaZonaMs("Tabuleiro::DesenhaEntidadesBase") << "ms em DesenhaEntidadesBase";
+    if (instanciado) {
+      const auto& lotes = tabuleiro.UltimosLotesInstancias();
+      std::cout << ", " << lotes.NumInstancias() << " instancias em " << lotes.NumLotes() << " lotes";
+    }
+    std::cout << std::endl;
+    // O mesmo quadro (a camera nao mexe) deve sair igual nos dois modos.
+    if (!instanciado) {
+      quadro_por_entidade = LeQuadro();
+    } else {
+      std::cout << "Pixels diferentes entre os modos: " << PixelsDiferentes(quadro_por_entidade, LeQuadro())
+                << " de " << (kTamJanela * kTamJanela) << std::endl;
+    }
+  }
+
+  // Sem o descarte por tronco de visao, todas as entidades passam por cada passo. O quadro tem que sair igual.
+  const int visiveis = tabuleiro.NumEntidadesVisiveis();
+  const std::vector<uint8_t> quadro_com_descarte = LeQuadro();
+  tabuleiro.AlteraDescarteTroncoVisao(false);
+  tabuleiro.Desenha();
+  glFinish();
+  perfil::Limpa();
+  boost::timer::cpu_timer timer;
+  for (int i = 0; i < kNumQuadros; ++i) {
+    tabuleiro.Desenha();
+    glFinish();
+  }
+  timer.stop();
+  std::cout << "Sem descarte: " << (timer.elapsed().wall / 1e6 / kNumQuadros) << "ms por quadro, "
+            << MediaZonaMs("Tabuleiro::DesenhaEntidadesBase") << "ms em DesenhaEntidadesBase; com descarte, "
+            << visiveis << " de " << num_entidades << " entidades no ultimo passo. Pixels diferentes: "
+            << PixelsDiferentes(quadro_com_descarte, LeQuadro()) << std::endl;
+}
+
+}  // namespace
+}  // namespace ent
+
+int main(int argc, char** argv) {
+  meulog::Inicializa(argc, argv);
+  if (!ent::CriaContextoSemJanela(ent::kTamJanela, ent::kTamJanela)) {
+    return 1;
+  }
+  ent::BenchmarkDesenhoEntidades();
+  return 0;
+}
@@ -0,0 +1,134 @@
+// Testes que precisam de um contexto grafico de verdade (EGL sem janela, ver contexto_sem_janela.h).
+#include <cmath>
+#include <memory>
+
+#include "ent/constantes.h"
+#include "ent/contexto_sem_janela.h"
+#include "ent/entidade.h"
+#include "ent/tabelas.h"
+#include "ent/tabuleiro.h"
+#include "gltab/gl.h"
+#include "gtest/gtest.h"
+#include "log/log.h"
+#include "m3d/m3d.h"
+#include "ntf/notificacao.h"
+#include "tex/texturas.h"
+
+namespace ent {
+namespace {
+
+constexpr int kTamJanela = 800;
+
+bool g_contexto_criado = false;
+
+class TesteDesenho : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    if (!g_contexto_criado) {
+      GTEST_SKIP() << "sem contexto grafico";
+    }
+    tabelas_ = std::make_unique<Tabelas>(&central_);
+    texturas_ = std::make_unique<tex::Texturas>(&central_);
+    modelos_ = std::make_unique<m3d::Modelos3d>(&central_);
+    tabuleiro_ = std::make_unique<Tabuleiro>(opcoes_, *tabelas_, texturas_.get(), modelos_.get(), &central_);
+    gl::IniciaGl(gl::TL_POR_PIXEL);
+    tabuleiro_->IniciaGL();
+    tabuleiro_->TrataRedimensionaJanela(kTamJanela, kTamJanela);
+  }
+
+  void Carrega(const ntf::Notificacao& n) {
+    tabuleiro_->TrataNotificacao(n);
+    central_.Notifica();
+  }
+
+  ntf::CentralNotificacoes central_;
+  OpcoesProto opcoes_;
+  std::unique_ptr<Tabelas> tabelas_;
+  std::unique_ptr<tex::Texturas> texturas_;
+  std::unique_ptr<m3d::Modelos3d> modelos_;
+  std::unique_ptr<Tabuleiro> tabuleiro_;
+};
+
+// Entidade 1 na origem, cercada por cubos que causam colisao, com a face a kDistanciaParede da origem. Sem
+// paredes_eixo_y, apenas as do eixo x.
+constexpr float kDistanciaParede = TAMANHO_LADO_QUADRADO;
+
+std::unique_ptr<ntf::Notificacao> TabuleiroCercado(bool paredes_eixo_y = true) {
+  auto n = ntf::NovaNotificacao(ntf::TN_DESERIALIZAR_TABULEIRO);
+  auto* tabuleiro = n->mutable_tabuleiro();
+  tabuleiro->set_largura(10);
+  tabuleiro->set_altura(10);
+  auto* e = tabuleiro->add_entidade();
+  e->set_id(1);
+  e->set_tipo(TE_ENTIDADE);
+  int id = 2;
+  const float centro = kDistanciaParede + TAMANHO_LADO_QUADRADO / 2.0f;
+  for (const auto& [x, y] : { std::make_pair(centro, 0.0f), std::make_pair(-centro, 0.0f),
+                              std::make_pair(0.0f, centro), std::make_pair(0.0f, -centro) }) {
+    if (!paredes_eixo_y && x == 0.0f) continue;
+    auto* parede = tabuleiro->add_entidade();
+    parede->set_id(id++);
+    parede->set_tipo(TE_FORMA);
+    parede->set_sub_tipo(TF_CUBO);
+    parede->set_causa_colisao(true);
+    parede->set_fixa(true);
+    parede->mutable_pos()->set_x(x);
+    parede->mutable_pos()->set_y(y);
+    parede->mutable_escala()->set_x(TAMANHO_LADO_QUADRADO);
+    parede->mutable_escala()->set_y(TAMANHO_LADO_QUADRADO);
+    parede->mutable_escala()->set_z(TAMANHO_LADO_QUADRADO * 2);
+  }
+  return n;
+}
+
+// O movimento por teclado detecta colisao a partir do centro do buffer de colisao, no canto inferior esquerdo da tela.
+// Com o controle virtual ligado, o botao de pagina anterior ocupa esse ponto; a busca 2d dos botoes nao pode valer
+// para a colisao.
+TEST_F(TesteDesenho, ColisaoComControleVirtualLigado) {
+  ASSERT_TRUE(opcoes_.desenha_controle_virtual());
+  Carrega(*TabuleiroCercado());
+  auto* entidade = tabuleiro_->BuscaEntidade(1);
+  ASSERT_NE(entidade, nullptr);
+  // As paredes sao fixas: so a entidade eh selecionada.
+  tabuleiro_->SelecionaTudo(/*fixas=*/false);
+  // Um quadro completo preenche os botoes retidos do controle virtual. O clique no botao de proxima pagina, no canto
+  // inferior direito, passa para a pagina que comeca pelo botao de pagina anterior.
+  tabuleiro_->Desenha();
+  tabuleiro_->TrataBotaoEsquerdoPressionado(kTamJanela - 5, 30);
+  tabuleiro_->TrataBotaoLiberado();
+  tabuleiro_->Desenha();
+  tabuleiro_->TrataMovimentoEntidadesSelecionadasOuCamera(/*frente_atras=*/true, 1.0f);
+  // Sem a parede, andaria um quadrado inteiro. Com ela, para com a extremidade encostando.
+  ASSERT_TRUE(entidade->Proto().has_destino());
+  const float andou = std::hypot(entidade->Proto().destino().x() - entidade->X(),
+                                 entidade->Proto().destino().y() - entidade->Y());
+  EXPECT_NEAR(andou, kDistanciaParede - entidade->Espaco(), 0.1f);
+}
+
+// Com o desenho interpolado entre passos de simulacao, a colisao tem que usar o olho corrente. Na primeira pessoa, o olho
+// do passo anterior esta sempre perto: interpolado com fracao 0, a colisao do movimento lateral (eixo x) olharia para a
+// frente da camera (eixo y), sem parede.
+TEST_F(TesteDesenho, ColisaoIgnoraInterpolacaoDaCamera) {
+  Carrega(*TabuleiroCercado(/*paredes_eixo_y=*/false));
+  auto* entidade = tabuleiro_->BuscaEntidade(1);
+  ASSERT_NE(entidade, nullptr);
+  tabuleiro_->SelecionaTudo(/*fixas=*/false);
+  tabuleiro_->AlternaCameraPrimeiraPessoa();
+  Carrega(*ntf::NovaNotificacao(ntf::TN_TEMPORIZADOR));
+  tabuleiro_->AlteraFracaoPassoDesenho(0.0f);
+  tabuleiro_->Desenha();
+  tabuleiro_->TrataMovimentoEntidadesSelecionadasOuCamera(/*frente_atras=*/false, 1.0f);
+  ASSERT_TRUE(entidade->Proto().has_destino());
+  const float andou = std::hypot(entidade->Proto().destino().x() - entidade->X(),
+                                 entidade->Proto().destino().y() - entidade->Y());
+  EXPECT_NEAR(andou, kDistanciaParede - entidade->Espaco(), 0.1f);
+}
+
+}  // namespace
+}  // namespace ent
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  ent::g_contexto_criado = ent::CriaContextoSemJanela(ent::kTamJanela, ent::kTamJanela);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,348 @@
+/** @file ent/ent_benchmark.cpp Benchmarks de CPU do tabuleiro e entidades. Nao usa OpenGL. */
+
+#include <boost/timer/timer.hpp>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "arq/arquivo.h"
+#include "ent/constantes.h"
+#include "ent/recomputa.h"
+#include "ent/tabelas.h"
+#include "ent/tabuleiro.h"
+#include "ent/tabuleiro_terreno.h"
+#include "log/log.h"
+#include "ntf/notificacao.h"
+
+// Contador de alocacoes do processo inteiro, para os benchmarks de memoria.
+std::atomic<int64_t> g_num_alocacoes{0};
+
+void* operator new(size_t tamanho) {
+  ++g_num_alocacoes;
+  void* p = std::malloc(tamanho == 0 ? 1 : tamanho);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace ent {
+namespace {
+
+// Imprime a vazao de uma medida.
+void ImprimeVazao(const std::string& nome, const boost::timer::cpu_timer& timer, int64_t num_operacoes) {
+  const double segundos = timer.elapsed().wall / 1e9;
+  std::cout << nome << ": " << num_operacoes << " operacoes em " << segundos << "s, "
+            << (num_operacoes / segundos / 1e6) << " Mop/s" << std::endl;
+}
+
+// Consultas de altura do chao, uma a uma e em lote.
+void BenchmarkZChao() {
+  constexpr int kTamX = 200;
+  constexpr int kTamY = 200;
+  constexpr int kNumConsultas = 1 << 20;
+  constexpr int kRepeticoes = 20;
+  const std::vector<double> pontos = Terreno::CriaPontosAleatorios(kTamX, kTamY);
+  CacheAlturasTerreno cache;
+  cache.Atualiza(CENARIO_PRINCIPAL, kTamX, kTamY, pontos.data(), static_cast<int>(pontos.size()));
+
+  std::minstd_rand motor(42);
+  // Um pouco maior que o tabuleiro, para exercitar as consultas de fora.
+  std::uniform_real_distribution<float> distribuicao_x(-kTamX * TAMANHO_LADO_QUADRADO_2 * 1.05f, kTamX * TAMANHO_LADO_QUADRADO_2 * 1.05f);
+  std::uniform_real_distribution<float> distribuicao_y(-kTamY * TAMANHO_LADO_QUADRADO_2 * 1.05f, kTamY * TAMANHO_LADO_QUADRADO_2 * 1.05f);
+  std::vector<float> x(kNumConsultas);
+  std::vector<float> y(kNumConsultas);
+  std::vector<float> z(kNumConsultas);
+  for (int i = 0; i < kNumConsultas; ++i) {
+    x[i] = distribuicao_x(motor);
+    y[i] = distribuicao_y(motor);
+  }
+
+  // Evita que o compilador descarte as consultas.
+  float controle = 0.0f;
+  {
+    boost::timer::cpu_timer timer;
+    for (int r = 0; r < kRepeticoes; ++r) {
+      for (int i = 0; i < kNumConsultas; ++i) {
+        controle += cache.ZChao(x[i], y[i]);
+      }
+    }
+    timer.stop();
+    ImprimeVazao("ZChao unitario", timer, int64_t(kNumConsultas) * kRepeticoes);
+  }
+  {
+    boost::timer::cpu_timer timer;
+    for (int r = 0; r < kRepeticoes; ++r) {
+      cache.ZChao(x, y, z);
+      controle += z[r];
+    }
+    timer.stop();
+    ImprimeVazao("ZChao em lote", timer, int64_t(kNumConsultas) * kRepeticoes);
+  }
+  std::cout << "controle: " << controle << std::endl;
+}
+
+// Descarte por tronco de visao em um mapa aberto grande, com a camera perspectiva olhando de cima para uma regiao.
+void BenchmarkDescarteTroncoVisao() {
+  constexpr int kNumEntidades = 20000;
+  constexpr int kRepeticoes = 500;
+  constexpr float kLadoMapa = 300 * TAMANHO_LADO_QUADRADO;
+  std::minstd_rand motor(42);
+  std::uniform_real_distribution<float> distribuicao(-kLadoMapa / 2.0f, kLadoMapa / 2.0f);
+  std::vector<EsferaEnvolvente> esferas(kNumEntidades);
+  for (auto& esfera : esferas) {
+    esfera.centro = Vector3(distribuicao(motor), distribuicao(motor), 0.0f);
+    esfera.raio = 2.5f * TAMANHO_LADO_QUADRADO;
+  }
+  // Perspectiva de 60 graus (como gl::Perspectiva), camera a 30m olhando para baixo.
+  const float perto = 0.5f, longe = 200.0f;
+  const float cotangente = 1.0f / tanf(30.0f * GRAUS_PARA_RAD);
+  Matrix4 prj(cotangente, 0.0f, 0.0f, 0.0f,
+              0.0f, cotangente, 0.0f, 0.0f,
+              0.0f, 0.0f, -(longe + perto) / (longe - perto), -1.0f,
+              0.0f, 0.0f, -2.0f * longe * perto / (longe - perto), 0.0f);
+  Matrix4 camera;
+  camera.translate(0.0f, 0.0f, -30.0f);
+  const TroncoVisao tronco = ExtraiTroncoVisao(prj * camera);
+
+  std::vector<int> visiveis;
+  int64_t controle = 0;
+  boost::timer::cpu_timer timer;
+  for (int r = 0; r < kRepeticoes; ++r) {
+    FiltraEsferasVisiveis(tronco, esferas, Vector3(), /*distancia_maxima=*/0.0f, &visiveis);
+    controle += visiveis.size();
+  }
+  timer.stop();
+  ImprimeVazao("FiltraEsferasVisiveis", timer, int64_t(kNumEntidades) * kRepeticoes);
+  std::cout << "visiveis: " << visiveis.size() << " de " << kNumEntidades << ", controle: " << controle << std::endl;
+}
+
+// Recomputacao completa de modelos variados (classes, talentos, pericias, magias, monstros).
+void BenchmarkRecomputaDependencias() {
+  constexpr int kRepeticoes = 2000;
+  const Tabelas tabelas(nullptr);
+  std::vector<EntidadeProto> protos;
+  for (const char* modelo : {"Humano Plebeu 1", "Orc Capitão", "Humana Ranger 9 Duas Armas", "Halfling Druida 10",
+                             "Humano Monge 5", "Humano Ladino 5", "Tigre Atroz", "Demônio Vrock"}) {
+    protos.push_back(tabelas.ModeloEntidade(modelo).entidade());
+    // A primeira recomputacao cria os bonus; as seguintes sao o caso comum.
+    RecomputaDependencias(tabelas, TT_NENHUM, &protos.back());
+  }
+
+  int controle = 0;
+  boost::timer::cpu_timer timer;
+  for (int r = 0; r < kRepeticoes; ++r) {
+    for (auto& proto : protos) {
+      RecomputaDependencias(tabelas, TT_NENHUM, &proto);
+      controle += proto.info_pericias_size();
+    }
+  }
+  timer.stop();
+  ImprimeVazao("RecomputaDependencias", timer, int64_t(kRepeticoes) * protos.size());
+  std::cout << "controle: " << controle << std::endl;
+}
+
+// Deserializacao de tabuleiro sem OpenGL, com uma thread e com as threads padrao.
+// Usa o castelo se estiver disponivel; caso contrario, um tabuleiro sintetico com modelos variados.
+void BenchmarkDeserializaTabuleiro() {
+  constexpr int kRepeticoes = 5;
+  constexpr int kNumEntidadesSintetico = 400;
+  const Tabelas tabelas(nullptr);
+  ntf::CentralNotificacoes central;
+
+  ntf::Notificacao n_tabuleiro;
+  try {
+    arq::LeArquivoBinProto(arq::TIPO_TABULEIRO_ESTATICO, "castelo.binproto", &n_tabuleiro);
+  } catch (...) {
+    // ParseProtoException nao deriva publicamente de std::exception.
+    n_tabuleiro.Clear();
+  }
+  if (n_tabuleiro.tabuleiro().entidade().empty()) {
+    LOG(INFO) << "castelo.binproto nao encontrado, usando tabuleiro sintetico";
+    n_tabuleiro.set_tipo(ntf::TN_DESERIALIZAR_TABULEIRO);
+    const std::vector<std::string> modelos = {
+        "Humano Plebeu 1", "Orc Capitão", "Humana Ranger 9 Duas Armas", "Halfling Druida 10",
+        "Humano Monge 5", "Humano Ladino 5", "Tigre Atroz", "Demônio Vrock"};
+    for (int i = 0; i < kNumEntidadesSintetico; ++i) {
+      auto* e = n_tabuleiro.mutable_tabuleiro()->add_entidade();
+      *e = tabelas.ModeloEntidade(modelos[i % modelos.size()]).entidade();
+      e->set_id(i + 1);
+      e->mutable_pos()->set_x(i % 20);
+      e->mutable_pos()->set_y(i / 20);
+    }
+  }
+  const int num_entidades = n_tabuleiro.tabuleiro().entidade_size();
+
+  for (int num_threads : {1, 0}) {
+    Tabuleiro tabuleiro(OpcoesProto::default_instance(), tabelas, nullptr, nullptr, &central);
+    // Sem receptor, as notificacoes geradas pela carga sao apenas descartadas por Notifica.
+    central.DesregistraReceptor(&tabuleiro);
+    tabuleiro.AlteraNumThreadsCarga(num_threads);
+    boost::timer::cpu_timer timer;
+    for (int r = 0; r < kRepeticoes; ++r) {
+      tabuleiro.TrataNotificacao(n_tabuleiro);
+      central.Notifica();
+    }
+    timer.stop();
+    ImprimeVazao(num_threads == 1 ? "DeserializaTabuleiro 1 thread" : "DeserializaTabuleiro threads padrao",
+                 timer, int64_t(kRepeticoes) * num_entidades);
+  }
+}
+
+// Passagem de rodada em uma batalha grande: cada entidade tem um evento em andamento. Mede o preenchimento e a
+// aplicacao do grupo, e o tamanho das mensagens de ida e de desfazer.
+void BenchmarkPassaRodada() {
+  constexpr int kRepeticoes = 20;
+  constexpr int kNumEntidades = 300;
+  const Tabelas tabelas(nullptr);
+  ntf::CentralNotificacoes central;
+  Tabuleiro tabuleiro(OpcoesProto::default_instance(), tabelas, nullptr, nullptr, &central);
+  central.DesregistraReceptor(&tabuleiro);
+  auto n_tabuleiro = ntf::NovaNotificacao(ntf::TN_DESERIALIZAR_TABULEIRO);
+  const std::vector<std::string> modelos = {
+      "Humano Plebeu 1", "Orc Capitão", "Humana Ranger 9 Duas Armas", "Humano Monge 5", "Tigre Atroz"};
+  for (int i = 0; i < kNumEntidades; ++i) {
+    auto* e = n_tabuleiro->mutable_tabuleiro()->add_entidade();
+    *e = tabelas.ModeloEntidade(modelos[i % modelos.size()]).entidade();
+    e->set_id(i + 1);
+    auto* evento = e->add_evento();
+    evento->set_id_efeito(EFEITO_BENCAO);
+    evento->set_id_unico(1000);
+    evento->set_rodadas(10 * kRepeticoes);
+  }
+  tabuleiro.TrataNotificacao(*n_tabuleiro);
+  central.Notifica();
+
+  size_t bytes = 0;
+  size_t bytes_desfazer = 0;
+  boost::timer::cpu_timer timer_preenche;
+  boost::timer::cpu_timer timer_aplica;
+  timer_preenche.stop();
+  timer_aplica.stop();
+  for (int r = 0; r < kRepeticoes; ++r) {
+    auto grupo = NovoGrupoNotificacoes();
+    auto grupo_desfazer = NovoGrupoNotificacoes();
+    timer_preenche.resume();
+    tabuleiro.PreenchePassaUmaRodada(/*passar_para_todos=*/true, grupo.get(), grupo_desfazer.get());
+    timer_preenche.stop();
+    timer_aplica.resume();
+    tabuleiro.TrataNotificacao(*grupo);
+    timer_aplica.stop();
+    bytes += grupo->ByteSizeLong();
+    bytes_desfazer += grupo_desfazer->ByteSizeLong();
+    central.Notifica();
+  }
+  std::cout << "PassaRodada " << kNumEntidades << " entidades: preenche "
+            << (timer_preenche.elapsed().wall / 1e6 / kRepeticoes) << "ms, aplica "
+            << (timer_aplica.elapsed().wall / 1e6 / kRepeticoes) << "ms, grupo " << (bytes / kRepeticoes)
+            << " bytes, desfazer " << (bytes_desfazer / kRepeticoes) << " bytes" << std::endl;
+}
+
+// Emissor remoto que serializa cada notificacao, como net::Servidor e net::Cliente.
+class EmissorSerializador : public ntf::EmissorRemoto {
+ public:
+  bool TrataNotificacaoRemota(const ntf::Notificacao& notificacao) override {
+    notificacao.SerializeToString(&buffer_);
+    bytes_ += buffer_.size();
+    return true;
+  }
+  size_t Bytes() const { return bytes_; }
+
+ private:
+  std::string buffer_;
+  size_t bytes_ = 0;
+};
+
+// Combate roteirizado: a cada turno, uma acao causa dano em varias entidades (grupo e desfazer na arena da acao,
+// repasse remoto na arena do ciclo) e o temporizador dispara Notifica. A cada rodada, passa a rodada para todos.
+// Compara o numero de alocacoes com e sem as arenas da central.
+void BenchmarkAlocacoesCombate() {
+  constexpr int kNumEntidades = 40;
+  constexpr int kNumRodadas = 10;
+  constexpr int kAlvosPorAcao = 6;
+  const Tabelas tabelas(nullptr);
+  for (bool usar_arenas : {false, true}) {
+    ntf::CentralNotificacoes central;
+    central.AlteraUsoArenas(usar_arenas);
+    Tabuleiro tabuleiro(OpcoesProto::default_instance(), tabelas, nullptr, nullptr, &central);
+    central.DesregistraReceptor(&tabuleiro);
+    EmissorSerializador emissor;
+    central.RegistraEmissorRemoto(&emissor);
+    auto n_tabuleiro = ntf::NovaNotificacao(ntf::TN_DESERIALIZAR_TABULEIRO);
+    for (int i = 0; i < kNumEntidades; ++i) {
+      auto* e = n_tabuleiro->mutable_tabuleiro()->add_entidade();
+      *e = tabelas.ModeloEntidade(i % 2 == 0 ? "Orc Capitão" : "Humano Plebeu 1").entidade();
+      e->set_id(i + 1);
+      auto* evento = e->add_evento();
+      evento->set_id_efeito(EFEITO_BENCAO);
+      evento->set_id_unico(1000);
+      evento->set_rodadas(10 * kNumRodadas);
+    }
+    tabuleiro.TrataNotificacao(*n_tabuleiro);
+    central.Notifica();
+
+    // Alocacoes na montagem das notificacoes, na aplicacao (que inclui recomputar as entidades) e no ciclo da central.
+    int64_t alocacoes_montagem = 0;
+    int64_t alocacoes_aplicacao = 0;
+    int64_t alocacoes_ciclo = 0;
+    auto conta = [](int64_t* total, int64_t* antes) {
+      const int64_t agora = g_num_alocacoes;
+      *total += agora - *antes;
+      *antes = agora;
+    };
+    boost::timer::cpu_timer timer;
+    int num_acoes = 0;
+    for (int r = 0; r < kNumRodadas; ++r) {
+      for (int turno = 0; turno < kNumEntidades; ++turno) {
+        int64_t antes = g_num_alocacoes;
+        {
+          ntf::ArenaAcao arena(&central);
+          auto grupo = NovoGrupoNotificacoes(arena.arena());
+          auto grupo_desfazer = NovoGrupoNotificacoes(arena.arena());
+          for (int a = 1; a <= kAlvosPorAcao; ++a) {
+            const auto* alvo = tabuleiro.BuscaEntidade((turno + a) % kNumEntidades + 1);
+            PreencheNotificacaoAtualizacaoPontosVida(
+                *alvo, -1, TD_LETAL, grupo->add_notificacao(), grupo_desfazer->add_notificacao());
+          }
+          conta(&alocacoes_montagem, &antes);
+          tabuleiro.TrataNotificacao(*grupo);
+          tabuleiro.AdicionaNotificacaoListaEventos(*grupo_desfazer);
+          conta(&alocacoes_aplicacao, &antes);
+          ++num_acoes;
+        }
+        central.AdicionaNotificacao(ntf::NovaNotificacao(ntf::TN_TEMPORIZADOR, central.ArenaCiclo()));
+        central.Notifica();
+        conta(&alocacoes_ciclo, &antes);
+      }
+      ntf::ArenaAcao arena(&central);
+      auto grupo = NovoGrupoNotificacoes(arena.arena());
+      tabuleiro.PreenchePassaUmaRodada(/*passar_para_todos=*/true, grupo.get(), nullptr);
+      tabuleiro.TrataNotificacao(*grupo);
+    }
+    timer.stop();
+    std::cout << "Combate " << (usar_arenas ? "com" : "sem") << " arenas, " << num_acoes
+              << " acoes. Alocacoes por acao: montagem " << (alocacoes_montagem / double(num_acoes)) << ", aplicacao "
+              << (alocacoes_aplicacao / double(num_acoes)) << ", ciclo " << (alocacoes_ciclo / double(num_acoes))
+              << "; " << (timer.elapsed().wall / 1e6 / num_acoes) << "ms por acao, "
+              << (emissor.Bytes() / num_acoes) << " bytes enviados por acao" << std::endl;
+  }
+}
+
+}  // namespace
+}  // namespace ent
+
+int main(int argc, char** argv) {
+  meulog::Inicializa(argc, argv);
+  ent::BenchmarkZChao();
+  ent::BenchmarkDescarteTroncoVisao();
+  ent::BenchmarkRecomputaDependencias();
+  ent::BenchmarkDeserializaTabuleiro();
+  ent::BenchmarkPassaRodada();
+  ent::BenchmarkAlocacoesCombate();
+  return 0;
+}
@@ -51,6 +51,25 @@ std::unique_ptr<Entidade> NovaEntidade(
   }
 }
 
+std::unique_ptr<Entidade> NovaEntidadeParaCargaParalela(
+    const EntidadeProto& proto, const Tabelas& tabelas, const Tabuleiro* tabuleiro, const Texturas* texturas, const m3d::Modelos3d* m3d,
+    ntf::CentralNotificacoes* central_adiada, const ParametrosDesenho* pd) {
+  switch (proto.tipo()) {
+    case TE_COMPOSTA:
+    case TE_ENTIDADE:
+    case TE_FORMA: {
+      auto entidade = std::unique_ptr<Entidade>(new Entidade(tabelas, tabuleiro, texturas, m3d, central_adiada, pd));
+      entidade->gravacao_vbo_adiada_ = true;
+      entidade->InicializaProto(proto);
+      return entidade;
+    }
+    default:
+      std::ostringstream oss;
+      oss << "Tipo de entidade inválido: " << proto.tipo();
+      throw std::logic_error(oss.str());
+  }
+}
+
 // Entidade
 Entidade::Entidade(
     const Tabelas& tabelas, const Tabuleiro* tabuleiro, const Texturas* texturas, const m3d::Modelos3d* m3d,
@@ -249,6 +268,11 @@ void TalvezCorrijaVisao(const Tabelas& tabelas, EntidadeProto* proto) {
 }  // namespace
 
 void Entidade::Inicializa(const EntidadeProto& novo_proto) {
+  InicializaProto(novo_proto);
+  InicializaDependencias();
+}
+
+void Entidade::InicializaProto(const EntidadeProto& novo_proto) {
   // Preciso do tipo aqui para atualizar as outras coisas de acordo.
   proto_.set_tipo(novo_proto.tipo());
   // Atualiza texturas e modelos 3d antes de tudo.
@@ -259,8 +283,6 @@ void Entidade::Inicializa(const EntidadeProto& novo_proto) {
   TalvezCorrijaTipoCelestialAbissal(&proto_);
   TalvezCorrijaVisao(tabelas_, &proto_);
   CorrigeCamposDeprecated(&proto_);
-  // Evitar oscilacoes juntas.
-  vd_.angulo_disco_luz_rad = ((RolaDado(360) - 1.0f) / 180.0f) * M_PI;
   if (proto_.tipo() == TE_FORMA) {
     InicializaForma(proto_, &vd_);
   } else if (proto_.tipo() == TE_COMPOSTA) {
@@ -269,6 +291,11 @@ void Entidade::Inicializa(const EntidadeProto& novo_proto) {
 
   AtualizaMatrizes();
   AtualizaVbo(parametros_desenho_);
+}
+
+void Entidade::InicializaDependencias() {
+  // Evitar oscilacoes juntas.
+  vd_.angulo_disco_luz_rad = ((RolaDado(360) - 1.0f) / 180.0f) * M_PI;
   // O recomputa vai gerar um pseudo max_dados_vida baseado em constituicao, entao temos que salvar antes.
   const bool tinha_max_pontos_vida = proto_.has_max_pontos_vida();
   RecomputaDependencias();
@@ -301,6 +328,21 @@ void Entidade::Inicializa(const EntidadeProto& novo_proto) {
   proto_.clear_proxima_salvacao();
 }
 
+bool Entidade::SemGrafico() const {
+  return tabuleiro_ != nullptr && tabuleiro_->SemGrafico();
+}
+
+void Entidade::FinalizaCargaParalela(ntf::CentralNotificacoes* central) {
+  central_ = central;
+  if (!gravacao_vbo_adiada_) return;
+  gravacao_vbo_adiada_ = false;
+  if (!SemGrafico() && !vd_.vbos_nao_gravados.Vazio()) {
+    vd_.vbos_gravados.Grava(vd_.vbos_nao_gravados);
+    V_ERRO("Erro gravacao de VBOs da carga paralela");
+  }
+  InicializaDependencias();
+}
+
 // static
 gl::VbosNaoGravados Entidade::ExtraiVbo(const EntidadeProto& proto, const ParametrosDesenho* pd, bool mundo) {
   return ExtraiVbo(proto, VariaveisDerivadas(), pd, mundo);
@@ -397,6 +439,7 @@ void Entidade::AtualizaVbo(const ParametrosDesenho* pd) {
   if (pd != nullptr) {
     vd_.vbos_nao_gravados = ExtraiVbo(pd == nullptr ? &ParametrosDesenho::default_instance() : pd, false);
     vd_.vbos_nao_gravados.AtribuiMatrizModelagem(vd_.matriz_modelagem);
+    if (gravacao_vbo_adiada_ || SemGrafico()) return;
     if (!vd_.vbos_nao_gravados.Vazio()) {
       vd_.vbos_gravados.Grava(vd_.vbos_nao_gravados);
     }
@@ -1819,6 +1862,19 @@ void Entidade::AtualizaParcial(const EntidadeProto& proto_parcial_orig) {
   VLOG(2) << "Entidade apos atualizacao parcial: " << proto_.ShortDebugString();
 }
 
+void Entidade::AplicaDeltaRodada(const DeltaRodadaEntidade& delta, bool reiniciar_ataque) {
+  if (reiniciar_ataque) {
+    // Nao afeta nada recomputado.
+    ReiniciaAtaque();
+  }
+  if (delta.eventos.empty() && delta.ataques.empty()) {
+    return;
+  }
+  vd_.atualiza_matriz_vbo = true;
+  AplicaDeltaRodadaEntidade(delta, &proto_);
+  RecomputaDependencias();
+}
+
 // Acao de display.
 void Entidade::AtualizaAcao(const std::string& id_acao) {
   proto_.set_ultima_acao(id_acao);
@@ -2357,6 +2413,62 @@ float Entidade::Espaco() const {
   return MultiplicadorTamanho() * TAMANHO_LADO_QUADRADO_2;
 }
 
+namespace {
+
+float MaiorComponente(const Escala& escala) {
+  return std::max({fabs(escala.x()), fabs(escala.y()), fabs(escala.z())});
+}
+
+// Raio em torno da posicao de uma forma ou composta, ja com sua escala.
+float RaioEnvolventeForma(const EntidadeProto& proto) {
+  if (proto.tipo() == TE_COMPOSTA) {
+    float raio = 0.0f;
+    for (const auto& sub : proto.sub_forma()) {
+      const Vector3 pos_sub(sub.pos().x(), sub.pos().y(), sub.pos().z());
+      raio = std::max(raio, pos_sub.length() + RaioEnvolventeForma(sub));
+    }
+    return raio * MaiorComponente(proto.escala());
+  }
+  if (proto.sub_tipo() == TF_LIVRE) {
+    // Pontos relativos a posicao, com a largura da linha.
+    float raio = 0.0f;
+    for (const auto& p : proto.ponto()) {
+      raio = std::max(raio, sqrtf(p.x() * p.x() + p.y() * p.y()));
+    }
+    return raio + TAMANHO_LADO_QUADRADO_2 * fabs(proto.escala().z());
+  }
+  // As formas unitarias cabem em [-0.5, 0.5] x [-0.5, 0.5] x [0, 1] (ou menos) antes da escala.
+  const auto& e = proto.escala();
+  return sqrtf(e.x() * e.x() + e.y() * e.y() + e.z() * e.z());
+}
+
+}  // namespace
+
+EsferaEnvolvente Entidade::EsferaDesenho() const {
+  EsferaEnvolvente esfera;
+  // Margem para efeitos, barras e pequenas deformacoes (vento, escala de efeitos).
+  constexpr float kMargem = TAMANHO_LADO_QUADRADO;
+  if (Tipo() == TE_ENTIDADE) {
+    esfera.centro = Vector3(X(), Y(), Z(/*delta_voo=*/true));
+    // A altura eh a do quadrado. Em pe, caida ou em acrobacia, a entidade fica a menos de 1.5 lado da base.
+    float lado = MultiplicadorTamanho() * TAMANHO_LADO_QUADRADO;
+    const auto& modelo = proto_.modelo_3d();
+    if (modelo.has_escala()) {
+      lado *= std::max(1.0f, MaiorComponente(modelo.escala()));
+    }
+    float deslocamento = 0.0f;
+    if (modelo.has_translacao()) {
+      const auto& t = modelo.translacao();
+      deslocamento = Vector3(t.x(), t.y(), t.z()).length();
+    }
+    esfera.raio = 1.5f * lado + deslocamento + kMargem;
+  } else {
+    esfera.centro = Vector3(X(), Y(), Z());
+    esfera.raio = RaioEnvolventeForma(proto_) + kMargem;
+  }
+  return esfera;
+}
+
 const DadosAtaque* Entidade::DadoAtaque(const std::string& grupo, int indice_ataque) const {
   std::vector<const DadosAtaque*> ataques_casados;
   for (const auto& da : proto_.dados_ataque()) {
@@ -2943,6 +3055,12 @@ bool Entidade::TemLuz() const {
   return proto_.has_luz() || vd_.luz_acao.inicio.has_raio_m();
 }
 
+float Entidade::AlcanceLuzMetros() const {
+  // Como em DesenhaLuz: o raio eh o do proto ou o da acao. A atenuacao chega a zero com o dobro do raio, e a visao na
+  // penumbra dobra o raio.
+  return 4.0f * std::max(RaioLuzMetros(), vd_.luz_acao.inicio.raio_m());
+}
+
 void Entidade::AtivaLuzAcao(const IluminacaoPontual& luz) {
   auto& luz_acao = vd_.luz_acao;
   luz_acao.duracao_ms = static_cast<int>(luz.duracao_ms());
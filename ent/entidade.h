@@ -2,6 +2,7 @@
 #define ENT_ENTIDADE_H
 
 #include <boost/timer/timer.hpp>
+#include <map>
 #include <optional>
 #include <stdexcept>
 #include <unordered_map>
@@ -38,12 +39,52 @@ enum class AplicaAlfaTranslucidos {
   NAO_APLICAR_SE_TRANSLUCIDO = 1,
 };
 void AjustaCor(const EntidadeProto& proto, const ParametrosDesenho* pd, AplicaAlfaTranslucidos aplicar_alfa_translucidos = AplicaAlfaTranslucidos::DEFAULT_APLICAR);
+/** A cor que AjustaCor usaria, sem muda-la. */
+void CorAjustada(const EntidadeProto& proto, const ParametrosDesenho* pd, AplicaAlfaTranslucidos aplicar_alfa_translucidos, float cor[4]);
+
+/** Lotes de instancias de desenho, agrupados por VBO e textura. Cada lote eh desenhado com uma chamada instanciada.
+* Uso, a cada quadro: Inicia, Adiciona para cada parte de entidade, Desenha.
+*/
+class LotesInstancias {
+ public:
+  // Comeca um novo quadro. As instancias serao multiplicadas pela matriz de modelagem corrente.
+  void Inicia();
+  // textura pode ser GL_INVALID_VALUE.
+  void Adiciona(const gl::VboGravado& vbo, unsigned int textura, const Matrix4& modelagem, const float cor[4]);
+  void Adiciona(const gl::VbosGravados& vbos, unsigned int textura, const Matrix4& modelagem, const float cor[4]);
+  void Desenha() const;
+  // Numero de lotes com instancias, ou seja, de chamadas de desenho (por VBO).
+  int NumLotes() const;
+  int NumInstancias() const;
+
+ private:
+  struct Lote {
+    const gl::VboGravado* vbo = nullptr;
+    const gl::VbosGravados* vbos = nullptr;
+    unsigned int textura = 0;
+    gl::LoteInstancias instancias;
+  };
+  Lote& BuscaOuCriaLote(const void* chave_vbo, unsigned int textura);
+
+  Matrix4 modelagem_base_;
+  std::vector<Lote> lotes_;
+  // Indice em lotes_ por (vbo ou vbos, textura). Lotes sem instancias no quadro anterior sao removidos em Inicia.
+  std::map<std::pair<const void*, unsigned int>, int> indice_lotes_;
+};
 
 /** Constroi uma entidade de acordo com o proto passando, inicializando-a. */
 std::unique_ptr<Entidade> NovaEntidade(
     const EntidadeProto& proto,
     const Tabelas& tabelas, const Tabuleiro* tabuleiro, const Texturas* texturas, const m3d::Modelos3d* m3d,
     ntf::CentralNotificacoes* central, const ParametrosDesenho* pd);
+/** Como NovaEntidade, mas pode ser chamada fora da thread principal: nao faz chamadas OpenGL, nao rola dados, nao recomputa
+* as dependencias e as notificacoes vao para central_adiada. A entidade so pode ser usada depois de
+* Entidade::FinalizaCargaParalela, na thread principal.
+*/
+std::unique_ptr<Entidade> NovaEntidadeParaCargaParalela(
+    const EntidadeProto& proto,
+    const Tabelas& tabelas, const Tabuleiro* tabuleiro, const Texturas* texturas, const m3d::Modelos3d* m3d,
+    ntf::CentralNotificacoes* central_adiada, const ParametrosDesenho* pd);
 inline std::unique_ptr<Entidade> NovaEntidadeParaTestes(const EntidadeProto& proto, const Tabelas& tabelas, const Tabuleiro* tabuleiro = nullptr) {
   return NovaEntidade(proto, tabelas, tabuleiro, nullptr, nullptr, nullptr, nullptr);
 }
@@ -60,6 +101,11 @@ class Entidade {
  public:
   /** Inicializa a entidade, recebendo seu proto diretamente. */
   void Inicializa(const EntidadeProto& proto);
+  /** Segunda fase de NovaEntidadeParaCargaParalela, na thread principal: grava os VBOs extraidos, passa a usar central,
+  * rola os dados da entidade e recomputa as dependencias. Deve ser chamada com todas as entidades da carga ja no
+  * tabuleiro (por exemplo, a montaria eh buscada pelo id), na ordem da carga, para os dados sairem deterministicos.
+  */
+  void FinalizaCargaParalela(ntf::CentralNotificacoes* central);
 
   /** Atualiza a entidade usando apenas alguns campos do proto passado. Nao atualiza posicao. */
   void AtualizaProto(const EntidadeProto& novo_proto);
@@ -79,6 +125,8 @@ class Entidade {
   bool TemLuz() const;
   /** Retorna o raio da luz (assume que esta ligada). */
   float RaioLuzMetros() const { return proto_.luz().has_raio_m() ? proto_.luz().raio_m() : 6.0f; }
+  /** Distancia a partir da qual a luz da entidade nao ilumina mais nada. */
+  float AlcanceLuzMetros() const;
   /** Liga a iluminacao por acao da entidade, tipo quando da um tiro. */
   void AtivaLuzAcao(const IluminacaoPontual& luz);
 
@@ -227,6 +275,10 @@ class Entidade {
 
   /** Atualiza apenas os campos presentes no proto para a entidade. */
   void AtualizaParcial(const EntidadeProto& proto_parcial);
+  /** Aplica a passagem de rodada calculada por CalculaDeltaRodadaEntidade. Equivale as atualizacoes parciais de
+  * eventos, ataques e reiniciar_ataque do caminho completo, mas so recomputa se algo mudou no proto.
+  */
+  void AplicaDeltaRodada(const DeltaRodadaEntidade& delta, bool reiniciar_ataque);
 
   /** Altera o indice de feitico da entidade para usado ou nao. */
   void AlteraFeitico(const std::string& id_classe, int nivel, int indice, bool usado);
@@ -260,6 +312,10 @@ class Entidade {
 
   /** desenha o objeto de forma solida. Pode alterar os parametros de desenho. */
   void Desenha(ParametrosDesenho* pd);
+  /** Como Desenha, mas o objeto vai para lotes quando possivel (ver AdicionaInstancias). Decoracoes e efeitos sao
+  * desenhados na hora; o objeto, apenas em LotesInstancias::Desenha.
+  */
+  void DesenhaComLotes(ParametrosDesenho* pd, LotesInstancias* lotes);
 
   /** Desenha a unidade de forma translucida. */
   void DesenhaTranslucido(ParametrosDesenho* pd);
@@ -369,6 +425,9 @@ class Entidade {
   /** O espaco da entidade, baseado no seu tamanho. */
   float Espaco() const;
 
+  /** Esfera que contem o desenho da entidade, para descarte por tronco de visao. Conservadora. */
+  EsferaEnvolvente EsferaDesenho() const;
+
   /** Limpa a proxima salvacao para a entidade. */
   void AtualizaProximaSalvacao(ResultadoSalvacao rs) { proto_.set_proxima_salvacao(rs); }
   void LimpaProximaSalvacao() { proto_.clear_proxima_salvacao(); }
@@ -466,6 +525,9 @@ class Entidade {
   friend std::unique_ptr<Entidade> NovaEntidade(
       const EntidadeProto& proto, const Tabelas& tabelas, const Tabuleiro* tabuleiro, const Texturas*, const m3d::Modelos3d*,
       ntf::CentralNotificacoes*, const ParametrosDesenho* pd);
+  friend std::unique_ptr<Entidade> NovaEntidadeParaCargaParalela(
+      const EntidadeProto& proto, const Tabelas& tabelas, const Tabuleiro* tabuleiro, const Texturas*, const m3d::Modelos3d*,
+      ntf::CentralNotificacoes*, const ParametrosDesenho* pd);
   Entidade(
       const Tabelas& tabelas, const Tabuleiro* tabuleiro, const Texturas* texturas, const m3d::Modelos3d* m3d,
       ntf::CentralNotificacoes* central, const ParametrosDesenho* pd);
@@ -660,6 +722,10 @@ class Entidade {
 
   /** Realiza o desenho do objeto com as decoracoes, como disco de selecao e barra de vida (de acordo com pd). */
   void DesenhaObjetoComDecoracoes(ParametrosDesenho* pd);
+  /** Adiciona as partes do objeto (peao, modelo 3d, moldura, tela e base) aos lotes, se todas puderem ser
+  * instanciadas. Retorna false, sem adicionar nada, caso contrario.
+  */
+  bool AdicionaInstancias(const ParametrosDesenho* pd, LotesInstancias* lotes) const;
 
   /** Realiza o desenho do objeto. */
   void DesenhaObjeto(ParametrosDesenho* pd);
@@ -677,6 +743,12 @@ class Entidade {
   void DesenhaEfeito(ParametrosDesenho* pd, const EntidadeProto::Evento& evento, const ComplementoEfeito& complemento);
 
   void RecomputaDependencias();
+  /** As duas metades de Inicializa. A primeira copia e corrige o proto, inicializa a forma, as matrizes e os VBOs; pode rodar
+  * fora da thread principal (ver NovaEntidadeParaCargaParalela). A segunda rola os dados da entidade e recomputa as
+  * dependencias.
+  */
+  void InicializaProto(const EntidadeProto& proto);
+  void InicializaDependencias();
 
   struct MatrizesDesenho {
     Matrix4 modelagem;
@@ -761,6 +833,11 @@ class Entidade {
 
   // A central é usada apenas para enviar notificacoes de textura ja que as entidades nao sao receptoras.
   ntf::CentralNotificacoes* central_ = nullptr;
+  // Carga paralela: os VBOs sao extraidos mas so gravados em FinalizaCargaParalela.
+  bool gravacao_vbo_adiada_ = false;
+
+  // Sem contexto grafico (ver Tabuleiro::AlteraSemGrafico): os VBOs sao extraidos mas nunca gravados.
+  bool SemGrafico() const;
 };
 
 }  // namespace ent
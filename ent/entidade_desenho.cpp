@@ -10,6 +10,7 @@
 #include "ent/util.h"
 #include "gltab/gl.h"
 #include "log/log.h"
+#include "log/perfil.h"
 #include "m3d/m3d.h"
 
 namespace gl {
@@ -30,8 +31,17 @@ bool MortaInconscienteIncapaz(const EntidadeProto& proto) {
 }  // namespace
 
 void AjustaCor(const EntidadeProto& proto, const ParametrosDesenho* pd, AplicaAlfaTranslucidos aplicar_alfa_translucidos) {
+  float cor[4];
+  CorAjustada(proto, pd, aplicar_alfa_translucidos, cor);
+  MudaCorAlfa(cor);
+}
+
+void CorAjustada(const EntidadeProto& proto, const ParametrosDesenho* pd, AplicaAlfaTranslucidos aplicar_alfa_translucidos, float cor[4]) {
   const auto& cp = proto.cor();
-  float cor[4] = { cp.r(), cp.g(), cp.b(), 1.0f };
+  cor[0] = cp.r();
+  cor[1] = cp.g();
+  cor[2] = cp.b();
+  cor[3] = 1.0f;
   if (pd->has_alfa_translucidos()) {
     cor[3] = cp.a();
     if (aplicar_alfa_translucidos == AplicaAlfaTranslucidos::DEFAULT_APLICAR || (aplicar_alfa_translucidos == AplicaAlfaTranslucidos::NAO_APLICAR_SE_TRANSLUCIDO && cp.a() == 1.0f)) {
@@ -44,7 +54,88 @@ void AjustaCor(const EntidadeProto& proto, const ParametrosDesenho* pd, AplicaAl
   if (MortaInconscienteIncapaz(proto)) {
     EscureceCor(cor);
   }
-  MudaCorAlfa(cor);
+}
+
+void LotesInstancias::Inicia() {
+  modelagem_base_ = gl::LeMatriz(gl::MATRIZ_MODELAGEM);
+  bool remover = false;
+  for (const auto& lote : lotes_) {
+    remover |= lote.instancias.Vazio();
+  }
+  if (remover) {
+    // Lotes que nao foram usados podem apontar para VBOs que ja nao existem.
+    lotes_.erase(std::remove_if(lotes_.begin(), lotes_.end(), [](const Lote& lote) { return lote.instancias.Vazio(); }),
+                 lotes_.end());
+    indice_lotes_.clear();
+    for (unsigned int i = 0; i < lotes_.size(); ++i) {
+      const void* chave = lotes_[i].vbo != nullptr ? static_cast<const void*>(lotes_[i].vbo) : lotes_[i].vbos;
+      indice_lotes_[{chave, lotes_[i].textura}] = i;
+    }
+  }
+  for (auto& lote : lotes_) {
+    lote.instancias.Limpa();
+  }
+}
+
+LotesInstancias::Lote& LotesInstancias::BuscaOuCriaLote(const void* chave_vbo, unsigned int textura) {
+  auto [it, inserido] = indice_lotes_.try_emplace({chave_vbo, textura}, static_cast<int>(lotes_.size()));
+  if (inserido) {
+    lotes_.emplace_back();
+    lotes_.back().textura = textura;
+  }
+  return lotes_[it->second];
+}
+
+void LotesInstancias::Adiciona(const gl::VboGravado& vbo, unsigned int textura, const Matrix4& modelagem, const float cor[4]) {
+  auto& lote = BuscaOuCriaLote(&vbo, textura);
+  lote.vbo = &vbo;
+  lote.instancias.Adiciona(modelagem_base_ * modelagem, cor);
+}
+
+void LotesInstancias::Adiciona(const gl::VbosGravados& vbos, unsigned int textura, const Matrix4& modelagem, const float cor[4]) {
+  auto& lote = BuscaOuCriaLote(&vbos, textura);
+  lote.vbos = &vbos;
+  lote.instancias.Adiciona(modelagem_base_ * modelagem, cor);
+}
+
+void LotesInstancias::Desenha() const {
+  PERFIL_ZONA("LotesInstancias::Desenha");
+  // Como em DesenhaObjetoEntidadeProtoComMatrizes, a tela de textura nao tem ajuste.
+  gl::MatrizEscopo salva_matriz_textura(gl::MATRIZ_AJUSTE_TEXTURA);
+  gl::CarregaIdentidade();
+  gl::AtualizaMatrizes();
+  gl::MatrizEscopo salva_matriz(gl::MATRIZ_MODELAGEM);
+  for (const auto& lote : lotes_) {
+    if (lote.instancias.Vazio()) continue;
+    if (lote.textura != GL_INVALID_VALUE) {
+      gl::Habilita(GL_TEXTURE_2D);
+      gl::LigacaoComTextura(GL_TEXTURE_2D, lote.textura);
+    }
+    if (lote.vbo != nullptr) {
+      lote.instancias.Desenha(*lote.vbo);
+    } else {
+      lote.instancias.Desenha(*lote.vbos);
+    }
+    if (lote.textura != GL_INVALID_VALUE) {
+      gl::Desabilita(GL_TEXTURE_2D);
+    }
+  }
+}
+
+int LotesInstancias::NumLotes() const {
+  int num = 0;
+  for (const auto& lote : lotes_) {
+    if (!lote.instancias.Vazio()) ++num;
+  }
+  return num;
+}
+
+int LotesInstancias::NumInstancias() const {
+  int num = 0;
+  for (const auto& lote : lotes_) {
+    num += lote.instancias.NumInstancias();
+  }
+  return num;
 }
 
 void Entidade::Desenha(ParametrosDesenho* pd) {
@@ -59,6 +150,23 @@ void Entidade::Desenha(ParametrosDesenho* pd) {
   DesenhaEfeitos(pd);
 }
 
+void Entidade::DesenhaComLotes(ParametrosDesenho* pd, LotesInstancias* lotes) {
+  if (vd_.nao_desenhar && !pd->has_picking_x()) {
+    return;
+  }
+  if (!proto_.visivel() || proto_.cor().a() < 1.0f) {
+    return;
+  }
+  if (AdicionaInstancias(pd, lotes)) {
+    gl::Habilita(GL_NORMALIZE);
+    DesenhaDecoracoes(pd);
+    gl::Desabilita(GL_NORMALIZE);
+  } else {
+    DesenhaObjetoComDecoracoes(pd);
+  }
+  DesenhaEfeitos(pd);
+}
+
 void Entidade::DesenhaTranslucido(ParametrosDesenho* pd) {
   if (vd_.nao_desenhar && !pd->has_picking_x()) {
     return;
@@ -108,6 +216,51 @@ void Entidade::DesenhaObjetoComDecoracoes(ParametrosDesenho* pd) {
   gl::Desabilita(GL_NORMALIZE);
 }
 
+bool Entidade::AdicionaInstancias(const ParametrosDesenho* pd, LotesInstancias* lotes) const {
+  const auto& proto = proto_;
+  // Picking precisa de um nome por entidade; os demais casos mudam estado de desenho por entidade.
+  if (proto.tipo() != TE_ENTIDADE || pd->has_picking_x() || pd->entidade_selecionada() || pd->has_alfa_translucidos() ||
+      proto.especular() || proto.ignora_luz() || proto.dois_lados() || Achatar(proto, pd)) {
+    return false;
+  }
+  float cor[4];
+  CorAjustada(proto, pd, AplicaAlfaTranslucidos::DEFAULT_APLICAR, cor);
+  const gl::VbosGravados* vbos_modelo = nullptr;
+  unsigned int textura = GL_INVALID_VALUE;
+  if (proto.has_modelo_3d()) {
+    // Com cor, o modelo usa mistura pre nevoa, que eh uniforme.
+    if (proto.cor().has_r() || vd_.m3d == nullptr) return false;
+    const auto* modelo = vd_.m3d->Modelo(proto.modelo_3d().id());
+    if (modelo == nullptr) return false;
+    vbos_modelo = &modelo->vbos_gravados;
+  } else if (!proto.info_textura().id().empty()) {
+    if (vd_.matriz_deslocamento_textura != Matrix4()) return false;
+  }
+  if (pd->desenha_texturas() && !proto.info_textura().id().empty()) {
+    if (vd_.texturas == nullptr) return false;
+    textura = vd_.texturas->Textura(proto.info_textura().id());
+  }
+
+  if (vbos_modelo != nullptr) {
+    lotes->Adiciona(*vbos_modelo, textura, vd_.matriz_modelagem, cor);
+  } else if (!proto.info_textura().id().empty()) {
+    lotes->Adiciona(g_vbos[VBO_MOLDURA_PECA], GL_INVALID_VALUE, vd_.matriz_modelagem_tijolo_tela, cor);
+    if (textura != GL_INVALID_VALUE) {
+      float cor_tela[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+      if (MortaInconscienteIncapaz(proto)) {
+        EscureceCor(cor_tela);
+      }
+      lotes->Adiciona(g_vbos[VBO_TELA_TEXTURA], textura, vd_.matriz_modelagem_tela_textura, cor_tela);
+    }
+  } else {
+    lotes->Adiciona(g_vbos[VBO_PEAO], GL_INVALID_VALUE, vd_.matriz_modelagem, cor);
+  }
+  if (DesenhaBase(proto)) {
+    lotes->Adiciona(g_vbos[VBO_BASE_PECA], GL_INVALID_VALUE, vd_.matriz_modelagem_tijolo_base, cor);
+  }
+  return true;
+}
+
 void Entidade::DesenhaObjetoProto(const EntidadeProto& proto, ParametrosDesenho* pd) {
   DesenhaObjetoProto(proto, VariaveisDerivadas(), pd);
 }
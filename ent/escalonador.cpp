@@ -0,0 +1,141 @@
+#include "ent/escalonador.h"
+
+#include <algorithm>
+
+#include "absl/strings/str_format.h"
+#include "log/log.h"
+
+namespace ent {
+
+namespace {
+
+double EmMs(Escalonador::Relogio::duration duracao) {
+  return std::chrono::duration<double, std::milli>(duracao).count();
+}
+
+}  // namespace
+
+Escalonador::Escalonador(int passo_ms, int max_passos_por_ciclo)
+    : passo_ms_(std::max(passo_ms, 1)), max_passos_por_ciclo_(std::max(max_passos_por_ciclo, 1)) {}
+
+void Escalonador::AlteraPassoMs(int passo_ms) {
+  passo_ms_ = std::max(passo_ms, 1);
+}
+
+void Escalonador::AlteraIntervaloQuadroMs(double intervalo_ms) {
+  intervalo_quadro_ = std::chrono::duration_cast<Relogio::duration>(
+      std::chrono::duration<double, std::milli>(std::max(intervalo_ms, 0.0)));
+}
+
+void Escalonador::AlteraOrcamentoTarefasMs(double orcamento_ms) {
+  orcamento_tarefas_ = std::chrono::duration_cast<Relogio::duration>(
+      std::chrono::duration<double, std::milli>(std::max(orcamento_ms, 0.0)));
+}
+
+int Escalonador::Passos(Relogio::time_point agora) {
+  if (!iniciado_) {
+    iniciado_ = true;
+    ultimo_ciclo_ = agora;
+    proximo_quadro_ = agora;
+    ultimo_quadro_ = agora;
+    return 0;
+  }
+  if (agora > ultimo_ciclo_) {
+    acumulado_ += agora - ultimo_ciclo_;
+    ultimo_ciclo_ = agora;
+  }
+  const auto passo = Passo();
+  int passos = static_cast<int>(acumulado_ / passo);
+  if (passos == 0) return 0;
+  if (passos > max_passos_por_ciclo_) {
+    const int descartados = passos - max_passos_por_ciclo_;
+    VLOG(1) << "Escalonador descartando " << descartados << " passos atrasados";
+    estatisticas_.passos_descartados += descartados;
+    acumulado_ -= descartados * passo;
+    passos = max_passos_por_ciclo_;
+  }
+  // O passo i (a partir de 1) venceu ha acumulado - i * passo.
+  for (int i = 1; i <= passos; ++i) {
+    const auto atraso = acumulado_ - i * passo;
+    const double atraso_ms = EmMs(atraso);
+    estatisticas_.atraso_total_ms += atraso_ms;
+    estatisticas_.atraso_maximo_ms = std::max(estatisticas_.atraso_maximo_ms, atraso_ms);
+    if (atraso >= passo) {
+      ++estatisticas_.passos_atrasados;
+    }
+  }
+  acumulado_ -= passos * passo;
+  estatisticas_.passos += passos;
+  passos_desde_quadro_ = true;
+  return passos;
+}
+
+float Escalonador::Fracao() const {
+  return std::clamp(static_cast<float>(EmMs(acumulado_) / passo_ms_), 0.0f, 1.0f);
+}
+
+bool Escalonador::DeveDesenhar(Relogio::time_point agora) {
+  Relogio::duration intervalo;
+  if (intervalo_quadro_ == Relogio::duration::zero()) {
+    if (!passos_desde_quadro_) return false;
+    intervalo = Passo();
+  } else {
+    if (agora < proximo_quadro_) return false;
+    intervalo = intervalo_quadro_;
+    proximo_quadro_ += intervalo_quadro_;
+    if (proximo_quadro_ <= agora) {
+      // Muito atrasado: recomeca a contagem em vez de desenhar varios quadros seguidos.
+      proximo_quadro_ = agora + intervalo_quadro_;
+    }
+  }
+  if (estatisticas_.quadros > 0) {
+    const int64_t intervalos = (agora - ultimo_quadro_) / intervalo;
+    if (intervalos > 1) {
+      estatisticas_.quadros_perdidos += intervalos - 1;
+    }
+  }
+  ++estatisticas_.quadros;
+  ultimo_quadro_ = agora;
+  passos_desde_quadro_ = false;
+  return true;
+}
+
+Escalonador::Relogio::time_point Escalonador::ProximoPrazo() const {
+  const auto proximo_passo = ultimo_ciclo_ + (Passo() - acumulado_);
+  if (intervalo_quadro_ == Relogio::duration::zero()) return proximo_passo;
+  return std::min(proximo_passo, proximo_quadro_);
+}
+
+void Escalonador::AdicionaTarefa(Tarefa tarefa) {
+  tarefas_.push_back(std::move(tarefa));
+}
+
+int Escalonador::ExecutaTarefas(Relogio::time_point inicio) {
+  const auto limite = inicio + orcamento_tarefas_;
+  int concluidas = 0;
+  bool primeira = true;
+  while (!tarefas_.empty()) {
+    if (!primeira && Relogio::now() >= limite) {
+      ++estatisticas_.ciclos_orcamento_esgotado;
+      break;
+    }
+    primeira = false;
+    if (tarefas_.front()()) {
+      tarefas_.pop_front();
+      ++concluidas;
+    }
+  }
+  estatisticas_.tarefas += concluidas;
+  return concluidas;
+}
+
+std::string Escalonador::ResumoEstatisticas() const {
+  const auto& e = estatisticas_;
+  return absl::StrFormat(
+      "passos: %d (atrasados: %d, descartados: %d), atraso medio: %.2fms, maximo: %.2fms; "
+      "quadros: %d (perdidos: %d); tarefas: %d (orcamento esgotado: %d, pendentes: %d)",
+      e.passos, e.passos_atrasados, e.passos_descartados, e.AtrasoMedioMs(), e.atraso_maximo_ms,
+      e.quadros, e.quadros_perdidos, e.tarefas, e.ciclos_orcamento_esgotado, tarefas_.size());
+}
+
+}  // namespace ent
@@ -0,0 +1,105 @@
+#ifndef ENT_ESCALONADOR_H
+#define ENT_ESCALONADOR_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+
+namespace ent {
+
+struct EstatisticasEscalonador {
+  // Passos de simulacao executados.
+  int64_t passos = 0;
+  // Passos executados com mais de um passo de atraso (o laco nao acordou a tempo).
+  int64_t passos_atrasados = 0;
+  // Passos descartados por excesso de atraso, para a simulacao nao entrar em espiral.
+  int64_t passos_descartados = 0;
+  double atraso_maximo_ms = 0;
+  double atraso_total_ms = 0;
+  // Quadros desenhados e quadros perdidos (mais de um intervalo de quadro entre dois desenhos).
+  int64_t quadros = 0;
+  int64_t quadros_perdidos = 0;
+  // Tarefas de fundo concluidas e ciclos em que o orcamento acabou com tarefas pendentes.
+  int64_t tarefas = 0;
+  int64_t ciclos_orcamento_esgotado = 0;
+
+  double AtrasoMedioMs() const { return passos == 0 ? 0.0 : atraso_total_ms / passos; }
+};
+
+/** Escalonador do laco principal, independente de interface.
+* A simulacao anda em passos fixos (TN_TEMPORIZADOR com Tabuleiro::AlteraPassoFixoMs): o tempo real decorrido eh
+* acumulado e cada passo consome passo_ms dele, entao o ritmo da simulacao nao depende do tempo de processamento nem do
+* desenho. O desenho tem ritmo proprio (o da tela) e recebe a fracao do proximo passo ja decorrida para interpolar.
+* Tarefas de fundo (carga de texturas, por exemplo) rodam ao fim de cada ciclo, ate o orcamento de tempo.
+*
+* Uso, a cada ciclo do laco:
+*   for (int i = escalonador.Passos(agora); i > 0; --i) { simula um passo; }
+*   escalonador.ExecutaTarefas(agora_apos_passos);
+*   if (escalonador.DeveDesenhar(agora)) { desenha com escalonador.Fracao(); }
+*   dorme ate escalonador.ProximoPrazo().
+*/
+class Escalonador {
+ public:
+  using Relogio = std::chrono::steady_clock;
+  // Tarefa de fundo: retorna verdadeiro quando terminou, falso para ser chamada de novo enquanto houver orcamento.
+  using Tarefa = std::function<bool()>;
+
+  explicit Escalonador(int passo_ms, int max_passos_por_ciclo = 5);
+
+  // Duracao de cada passo de simulacao. Minimo 1ms.
+  void AlteraPassoMs(int passo_ms);
+  int PassoMs() const { return passo_ms_; }
+  // Intervalo entre quadros desenhados. Zero desenha a cada ciclo em que a simulacao andou.
+  void AlteraIntervaloQuadroMs(double intervalo_ms);
+  // Tempo maximo por ciclo para as tarefas de fundo. Pelo menos uma tarefa roda por ciclo, para nao haver fome.
+  void AlteraOrcamentoTarefasMs(double orcamento_ms);
+
+  /** Acumula o tempo ate agora e retorna quantos passos de simulacao devem rodar. O primeiro ciclo apenas inicia o
+  * relogio. Se mais de max_passos_por_ciclo estiverem pendentes, o excesso eh descartado.
+  */
+  int Passos(Relogio::time_point agora);
+  // Fracao do proximo passo ja decorrida, em [0, 1), para interpolar o desenho entre o estado anterior e o atual.
+  float Fracao() const;
+
+  /** Retorna se deve desenhar agora e, se sim, marca o quadro. Sem intervalo de quadro, desenha apenas apos
+  * passos de simulacao.
+  */
+  bool DeveDesenhar(Relogio::time_point agora);
+
+  // Quando o laco deve acordar: o proximo passo ou o proximo quadro, o que vier antes.
+  Relogio::time_point ProximoPrazo() const;
+
+  void AdicionaTarefa(Tarefa tarefa);
+  size_t NumTarefasPendentes() const { return tarefas_.size(); }
+  // Executa tarefas, em ordem, ate o orcamento contado a partir de inicio. Retorna quantas terminaram.
+  int ExecutaTarefas(Relogio::time_point inicio);
+
+  const EstatisticasEscalonador& Estatisticas() const { return estatisticas_; }
+  std::string ResumoEstatisticas() const;
+  void ZeraEstatisticas() { estatisticas_ = EstatisticasEscalonador(); }
+
+ private:
+  Relogio::duration Passo() const { return std::chrono::milliseconds(passo_ms_); }
+
+  int passo_ms_;
+  const int max_passos_por_ciclo_;
+  Relogio::duration intervalo_quadro_ = Relogio::duration::zero();
+  Relogio::duration orcamento_tarefas_ = std::chrono::milliseconds(4);
+
+  bool iniciado_ = false;
+  // Tempo real ainda nao consumido por passos.
+  Relogio::duration acumulado_ = Relogio::duration::zero();
+  Relogio::time_point ultimo_ciclo_;
+  Relogio::time_point proximo_quadro_;
+  Relogio::time_point ultimo_quadro_;
+  bool passos_desde_quadro_ = false;
+
+  std::deque<Tarefa> tarefas_;
+  EstatisticasEscalonador estatisticas_;
+};
+
+}  // namespace ent
+
+#endif  // ENT_ESCALONADOR_H
@@ -0,0 +1,274 @@
+#include "ent/gravacao_notificacoes.h"
+
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include <thread>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "ent/util.h"
+#include "log/log.h"
+
+namespace ent {
+
+namespace {
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::StringOutputStream;
+
+constexpr char kAssinatura[] = "TVGN";
+constexpr int kTamanhoAssinatura = 4;
+constexpr uint32_t kVersao = 1;
+// O buffer eh escrito no arquivo ao passar deste tamanho.
+constexpr size_t kTamanhoMaximoBuffer = 64 * 1024;
+// Limite de sanidade para um registro (tabuleiros grandes cabem com folga).
+constexpr uint32_t kTamanhoMaximoRegistro = 256 * 1024 * 1024;
+
+}  // namespace
+
+GravadorNotificacoes::GravadorNotificacoes(const std::string& caminho, ntf::CentralNotificacoes* central)
+    : central_(central), semente_(SementeDados()), arquivo_(caminho, std::ios::binary | std::ios::trunc) {
+  if (!arquivo_) {
+    throw std::logic_error(absl::StrCat("Erro abrindo gravacao: ", caminho));
+  }
+  {
+    StringOutputStream saida(&buffer_);
+    CodedOutputStream cos(&saida);
+    cos.WriteRaw(kAssinatura, kTamanhoAssinatura);
+    cos.WriteVarint32(kVersao);
+    cos.WriteVarint32(semente_);
+  }
+  inicio_ = std::chrono::steady_clock::now();
+  // A sequencia de dados da gravacao comeca aqui.
+  AlteraSementeDados(semente_);
+  AlteraObservadorDados([this](unsigned int nfaces, int valor) { GravaDado(nfaces, valor); });
+  central_->RegistraReceptor(this);
+  central_->RegistraEmissorRemoto(this);
+  LOG(INFO) << "Gravando notificacoes em " << caminho << ", semente: " << semente_;
+}
+
+GravadorNotificacoes::~GravadorNotificacoes() {
+  central_->DesregistraReceptor(this);
+  central_->DesregistraEmissorRemoto(this);
+  AlteraObservadorDados(nullptr);
+  Descarrega();
+  LOG(INFO) << "Gravacao terminada, registros: " << num_registros_;
+}
+
+bool GravadorNotificacoes::TrataNotificacao(const ntf::Notificacao& notificacao) {
+  GravaNotificacao(RegistroGravacao::LOCAL, notificacao);
+  return true;
+}
+
+bool GravadorNotificacoes::TrataNotificacaoRemota(const ntf::Notificacao& notificacao) {
+  GravaNotificacao(RegistroGravacao::REMOTA, notificacao);
+  return true;
+}
+
+void GravadorNotificacoes::GravaNotificacao(RegistroGravacao::Tipo tipo, const ntf::Notificacao& notificacao) {
+  std::string conteudo;
+  notificacao.SerializeToString(&conteudo);
+  std::lock_guard<std::mutex> trava(mutex_);
+  GravaRegistro(tipo, conteudo);
+}
+
+void GravadorNotificacoes::GravaDado(unsigned int nfaces, int valor) {
+  std::string conteudo;
+  {
+    StringOutputStream saida(&conteudo);
+    CodedOutputStream cos(&saida);
+    cos.WriteVarint32(nfaces);
+    cos.WriteVarint32(static_cast<uint32_t>(valor));
+  }
+  std::lock_guard<std::mutex> trava(mutex_);
+  GravaRegistro(RegistroGravacao::DADO, conteudo);
+}
+
+void GravadorNotificacoes::GravaRegistro(RegistroGravacao::Tipo tipo, const std::string& conteudo) {
+  const int64_t tempo_us = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - inicio_).count();
+  const uint64_t delta_us = static_cast<uint64_t>(std::max<int64_t>(0, tempo_us - ultimo_tempo_us_));
+  ultimo_tempo_us_ += delta_us;
+  const uint32_t tamanho = 1 + CodedOutputStream::VarintSize64(delta_us) + conteudo.size();
+  {
+    StringOutputStream saida(&buffer_);
+    CodedOutputStream cos(&saida);
+    cos.WriteVarint32(tamanho);
+    const uint8_t byte_tipo = static_cast<uint8_t>(tipo);
+    cos.WriteRaw(&byte_tipo, 1);
+    cos.WriteVarint64(delta_us);
+    cos.WriteString(conteudo);
+  }
+  ++num_registros_;
+  if (buffer_.size() > kTamanhoMaximoBuffer) {
+    arquivo_.write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+}
+
+void GravadorNotificacoes::Descarrega() {
+  std::lock_guard<std::mutex> trava(mutex_);
+  arquivo_.write(buffer_.data(), buffer_.size());
+  arquivo_.flush();
+  buffer_.clear();
+}
+
+struct LeitorGravacao::Estado {
+  explicit Estado(const std::string& caminho) : arquivo(caminho, std::ios::binary), entrada(&arquivo) {}
+  std::ifstream arquivo;
+  google::protobuf::io::IstreamInputStream entrada;
+};
+
+LeitorGravacao::LeitorGravacao(const std::string& caminho) : estado_(new Estado(caminho)) {
+  if (!estado_->arquivo) {
+    throw std::logic_error(absl::StrCat("Erro abrindo gravacao: ", caminho));
+  }
+  CodedInputStream cis(&estado_->entrada);
+  char assinatura[kTamanhoAssinatura];
+  uint32_t versao = 0;
+  if (!cis.ReadRaw(assinatura, kTamanhoAssinatura) || std::string(assinatura, kTamanhoAssinatura) != kAssinatura ||
+      !cis.ReadVarint32(&versao) || !cis.ReadVarint32(&semente_)) {
+    throw std::logic_error(absl::StrCat("Arquivo nao eh uma gravacao de notificacoes: ", caminho));
+  }
+  if (versao != kVersao) {
+    throw std::logic_error(absl::StrFormat("Versao de gravacao nao suportada: %d", versao));
+  }
+}
+
+LeitorGravacao::~LeitorGravacao() {}
+
+bool LeitorGravacao::Le(RegistroGravacao* registro) {
+  // Um CodedInputStream por registro: o limite de bytes dele vale por instancia, e a gravacao pode ser grande.
+  CodedInputStream cis(&estado_->entrada);
+  uint32_t tamanho = 0;
+  if (!cis.ReadVarint32(&tamanho)) return false;
+  if (tamanho < 2 || tamanho > kTamanhoMaximoRegistro) {
+    throw std::logic_error(absl::StrFormat("Registro de gravacao com tamanho invalido: %d", tamanho));
+  }
+  std::string conteudo;
+  if (!cis.ReadString(&conteudo, tamanho)) {
+    LOG(WARNING) << "Registro truncado no fim da gravacao, ignorando";
+    return false;
+  }
+  CodedInputStream cis_registro(reinterpret_cast<const uint8_t*>(conteudo.data()), conteudo.size());
+  uint8_t byte_tipo = 0;
+  uint64_t delta_us = 0;
+  if (!cis_registro.ReadRaw(&byte_tipo, 1) || !cis_registro.ReadVarint64(&delta_us)) {
+    throw std::logic_error("Registro de gravacao corrompido");
+  }
+  tempo_us_ += delta_us;
+  registro->tempo_us = tempo_us_;
+  registro->notificacao.clear();
+  switch (byte_tipo) {
+    case RegistroGravacao::LOCAL:
+    case RegistroGravacao::REMOTA: {
+      registro->tipo = static_cast<RegistroGravacao::Tipo>(byte_tipo);
+      const int inicio = cis_registro.CurrentPosition();
+      registro->notificacao.assign(conteudo, inicio, std::string::npos);
+      return true;
+    }
+    case RegistroGravacao::DADO: {
+      registro->tipo = RegistroGravacao::DADO;
+      uint32_t nfaces = 0;
+      uint32_t valor = 0;
+      if (!cis_registro.ReadVarint32(&nfaces) || !cis_registro.ReadVarint32(&valor)) {
+        throw std::logic_error("Registro de dado corrompido");
+      }
+      registro->nfaces = nfaces;
+      registro->valor = static_cast<int>(valor);
+      return true;
+    }
+    default:
+      throw std::logic_error(absl::StrFormat("Tipo de registro de gravacao invalido: %d", byte_tipo));
+  }
+}
+
+std::string EstatisticasReproducao::Resumo() const {
+  return absl::StrFormat(
+      "notificacoes locais: %d, remotas: %d, descartadas: %d, bytes: %d, dados: %d (divergentes: %d, nao rolados: %d), "
+      "gravacao: %.2fs, tratamento: %.3fs, %.1f notificacoes/s",
+      notificacoes_locais, notificacoes_remotas, notificacoes_descartadas, bytes_notificacoes, dados,
+      dados_divergentes, dados_nao_rolados, segundos_gravacao, segundos_tratamento, NotificacoesPorSegundo());
+}
+
+EstatisticasReproducao ReproduzGravacao(
+    const std::string& caminho, ntf::Receptor* receptor, bool tempo_real,
+    const std::function<void()>& apos_notificacao) {
+  LeitorGravacao leitor(caminho);
+  EstatisticasReproducao estatisticas;
+  AlteraSementeDados(leitor.Semente());
+  LimpaDadosAcumulados();
+
+  // Dados gravados para a notificacao corrente e ainda nao rolados, na ordem.
+  std::deque<std::pair<unsigned int, int>> esperados;
+  AlteraObservadorDados([&esperados, &estatisticas](unsigned int nfaces, int valor) {
+    if (esperados.empty() || esperados.front().first != nfaces || esperados.front().second != valor) {
+      ++estatisticas.dados_divergentes;
+    }
+    if (!esperados.empty()) {
+      esperados.pop_front();
+    }
+  });
+
+  const auto inicio = std::chrono::steady_clock::now();
+  RegistroGravacao registro;
+  bool pendente = leitor.Le(&registro);
+  ntf::Notificacao notificacao;
+  while (pendente) {
+    estatisticas.segundos_gravacao = registro.tempo_us / 1e6;
+    if (registro.tipo != RegistroGravacao::LOCAL) {
+      // Remotas sao saidas da sessao original; dados sem notificacao (rolados antes da primeira) sao ignorados.
+      if (registro.tipo == RegistroGravacao::REMOTA) {
+        ++estatisticas.notificacoes_remotas;
+        estatisticas.bytes_notificacoes += registro.notificacao.size();
+      } else {
+        ++estatisticas.dados;
+      }
+      pendente = leitor.Le(&registro);
+      continue;
+    }
+    if (!notificacao.ParseFromString(registro.notificacao)) {
+      throw std::logic_error("Notificacao de gravacao corrompida");
+    }
+    estatisticas.bytes_notificacoes += registro.notificacao.size();
+    const int64_t tempo_us = registro.tempo_us;
+    // Os dados rolados no tratamento original vem logo apos a notificacao.
+    esperados.clear();
+    LimpaDadosAcumulados();
+    while ((pendente = leitor.Le(&registro)) && registro.tipo == RegistroGravacao::DADO) {
+      ++estatisticas.dados;
+      esperados.emplace_back(registro.nfaces, registro.valor);
+      if (NumParaFace(registro.nfaces, /*logar_erro=*/false).has_value()) {
+        AcumulaDado(registro.valor);
+      }
+    }
+    if (notificacao.tipo() == ntf::TN_SERIALIZAR_TABULEIRO ||
+        notificacao.tipo() == ntf::TN_SERIALIZAR_ENTIDADES_SELECIONAVEIS) {
+      ++estatisticas.notificacoes_descartadas;
+      continue;
+    }
+    if (tempo_real) {
+      std::this_thread::sleep_until(inicio + std::chrono::microseconds(tempo_us));
+    }
+    const auto antes = std::chrono::steady_clock::now();
+    receptor->TrataNotificacao(notificacao);
+    if (apos_notificacao) {
+      apos_notificacao();
+    }
+    estatisticas.segundos_tratamento +=
+        std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - antes).count();
+    ++estatisticas.notificacoes_locais;
+    estatisticas.dados_nao_rolados += esperados.size();
+  }
+  AlteraObservadorDados(nullptr);
+  LimpaDadosAcumulados();
+  return estatisticas;
+}
+
+}  // namespace ent
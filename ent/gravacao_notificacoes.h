@@ -0,0 +1,133 @@
+#ifndef ENT_GRAVACAO_NOTIFICACOES_H
+#define ENT_GRAVACAO_NOTIFICACOES_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "ntf/notificacao.h"
+
+namespace ent {
+
+/** Um registro da gravacao. */
+struct RegistroGravacao {
+  enum Tipo {
+    // Notificacao despachada aos receptores locais (inclusive as recebidas da rede).
+    LOCAL = 1,
+    // Notificacao emitida para a rede.
+    REMOTA = 2,
+    // Valor retornado por RolaDado, durante o tratamento da ultima notificacao local.
+    DADO = 3,
+  };
+  Tipo tipo = LOCAL;
+  // Microssegundos desde o inicio da gravacao.
+  int64_t tempo_us = 0;
+  // Notificacao serializada, para LOCAL e REMOTA.
+  std::string notificacao;
+  // Para DADO.
+  unsigned int nfaces = 0;
+  int valor = 0;
+};
+
+/** Grava, em um arquivo binario compacto, todas as notificacoes que passam pela central (locais e remotas) e os dados
+* rolados, com o tempo de cada uma. Permite reproduzir uma sessao real com ReproduzGravacao.
+*
+* Formato: "TVGN", versao e semente de RolaDado (varints), seguidos dos registros. Cada registro eh o tamanho (varint)
+* e o conteudo: tipo (1 byte), delta de tempo em relacao ao registro anterior em us (varint) e a notificacao
+* serializada, ou o numero de faces e o valor do dado (varints).
+*
+* Ao ser criado, o gravador reinicia RolaDado com a semente gravada e passa a observar os dados. Deve ser criado logo
+* apos a central, antes dos outros receptores, para gravar cada notificacao antes dos dados rolados no tratamento dela.
+* Para a reproducao partir do mesmo estado, a gravacao deve comecar com o programa (o tabuleiro chega por notificacao).
+*/
+class GravadorNotificacoes : public ntf::Receptor, public ntf::EmissorRemoto {
+ public:
+  // Lanca std::logic_error se nao conseguir abrir o arquivo.
+  GravadorNotificacoes(const std::string& caminho, ntf::CentralNotificacoes* central);
+  ~GravadorNotificacoes();
+
+  bool TrataNotificacao(const ntf::Notificacao& notificacao) override;
+  bool TrataNotificacaoRemota(const ntf::Notificacao& notificacao) override;
+
+  // Escreve o que estiver no buffer.
+  void Descarrega();
+
+  int64_t NumRegistros() const { return num_registros_; }
+  uint32_t Semente() const { return semente_; }
+
+ private:
+  void GravaNotificacao(RegistroGravacao::Tipo tipo, const ntf::Notificacao& notificacao);
+  void GravaDado(unsigned int nfaces, int valor);
+  // Escreve no buffer o registro com tipo, delta de tempo e conteudo. Requer mutex_.
+  void GravaRegistro(RegistroGravacao::Tipo tipo, const std::string& conteudo);
+
+  ntf::CentralNotificacoes* central_;
+  uint32_t semente_;
+  std::ofstream arquivo_;
+  // Dados podem ser rolados fora da thread principal.
+  std::mutex mutex_;
+  std::string buffer_;
+  std::chrono::steady_clock::time_point inicio_;
+  int64_t ultimo_tempo_us_ = 0;
+  int64_t num_registros_ = 0;
+};
+
+/** Le os registros de uma gravacao, em ordem. */
+class LeitorGravacao {
+ public:
+  // Lanca std::logic_error se o arquivo nao puder ser aberto ou nao for uma gravacao.
+  explicit LeitorGravacao(const std::string& caminho);
+  ~LeitorGravacao();
+
+  uint32_t Semente() const { return semente_; }
+  /** Le o proximo registro. @return false no fim do arquivo. Lanca std::logic_error se o registro estiver corrompido
+  * (um registro truncado no fim, de gravacao interrompida, eh apenas ignorado).
+  */
+  bool Le(RegistroGravacao* registro);
+
+ private:
+  struct Estado;
+  std::unique_ptr<Estado> estado_;
+  uint32_t semente_ = 0;
+  int64_t tempo_us_ = 0;
+};
+
+struct EstatisticasReproducao {
+  int64_t notificacoes_locais = 0;
+  // Remotas e descartadas (serializacoes, para nao escrever arquivos) sao apenas contadas.
+  int64_t notificacoes_remotas = 0;
+  int64_t notificacoes_descartadas = 0;
+  int64_t bytes_notificacoes = 0;
+  int64_t dados = 0;
+  // Dados rolados com valor ou numero de faces diferente do gravado, ou a mais: o comportamento divergiu da gravacao.
+  int64_t dados_divergentes = 0;
+  // Dados gravados que nao foram rolados durante a reproducao.
+  int64_t dados_nao_rolados = 0;
+  // Duracao da gravacao e tempo gasto tratando as notificacoes locais.
+  double segundos_gravacao = 0;
+  double segundos_tratamento = 0;
+
+  double NotificacoesPorSegundo() const {
+    return segundos_tratamento <= 0 ? 0.0 : notificacoes_locais / segundos_tratamento;
+  }
+  std::string Resumo() const;
+};
+
+/** Reproduz a gravacao no receptor (normalmente um Tabuleiro sem grafico, desregistrado da propria central, para nao
+* tratar duas vezes o que ele mesmo gera). Cada notificacao local eh entregue ao receptor com os dados rolados no
+* tratamento original acumulados (AcumulaDado), e os dados rolados sao comparados com os gravados. Apos cada notificacao,
+* apos_notificacao eh chamada, se houver (por exemplo, para despachar a central do receptor).
+* Em tempo real, respeita os tempos gravados; senao, reproduz o mais rapido possivel.
+* Lanca std::logic_error se a gravacao nao puder ser lida.
+*/
+EstatisticasReproducao ReproduzGravacao(
+    const std::string& caminho, ntf::Receptor* receptor, bool tempo_real,
+    const std::function<void()>& apos_notificacao = nullptr);
+
+}  // namespace ent
+
+#endif  // ENT_GRAVACAO_NOTIFICACOES_H
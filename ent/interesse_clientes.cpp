@@ -0,0 +1,200 @@
+#include "ent/interesse_clientes.h"
+
+#include "ent/entidade.h"
+#include "ent/tabuleiro.h"
+#include "ent/util.h"
+#include "log/log.h"
+#include "ntf/notificacao.h"
+
+namespace ent {
+
+InteresseClientes::InteresseClientes(const Tabuleiro* tabuleiro, ntf::CentralNotificacoes* central)
+    : tabuleiro_(tabuleiro), central_(central) {}
+
+bool InteresseClientes::Interessa(
+    const ntf::InteresseCliente& interesse, unsigned int id, const Relevancia& relevancia) {
+  if (interesse.has_id_entidade_camera() && interesse.id_entidade_camera() == id) return true;
+  if (relevancia.selecionavel_para_jogador) return true;
+  return relevancia.visivel && relevancia.id_cenario == interesse.id_cenario();
+}
+
+InteresseClientes::Relevancia InteresseClientes::RelevanciaEntidade(const Entidade& entidade) {
+  Relevancia relevancia;
+  relevancia.id_cenario = entidade.IdCenario();
+  relevancia.visivel = entidade.Proto().visivel();
+  relevancia.selecionavel_para_jogador = entidade.SelecionavelParaJogador();
+  return relevancia;
+}
+
+InteresseClientes::Relevancia InteresseClientes::RelevanciaApos(
+    const Entidade& entidade, const ntf::Notificacao& notificacao) {
+  Relevancia relevancia = RelevanciaEntidade(entidade);
+  const auto& proto = notificacao.entidade();
+  if (proto.has_pos()) {
+    relevancia.id_cenario = proto.pos().id_cenario();
+  } else if (proto.has_destino()) {
+    relevancia.id_cenario = proto.destino().id_cenario();
+  }
+  if (proto.has_visivel()) {
+    relevancia.visivel = proto.visivel();
+  }
+  if (proto.has_selecionavel_para_jogador()) {
+    relevancia.selecionavel_para_jogador = proto.selecionavel_para_jogador();
+  }
+  return relevancia;
+}
+
+bool InteresseClientes::InteressaAntesOuDepois(
+    const Cliente& cliente, unsigned int id, const Relevancia* antes, const Relevancia& depois) const {
+  // Sem o estado anterior, o atual pode ja ser o posterior e a entidade estar saindo do cenario do cliente.
+  if (antes == nullptr) return true;
+  return Interessa(cliente.interesse, id, *antes) || Interessa(cliente.interesse, id, depois);
+}
+
+std::unique_ptr<ntf::Notificacao> InteresseClientes::NotificacaoEstado(
+    const std::string& id_rede, const Entidade& entidade) {
+  auto n = ntf::NovaNotificacao(ntf::TN_ATUALIZAR_ENTIDADE);
+  n->set_id_rede(id_rede);
+  *n->mutable_entidade() = entidade.Proto();
+  return n;
+}
+
+void InteresseClientes::Filtra(const ntf::Notificacao& notificacao, const std::vector<std::string>& ids_clientes,
+                               std::vector<bool>* interessa, std::vector<Recuperacao>* recuperacoes) {
+  if (notificacao.tipo() == ntf::TN_REMOVER_ENTIDADE) {
+    EsqueceEntidade(notificacao.entidade().id());
+    return;
+  }
+  if (clientes_.empty()) return;
+  switch (notificacao.tipo()) {
+    case ntf::TN_ATUALIZAR_ENTIDADE:
+    case ntf::TN_ATUALIZAR_PARCIAL_ENTIDADE_NOTIFICANDO_SE_LOCAL:
+    case ntf::TN_MOVER_ENTIDADE:
+      FiltraEntidade(notificacao, ids_clientes, interessa, recuperacoes);
+      return;
+    case ntf::TN_MOVER_ENTIDADES_COMPACTO: {
+      std::vector<unsigned int> ids;
+      for (const auto& movimento : DescompactaMovimentos(notificacao.movimentos_entidades())) {
+        ids.push_back(movimento.id);
+      }
+      FiltraTransiente(ids, ids_clientes, interessa);
+      return;
+    }
+    case ntf::TN_ADICIONAR_ACAO: {
+      const auto& acao = notificacao.acao();
+      std::vector<unsigned int> ids;
+      if (acao.has_id_entidade_origem()) ids.push_back(acao.id_entidade_origem());
+      if (acao.has_id_entidade_destino()) ids.push_back(acao.id_entidade_destino());
+      for (const auto& por_entidade : acao.por_entidade()) {
+        ids.push_back(por_entidade.id());
+      }
+      ids.insert(ids.end(), acao.ids_afetados().begin(), acao.ids_afetados().end());
+      // Acoes sem entidades (por exemplo, em area a partir de uma posicao) vao para todos.
+      if (ids.empty()) return;
+      FiltraTransiente(ids, ids_clientes, interessa);
+      return;
+    }
+    default:
+      return;
+  }
+}
+
+void InteresseClientes::FiltraEntidade(
+    const ntf::Notificacao& notificacao, const std::vector<std::string>& ids_clientes,
+    std::vector<bool>* interessa, std::vector<Recuperacao>* recuperacoes) {
+  const unsigned int id = notificacao.entidade().id();
+  const auto* entidade = tabuleiro_->BuscaEntidade(id);
+  if (entidade == nullptr) {
+    ultima_relevancia_.erase(id);
+    return;
+  }
+  const Relevancia depois = RelevanciaApos(*entidade, notificacao);
+  auto it_antes = ultima_relevancia_.find(id);
+  const Relevancia* antes = it_antes == ultima_relevancia_.end() ? nullptr : &it_antes->second;
+  for (size_t i = 0; i < ids_clientes.size(); ++i) {
+    auto it = clientes_.find(ids_clientes[i]);
+    if (it == clientes_.end() || it->second.interesse.sem_filtro()) continue;
+    Cliente& cliente = it->second;
+    if (!InteressaAntesOuDepois(cliente, id, antes, depois)) {
+      (*interessa)[i] = false;
+      cliente.defasadas.insert(id);
+    } else if (cliente.defasadas.erase(id) > 0) {
+      // O estado atual vai antes: se a notificacao ainda nao foi aplicada (repasse), ela vem por cima dele.
+      recuperacoes->push_back(Recuperacao{i, NotificacaoEstado(ids_clientes[i], *entidade)});
+    }
+  }
+  ultima_relevancia_[id] = depois;
+}
+
+void InteresseClientes::FiltraTransiente(
+    const std::vector<unsigned int>& ids, const std::vector<std::string>& ids_clientes,
+    std::vector<bool>* interessa) const {
+  for (size_t i = 0; i < ids_clientes.size(); ++i) {
+    auto it = clientes_.find(ids_clientes[i]);
+    if (it == clientes_.end() || it->second.interesse.sem_filtro()) continue;
+    bool algum = false;
+    for (unsigned int id : ids) {
+      const auto* entidade = tabuleiro_->BuscaEntidade(id);
+      if (entidade == nullptr || Interessa(it->second.interesse, id, RelevanciaEntidade(*entidade))) {
+        algum = true;
+        break;
+      }
+    }
+    (*interessa)[i] = algum;
+  }
+}
+
+void InteresseClientes::AtualizaInteresse(const std::string& id_rede, const ntf::InteresseCliente& interesse) {
+  VLOG(1) << "Interesse de '" << id_rede << "': " << interesse.ShortDebugString();
+  Cliente& cliente = clientes_[id_rede];
+  cliente.interesse = interesse;
+  int enviadas = 0;
+  for (auto it = cliente.defasadas.begin(); it != cliente.defasadas.end();) {
+    const auto* entidade = tabuleiro_->BuscaEntidade(*it);
+    if (entidade == nullptr) {
+      it = cliente.defasadas.erase(it);
+      continue;
+    }
+    if (!interesse.sem_filtro() && !Interessa(interesse, *it, RelevanciaEntidade(*entidade))) {
+      ++it;
+      continue;
+    }
+    central_->AdicionaNotificacaoRemota(NotificacaoEstado(id_rede, *entidade).release());
+    ++enviadas;
+    it = cliente.defasadas.erase(it);
+  }
+  if (enviadas > 0) {
+    VLOG(1) << "Enviei " << enviadas << " entidades defasadas para '" << id_rede << "'";
+  }
+}
+
+void InteresseClientes::RemoveCliente(const std::string& id_rede) {
+  clientes_.erase(id_rede);
+}
+
+void InteresseClientes::ClienteRessincronizado(const std::string& id_rede) {
+  auto it = clientes_.find(id_rede);
+  if (it == clientes_.end()) return;
+  it->second.defasadas.clear();
+}
+
+void InteresseClientes::EsqueceEntidade(unsigned int id) {
+  ultima_relevancia_.erase(id);
+  for (auto& [id_rede, cliente] : clientes_) {
+    cliente.defasadas.erase(id);
+  }
+}
+
+void InteresseClientes::Limpa() {
+  for (auto& [id_rede, cliente] : clientes_) {
+    cliente.defasadas.clear();
+  }
+  ultima_relevancia_.clear();
+}
+
+int InteresseClientes::NumDefasadas(const std::string& id_rede) const {
+  auto it = clientes_.find(id_rede);
+  return it == clientes_.end() ? 0 : static_cast<int>(it->second.defasadas.size());
+}
+
+}  // namespace ent
@@ -0,0 +1,91 @@
+#ifndef ENT_INTERESSE_CLIENTES_H
+#define ENT_INTERESSE_CLIENTES_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "net/interesse.h"
+#include "ntf/notificacao.pb.h"
+
+namespace ntf {
+class CentralNotificacoes;
+}  // namespace ntf
+
+namespace ent {
+
+class Entidade;
+class Tabuleiro;
+
+/** Filtro de interesse do servidor (mestre): cada cliente informa o cenario que ve e a entidade da camera
+* (TN_INFORMAR_INTERESSE), e as atualizacoes de entidades que ele nao ve nao lhe sao enviadas.
+* Uma entidade interessa ao cliente se for a da camera, se for selecionavel para jogador, ou se estiver visivel no
+* cenario do cliente, antes ou depois da atualizacao. Atualizacoes descartadas deixam a entidade defasada para o
+* cliente; quando ela volta a interessar (ou o cliente muda de cenario), o cliente recebe o estado completo dela antes
+* da proxima atualizacao.
+* Notificacoes transientes (acoes, movimentos parciais) sao apenas descartadas. Todo o resto passa. A remocao de uma
+* entidade passa para todos e apaga o que se sabia dela.
+*/
+class InteresseClientes : public net::FiltroInteresse {
+ public:
+  // Nao possui os parametros.
+  InteresseClientes(const Tabuleiro* tabuleiro, ntf::CentralNotificacoes* central);
+
+  void Filtra(const ntf::Notificacao& notificacao, const std::vector<std::string>& ids_clientes,
+              std::vector<bool>* interessa, std::vector<Recuperacao>* recuperacoes) override;
+
+  /** Atualiza o interesse do cliente e envia a ele o estado das entidades defasadas que passam a interessar. */
+  void AtualizaInteresse(const std::string& id_rede, const ntf::InteresseCliente& interesse);
+  void RemoveCliente(const std::string& id_rede);
+  void ClienteRessincronizado(const std::string& id_rede) override;
+  // Esquece as entidades, para um novo tabuleiro (que os clientes recebem inteiro). Mantem o interesse dos clientes.
+  void Limpa();
+
+  // Entidades cujas atualizacoes o cliente nao recebeu.
+  int NumDefasadas(const std::string& id_rede) const;
+  // Entidades com relevancia guardada (ver ultima_relevancia_).
+  int NumEntidadesConhecidas() const { return static_cast<int>(ultima_relevancia_.size()); }
+
+ private:
+  // O que define o interesse em uma entidade.
+  struct Relevancia {
+    int id_cenario = -1;
+    bool visivel = true;
+    bool selecionavel_para_jogador = false;
+  };
+  struct Cliente {
+    ntf::InteresseCliente interesse;
+    std::unordered_set<unsigned int> defasadas;
+  };
+
+  static bool Interessa(const ntf::InteresseCliente& interesse, unsigned int id, const Relevancia& relevancia);
+  static Relevancia RelevanciaEntidade(const Entidade& entidade);
+  // Estado da entidade apos a notificacao: o atual, com o que a notificacao altera (se ainda nao aplicada).
+  static Relevancia RelevanciaApos(const Entidade& entidade, const ntf::Notificacao& notificacao);
+
+  void FiltraEntidade(const ntf::Notificacao& notificacao, const std::vector<std::string>& ids_clientes,
+                      std::vector<bool>* interessa, std::vector<Recuperacao>* recuperacoes);
+  // Para acoes e movimentos parciais: passa se alguma das entidades interessar ao cliente.
+  void FiltraTransiente(const std::vector<unsigned int>& ids, const std::vector<std::string>& ids_clientes,
+                        std::vector<bool>* interessa) const;
+  // Se o cliente deve receber uma atualizacao da entidade id, considerando os estados antes e depois dela.
+  bool InteressaAntesOuDepois(
+      const Cliente& cliente, unsigned int id, const Relevancia* antes, const Relevancia& depois) const;
+  // Apaga a entidade removida da relevancia e das defasadas.
+  void EsqueceEntidade(unsigned int id);
+  // Estado completo da entidade, para o cliente que o perdeu.
+  static std::unique_ptr<ntf::Notificacao> NotificacaoEstado(const std::string& id_rede, const Entidade& entidade);
+
+  const Tabuleiro* tabuleiro_;
+  ntf::CentralNotificacoes* central_;
+  std::unordered_map<std::string, Cliente> clientes_;
+  // Relevancia das entidades na ultima notificacao filtrada. Necessaria porque a notificacao pode ser filtrada depois
+  // de aplicada: sem isso, quem sai do cenario do cliente nunca seria visto saindo.
+  std::unordered_map<unsigned int, Relevancia> ultima_relevancia_;
+};
+
+}  // namespace ent
+
+#endif  // ENT_INTERESSE_CLIENTES_H
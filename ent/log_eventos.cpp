@@ -0,0 +1,183 @@
+#include "ent/log_eventos.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "absl/strings/str_format.h"
+#include "ent/util.h"
+#include "log/log.h"
+
+namespace ent {
+
+bool EventoLog::EnvolveEntidade(unsigned int id) const {
+  return std::any_of(entidades.begin(), entidades.end(), [id](const auto& par) { return par.first == id; });
+}
+
+std::string FormataEventoLog(const EventoLog& evento) {
+  std::string texto;
+  switch (evento.tipo) {
+    case EventoLog::TEXTO:
+      texto = evento.texto;
+      break;
+    case EventoLog::TEXTO_ENTIDADE:
+      texto = absl::StrFormat(
+          "entidade %s: %s", evento.entidades.empty() ? "null" : evento.entidades[0].second.c_str(), evento.texto.c_str());
+      break;
+    case EventoLog::NOTIFICACAO:
+    case EventoLog::DESFAZENDO:
+    case EventoLog::REFAZENDO: {
+      if (evento.notificacao == nullptr) break;
+      const std::string resumo = ResumoNotificacao(*evento.notificacao, [&evento](unsigned int id) {
+        for (const auto& [id_entidade, rotulo] : evento.entidades) {
+          if (id_entidade == id) return rotulo;
+        }
+        return std::string("null");
+      });
+      if (evento.tipo == EventoLog::NOTIFICACAO) {
+        texto = resumo;
+      } else {
+        texto = absl::StrFormat("%s: %s", evento.tipo == EventoLog::DESFAZENDO ? "desfazendo" : "refazendo", resumo.c_str());
+      }
+      break;
+    }
+  }
+  std::replace(texto.begin(), texto.end(), '\n', ' ');
+  return texto;
+}
+
+BufferLogEventos::BufferLogEventos(int capacidade)
+    : eventos_(std::max(1, capacidade)), textos_(eventos_.size()), formatado_(eventos_.size(), false),
+      criacao_(std::chrono::steady_clock::now()) {}
+
+BufferLogEventos::~BufferLogEventos() {
+  {
+    std::lock_guard<std::mutex> trava(mutex_);
+    terminar_ = true;
+  }
+  cond_.notify_all();
+  if (thread_ != nullptr) {
+    thread_->join();
+  }
+}
+
+void BufferLogEventos::Adiciona(EventoLog evento) {
+  evento.tempo_ms = TempoMs();
+  int posicao;
+  if (tamanho_ < Capacidade()) {
+    posicao = (inicio_ + tamanho_) % Capacidade();
+    ++tamanho_;
+  } else {
+    // Cheio: sobrescreve o mais antigo.
+    posicao = inicio_;
+    inicio_ = (inicio_ + 1) % Capacidade();
+  }
+  if (sessao_ativa_) {
+    {
+      std::lock_guard<std::mutex> trava(mutex_);
+      pendentes_.push_back(evento);
+    }
+    cond_.notify_all();
+  }
+  eventos_[posicao] = std::move(evento);
+  textos_[posicao].clear();
+  formatado_[posicao] = false;
+}
+
+void BufferLogEventos::Limpa() {
+  for (auto& evento : eventos_) evento = EventoLog();
+  for (auto& texto : textos_) texto.clear();
+  std::fill(formatado_.begin(), formatado_.end(), false);
+  inicio_ = 0;
+  tamanho_ = 0;
+}
+
+const std::string& BufferLogEventos::Texto(int i) const {
+  const int posicao = Indice(i);
+  if (!formatado_[posicao]) {
+    textos_[posicao] = FormataEventoLog(eventos_[posicao]);
+    formatado_[posicao] = true;
+  }
+  return textos_[posicao];
+}
+
+std::vector<int> BufferLogEventos::Consulta(const FiltroLogEventos& filtro) const {
+  std::vector<int> indices;
+  for (int i = 0; i < tamanho_; ++i) {
+    if (filtro.max_eventos >= 0 && static_cast<int>(indices.size()) >= filtro.max_eventos) break;
+    const auto& evento = Evento(i);
+    // Do mais recente para o mais antigo: antes do intervalo, nada mais passa.
+    if (evento.tempo_ms < filtro.desde_ms) break;
+    if (evento.tempo_ms > filtro.ate_ms) continue;
+    if (filtro.id_entidade != 0xFFFFFFFF && !evento.EnvolveEntidade(filtro.id_entidade)) continue;
+    indices.push_back(i);
+  }
+  return indices;
+}
+
+std::vector<std::string> BufferLogEventos::Textos(const FiltroLogEventos& filtro) const {
+  std::vector<std::string> textos;
+  for (int i : Consulta(filtro)) {
+    textos.push_back(Texto(i));
+  }
+  return textos;
+}
+
+int64_t BufferLogEventos::TempoMs() const {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - criacao_).count();
+}
+
+void BufferLogEventos::AlteraArquivoSessao(const std::string& caminho) {
+  std::unique_lock<std::mutex> ul(mutex_);
+  cond_.wait(ul, [this] { return pendentes_.empty() && !escrevendo_; });
+  if (arquivo_.is_open()) {
+    arquivo_.close();
+  }
+  sessao_ativa_ = false;
+  if (caminho.empty()) return;
+  arquivo_.open(caminho, std::ios::out | std::ios::app);
+  if (!arquivo_) {
+    throw std::logic_error(std::string("Erro abrindo log de eventos da sessao: ") + caminho);
+  }
+  sessao_ativa_ = true;
+  if (thread_ == nullptr) {
+    thread_.reset(new std::thread(&BufferLogEventos::LoopEscrita, this));
+  }
+}
+
+void BufferLogEventos::EsperaEscrita() {
+  std::unique_lock<std::mutex> ul(mutex_);
+  cond_.wait(ul, [this] { return pendentes_.empty() && !escrevendo_; });
+}
+
+void BufferLogEventos::LoopEscrita() {
+  std::unique_lock<std::mutex> ul(mutex_);
+  while (true) {
+    cond_.wait(ul, [this] { return terminar_ || !pendentes_.empty(); });
+    if (pendentes_.empty()) {
+      // terminar_ sem nada pendente.
+      return;
+    }
+    std::vector<EventoLog> eventos;
+    eventos.swap(pendentes_);
+    escrevendo_ = true;
+    ul.unlock();
+
+    // A formatacao tambem fica fora da thread principal.
+    std::string bloco;
+    for (const auto& evento : eventos) {
+      absl::StrAppendFormat(&bloco, "[%d.%03ds] %s\n",
+          evento.tempo_ms / 1000, evento.tempo_ms % 1000, FormataEventoLog(evento).c_str());
+    }
+    arquivo_ << bloco;
+    arquivo_.flush();
+    if (!arquivo_) {
+      LOG(ERROR) << "Erro escrevendo log de eventos da sessao";
+    }
+
+    ul.lock();
+    escrevendo_ = false;
+    cond_.notify_all();
+  }
+}
+
+}  // namespace ent
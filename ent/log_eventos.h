@@ -0,0 +1,125 @@
+#ifndef ENT_LOG_EVENTOS_H
+#define ENT_LOG_EVENTOS_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ntf/notificacao.pb.h"
+
+namespace ent {
+
+/** Um evento do log. Guarda apenas os dados: o texto eh montado por FormataEventoLog, quando o evento eh exibido. */
+struct EventoLog {
+  enum Tipo {
+    // Texto livre.
+    TEXTO = 0,
+    // Texto sobre a primeira entidade de entidades: "entidade <rotulo>: <texto>".
+    TEXTO_ENTIDADE = 1,
+    // Resumo de notificacao (ver ResumoNotificacao).
+    NOTIFICACAO = 2,
+    // Resumo de notificacao desfeita ou refeita.
+    DESFAZENDO = 3,
+    REFAZENDO = 4,
+  };
+  Tipo tipo = TEXTO;
+  // Milissegundos desde a criacao do log. Preenchido por BufferLogEventos::Adiciona.
+  int64_t tempo_ms = 0;
+  std::string texto;
+  // Para os tipos de notificacao, apenas o que o resumo usa (ver ReduzNotificacaoParaResumo). Compartilhada com a
+  // escrita em segundo plano.
+  std::shared_ptr<const ntf::Notificacao> notificacao;
+  // Ids das entidades envolvidas e seus rotulos no momento do evento (a entidade pode ser removida antes da exibicao).
+  std::vector<std::pair<unsigned int, std::string>> entidades;
+
+  bool EnvolveEntidade(unsigned int id) const;
+};
+
+/** Monta o texto do evento, em uma linha. */
+std::string FormataEventoLog(const EventoLog& evento);
+
+/** Filtro de BufferLogEventos::Consulta. */
+struct FiltroLogEventos {
+  // Apenas eventos envolvendo a entidade. IdInvalido para todas.
+  unsigned int id_entidade = 0xFFFFFFFF;
+  // Intervalo de tempo, em ms desde a criacao do log, inclusivo.
+  int64_t desde_ms = 0;
+  int64_t ate_ms = std::numeric_limits<int64_t>::max();
+  // Maximo de eventos retornados (os mais recentes). Negativo para todos.
+  int max_eventos = -1;
+};
+
+/** Log de eventos do tabuleiro: buffer circular de capacidade fixa. Os eventos mais antigos sao sobrescritos.
+* O texto de cada evento so eh formatado quando pedido (Texto), e entao guardado.
+* Opcionalmente, escreve cada evento formatado em um arquivo da sessao, em uma thread propria.
+* Exceto pela escrita, deve ser usado apenas pela thread principal.
+*/
+class BufferLogEventos {
+ public:
+  static constexpr int kCapacidadePadrao = 256;
+
+  explicit BufferLogEventos(int capacidade = kCapacidadePadrao);
+  // Termina a escrita pendente antes de retornar.
+  ~BufferLogEventos();
+
+  /** Adiciona o evento, preenchendo o tempo. */
+  void Adiciona(EventoLog evento);
+  /** Remove os eventos. Nao afeta o arquivo da sessao. */
+  void Limpa();
+
+  int Tamanho() const { return tamanho_; }
+  int Capacidade() const { return static_cast<int>(eventos_.size()); }
+  /** Evento i, sendo 0 o mais recente. */
+  const EventoLog& Evento(int i) const { return eventos_[Indice(i)]; }
+  /** Texto do evento i, sendo 0 o mais recente. Formata na primeira chamada. */
+  const std::string& Texto(int i) const;
+
+  /** Retorna os indices (para Evento e Texto) que passam pelo filtro, do mais recente para o mais antigo. */
+  std::vector<int> Consulta(const FiltroLogEventos& filtro = FiltroLogEventos()) const;
+  /** Textos dos eventos que passam pelo filtro, do mais recente para o mais antigo. */
+  std::vector<std::string> Textos(const FiltroLogEventos& filtro = FiltroLogEventos()) const;
+
+  /** Milissegundos desde a criacao do log, na mesma base de EventoLog::tempo_ms. */
+  int64_t TempoMs() const;
+
+  /** Passa a escrever os eventos adicionados ao fim do arquivo (caminho completo). Vazio desliga a escrita.
+  * Lanca std::logic_error se nao conseguir abrir o arquivo.
+  */
+  void AlteraArquivoSessao(const std::string& caminho);
+  /** Bloqueia ate os eventos adicionados estarem no arquivo da sessao. */
+  void EsperaEscrita();
+
+ private:
+  int Indice(int i) const { return (inicio_ + tamanho_ - 1 - i + Capacidade()) % Capacidade(); }
+  void LoopEscrita();
+
+  std::vector<EventoLog> eventos_;
+  // Cache de Texto, por posicao em eventos_.
+  mutable std::vector<std::string> textos_;
+  mutable std::vector<bool> formatado_;
+  int inicio_ = 0;
+  int tamanho_ = 0;
+  const std::chrono::steady_clock::time_point criacao_;
+
+  // Escrita da sessao. sessao_ativa_ eh lido apenas pela thread principal, para Adiciona nao travar sem arquivo.
+  bool sessao_ativa_ = false;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::unique_ptr<std::thread> thread_;
+  std::ofstream arquivo_;
+  bool escrevendo_ = false;
+  bool terminar_ = false;
+  std::vector<EventoLog> pendentes_;
+};
+
+}  // namespace ent
+
+#endif  // ENT_LOG_EVENTOS_H
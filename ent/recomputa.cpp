@@ -45,14 +45,6 @@ void DobraMargemCritico(DadosAtaque* da) {
   da->set_margem_critico(21 - margem);
 }
 
-// Retorna o bonus do talento para a pericia ou zero caso nao haja.
-int BonusTalento(const std::string& id_pericia, const TalentoProto& talento) {
-  for (const auto& bp : talento.bonus_pericias()) {
-    if (bp.id() == id_pericia) return bp.valor();
-  }
-  return 0;
-}
-
 int CalculaBonusBaseAtaque(const EntidadeProto& proto) {
   if (PossuiEvento(EFEITO_PODER_DIVINO, proto)) {
     return Nivel(proto);
@@ -1818,36 +1810,47 @@ const DadosAtaque& DadoCorrenteParaCA(const EntidadeProto& proto) {
 }
 
 void RecomputaDependenciasPericias(const Tabelas& tabelas, EntidadeProto* proto) {
-  // Pericias afetadas por talentos.
-  std::unordered_map<std::string, std::vector<const TalentoProto*>> talentos_por_pericia;
-  for (const auto& talento : tabelas.todas().tabela_talentos().talentos()) {
-    for (const auto& bp : talento.bonus_pericias()) {
-      talentos_por_pericia[bp.id()].push_back(&talento);
-    }
-  }
-
-  // Mapa do proto do personagem, porque iremos iterar nas pericias existentes na tabela.
-  std::unordered_map<std::string, InfoPericia> mapa_pericias_proto;
+  // Classes e talentos da entidade resolvidos uma vez, por indice de tabela.
+  const int num_pericias = tabelas.NumPericias();
+  const std::vector<bool> pericias_de_classe = PericiasDeClassePorIndice(tabelas, *proto);
+  const std::vector<bool> talentos_entidade = TalentosPorIndice(tabelas, *proto);
+  const std::vector<bool> foco_em_pericia = PericiasComplementoTalentoPorIndice(tabelas, "foco_em_pericia", *proto);
+
+  // Pericias do proto do personagem por indice de tabela, porque iremos iterar nas pericias existentes na tabela.
+  // As que nao estao na tabela sao mantidas a parte.
+  std::vector<InfoPericia> pericias_proto(num_pericias);
+  std::vector<InfoPericia> pericias_fora_tabela;
   std::unordered_set<std::string> remocoes;
   for (InfoPericia& ip : *proto->mutable_info_pericias()) {
     if (!ip.substituir().empty()) {
       remocoes.insert(ip.substituir());
     }
-    mapa_pericias_proto[ip.id()].Swap(&ip);
+    if (const int indice = tabelas.IndicePericia(ip.id()); indice >= 0) {
+      pericias_proto[indice].Swap(&ip);
+    } else {
+      pericias_fora_tabela.emplace_back().Swap(&ip);
+    }
   }
   for (const auto& remocao: remocoes) {
-    mapa_pericias_proto.erase(remocao);
+    if (const int indice = tabelas.IndicePericia(remocao); indice >= 0) {
+      pericias_proto[indice].Clear();
+    } else {
+      pericias_fora_tabela.erase(
+          std::remove_if(pericias_fora_tabela.begin(), pericias_fora_tabela.end(),
+                         [&remocao](const InfoPericia& ip) { return ip.id() == remocao; }),
+          pericias_fora_tabela.end());
+    }
   }
   proto->clear_info_pericias();
 
   // Cria todas as pericias do personagem.
-  for (const auto& pt : tabelas.todas().tabela_pericias().pericias()) {
+  for (int indice_pericia = 0; indice_pericia < num_pericias; ++indice_pericia) {
     // Acha a pericia no personagem se houver para pegar os pontos e calcular a graduacao.
-    auto it = mapa_pericias_proto.find(pt.id());
-    if (it == mapa_pericias_proto.end()) {
-      mapa_pericias_proto[pt.id()].set_id(pt.id());
+    auto& pericia_proto = pericias_proto[indice_pericia];
+    if (pericia_proto.id().empty()) {
+      pericia_proto.set_id(tabelas.PericiaPorIndice(indice_pericia).id());
     } else {
-      it->second.mutable_restricoes_sinergia()->Clear();
+      pericia_proto.mutable_restricoes_sinergia()->Clear();
     }
   }
 
@@ -1862,9 +1865,10 @@ void RecomputaDependenciasPericias(const Tabelas& tabelas, EntidadeProto* proto)
       ? 2
       : c_any_of(itens_mundanos, [](const ItemTesouroProto& item) { return item.id() == "ferramentas_artesao";}) ? 0 : -2;
 
-  for (const auto& pt : tabelas.todas().tabela_pericias().pericias()) {
+  for (int indice_pericia = 0; indice_pericia < num_pericias; ++indice_pericia) {
     // Graduacoes.
-    auto& pericia_proto = mapa_pericias_proto[pt.id()];
+    const auto& pt = tabelas.PericiaPorIndice(indice_pericia);
+    auto& pericia_proto = pericias_proto[indice_pericia];
     if (!pt.derivada_de().empty()) continue;
 
     // Atributo.
@@ -1873,20 +1877,11 @@ void RecomputaDependenciasPericias(const Tabelas& tabelas, EntidadeProto* proto)
 
     if (!pt.de_habilidade().empty()) continue;
 
-    const int graduacoes = PericiaDeClasse(tabelas, pt.id(), *proto) ? pericia_proto.pontos() : pericia_proto.pontos() / 2;
+    const int graduacoes = pericias_de_classe[indice_pericia] ? pericia_proto.pontos() : pericia_proto.pontos() / 2;
     AtribuiOuRemoveBonus(graduacoes, TB_BASE, "graduacao", pericia_proto.mutable_bonus());
 
     // Talento.
-    AtribuiOuRemoveBonus(PossuiTalento("foco_em_pericia", pt.id(), *proto) ? 3 : 0, TB_SEM_NOME, "foco_em_pericia", pericia_proto.mutable_bonus());
-
-    // Sinergia.
-    for (const auto& s : pt.sinergias()) {
-      auto& pericia_alvo = mapa_pericias_proto[s.id()];
-      AtribuiOuRemoveBonus(
-          graduacoes >= 5 ? 2 : 0, TB_SINERGIA,
-          absl::StrFormat("sinergia_%s", pt.id().c_str()),
-          pericia_alvo.mutable_bonus());
-    }
+    AtribuiOuRemoveBonus(foco_em_pericia[indice_pericia] ? 3 : 0, TB_SEM_NOME, "foco_em_pericia", pericia_proto.mutable_bonus());
 
     if (pt.id() == "esconderse") {
       // Bonus de tamanho.
@@ -1906,19 +1901,15 @@ void RecomputaDependenciasPericias(const Tabelas& tabelas, EntidadeProto* proto)
     }
 
     // Talento.
-    auto par_pericia_talentos = talentos_por_pericia.find(pt.id());
-    if (par_pericia_talentos != talentos_por_pericia.end()) {
-      for (const auto* talento : par_pericia_talentos->second) {
-        const int bonus_talento = PossuiTalento(talento->id(), *proto) ? BonusTalento(pt.id(), *talento) : 0;
-        AtribuiOuRemoveBonus(bonus_talento, TB_TALENTO, "talento", pericia_proto.mutable_bonus());
-      }
+    for (const auto& bt : tabelas.TalentosComBonusPericia(indice_pericia)) {
+      AtribuiOuRemoveBonus(talentos_entidade[bt.indice_talento] ? bt.valor : 0, TB_TALENTO, "talento", pericia_proto.mutable_bonus());
     }
 
     // Heroismo
     AtribuiOuRemoveBonus(heroismo ? 2 : 0, TB_MORAL, "heroismo", pericia_proto.mutable_bonus());
 
     // Bonus de ferramenta de ladino.
-    if (c_any(std::vector<std::string>{"abrir_fechaduras", "operar_mecanismo"}, pericia_proto.id())) {
+    if (pericia_proto.id() == "abrir_fechaduras" || pericia_proto.id() == "operar_mecanismo") {
       AtribuiOuRemoveBonus(bonus_ferramenta_ladino, TB_CIRCUNSTANCIA, "ferramenta", pericia_proto.mutable_bonus());
     }
     if (pericia_proto.id().find("oficios") == 0) {
@@ -1930,21 +1921,38 @@ void RecomputaDependenciasPericias(const Tabelas& tabelas, EntidadeProto* proto)
       AtribuiOuRemoveBonus(
           DadoCorrenteParaCA(*proto).empunhadura() == EA_ARMA_ESCUDO ? -PenalidadeEscudo(tabelas, *proto) : 0, TB_SEM_NOME, "escudo", pericia_proto.mutable_bonus());
     }
+
+    // Sinergia, nas outras pericias.
+    for (int indice_alvo : tabelas.SinergiasPericia(indice_pericia)) {
+      auto& pericia_alvo = pericias_proto[indice_alvo];
+      AtribuiOuRemoveBonus(
+          graduacoes >= 5 ? 2 : 0, TB_SINERGIA,
+          absl::StrFormat("sinergia_%s", pt.id().c_str()),
+          pericia_alvo.mutable_bonus());
+    }
     //LOG(INFO) << "pericia_proto: " << pericia_proto.ShortDebugString();
   }
   // Pericias derivadas.
-  for (const auto& pt : tabelas.todas().tabela_pericias().pericias()) {
+  for (int indice_pericia = 0; indice_pericia < num_pericias; ++indice_pericia) {
+    const auto& pt = tabelas.PericiaPorIndice(indice_pericia);
     if (pt.derivada_de().empty()) continue;
-    auto& pericia_proto = mapa_pericias_proto[pt.id()];
-    const auto& pericia_origem = mapa_pericias_proto[pt.derivada_de()];
+    const int indice_origem = tabelas.IndicePericia(pt.derivada_de());
+    if (indice_origem < 0) continue;
+    auto& pericia_proto = pericias_proto[indice_pericia];
+    const auto& pericia_origem = pericias_proto[indice_origem];
     pericia_proto.set_pontos(0);
     LimpaBonus(TB_BASE, "graduacao", pericia_proto.mutable_bonus());
     AtribuiOuRemoveBonus(BonusTotal(pericia_origem.bonus()), TB_SEM_NOME, "origem", pericia_proto.mutable_bonus());
   }
   // Pericias de habilidade.
-  for (const auto& pt : tabelas.todas().tabela_pericias().pericias()) {
-    if (pt.de_habilidade().empty() || !mapa_pericias_proto.contains(pt.de_habilidade())) continue;
-    auto& pericia_proto = mapa_pericias_proto[pt.id()];
+  for (int indice_pericia = 0; indice_pericia < num_pericias; ++indice_pericia) {
+    const auto& pt = tabelas.PericiaPorIndice(indice_pericia);
+    if (pt.de_habilidade().empty()) continue;
+    if (tabelas.IndicePericia(pt.de_habilidade()) < 0 &&
+        c_none_of(pericias_fora_tabela, [&pt](const InfoPericia& ip) { return ip.id() == pt.de_habilidade(); })) {
+      continue;
+    }
+    auto& pericia_proto = pericias_proto[indice_pericia];
     pericia_proto.set_pontos(0);  // nao pode ter pontos
     LimpaBonus(TB_BASE, "graduacao", pericia_proto.mutable_bonus());
     int graduacoes = 0;
@@ -1963,9 +1971,12 @@ void RecomputaDependenciasPericias(const Tabelas& tabelas, EntidadeProto* proto)
     AtribuiOuRemoveBonus(graduacoes, TB_SEM_NOME, origem, pericia_proto.mutable_bonus());
   }
 
-  // Atribui de volta ao proto.
-  for (auto& it : mapa_pericias_proto) {
-    proto->add_info_pericias()->Swap(&it.second);
+  // Atribui de volta ao proto, na ordem da tabela.
+  for (auto& ip : pericias_proto) {
+    proto->add_info_pericias()->Swap(&ip);
+  }
+  for (auto& ip : pericias_fora_tabela) {
+    proto->add_info_pericias()->Swap(&ip);
   }
 }
 
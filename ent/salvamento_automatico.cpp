@@ -0,0 +1,151 @@
+#include "ent/salvamento_automatico.h"
+
+#include <boost/filesystem.hpp>
+
+#include "log/log.h"
+#include "log/perfil.h"
+
+namespace ent {
+
+SalvamentoAutomatico::SalvamentoAutomatico(arq::tipo_e tipo, const std::string& nome_arquivo, int num_copias)
+    : tipo_(tipo), nome_arquivo_(nome_arquivo), num_copias_(num_copias) {}
+
+SalvamentoAutomatico::~SalvamentoAutomatico() {
+  {
+    std::lock_guard<std::mutex> trava(mutex_);
+    terminar_ = true;
+  }
+  cond_.notify_all();
+  if (thread_ != nullptr) {
+    thread_->join();
+  }
+}
+
+void SalvamentoAutomatico::AlteraNumCopias(int num_copias) {
+  std::lock_guard<std::mutex> trava(mutex_);
+  num_copias_ = num_copias;
+}
+
+void SalvamentoAutomatico::Agenda(std::unique_ptr<ntf::Notificacao> instantaneo) {
+  {
+    std::lock_guard<std::mutex> trava(mutex_);
+    if (pendente_ != nullptr) {
+      ++metricas_.num_descartados;
+    }
+    pendente_ = std::move(instantaneo);
+    ultimo_ = pendente_;
+    agendamento_pendente_ = std::chrono::steady_clock::now();
+    // A thread so eh criada no primeiro salvamento: a maioria dos tabuleiros (clientes, testes) nunca salva.
+    if (thread_ == nullptr) {
+      thread_.reset(new std::thread(&SalvamentoAutomatico::Loop, this));
+    }
+  }
+  cond_.notify_all();
+}
+
+void SalvamentoAutomatico::EsperaTermino() {
+  std::unique_lock<std::mutex> ul(mutex_);
+  cond_.wait(ul, [this] { return pendente_ == nullptr && !salvando_; });
+}
+
+bool SalvamentoAutomatico::SalvaUltimoInstantaneo(const std::string& nome_arquivo) {
+  std::shared_ptr<const ntf::Notificacao> ultimo;
+  {
+    std::lock_guard<std::mutex> trava(mutex_);
+    ultimo = ultimo_;
+  }
+  if (ultimo == nullptr) return false;
+  try {
+    arq::EscreveArquivoBinProtoComprimido(tipo_, nome_arquivo, *ultimo);
+  } catch (const std::logic_error& e) {
+    LOG(ERROR) << "Falha salvando ultimo instantaneo em '" << nome_arquivo << "': " << e.what();
+    return false;
+  }
+  return true;
+}
+
+SalvamentoAutomatico::Metricas SalvamentoAutomatico::LeMetricas() const {
+  std::lock_guard<std::mutex> trava(mutex_);
+  return metricas_;
+}
+
+std::string SalvamentoAutomatico::NomeCopia(int i) const {
+  boost::filesystem::path caminho(nome_arquivo_);
+  return caminho.stem().string() + "_" + std::to_string(i) + caminho.extension().string();
+}
+
+void SalvamentoAutomatico::RotacionaCopias(int num_copias) {
+  if (num_copias <= 0) return;
+  auto caminho = [this](const std::string& nome) {
+    return boost::filesystem::path(arq::Diretorio(tipo_) + "/" + nome);
+  };
+  boost::system::error_code ec;
+  if (!boost::filesystem::exists(caminho(nome_arquivo_), ec)) return;
+  boost::filesystem::remove(caminho(NomeCopia(num_copias)), ec);
+  for (int i = num_copias - 1; i >= 1; --i) {
+    if (boost::filesystem::exists(caminho(NomeCopia(i)), ec)) {
+      boost::filesystem::rename(caminho(NomeCopia(i)), caminho(NomeCopia(i + 1)), ec);
+    }
+  }
+  // Copia em vez de renomear: assim o arquivo principal nunca deixa de existir.
+  boost::filesystem::copy_file(
+      caminho(nome_arquivo_), caminho(NomeCopia(1)), boost::filesystem::copy_options::overwrite_existing, ec);
+  if (ec) {
+    LOG(WARNING) << "Falha copiando salvamento anterior: " << ec.message();
+  }
+  arq::InvalidaCacheDiretorio(tipo_);
+}
+
+void SalvamentoAutomatico::Loop() {
+  std::unique_lock<std::mutex> ul(mutex_);
+  while (true) {
+    cond_.wait(ul, [this] { return terminar_ || pendente_ != nullptr; });
+    if (pendente_ == nullptr) {
+      // terminar_ sem nada pendente.
+      return;
+    }
+    std::shared_ptr<const ntf::Notificacao> instantaneo = std::move(pendente_);
+    pendente_.reset();
+    const auto agendamento = agendamento_pendente_;
+    const int num_copias = num_copias_;
+    salvando_ = true;
+    ul.unlock();
+
+    bool sucesso = true;
+    size_t tamanho = 0;
+    size_t tamanho_comprimido = 0;
+    {
+      PERFIL_ZONA("SalvamentoAutomatico::Salva");
+      try {
+        tamanho = instantaneo->ByteSizeLong();
+        RotacionaCopias(num_copias);
+        arq::EscreveArquivoBinProtoComprimido(tipo_, nome_arquivo_, *instantaneo);
+        boost::system::error_code ec;
+        tamanho_comprimido = boost::filesystem::file_size(arq::Diretorio(tipo_) + "/" + nome_arquivo_, ec);
+      } catch (const std::exception& e) {
+        LOG(ERROR) << "Falha no salvamento automatico de '" << nome_arquivo_ << "': " << e.what();
+        sucesso = false;
+      }
+    }
+    const double latencia_ms =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - agendamento).count();
+
+    ul.lock();
+    salvando_ = false;
+    if (sucesso) {
+      ++metricas_.num_salvamentos;
+      metricas_.ultima_latencia_ms = latencia_ms;
+      metricas_.maior_latencia_ms = std::max(metricas_.maior_latencia_ms, latencia_ms);
+      metricas_.total_latencia_ms += latencia_ms;
+      metricas_.ultimo_tamanho_bytes = tamanho;
+      metricas_.ultimo_tamanho_comprimido_bytes = tamanho_comprimido;
+      VLOG(1) << "Salvamento automatico em " << nome_arquivo_ << ": " << tamanho << " bytes (" << tamanho_comprimido
+              << " comprimidos), " << latencia_ms << "ms";
+    } else {
+      ++metricas_.num_falhas;
+    }
+    cond_.notify_all();
+  }
+}
+
+}  // namespace ent
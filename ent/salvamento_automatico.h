@@ -0,0 +1,86 @@
+#ifndef ENT_SALVAMENTO_AUTOMATICO_H
+#define ENT_SALVAMENTO_AUTOMATICO_H
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "arq/arquivo.h"
+#include "ntf/notificacao.pb.h"
+
+namespace ent {
+
+/** Salva instantaneos do tabuleiro em segundo plano.
+* A thread principal apenas copia os protos (SerializaTabuleiro) e agenda o instantaneo. A serializacao, compressao e
+* escrita (atomica, via arq) acontecem na thread do salvamento. Os salvamentos anteriores sao mantidos em copias
+* rotativas: nome_1.ext eh o anterior, nome_2.ext o antes dele, e assim por diante.
+*/
+class SalvamentoAutomatico {
+ public:
+  struct Metricas {
+    int num_salvamentos = 0;
+    int num_falhas = 0;
+    // Instantaneos substituidos por um mais novo antes de serem escritos.
+    int num_descartados = 0;
+    // Latencia entre Agenda e o arquivo estar no disco.
+    double ultima_latencia_ms = 0;
+    double maior_latencia_ms = 0;
+    double total_latencia_ms = 0;
+    // Tamanhos do ultimo salvamento, antes e depois da compressao.
+    size_t ultimo_tamanho_bytes = 0;
+    size_t ultimo_tamanho_comprimido_bytes = 0;
+
+    double MediaLatenciaMs() const { return num_salvamentos == 0 ? 0 : total_latencia_ms / num_salvamentos; }
+  };
+
+  SalvamentoAutomatico(arq::tipo_e tipo, const std::string& nome_arquivo, int num_copias);
+  // Termina o salvamento pendente antes de retornar.
+  ~SalvamentoAutomatico();
+
+  void AlteraNumCopias(int num_copias);
+
+  /** Agenda o salvamento do instantaneo (uma notificacao TN_DESERIALIZAR_TABULEIRO). Retorna imediatamente.
+  * Se houver outro instantaneo esperando, ele eh descartado em favor deste.
+  */
+  void Agenda(std::unique_ptr<ntf::Notificacao> instantaneo);
+
+  // Bloqueia ate nao haver salvamento pendente nem em andamento.
+  void EsperaTermino();
+
+  /** Escreve o ultimo instantaneo agendado em nome_arquivo, na thread corrente, sem copias rotativas.
+  * Nao acessa o tabuleiro, entao pode ser chamada de outra thread (watchdog). Retorna false se nao houver instantaneo.
+  */
+  bool SalvaUltimoInstantaneo(const std::string& nome_arquivo);
+
+  Metricas LeMetricas() const;
+  const std::string& NomeArquivo() const { return nome_arquivo_; }
+  // Nome da copia de indice i (1 eh a mais recente).
+  std::string NomeCopia(int i) const;
+
+ private:
+  void Loop();
+  // Renomeia as copias antigas e copia o arquivo atual para a copia 1.
+  void RotacionaCopias(int num_copias);
+
+  const arq::tipo_e tipo_;
+  const std::string nome_arquivo_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cond_;
+  std::unique_ptr<std::thread> thread_;
+  bool terminar_ = false;
+  bool salvando_ = false;
+  int num_copias_ = 0;
+  // Proximo a ser salvo, e o ultimo agendado (que continua valido depois de salvo, para o watchdog).
+  std::shared_ptr<const ntf::Notificacao> pendente_;
+  std::shared_ptr<const ntf::Notificacao> ultimo_;
+  std::chrono::steady_clock::time_point agendamento_pendente_;
+  Metricas metricas_;
+};
+
+}  // namespace ent
+
+#endif  // ENT_SALVAMENTO_AUTOMATICO_H
@@ -384,7 +384,7 @@ void Tabelas::RecarregaMapas() {
     if (arma.tipo_dano().size() == 1 && arma.tipo_dano(0) == TD_CORTANTE && !arma.acao().has_som_fracasso()) {
       arma.mutable_acao()->set_som_fracasso("steel.wav");
     }
-    armas_[arma.id()] = &arma;
+    armas_.Insere(arma.id(), &arma);
   }
   const std::vector<std::string> classes_arcanas = {"mago", "bardo"};
   const std::vector<std::string> classes_divinas = {"druida", "clerigo", "paladino", "ranger"};
@@ -418,7 +418,7 @@ void Tabelas::RecarregaMapas() {
         ea.set_origem(feitico.id());
       }
     }
-    feiticos_[feitico.id()] = &feitico;
+    feiticos_.Insere(feitico.id(), &feitico);
     for (const auto& ic : feitico.info_classes()) {
       auto& mapa_classe = feiticos_por_classe_por_nivel_[ic.id()];
       mapa_classe[ic.nivel()].push_back(&feitico);
@@ -459,7 +459,7 @@ void Tabelas::RecarregaMapas() {
     novo_arco->set_nome(absl::StrFormat("%s (%d)", arco_base.nome().c_str(), i));
     novo_arco->set_preco(absl::StrFormat("%d PO", (i * preco) + preco));
     novo_arco->set_max_forca(i);
-    armas_[novo_arco->id()] = novo_arco;
+    armas_.Insere(novo_arco->id(), novo_arco);
   };
   for (int i = 1; i < 10; ++i) CriaArcoComposto(i, 75, Arma("arco_curto_composto"));
   for (int i = 1; i < 10; ++i) CriaArcoComposto(i, 100, Arma("arco_longo_composto"));
@@ -542,7 +542,7 @@ void Tabelas::RecarregaMapas() {
   }
 
   for (auto& talento : *tabelas_.mutable_tabela_talentos()->mutable_talentos()) {
-    talentos_[talento.id()] = &talento;
+    talentos_.Insere(talento.id(), &talento);
     if (!talento.link().empty()) continue;
     std::vector<std::string> res = absl::StrSplit(talento.nome_ingles(), " ,-'/");
     for (unsigned int i = 1; i < res.size(); ++i) {
@@ -580,11 +580,40 @@ void Tabelas::RecarregaMapas() {
   }
 
   for (const auto& classe : tabelas_.tabela_classes().info_classes()) {
-    classes_[classe.id()] = &classe;
+    classes_.Insere(classe.id(), &classe);
   }
 
   for (const auto& pericia : tabelas_.tabela_pericias().pericias()) {
-    pericias_[pericia.id()] = &pericia;
+    pericias_.Insere(pericia.id(), &pericia);
+  }
+
+  pericias_de_classe_.assign(classes_.size() * pericias_.size(), false);
+  for (int indice_classe = 0; indice_classe < classes_.size(); ++indice_classe) {
+    for (const auto& id_pericia : classes_.Item(indice_classe).pericias()) {
+      if (int indice_pericia = pericias_.Indice(id_pericia); indice_pericia >= 0) {
+        pericias_de_classe_[indice_classe * pericias_.size() + indice_pericia] = true;
+      }
+    }
+  }
+  talentos_por_pericia_.assign(pericias_.size(), {});
+  for (int indice_talento = 0; indice_talento < talentos_.size(); ++indice_talento) {
+    for (const auto& bp : talentos_.Item(indice_talento).bonus_pericias()) {
+      if (int indice_pericia = pericias_.Indice(bp.id()); indice_pericia >= 0) {
+        auto& talentos = talentos_por_pericia_[indice_pericia];
+        // Vale o primeiro bonus do talento para a pericia.
+        if (talentos.empty() || talentos.back().indice_talento != indice_talento) {
+          talentos.push_back({indice_talento, bp.valor()});
+        }
+      }
+    }
+  }
+  sinergias_por_pericia_.assign(pericias_.size(), {});
+  for (int indice_pericia = 0; indice_pericia < pericias_.size(); ++indice_pericia) {
+    for (const auto& s : pericias_.Item(indice_pericia).sinergias()) {
+      if (int indice_alvo = pericias_.Indice(s.id()); indice_alvo >= 0) {
+        sinergias_por_pericia_[indice_pericia].push_back(indice_alvo);
+      }
+    }
   }
 
   for (const auto& acao : tabela_acoes_.acao()) {
@@ -645,8 +674,7 @@ const ArmaduraOuEscudoProto& Tabelas::Escudo(const std::string& id) const {
 }
 
 const ArmaProto& Tabelas::Arma(const std::string& id) const {
-  auto it = armas_.find(id);
-  return it == armas_.end() ? ArmaProto::default_instance() : *it->second;
+  return armas_.Item(id);
 }
 
 const std::string Tabelas::FeiticoConversaoEspontanea(
@@ -685,8 +713,7 @@ const std::string Tabelas::FeiticoConversaoEspontanea(
 }
 
 const ArmaProto& Tabelas::Feitico(const std::string& id) const {
-  auto it = feiticos_.find(id);
-  return it == feiticos_.end() ? ArmaProto::default_instance() : *it->second;
+  return feiticos_.Item(id);
 }
 
 const ArmaProto& Tabelas::ArmaOuFeitico(const std::string& id) const {
@@ -790,13 +817,11 @@ const ItemTesouroProto& Tabelas::Bracadeiras(const std::string& id) const {
 }
 
 const TalentoProto& Tabelas::Talento(const std::string& id) const {
-  auto it = talentos_.find(id);
-  return it == talentos_.end() ? TalentoProto::default_instance() : *it->second;
+  return talentos_.Item(id);
 }
 
 const InfoClasse& Tabelas::Classe(const std::string& id) const {
-  auto it = classes_.find(id);
-  return it == classes_.end() ? InfoClasse::default_instance() : *it->second;
+  return classes_.Item(id);
 }
 
 const RacaProto& Tabelas::Raca(const std::string& id) const {
@@ -820,8 +845,24 @@ const DoencaProto& Tabelas::Doenca(const std::string& id) const {
 }
 
 const PericiaProto& Tabelas::Pericia(const std::string& id) const {
-  auto it = pericias_.find(id);
-  return it == pericias_.end() ? PericiaProto::default_instance() : *it->second;
+  return pericias_.Item(id);
+}
+
+bool Tabelas::PericiaDeClasse(int indice_classe, int indice_pericia) const {
+  if (indice_classe < 0 || indice_classe >= classes_.size() || indice_pericia < 0 || indice_pericia >= pericias_.size()) {
+    return false;
+  }
+  return pericias_de_classe_[indice_classe * pericias_.size() + indice_pericia];
+}
+
+const std::vector<BonusTalentoPericia>& Tabelas::TalentosComBonusPericia(int indice_pericia) const {
+  static const std::vector<BonusTalentoPericia> vazio;
+  return indice_pericia < 0 || indice_pericia >= pericias_.size() ? vazio : talentos_por_pericia_[indice_pericia];
+}
+
+const std::vector<int>& Tabelas::SinergiasPericia(int indice_pericia) const {
+  static const std::vector<int> vazio;
+  return indice_pericia < 0 || indice_pericia >= pericias_.size() ? vazio : sinergias_por_pericia_[indice_pericia];
 }
 
 bool Tabelas::TrataNotificacao(const ntf::Notificacao& notificacao) {
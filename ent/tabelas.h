@@ -2,7 +2,9 @@
 #define ENT_TABELAS_H
 
 #include <optional>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "ent/acoes.pb.h"
 #include "ent/tabelas.pb.h"
@@ -11,6 +13,51 @@
 
 namespace ent {
 
+// Mapa de ids de tabela para indices densos, atribuidos na carga das tabelas. Com o indice em maos, a busca eh um
+// acesso a vetor, sem hash de string. Indices sao validos ate a proxima recarga das tabelas.
+template <class T>
+class MapaInternado {
+ public:
+  void clear() {
+    indices_.clear();
+    itens_.clear();
+  }
+
+  // Ids repetidos mantem o indice original e passam a apontar para o ultimo item.
+  void Insere(const std::string& id, const T* item) {
+    auto [it, inserido] = indices_.try_emplace(id, static_cast<int>(itens_.size()));
+    if (inserido) {
+      itens_.push_back(item);
+    } else {
+      itens_[it->second] = item;
+    }
+  }
+
+  // Retorna -1 se nao houver.
+  int Indice(const std::string& id) const {
+    auto it = indices_.find(id);
+    return it == indices_.end() ? -1 : it->second;
+  }
+
+  // Retorna a instancia padrao para indices invalidos.
+  const T& Item(int indice) const {
+    return indice < 0 || indice >= static_cast<int>(itens_.size()) ? T::default_instance() : *itens_[indice];
+  }
+  const T& Item(const std::string& id) const { return Item(Indice(id)); }
+
+  int size() const { return static_cast<int>(itens_.size()); }
+
+ private:
+  std::unordered_map<std::string, int> indices_;
+  std::vector<const T*> itens_;
+};
+
+// Bonus de um talento (bonus_pericias) para uma pericia.
+struct BonusTalentoPericia {
+  int indice_talento = -1;
+  int valor = 0;
+};
+
 // Classe que gerencia as tabelas.
 class Tabelas : public ntf::Receptor {
  public:
@@ -67,6 +114,27 @@ class Tabelas : public ntf::Receptor {
   const TalentoProto& Talento(const std::string& id) const;
   const InfoClasse& Classe(const std::string& id) const;
   const PericiaProto& Pericia(const std::string& id) const;
+
+  // Indices densos (ver MapaInternado), para quem consulta o mesmo id repetidamente. -1 se o id nao existir.
+  int IndiceArma(const std::string& id) const { return armas_.Indice(id); }
+  int IndiceFeitico(const std::string& id) const { return feiticos_.Indice(id); }
+  int IndiceTalento(const std::string& id) const { return talentos_.Indice(id); }
+  int IndicePericia(const std::string& id) const { return pericias_.Indice(id); }
+  int IndiceClasse(const std::string& id) const { return classes_.Indice(id); }
+  int NumTalentos() const { return talentos_.size(); }
+  int NumPericias() const { return pericias_.size(); }
+  // Retornam a instancia padrao para indices invalidos.
+  const ArmaProto& ArmaPorIndice(int indice) const { return armas_.Item(indice); }
+  const ArmaProto& FeiticoPorIndice(int indice) const { return feiticos_.Item(indice); }
+  const TalentoProto& TalentoPorIndice(int indice) const { return talentos_.Item(indice); }
+  const PericiaProto& PericiaPorIndice(int indice) const { return pericias_.Item(indice); }
+  const InfoClasse& ClassePorIndice(int indice) const { return classes_.Item(indice); }
+  // Se a pericia eh de classe para a classe (campo pericias de InfoClasse), pre computado na carga.
+  bool PericiaDeClasse(int indice_classe, int indice_pericia) const;
+  // Talentos com bonus_pericias para a pericia e seus valores, na ordem dos indices de talento.
+  const std::vector<BonusTalentoPericia>& TalentosComBonusPericia(int indice_pericia) const;
+  // Indices das pericias alvo das sinergias da pericia, na ordem de sinergias. Alvos inexistentes sao omitidos.
+  const std::vector<int>& SinergiasPericia(int indice_pericia) const;
   const Acoes& TodasAcoes() const { return tabela_acoes_; }
   const Modelos& TodosModelosEntidades() const { return tabela_modelos_entidades_; }
   const std::unordered_map<std::string, ifg::ItemMenu>& TodosItensMenu() const { return itens_menu_; }
@@ -95,8 +163,8 @@ class Tabelas : public ntf::Receptor {
 
   std::unordered_map<std::string, const ArmaduraOuEscudoProto*> armaduras_;
   std::unordered_map<std::string, const ArmaduraOuEscudoProto*> escudos_;
-  std::unordered_map<std::string, const ArmaProto*> armas_;
-  std::unordered_map<std::string, const ArmaProto*> feiticos_;
+  MapaInternado<ArmaProto> armas_;
+  MapaInternado<ArmaProto> feiticos_;
   std::unordered_map<std::string, std::unordered_map<int, std::vector<const ArmaProto*>>> feiticos_por_classe_por_nivel_;
   std::unordered_map<int, const EfeitoProto*> efeitos_;
   std::unordered_map<int, const EfeitoModeloProto*> efeitos_modelos_;
@@ -115,9 +183,14 @@ class Tabelas : public ntf::Receptor {
   std::unordered_map<std::string, const ItemTesouroProto*> amuletos_;
   std::unordered_map<std::string, const ItemTesouroProto*> chapeus_;
   std::unordered_map<std::string, const ItemTesouroProto*> botas_;
-  std::unordered_map<std::string, const TalentoProto*> talentos_;
-  std::unordered_map<std::string, const PericiaProto*> pericias_;
-  std::unordered_map<std::string, const InfoClasse*> classes_;
+  MapaInternado<TalentoProto> talentos_;
+  MapaInternado<PericiaProto> pericias_;
+  MapaInternado<InfoClasse> classes_;
+  // Matriz classe x pericia (indices densos), linha a linha.
+  std::vector<bool> pericias_de_classe_;
+  // Por indice de pericia.
+  std::vector<std::vector<BonusTalentoPericia>> talentos_por_pericia_;
+  std::vector<std::vector<int>> sinergias_por_pericia_;
   std::unordered_map<std::string, const RacaProto*> racas_;
   std::unordered_map<std::string, const AcaoProto*> acoes_;
   std::unordered_map<std::string, const DominioProto*> dominios_;
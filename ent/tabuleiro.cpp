@@ -7,7 +7,11 @@
 #ifndef __APPLE__
 #include <execution>
 #endif
+#include <atomic>
+#include <exception>
 #include <memory>
+#include <thread>
+#include <unordered_set>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/range/adaptor/reversed.hpp>
@@ -18,6 +22,7 @@
 #include <cstdlib>
 #include <cmath>
 #include <map>
+#include <numeric>
 #include <stdexcept>
 #include <string>
 #include <utility>
@@ -45,6 +50,7 @@
 #include "gltab/gl.h"
 #include "ifg/tecladomouse.h"
 #include "log/log.h"
+#include "log/perfil.h"
 #include "matrix/vectors.h"
 #include "net/util.h"  // hack to_string
 #include "ntf/notificacao.h"
@@ -140,13 +146,9 @@ void SalvaConfiguracoes(const OpcoesProto& proto) {
 }
 
 // Usado pelas funcoes de timer para enfileiras os tempos.
-void EnfileiraTempo(const boost::timer::cpu_timer& timer, std::list<uint64_t>* tempos) {
-  constexpr static unsigned int kMaximoTamTemposRenderizacao = 10;
-  auto passou_ms = timer.elapsed().wall / DIV_NANO_PARA_MS;
-  if (tempos->size() == kMaximoTamTemposRenderizacao) {
-    tempos->pop_back();
-  }
-  tempos->push_front(passou_ms);
+void EnfileiraTempo(const boost::timer::cpu_timer& timer, boost::circular_buffer<uint64_t>* tempos) {
+  // Cheio, o push_front sobrescreve o mais antigo.
+  tempos->push_front(timer.elapsed().wall / DIV_NANO_PARA_MS);
 }
 
 const TabuleiroProto& BuscaSubCenario(int id_cenario, const TabuleiroProto& proto) {
@@ -179,7 +181,9 @@ Tabuleiro::Tabuleiro(
       texturas_(texturas),
       m3d_(m3d),
       central_(central),
-      modo_mestre_(true) {
+      modo_mestre_(true),
+      salvamento_automatico_(arq::TIPO_TABULEIRO, ARQUIVO_SALVAMENTO_AUTOMATICO, opcoes.num_copias_salvamento_automatico()),
+      interesse_clientes_(this, central) {
   central_->RegistraReceptor(this);
 
   // Modelos.
@@ -203,6 +207,7 @@ Tabuleiro::Tabuleiro(
   }
 
   opcoes_ = opcoes;
+  temporizador_salvamento_automatico_ms_ = opcoes_.intervalo_salvamento_automatico_s() * 1000;
 #if DEBUG
   //opcoes_.set_mostra_fps(true);
   //opcoes_.set_desenha_olho(true);
@@ -221,15 +226,25 @@ Tabuleiro::Tabuleiro(
                << ", lista_eventos_.size() == " << lista_eventos_.size()
                << ", processando_grupo_: " << processando_grupo_;
 
+    // A thread principal esta travada, possivelmente no meio de uma alteracao do tabuleiro. Se houver, usa o ultimo
+    // instantaneo do salvamento automatico, que nao depende do estado corrente.
+    if (salvamento_automatico_.SalvaUltimoInstantaneo(ARQUIVO_WATCHDOG)) {
+      return;
+    }
     ntf::Notificacao notificacao;
     notificacao.set_tipo(ntf::TN_SERIALIZAR_TABULEIRO);
-    notificacao.set_endereco("dinamico://tabuleiro_watchdog.binproto");
+    notificacao.set_endereco("dinamico://" ARQUIVO_WATCHDOG);
     this->TrataNotificacao(notificacao);
   });
 #endif
 }
 
 Tabuleiro::~Tabuleiro() {
+#if USAR_WATCHDOG
+  // Antes de qualquer membro ser destruido: a funcao do watchdog usa o salvamento automatico e o estado do tabuleiro,
+  // que seriam destruidos antes dele.
+  watchdog_.Para();
+#endif
   LiberaTextura();
   LiberaControleVirtual();
   LOG(INFO) << "timers por entidade";
@@ -265,6 +280,7 @@ void Tabuleiro::DadosFramebuffer::Apaga() {
 
 void Tabuleiro::ResetGrafico() {
   LOG(INFO) << "Tabuleiro::ResetGrafico";
+  if (sem_grafico_) return;
   IniciaGL(true);
   RegeraVboTabuleiro();
   // TODO reenviar as texturas?
@@ -278,6 +294,7 @@ void Tabuleiro::EstadoInicial() {
   proto_.Clear();
   //cenario_corrente_ = CENARIO_PRINCIPAL;
   proto_corrente_ = &proto_;
+  interesse_clientes_.Limpa();
   // Iluminacao.
   ReiniciaIluminacao(&proto_);
   // Olho.
@@ -288,10 +305,13 @@ void Tabuleiro::EstadoInicial() {
   ultimo_x_ = ultimo_y_ = 0;
   ultimo_x_3d_ = ultimo_y_3d_ = ultimo_z_3d_ = 0;
   primeiro_x_3d_ = primeiro_y_3d_ = primeiro_z_3d_ = 0;
-  ciclos_para_atualizar_ = -1;
+  ms_para_atualizar_ = -1;
+  movimentos_replicados_.clear();
   // Mapa de entidades e acoes vazios.
   entidades_.clear();
   entidades_ordenadas_.clear();
+  esferas_ordenadas_.clear();
+  indices_visiveis_.clear();
   acoes_.clear();
   // Entidades selecionadas.
   ids_entidades_selecionadas_.clear();
@@ -318,7 +338,7 @@ void Tabuleiro::EstadoInicial() {
   info_geral_.clear();
 
   // LogEventos.
-  log_eventos_.clear();
+  log_eventos_.Limpa();
   log_eventos_clientes_.clear();
   pagina_log_eventos_ = 0;
   pagina_horizontal_log_eventos_ = 0;
@@ -426,25 +446,27 @@ void Tabuleiro::ConfiguraOlhar() {
       gl::AtualizaMatrizes();
       gl::MudaModoMatriz(gl::MATRIZ_CAMERA);
     }
-    const Posicao& alvo = olho_.alvo();
+    Posicao pos;
+    Posicao alvo;
+    OlhoParaDesenho(&pos, &alvo);
     if (camera_ == CAMERA_ISOMETRICA) {
       gl::OlharPara(
           // from.
-          alvo.x(), alvo.y(), olho_.pos().z(),
+          alvo.x(), alvo.y(), pos.z(),
           // to.
           alvo.x(), alvo.y(), alvo.z(),
           // up
-          alvo.x() - olho_.pos().x(), alvo.y() - olho_.pos().y(), 0.0);
+          alvo.x() - pos.x(), alvo.y() - pos.y(), 0.0);
     } else {
       Vector3 up;
-      if (olho_.pos().x() != alvo.x() || olho_.pos().y() != alvo.y()) {
+      if (pos.x() != alvo.x() || pos.y() != alvo.y()) {
         up.z = 1.0f;
       } else {
         up.y = 1.0f;
       }
       gl::OlharPara(
           // from.
-          olho_.pos().x(), olho_.pos().y(), olho_.pos().z(),
+          pos.x(), pos.y(), pos.z(),
           // to.
           alvo.x(), alvo.y(), alvo.z(),
           // up
@@ -472,6 +494,31 @@ void Tabuleiro::ConfiguraOlhar() {
   }
 }
 
+void Tabuleiro::OlhoParaDesenho(Posicao* pos, Posicao* alvo) const {
+  *pos = olho_.pos();
+  *alvo = olho_.alvo();
+  // So o quadro exibido eh interpolado. Picking e colisao (que troca olho_ pelo olho da entidade) usam o olho atual.
+  if (parametros_desenho_.has_picking_x() || !olho_anterior_valido_ || fracao_passo_desenho_ >= 1.0f ||
+      olho_pos_anterior_.id_cenario() != pos->id_cenario()) {
+    return;
+  }
+  // Saltos (troca de camera, entidade presa teleportada) nao sao interpolados.
+  const float MAXIMO_INTERPOLAVEL_METROS = 5.0f;
+  const float maximo_quadrado = MAXIMO_INTERPOLAVEL_METROS * MAXIMO_INTERPOLAVEL_METROS;
+  if (DistanciaEmMetrosAoQuadrado(olho_pos_anterior_, *pos) > maximo_quadrado ||
+      DistanciaEmMetrosAoQuadrado(olho_alvo_anterior_, *alvo) > maximo_quadrado) {
+    return;
+  }
+  const float f = fracao_passo_desenho_;
+  auto interpola = [f](const Posicao& anterior, Posicao* atual) {
+    atual->set_x(anterior.x() + (atual->x() - anterior.x()) * f);
+    atual->set_y(anterior.y() + (atual->y() - anterior.y()) * f);
+    atual->set_z(anterior.z() + (atual->z() - anterior.z()) * f);
+  };
+  interpola(olho_pos_anterior_, pos);
+  interpola(olho_alvo_anterior_, alvo);
+}
+
 void Tabuleiro::ConfiguraOlharMapeamentoNeve() {
   Vector4 vl(-variaveis_clima_.vetor.x, -variaveis_clima_.vetor.y, -variaveis_clima_.vetor.z, 1.0f);
   Matrix4 ms;
@@ -711,6 +758,7 @@ void Tabuleiro::DesenhaFramebufferPrincipal() {
 }
 
 void Tabuleiro::DesenhaMapaOclusao() {
+  PERFIL_ZONA("Tabuleiro::DesenhaMapaOclusao");
   parametros_desenho_.Clear();
   parametros_desenho_.set_tipo_visao(VISAO_NORMAL);
   // Zera as coisas nao usadas durante oclusao.
@@ -771,6 +819,7 @@ void Tabuleiro::DesenhaMapaOclusao() {
 }
 
 void Tabuleiro::DesenhaMapaSombraLuzPontual(unsigned int indice_luz) {
+  PERFIL_ZONA("Tabuleiro::DesenhaMapaSombraLuzPontual");
   if (indice_luz >= luzes_pontuais_.size() || indice_luz >= dfb_luzes_.size()) {
     LOG(WARNING) << "Alguma coisa errada na configuracao da luz, indice_luz: " << indice_luz
                  << ", luzes_pontuais_.size(): " << luzes_pontuais_.size()
@@ -898,6 +947,7 @@ void Tabuleiro::DesenhaMapaNeve() {
 
 
 void Tabuleiro::DesenhaMapaSombraLuzDirecional() {
+  PERFIL_ZONA("Tabuleiro::DesenhaMapaSombraLuzDirecional");
   parametros_desenho_.Clear();
   parametros_desenho_.set_tipo_visao(VISAO_NORMAL);
   // Zera as coisas nao usadas na sombra.
@@ -1002,6 +1052,7 @@ int Tabuleiro::Desenha() {
   glFinish();
 #endif
   timer_uma_renderizacao_completa_.start();
+  PERFIL_ZONA("Tabuleiro::Desenha");
 
   V_ERRO_RET("InicioDesenha");
 
@@ -1101,6 +1152,7 @@ int Tabuleiro::Desenha() {
   glFinish();
 #endif
   timer_renderizacao_mapas_.start();
+  auto inicio_mapas_ns = perfil::AgoraNs();
   if (MapeamentoOclusao() && !modo_debug_) {
     GLint original;
     gl::Le(GL_FRAMEBUFFER_BINDING, &original);
@@ -1196,6 +1248,7 @@ int Tabuleiro::Desenha() {
 #endif
   timer_renderizacao_mapas_.stop();
   EnfileiraTempo(timer_renderizacao_mapas_, &tempos_renderizacao_mapas_);
+  perfil::GravaZona("Tabuleiro::DesenhaMapas", inicio_mapas_ns, perfil::AgoraNs());
 
 #if !USAR_OPENGL_ES
   if (opcoes_.anti_aliasing()) {
@@ -1849,7 +1902,8 @@ void Tabuleiro::AlternaEmCorpoACorpoNotificando() {
 }
 
 void Tabuleiro::AlternaFlanqueandoEntidadesSelecionadasNotificando() {
-  auto grupo = NovoGrupoNotificacoes();
+  ntf::ArenaAcao arena(central_);
+  auto grupo = NovoGrupoNotificacoes(arena.arena());
   for (unsigned int id : IdsEntidadesSelecionadasOuPrimeiraPessoa()) {
     auto* entidade_selecionada = BuscaEntidade(id);
     if (entidade_selecionada == nullptr) continue;
@@ -2148,8 +2202,7 @@ void Tabuleiro::AtualizaParcialEntidadeNotificando(const ntf::Notificacao& notif
     return;
   }
   if (notificacao.local()) {
-    auto* n_remota = new ntf::Notificacao(notificacao);
-    central_->AdicionaNotificacaoRemota(n_remota);
+    central_->AdicionaNotificacaoRemota(ntf::CopiaNotificacao(notificacao, central_->ArenaCiclo()));
   }
   entidade->AtualizaParcial(notificacao.entidade());
 }
@@ -2368,11 +2421,12 @@ ntf::Notificacao Tabuleiro::ArrumaIdsEntidadesAdicionadas() const {
 }
 
 bool Tabuleiro::TrataNotificacao(const ntf::Notificacao& notificacao) {
+  PERFIL_ZONA("Tabuleiro::TrataNotificacao");
   switch (notificacao.tipo()) {
     case ntf::TN_REQUISITAR_LOG_EVENTOS: {
       // Cliente recebendo recebendo requisicao de log.
       std::string log_str;
-      for (const auto& linha : log_eventos_) {
+      for (const auto& linha : log_eventos_.Textos()) {
         absl::StrAppendFormat(&log_str, "%s\n", linha.c_str());
       }
       auto n = ntf::NovaNotificacao(ntf::TN_ENVIAR_LOG_EVENTOS);
@@ -2395,7 +2449,7 @@ bool Tabuleiro::TrataNotificacao(const ntf::Notificacao& notificacao) {
       }
       e->AlteraTodosFeiticos(notificacao.entidade());
       if (notificacao.local()) {
-        central_->AdicionaNotificacaoRemota(new ntf::Notificacao(notificacao));
+        central_->AdicionaNotificacaoRemota(ntf::CopiaNotificacao(notificacao, central_->ArenaCiclo()));
       }
       break;
     }
@@ -2418,7 +2472,7 @@ bool Tabuleiro::TrataNotificacao(const ntf::Notificacao& notificacao) {
       }
       e->AlteraFeitico(id_classe, nivel, indice, usado);
       if (notificacao.local()) {
-        central_->AdicionaNotificacaoRemota(new ntf::Notificacao(notificacao));
+        central_->AdicionaNotificacaoRemota(ntf::CopiaNotificacao(notificacao, central_->ArenaCiclo()));
       }
       break;
     }
@@ -2488,6 +2542,7 @@ bool Tabuleiro::TrataNotificacao(const ntf::Notificacao& notificacao) {
     case ntf::TN_DESCONECTADO: {
       if (EmModoMestre()) {
         // cliente desconectado.
+        interesse_clientes_.RemoveCliente(notificacao.id_rede());
         for (auto it : clientes_) {
           if (it.second == notificacao.id_rede()) {
             LOG(INFO) << "Removendo cliente: " << notificacao.id_rede();
@@ -2499,12 +2554,19 @@ bool Tabuleiro::TrataNotificacao(const ntf::Notificacao& notificacao) {
         LOG(ERROR) << "Nao encontrei cliente desconectado: '" << notificacao.id_rede() << "'";
         return true;
       } else {
+        interesse_informado_valido_ = false;
         if (notificacao.has_erro()) {
           central_->AdicionaNotificacao(ntf::NovaNotificacaoErro(notificacao.erro()));
         }
         return true;
       }
     }
+    case ntf::TN_INFORMAR_INTERESSE: {
+      if (EmModoMestre() && !notificacao.local()) {
+        interesse_clientes_.AtualizaInteresse(notificacao.id_rede(), notificacao.interesse());
+      }
+      return true;
+    }
     case ntf::TN_GRUPO_NOTIFICACOES: {
       // Nunca deve vir da central.
       processando_grupo_ = true;
@@ -2535,6 +2597,8 @@ bool Tabuleiro::TrataNotificacao(const ntf::Notificacao& notificacao) {
       if (notificacao.local()) {
         if (!notificacao.has_erro()) {
           EntraModoClique(MODO_AGUARDANDO);
+          // Nova conexao: o servidor ainda nao sabe o que interessa a este cliente.
+          interesse_informado_valido_ = false;
           central_->AdicionaNotificacao(ntf::NovaNotificacaoErroTipada(ntf::TN_INFO, "Conectado ao servidor"));
           // Aqui comeca o fluxo de envio de coisas de servidor para cliente. Nessa primeira mensagem
           // o cliente cria uma notificacao para cada componente que tratara essa mensagem mandar suas
@@ -2573,9 +2637,9 @@ bool Tabuleiro::TrataNotificacao(const ntf::Notificacao& notificacao) {
       }
       acoes_.push_back(std::move(acao));
       if (notificacao.local() && !notificacao.acao().local_apenas()) {
-        auto* n_remota = new ntf::Notificacao(notificacao);
+        auto n_remota = ntf::CopiaNotificacao(notificacao, central_->ArenaCiclo());
         n_remota->mutable_acao()->clear_afeta_pontos_vida();
-        central_->AdicionaNotificacaoRemota(n_remota);
+        central_->AdicionaNotificacaoRemota(std::move(n_remota));
       }
       return true;
     }
@@ -2652,11 +2716,20 @@ bool Tabuleiro::TrataNotificacao(const ntf::Notificacao& notificacao) {
         // Enviar remotamente.
         if (notificacao.clientes_pendentes()) {
           try {
-            // Estamos enviando para um novo cliente.
+            // Estamos enviando para um novo cliente, ou ressincronizando um atrasado (que mantem o id).
             nt_tabuleiro->set_id_rede(notificacao.id_rede());
-            int id_tab = GeraIdTabuleiro();
+            auto it_cliente = std::find_if(clientes_.begin(), clientes_.end(), [&notificacao](const auto& par) {
+              return par.second == notificacao.id_rede();
+            });
+            int id_tab = it_cliente != clientes_.end() ? it_cliente->first : GeraIdTabuleiro();
             clientes_.insert(std::make_pair(id_tab, notificacao.id_rede()));
             nt_tabuleiro->mutable_tabuleiro()->set_id_cliente(id_tab);
+            if (!id_rede_mestre_automatico_.empty() && notificacao.id_rede() == id_rede_mestre_automatico_) {
+              // Processada depois, vai para o cliente apos o tabuleiro.
+              auto n = ntf::NovaNotificacao(ntf::TN_ALTERAR_MODO_MESTRE_SECUNDARIO);
+              n->mutable_entidade()->set_id(id_tab);
+              central_->AdicionaNotificacao(n.release());
+            }
           } catch (const std::logic_error& e) {
             auto ne = ntf::NovaNotificacao(ntf::TN_ERRO);
             ne->set_erro(e.what());
@@ -2817,6 +2890,19 @@ bool Tabuleiro::TrataNotificacao(const ntf::Notificacao& notificacao) {
       MoveEntidadeNotificando(notificacao);
       return true;
     }
+    case ntf::TN_MOVER_ENTIDADES_COMPACTO: {
+      if (!notificacao.local()) {
+        AplicaMovimentosCompactados(notificacao.movimentos_entidades());
+      }
+      return true;
+    }
+    case ntf::TN_PASSAR_RODADA_EM_LOTE: {
+      if (notificacao.local()) {
+        central_->AdicionaNotificacaoRemota(ntf::CopiaNotificacao(notificacao, central_->ArenaCiclo()));
+      }
+      AplicaDeltaRodada(notificacao.delta_rodada());
+      return true;
+    }
     case ntf::TN_ATUALIZAR_ENTIDADE: {
       AtualizaEntidadeNotificando(notificacao);
       return true;
@@ -2875,10 +2961,11 @@ bool Tabuleiro::TrataNotificacao(const ntf::Notificacao& notificacao) {
         }
         // So repassa a notificacao pros clientes se a origem dela for local, para evitar ficar enviando
         // infinitamente.
-        auto* n_remota = new ntf::Notificacao(notificacao);
-        central_->AdicionaNotificacaoRemota(n_remota);
+        central_->AdicionaNotificacaoRemota(ntf::CopiaNotificacao(notificacao, central_->ArenaCiclo()));
 
-        auto grupo = NovoGrupoNotificacoes();
+        // Copias completas de todas as entidades do cenario: vai na arena, pois so vive ate ser tratado.
+        ntf::ArenaAcao arena(central_);
+        auto grupo = NovoGrupoNotificacoes(arena.arena());
         for (const auto& [id, entidade] : TodasEntidades()) {
           if (entidade->IdCenario() != notificacao.tabuleiro().id_cenario()) continue;
           auto [n, e_antes, e_depois] = NovaNotificacaoFilha(ntf::TN_ATUALIZAR_ENTIDADE, *entidade, grupo.get());
@@ -2900,7 +2987,7 @@ bool Tabuleiro::TrataNotificacao(const ntf::Notificacao& notificacao) {
       if (notificacao.local()) {
         // So repassa a notificacao pros clientes se a origem dela for local, para evitar ficar enviando
         // infinitamente.
-        central_->AdicionaNotificacaoRemota(new ntf::Notificacao(notificacao));
+        central_->AdicionaNotificacaoRemota(ntf::CopiaNotificacao(notificacao, central_->ArenaCiclo()));
       }
       return true;
     }
@@ -2947,35 +3034,69 @@ bool Tabuleiro::TrataNotificacao(const ntf::Notificacao& notificacao) {
 }
 
 void Tabuleiro::RefrescaMovimentosParciais() {
+  PERFIL_ZONA("Tabuleiro::RefrescaMovimentosParciais");
+  std::vector<unsigned int> ids;
+  bool com_rotacao_escala = false;
   if (estado_ == ETAB_ENTS_PRESSIONADAS) {
-    for (unsigned int id : IdsEntidadesSelecionadasEMontadasOuPrimeiraPessoa()) {
-      auto* e = BuscaEntidade(id);
-      if (e == nullptr) {
-        continue;
-      }
-      Posicao pos;
-      pos.set_x(e->X());
-      pos.set_y(e->Y());
-      pos.set_z(e->Z());
-      auto n = ntf::NovaNotificacao(ntf::TN_MOVER_ENTIDADE);
-      n->mutable_entidade()->set_id(id);
-      n->mutable_entidade()->mutable_destino()->CopyFrom(pos);
-      central_->AdicionaNotificacaoRemota(n.release());
-    }
+    ids = IdsEntidadesSelecionadasEMontadasOuPrimeiraPessoa();
   } else if (estado_ == ETAB_ENTS_TRANSLACAO_ROTACAO || estado_ == ETAB_ESCALANDO_ROTACIONANDO_ENTIDADE_PINCA) {
     for (const auto& id_proto : translacoes_rotacoes_escalas_antes_) {
-      auto* e = BuscaEntidade(id_proto.first);
-      if (e == nullptr) {
-        continue;
-      }
-      // Atualiza clientes quando delta passar de algum valor.
-      auto nr = ntf::NovaNotificacao(ntf::TN_ATUALIZAR_PARCIAL_ENTIDADE_NOTIFICANDO_SE_LOCAL);
-      nr->mutable_entidade()->set_id(e->Id());
-      nr->mutable_entidade()->set_rotacao_z_graus(e->RotacaoZGraus());
-      *nr->mutable_entidade()->mutable_escala() = e->Proto().escala();
-      *nr->mutable_entidade()->mutable_pos() = e->Pos();
-      central_->AdicionaNotificacaoRemota(nr.release());
+      ids.push_back(id_proto.first);
+    }
+    com_rotacao_escala = true;
+  } else {
+    return;
+  }
+  std::vector<MovimentoQuantizado> movimentos;
+  for (unsigned int id : ids) {
+    auto* e = BuscaEntidade(id);
+    if (e == nullptr) {
+      continue;
+    }
+    Posicao pos;
+    pos.set_x(e->X());
+    pos.set_y(e->Y());
+    pos.set_z(e->Z());
+    auto movimento = QuantizaMovimento(id, pos, e->RotacaoZGraus(), e->Proto().escala());
+    auto it = movimentos_replicados_.find(id);
+    if (it != movimentos_replicados_.end() && it->second == movimento) {
+      continue;
+    }
+    movimentos_replicados_[id] = movimento;
+    movimentos.push_back(movimento);
+  }
+  if (movimentos.empty()) {
+    return;
+  }
+  auto n = ntf::NovaNotificacao(ntf::TN_MOVER_ENTIDADES_COMPACTO);
+  CompactaMovimentos(movimentos, com_rotacao_escala, n->mutable_movimentos_entidades());
+  central_->AdicionaNotificacaoRemota(n.release());
+}
+
+void Tabuleiro::AplicaMovimentosCompactados(const MovimentosEntidadesProto& proto) {
+  for (const auto& movimento : DescompactaMovimentos(proto)) {
+    auto* e = BuscaEntidade(movimento.id);
+    if (e == nullptr) {
+      continue;
     }
+    e->Destino(PosicaoMovimento(movimento));
+    if (proto.com_rotacao_escala()) {
+      EntidadeProto parcial;
+      parcial.set_rotacao_z_graus(RotacaoZGrausMovimento(movimento));
+      *parcial.mutable_escala() = EscalaMovimento(movimento);
+      e->AtualizaParcial(parcial);
+    }
+  }
+}
+
+void Tabuleiro::AplicaDeltaRodada(const DeltaRodadaProto& proto) {
+  PERFIL_ZONA("Tabuleiro::AplicaDeltaRodada");
+  for (const auto& delta : DescompactaDeltaRodada(proto)) {
+    auto* e = BuscaEntidade(delta.id);
+    if (e == nullptr) {
+      continue;
+    }
+    e->AplicaDeltaRodada(delta, proto.reiniciar_ataque());
   }
 }
 
@@ -3274,9 +3395,10 @@ void Tabuleiro::AtualizaPorTemporizacao() {
   glFinish();
 #endif
   // quanto passou desde a ultima atualizacao. Usa o tempo entre cenas pois este timer eh do da atualizacao.
-  auto passou_ms = timer_entre_atualizacoes_.elapsed().wall / DIV_NANO_PARA_MS;
+  auto passou_ms = passo_fixo_ms_ > 0 ? passo_fixo_ms_ : timer_entre_atualizacoes_.elapsed().wall / DIV_NANO_PARA_MS;
   timer_entre_atualizacoes_.start();
   timer_uma_atualizacao_.start();
+  PERFIL_ZONA("Tabuleiro::AtualizaPorTemporizacao");
   if (regerar_vbos_entidades_) {
     parametros_desenho_.set_regera_vbo(true);
   }
@@ -3292,26 +3414,33 @@ void Tabuleiro::AtualizaPorTemporizacao() {
   }
   // Em algumas situacoes, nao se deve atualizar o olho. Por exemplo, quando se esta pressionando entidades para mover,
   // ao move-la, o olho ira se atualizar e o ponto de destino mudara, assim como as matrizes.
+  olho_pos_anterior_ = olho_.pos();
+  olho_alvo_anterior_ = olho_.alvo();
+  olho_anterior_valido_ = true;
   if (estado_ != ETAB_ENTS_PRESSIONADAS && estado_ != ETAB_DESLIZANDO) {
     AtualizaOlho(passou_ms, false  /*forcar*/);
   }
   AtualizaAcoes(passou_ms);
+  if (!EmModoMestre()) {
+    InformaInteresseSeMudou();
+  }
 
 #if DEBUG
   glFinish();
 #endif
   timer_uma_atualizacao_.stop();
   EnfileiraTempo(timer_uma_atualizacao_, &tempos_uma_atualizacao_);
-  if (ciclos_para_atualizar_ == 0) {
-    if (ModoClique() == MODO_TERRENO) {
-      RefrescaTerrenoParaClientes();
-      ciclos_para_atualizar_ = opcoes_.fps();
-    } else {
-      RefrescaMovimentosParciais();
-      ciclos_para_atualizar_ = opcoes_.fps() / 3;
+  if (ms_para_atualizar_ >= 0) {
+    ms_para_atualizar_ -= static_cast<int>(passou_ms);
+    if (ms_para_atualizar_ <= 0) {
+      if (ModoClique() == MODO_TERRENO) {
+        RefrescaTerrenoParaClientes();
+        ms_para_atualizar_ = kIntervaloTerrenoParaClientesMs;
+      } else {
+        RefrescaMovimentosParciais();
+        ms_para_atualizar_ = kIntervaloMovimentosParciaisMs;
+      }
     }
-  } else if (ciclos_para_atualizar_ > 0) {
-    --ciclos_para_atualizar_;
   }
   if (temporizador_detalhamento_ms_ > 0) {
     temporizador_detalhamento_ms_ -= passou_ms;
@@ -3321,6 +3450,13 @@ void Tabuleiro::AtualizaPorTemporizacao() {
   } else if (!info_geral_.empty()) {
     info_geral_.clear();
   }
+  if (opcoes_.intervalo_salvamento_automatico_s() > 0 && EmModoMestre()) {
+    temporizador_salvamento_automatico_ms_ -= passou_ms;
+    if (temporizador_salvamento_automatico_ms_ <= 0) {
+      SalvaAutomaticamente();
+      temporizador_salvamento_automatico_ms_ = opcoes_.intervalo_salvamento_automatico_s() * 1000;
+    }
+  }
 #if USAR_WATCHDOG
   if (EmModoMestre()) {
     watchdog_.Refresca();
@@ -3339,7 +3475,7 @@ void Tabuleiro::TrataAtualizarIniciativaNotificando(const ntf::Notificacao& noti
   DeserializaIniciativas(notificacao.tabuleiro());
   // Repassa aos outros.
   if (notificacao.local()) {
-    central_->AdicionaNotificacaoRemota(new ntf::Notificacao(notificacao));
+    central_->AdicionaNotificacaoRemota(ntf::CopiaNotificacao(notificacao, central_->ArenaCiclo()));
   }
   SelecionaEntidadeIniciativa();
 }
@@ -3395,11 +3531,13 @@ void ZeraControlesEntidadeNotificando(const Entidade& entidade, ntf::Notificacao
 }
 
 void Tabuleiro::ProximaIniciativaModoMestre() {
-  auto grupo = NovoGrupoNotificacoes();
+  // Os grupos so vivem ate serem tratados e copiados para a lista de eventos.
+  ntf::ArenaAcao arena(central_);
+  auto grupo = NovoGrupoNotificacoes(arena.arena());
   auto* n = NovaNotificacaoFilha(ntf::TN_ATUALIZAR_LISTA_INICIATIVA, grupo.get());
   SerializaIniciativas(n->mutable_tabuleiro_antes());
   SerializaIniciativas(n->mutable_tabuleiro());
-  auto grupo_desfazer = NovoGrupoNotificacoes();
+  auto grupo_desfazer = NovoGrupoNotificacoes(arena.arena());
   // Faz agora pra ficar na ordem certa.
   auto* n_desfazer = grupo_desfazer->add_notificacao();
 
@@ -3534,6 +3672,7 @@ void Tabuleiro::TrataRedimensionaJanela(int largura, int altura) {
 }
 
 void Tabuleiro::IniciaGL(bool reinicio  /*bom pra debug de leak*/) {
+  if (sem_grafico_) return;
 #if !USAR_OPENGL_ES
 #ifdef GL_PROGRAM_POINT_SIZE
   gl::Habilita(GL_PROGRAM_POINT_SIZE);  // deixa o shader decidir tamanho do ponto.
@@ -3564,6 +3703,7 @@ void Tabuleiro::IniciaGL(bool reinicio  /*bom pra debug de leak*/) {
   }
 
   Entidade::IniciaGl(central_);
+  Acao::IniciaGl();
   regerar_vbos_entidades_ = true;
   RequerAtualizacaoLuzesPontuais();
 
@@ -3836,6 +3976,7 @@ void Tabuleiro::DesenhaClima() {
 }
 
 void Tabuleiro::DesenhaCena(bool debug) {
+  PERFIL_ZONA("Tabuleiro::DesenhaCena");
   //if (glGetError() == GL_NO_ERROR) LOG(ERROR) << "ok!";
   V_ERRO("ha algum erro no opengl, investigue");
 
@@ -4174,6 +4315,7 @@ void Tabuleiro::DesenhaCena(bool debug) {
     glFinish();
 #endif
     timer_uma_renderizacao_controle_virtual_.start();
+    PERFIL_ZONA("Tabuleiro::DesenhaControleVirtual");
     DesenhaControleVirtual();
 #if DEBUG
     glFinish();
@@ -4305,152 +4447,206 @@ void Tabuleiro::GeraVboCaixaCeu() {
 }
 
 void Tabuleiro::RegeraVboTabuleiro() {
+  PERFIL_ZONA("Tabuleiro::RegeraVboTabuleiro");
+  cache_alturas_.Invalida();
+  if (sem_grafico_) return;
   V_ERRO("RegeraVboTabuleiro inicio");
-  std::vector<float> coordenadas_tabuleiro;
-  std::vector<float> coordenadas_textura;
-  std::vector<float> coordenadas_normais;
-  std::vector<unsigned short> indices_tabuleiro;
+  // Todo VBO deve ser desgravado para o caso de recuperacao de contexto.
+  pedacos_terreno_.clear();
+  pontos_terreno_gravados_.clear();
+  num_pedacos_terreno_x_ = 0;
+  id_cenario_pedacos_terreno_ = proto_corrente_->id_cenario();
+  tam_x_pedacos_terreno_ = TamanhoX();
+  tam_y_pedacos_terreno_ = TamanhoY();
   if (!proto_corrente_->ponto_terreno().empty() &&
       proto_corrente_->ponto_terreno_size() != (TamanhoX() + 1) * (TamanhoY() + 1)) {
     LOG(ERROR) << "Tamanho de terreno invalido: corrente " << proto_corrente_->ponto_terreno_size()
                << ", rhs: " << ((TamanhoX() + 1) * (TamanhoY() + 1));
     return;
   }
+  if (TamanhoX() <= 0 || TamanhoY() <= 0) {
+    return;
+  }
   VLOG(2) << "Regerando vbo tabuleiro, pontos: " << proto_corrente_->ponto_terreno_size();
-  Terreno terreno(TamanhoX(), TamanhoY(),
-                  Wrapper<RepeatedField<double>>(proto_corrente_->ponto_terreno()));
-  terreno.Preenche(&indices_tabuleiro,
-                   &coordenadas_tabuleiro,
-                   &coordenadas_normais,
-                   &coordenadas_textura);
+  pontos_terreno_gravados_.assign(proto_corrente_->ponto_terreno().begin(), proto_corrente_->ponto_terreno().end());
+  num_pedacos_terreno_x_ = (TamanhoX() + TAMANHO_PEDACO_TERRENO - 1) / TAMANHO_PEDACO_TERRENO;
+  const int num_pedacos_y = (TamanhoY() + TAMANHO_PEDACO_TERRENO - 1) / TAMANHO_PEDACO_TERRENO;
+  pedacos_terreno_.resize(num_pedacos_terreno_x_ * num_pedacos_y);
+  for (int py = 0; py < num_pedacos_y; ++py) {
+    for (int px = 0; px < num_pedacos_terreno_x_; ++px) {
+      const int indice = py * num_pedacos_terreno_x_ + px;
+      auto& pedaco = pedacos_terreno_[indice];
+      pedaco.x_inicial = px * TAMANHO_PEDACO_TERRENO;
+      pedaco.y_inicial = py * TAMANHO_PEDACO_TERRENO;
+      pedaco.x_final = std::min(pedaco.x_inicial + TAMANHO_PEDACO_TERRENO, TamanhoX());
+      pedaco.y_final = std::min(pedaco.y_inicial + TAMANHO_PEDACO_TERRENO, TamanhoY());
+      RegeraVboPedacoTerreno(indice);
+    }
+  }
+  V_ERRO("RegeraVboTabuleiro fim");
+}
+
+void Tabuleiro::RegeraVboTerrenoAlterado() {
+  PERFIL_ZONA("Tabuleiro::RegeraVboTerrenoAlterado");
+  cache_alturas_.Invalida();
+  if (sem_grafico_) return;
+  const auto& pontos = proto_corrente_->ponto_terreno();
+  if (pedacos_terreno_.empty() ||
+      id_cenario_pedacos_terreno_ != proto_corrente_->id_cenario() ||
+      tam_x_pedacos_terreno_ != TamanhoX() || tam_y_pedacos_terreno_ != TamanhoY() ||
+      pontos_terreno_gravados_.size() != static_cast<size_t>(pontos.size())) {
+    RegeraVboTabuleiro();
+    return;
+  }
+  const int num_x = TamanhoX() + 1;
+  const int num_pedacos_y = static_cast<int>(pedacos_terreno_.size()) / num_pedacos_terreno_x_;
+  std::vector<bool> alterados(pedacos_terreno_.size(), false);
+  for (int indice = 0; indice < pontos.size(); ++indice) {
+    if (pontos.Get(indice) == pontos_terreno_gravados_[indice]) continue;
+    pontos_terreno_gravados_[indice] = pontos.Get(indice);
+    // A altura do ponto muda as normais dos vizinhos. O ponto v pertence aos pedacos (v - 1) / T e v / T,
+    // ja que pedacos adjacentes compartilham a borda.
+    const int x = indice % num_x;
+    const int y = indice / num_x;
+    const int px_inicial = std::max(x - 2, 0) / TAMANHO_PEDACO_TERRENO;
+    const int px_final = std::min((x + 1) / TAMANHO_PEDACO_TERRENO, num_pedacos_terreno_x_ - 1);
+    const int py_inicial = std::max(y - 2, 0) / TAMANHO_PEDACO_TERRENO;
+    const int py_final = std::min((y + 1) / TAMANHO_PEDACO_TERRENO, num_pedacos_y - 1);
+    for (int py = py_inicial; py <= py_final; ++py) {
+      for (int px = px_inicial; px <= px_final; ++px) {
+        alterados[py * num_pedacos_terreno_x_ + px] = true;
+      }
+    }
+  }
+  for (unsigned int i = 0; i < alterados.size(); ++i) {
+    if (alterados[i]) {
+      RegeraVboPedacoTerreno(i);
+    }
+  }
+}
+
+void Tabuleiro::RegeraVboPedacoTerreno(int indice_pedaco) {
+  V_ERRO("RegeraVboPedacoTerreno inicio");
+  auto& pedaco = pedacos_terreno_[indice_pedaco];
+  const float deslocamento_x = -TamanhoX() * TAMANHO_LADO_QUADRADO_2;
+  const float deslocamento_y = -TamanhoY() * TAMANHO_LADO_QUADRADO_2;
   {
+    std::vector<float> coordenadas_tabuleiro;
+    std::vector<float> coordenadas_textura;
+    std::vector<float> coordenadas_normais;
+    std::vector<unsigned short> indices_tabuleiro;
+    Terreno::PreenchePedaco(
+        TamanhoX(), TamanhoY(), pontos_terreno_gravados_.empty() ? nullptr : pontos_terreno_gravados_.data(),
+        pedaco.x_inicial, pedaco.y_inicial, pedaco.x_final, pedaco.y_final,
+        &indices_tabuleiro, &coordenadas_tabuleiro, &coordenadas_normais, &coordenadas_textura);
+    pedaco.z_min = pedaco.z_max = coordenadas_tabuleiro[2];
+    for (unsigned int i = 2; i < coordenadas_tabuleiro.size(); i += 3) {
+      pedaco.z_min = std::min(pedaco.z_min, coordenadas_tabuleiro[i]);
+      pedaco.z_max = std::max(pedaco.z_max, coordenadas_tabuleiro[i]);
+    }
     gl::VbosNaoGravados tabuleiro_nao_gravado;
     gl::VboNaoGravado tabuleiro_parcial;
     tabuleiro_parcial.AtribuiIndices(&indices_tabuleiro);
     tabuleiro_parcial.AtribuiCoordenadas(3, &coordenadas_tabuleiro);
     tabuleiro_parcial.AtribuiTexturas(&coordenadas_textura);
     tabuleiro_parcial.AtribuiNormais(&coordenadas_normais);
-    tabuleiro_parcial.Translada(
-        -TamanhoX() * TAMANHO_LADO_QUADRADO_2, -TamanhoY() * TAMANHO_LADO_QUADRADO_2, 0);
+    tabuleiro_parcial.Translada(deslocamento_x, deslocamento_y, 0);
     tabuleiro_nao_gravado.Concatena(tabuleiro_parcial);
     tabuleiro_nao_gravado.AtribuiMatrizModelagem(Matrix4());
 
-    V_ERRO("RegeraVboTabuleiro antes gravar");
-    // Todo VBO deve ser desgravado para o caso de recuperacao de contexto.
-    vbos_tabuleiro_.Nomeia("terreno");
-    vbos_tabuleiro_.Desgrava();
-    vbos_tabuleiro_.Grava(tabuleiro_nao_gravado);
+    V_ERRO("RegeraVboPedacoTerreno antes gravar");
+    pedaco.vbos_terreno.Nomeia(absl::StrFormat("terreno %d", indice_pedaco));
+    pedaco.vbos_terreno.Desgrava();
+    pedaco.vbos_terreno.Grava(tabuleiro_nao_gravado);
   }
-  V_ERRO("RegeraVboTabuleiro depois gravar");
+  V_ERRO("RegeraVboPedacoTerreno depois gravar");
 
-  // Regera a grade.
+  // Regera a grade do pedaco. As linhas finais leste e norte ficam com os ultimos pedacos.
   std::vector<float> coordenadas_grade;
   std::vector<unsigned short> indices_grade;
   int indice = 0;
-  float deslocamento_x = -TamanhoX() * TAMANHO_LADO_QUADRADO_2;
-  float deslocamento_y = -TamanhoY() * TAMANHO_LADO_QUADRADO_2;
-  gl::VbosNaoGravados grade_nao_gravada;
   const float expessura_linha = proto_corrente_->has_expessura_grade_m() ? proto_corrente_->expessura_grade_m() : opcoes_.expessura_grade_m();
   const float expessura_linha_2 = expessura_linha / 2.0f;
+  auto adiciona_quadrilatero = [&coordenadas_grade, &indices_grade, &indice] (
+      float x_inicial, float y_inicial, float z_inicial, float x_final, float y_final, float z_final, bool vertical) {
+    coordenadas_grade.push_back(x_inicial);
+    coordenadas_grade.push_back(y_inicial);
+    coordenadas_grade.push_back(z_inicial);
+    coordenadas_grade.push_back(x_final);
+    coordenadas_grade.push_back(y_inicial);
+    coordenadas_grade.push_back(vertical ? z_inicial : z_final);
+    coordenadas_grade.push_back(x_final);
+    coordenadas_grade.push_back(y_final);
+    coordenadas_grade.push_back(z_final);
+    coordenadas_grade.push_back(x_inicial);
+    coordenadas_grade.push_back(y_final);
+    coordenadas_grade.push_back(vertical ? z_final : z_inicial);
+    indices_grade.push_back(indice);
+    indices_grade.push_back(indice + 1);
+    indices_grade.push_back(indice + 2);
+    indices_grade.push_back(indice);
+    indices_grade.push_back(indice + 2);
+    indices_grade.push_back(indice + 3);
+    indice += 4;
+  };
   // Linhas verticais (S-N).
-  {
-    int flush_count = 0;
-    gl::VboNaoGravado grade_vertical;
-    for (int xcorrente = 0; xcorrente <= TamanhoX(); ++xcorrente) {
-      float x_inicial = (xcorrente * TAMANHO_LADO_QUADRADO) - expessura_linha_2 + deslocamento_x;
-      float x_final = x_inicial + expessura_linha;
-      for (int ycorrente = 0; ycorrente < TamanhoY(); ++ycorrente) {
-        float y_inicial = ycorrente * TAMANHO_LADO_QUADRADO + deslocamento_y;
-        float y_final = y_inicial + TAMANHO_LADO_QUADRADO;
-        coordenadas_grade.push_back(x_inicial);
-        coordenadas_grade.push_back(y_inicial);
-        coordenadas_grade.push_back(AlturaPonto(xcorrente, ycorrente));
-        coordenadas_grade.push_back(x_final);
-        coordenadas_grade.push_back(y_inicial);
-        coordenadas_grade.push_back(AlturaPonto(xcorrente, ycorrente));
-        coordenadas_grade.push_back(x_final);
-        coordenadas_grade.push_back(y_final);
-        coordenadas_grade.push_back(AlturaPonto(xcorrente, ycorrente + 1));
-        coordenadas_grade.push_back(x_inicial);
-        coordenadas_grade.push_back(y_final);
-        coordenadas_grade.push_back(AlturaPonto(xcorrente, ycorrente + 1));
-        indices_grade.push_back(indice);
-        indices_grade.push_back(indice + 1);
-        indices_grade.push_back(indice + 2);
-        indices_grade.push_back(indice);
-        indices_grade.push_back(indice + 2);
-        indices_grade.push_back(indice + 3);
-        if (++flush_count >= 100) {
-          grade_vertical.AtribuiIndices(&indices_grade);
-          grade_vertical.AtribuiCoordenadas(3, &coordenadas_grade);
-          grade_nao_gravada.Concatena(&grade_vertical);
-          coordenadas_grade.clear();
-          indices_grade.clear();
-          indice = 0;
-          flush_count = 0; 
-        } else {
-          indice += 4;
-        }
-      }
-    }
-    grade_vertical.AtribuiIndices(&indices_grade);
-    grade_vertical.AtribuiCoordenadas(3, &coordenadas_grade);
-    grade_nao_gravada.Concatena(&grade_vertical);
-    coordenadas_grade.clear();
-    indices_grade.clear();
-  }
-  indice = 0;
-  {
-    int flush_count = 0;
-    gl::VboNaoGravado grade_horizontal;
-    for (int ycorrente = 0; ycorrente <= TamanhoY(); ++ycorrente) {
-      float y_inicial = (ycorrente * TAMANHO_LADO_QUADRADO) - expessura_linha_2 + deslocamento_y;
-      float y_final = y_inicial + expessura_linha;
-      for (int xcorrente = 0; xcorrente < TamanhoX(); ++xcorrente) {
-        float x_inicial = xcorrente * TAMANHO_LADO_QUADRADO + deslocamento_x;
-        float x_final = x_inicial + TAMANHO_LADO_QUADRADO;
-        coordenadas_grade.push_back(x_inicial);
-        coordenadas_grade.push_back(y_inicial);
-        coordenadas_grade.push_back(AlturaPonto(xcorrente, ycorrente));
-        coordenadas_grade.push_back(x_final);
-        coordenadas_grade.push_back(y_inicial);
-        coordenadas_grade.push_back(AlturaPonto(xcorrente + 1, ycorrente));
-        coordenadas_grade.push_back(x_final);
-        coordenadas_grade.push_back(y_final);
-        coordenadas_grade.push_back(AlturaPonto(xcorrente + 1, ycorrente));
-        coordenadas_grade.push_back(x_inicial);
-        coordenadas_grade.push_back(y_final);
-        coordenadas_grade.push_back(AlturaPonto(xcorrente , ycorrente));
-        indices_grade.push_back(indice);
-        indices_grade.push_back(indice + 1);
-        indices_grade.push_back(indice + 2);
-        indices_grade.push_back(indice);
-        indices_grade.push_back(indice + 2);
-        indices_grade.push_back(indice + 3);
-        if (++flush_count >= 100) {
-          indice = 0;
-          grade_horizontal.AtribuiIndices(&indices_grade);
-          grade_horizontal.AtribuiCoordenadas(3, &coordenadas_grade);
-          grade_nao_gravada.Concatena(&grade_horizontal);
-          coordenadas_grade.clear();
-          indices_grade.clear();
-          flush_count = 0;
-        } else {
-          indice += 4;
-        }
-      }
+  const int x_ultima_linha = pedaco.x_final == TamanhoX() ? pedaco.x_final : pedaco.x_final - 1;
+  for (int xcorrente = pedaco.x_inicial; xcorrente <= x_ultima_linha; ++xcorrente) {
+    float x_inicial = (xcorrente * TAMANHO_LADO_QUADRADO) - expessura_linha_2 + deslocamento_x;
+    float x_final = x_inicial + expessura_linha;
+    for (int ycorrente = pedaco.y_inicial; ycorrente < pedaco.y_final; ++ycorrente) {
+      float y_inicial = ycorrente * TAMANHO_LADO_QUADRADO + deslocamento_y;
+      float y_final = y_inicial + TAMANHO_LADO_QUADRADO;
+      adiciona_quadrilatero(x_inicial, y_inicial, AlturaPonto(xcorrente, ycorrente),
+                            x_final, y_final, AlturaPonto(xcorrente, ycorrente + 1), /*vertical=*/true);
+    }
+  }
+  // Linhas horizontais (W-E).
+  const int y_ultima_linha = pedaco.y_final == TamanhoY() ? pedaco.y_final : pedaco.y_final - 1;
+  for (int ycorrente = pedaco.y_inicial; ycorrente <= y_ultima_linha; ++ycorrente) {
+    float y_inicial = (ycorrente * TAMANHO_LADO_QUADRADO) - expessura_linha_2 + deslocamento_y;
+    float y_final = y_inicial + expessura_linha;
+    for (int xcorrente = pedaco.x_inicial; xcorrente < pedaco.x_final; ++xcorrente) {
+      float x_inicial = xcorrente * TAMANHO_LADO_QUADRADO + deslocamento_x;
+      float x_final = x_inicial + TAMANHO_LADO_QUADRADO;
+      adiciona_quadrilatero(x_inicial, y_inicial, AlturaPonto(xcorrente, ycorrente),
+                            x_final, y_final, AlturaPonto(xcorrente + 1, ycorrente), /*vertical=*/false);
+    }
+  }
+  gl::VboNaoGravado grade;
+  grade.AtribuiIndices(&indices_grade);
+  grade.AtribuiCoordenadas(3, &coordenadas_grade);
+  gl::VbosNaoGravados grade_nao_gravada;
+  grade_nao_gravada.Concatena(&grade);
+  grade_nao_gravada.AtribuiMatrizModelagem(Matrix4());
+  pedaco.vbos_grade.Desgrava();
+  pedaco.vbos_grade.Grava(grade_nao_gravada);
+  pedaco.vbos_grade.Nomeia(absl::StrFormat("grade tabuleiro %d", indice_pedaco));
+  V_ERRO("RegeraVboPedacoTerreno fim");
+}
+
+void Tabuleiro::DesenhaPedacosTerreno(bool grade) const {
+  // Testa cada pedaco contra o tronco de visao corrente, que pode ser da camera, da luz ou do picking.
+  const TroncoVisao tronco = ExtraiTroncoVisao(
+      gl::LeMatriz(gl::MATRIZ_PROJECAO) * gl::LeMatriz(gl::MATRIZ_CAMERA) * gl::LeMatriz(gl::MATRIZ_MODELAGEM));
+  const float deslocamento_x = -TamanhoX() * TAMANHO_LADO_QUADRADO_2;
+  const float deslocamento_y = -TamanhoY() * TAMANHO_LADO_QUADRADO_2;
+  // Margem para a expessura das linhas da grade.
+  const float margem = TAMANHO_LADO_QUADRADO_10;
+  for (const auto& pedaco : pedacos_terreno_) {
+    Vector3 min(pedaco.x_inicial * TAMANHO_LADO_QUADRADO + deslocamento_x - margem,
+                pedaco.y_inicial * TAMANHO_LADO_QUADRADO + deslocamento_y - margem,
+                pedaco.z_min);
+    Vector3 max(pedaco.x_final * TAMANHO_LADO_QUADRADO + deslocamento_x + margem,
+                pedaco.y_final * TAMANHO_LADO_QUADRADO + deslocamento_y + margem,
+                pedaco.z_max);
+    if (CaixaForaTroncoVisao(tronco, min, max)) continue;
+    if (grade) {
+      pedaco.vbos_grade.Desenha();
+    } else {
+      pedaco.vbos_terreno.Desenha();
     }
-    grade_horizontal.AtribuiIndices(&indices_grade);
-    grade_horizontal.AtribuiCoordenadas(3, &coordenadas_grade);
-    grade_nao_gravada.Concatena(&grade_horizontal);
-    coordenadas_grade.clear();
-    indices_grade.clear();
   }
-  grade_nao_gravada.AtribuiMatrizModelagem(Matrix4());
-  vbos_grade_.Desgrava();
-  vbos_grade_.Grava(grade_nao_gravada);
-  vbos_grade_.Nomeia("grade tabuleiro");
-  V_ERRO("RegeraVboTabuleiro fim");
 }
 
 void Tabuleiro::GeraFramebufferColisao(int tamanho, DadosFramebuffer* dfb) {
@@ -4642,6 +4838,7 @@ void Tabuleiro::GeraFramebufferPrincipal(int tamanho, DadosFramebuffer* dfb) {
 }
 
 void Tabuleiro::GeraFramebuffer(bool reinicia) {
+  if (sem_grafico_) return;
   GeraFramebufferColisao(TAM_BUFFER_COLISAO, &dfb_colisao_);
   if (opcoes_.mapeamento_sombras()) {
     // Por nao ser cubica, pode ter o dobro do tamanho.
@@ -4782,7 +4979,7 @@ void Tabuleiro::GeraMontanhaNotificando(float suavizacao) {
       }
     }
   }
-  RegeraVboTabuleiro();
+  RegeraVboTerrenoAlterado();
   RefrescaTerrenoParaClientes();
   {
     auto* cenario_depois = n_desfazer.mutable_tabuleiro();
@@ -4809,7 +5006,7 @@ void Tabuleiro::GeraTerrenoAleatorioNotificando() {
   }
   proto_corrente_->mutable_ponto_terreno()->Resize((TamanhoX() + 1) * (TamanhoY() + 1), 0);
   std::copy(pontos.begin(), pontos.end(), proto_corrente_->mutable_ponto_terreno()->begin());
-  RegeraVboTabuleiro();
+  RegeraVboTerrenoAlterado();
   RefrescaTerrenoParaClientes();
   ntf::Notificacao n_desfazer;
   n_desfazer.set_tipo(ntf::TN_ATUALIZAR_RELEVO_TABULEIRO);
@@ -4859,7 +5056,7 @@ void Tabuleiro::TrataDeltaTerreno(float delta) {
   AtualizaAlturaQuadrado(
       [delta] (const RepeatedField<double>& pontos, int indice) { return pontos.Get(indice) + delta; },
       quad_x, quad_y, TamanhoX(), proto_corrente_->mutable_ponto_terreno());
-  RegeraVboTabuleiro();
+  RegeraVboTerrenoAlterado();
   RefrescaTerrenoParaClientes();
   {
     auto* cenario_depois = n_desfazer.mutable_tabuleiro();
@@ -4897,7 +5094,7 @@ void Tabuleiro::TrataNivelamentoTerreno(int x, int y) {
   AtualizaAlturaQuadrado(
       [pz3d] (const RepeatedField<double>&, int) { return pz3d; },
       quad_x, quad_y, TamanhoX(), proto_corrente_->mutable_ponto_terreno());
-  RegeraVboTabuleiro();
+  RegeraVboTerrenoAlterado();
 }
 
 void Tabuleiro::DesenhaTabuleiro() {
@@ -4966,7 +5163,7 @@ void Tabuleiro::DesenhaTabuleiro() {
       }
       gl::AtualizaMatrizes();
     }
-    vbos_tabuleiro_.Desenha();
+    DesenhaPedacosTerreno(/*grade=*/false);
     gl::ParametroTextura(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     gl::ParametroTextura(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     {
@@ -5166,11 +5363,47 @@ void Tabuleiro::OrdenaEntidades(const ParametrosDesenho& pd) {
     }
   }
   std::sort(entidades_ordenadas_.begin(), entidades_ordenadas_.end(), funcao);
+  esferas_ordenadas_.clear();
+  for (const auto* entidade : entidades_ordenadas_) {
+    esferas_ordenadas_.push_back(entidade->EsferaDesenho());
+  }
 }
 
-void Tabuleiro::DesenhaEntidadesBase(const std::function<void (Entidade*, ParametrosDesenho*)>& f) {
+void Tabuleiro::FiltraEntidadesVisiveis() {
+  PERFIL_ZONA("Tabuleiro::FiltraEntidadesVisiveis");
+  if (!descarte_tronco_visao_) {
+    indices_visiveis_.resize(entidades_ordenadas_.size());
+    std::iota(indices_visiveis_.begin(), indices_visiveis_.end(), 0);
+    return;
+  }
+  const TroncoVisao tronco = ExtraiTroncoVisao(
+      gl::LeMatriz(gl::MATRIZ_PROJECAO) * gl::LeMatriz(gl::MATRIZ_CAMERA) * gl::LeMatriz(gl::MATRIZ_MODELAGEM));
+  Vector3 referencia;
+  float distancia_maxima = 0.0f;
+  if (parametros_desenho_.has_desenha_mapa_luzes()) {
+    // O que esta alem do alcance da luz nao faz sombra em nada que ela ilumine.
+    const auto* entidade_luz = BuscaEntidade(parametros_desenho_.entidade_referencia_luz());
+    for (const auto& luz : luzes_pontuais_) {
+      if (entidade_luz == nullptr || luz.id != entidade_luz->Id()) continue;
+      referencia = PosParaVector3(luz.pos);
+      distancia_maxima = entidade_luz->AlcanceLuzMetros();
+      break;
+    }
+  }
+  FiltraEsferasVisiveis(tronco, esferas_ordenadas_, referencia, distancia_maxima, &indices_visiveis_);
+}
+
+void Tabuleiro::DesenhaEntidadesBase(const std::function<void (Entidade*, ParametrosDesenho*)>& f, bool usar_lotes) {
+  PERFIL_ZONA("Tabuleiro::DesenhaEntidadesBase");
+  // Picking precisa de uma chamada por entidade, com seu nome.
+  usar_lotes = usar_lotes && desenho_instanciado_ && !parametros_desenho_.has_picking_x();
+  if (usar_lotes) {
+    lotes_instancias_.Inicia();
+  }
+  FiltraEntidadesVisiveis();
   //LOG(INFO) << "LOOP";
-  for (auto* entidade : entidades_ordenadas_) {
+  for (int indice : indices_visiveis_) {
+    auto* entidade = entidades_ordenadas_[indice];
     //LOG(INFO) << "entidade: " << RotuloEntidade(entidade);
     if (entidade == nullptr) {
       LOG(ERROR) << "Entidade nao existe.";
@@ -5212,7 +5445,14 @@ void Tabuleiro::DesenhaEntidadesBase(const std::function<void (Entidade*, Parame
           parametros_desenho_.has_desenha_mapa_luzes()) &&
         (VisaoMestre() || entidade->SelecionavelParaJogador()));
     //LOG(INFO) << "Desenhando: " << entidade->Id();
-    f(entidade, &parametros_desenho_);
+    if (usar_lotes) {
+      entidade->DesenhaComLotes(&parametros_desenho_, &lotes_instancias_);
+    } else {
+      f(entidade, &parametros_desenho_);
+    }
+  }
+  if (usar_lotes) {
+    lotes_instancias_.Desenha();
   }
   parametros_desenho_.set_entidade_selecionada(false);
   parametros_desenho_.set_desenha_barra_vida(false);
@@ -5250,22 +5490,38 @@ void Tabuleiro::DesenhaAuras() {
 }
 
 void Tabuleiro::DesenhaAcoes() {
-  for (auto& a : acoes_) {
-    VLOG(4) << "Desenhando acao:" << a->Proto().ShortDebugString();
-    if (a->IdCenario() != IdCenario()) {
-      continue;
-    }
-    a->Desenha(&parametros_desenho_);
-  }
+  DesenhaAcoesBase(/*translucidas=*/false);
 }
 
 void Tabuleiro::DesenhaAcoesTranslucidas() {
+  DesenhaAcoesBase(/*translucidas=*/true);
+}
+
+void Tabuleiro::DesenhaAcoesBase(bool translucidas) {
+  PERFIL_ZONA("Tabuleiro::DesenhaAcoesBase");
+  // As acoes desenhadas apenas pela geometria vao para os lotes, agrupadas por geometria, textura e estado. As demais
+  // (texto, raios, sinalizacoes...) sao desenhadas uma a uma.
+  const bool usar_lotes = desenho_instanciado_ && !parametros_desenho_.has_picking_x();
+  LotesAcoes* lotes = translucidas ? &lotes_acoes_translucidas_ : &lotes_acoes_;
+  if (usar_lotes) {
+    lotes->Inicia();
+  }
   for (auto& a : acoes_) {
     VLOG(4) << "Desenhando acao:" << a->Proto().ShortDebugString();
     if (a->IdCenario() != IdCenario()) {
       continue;
     }
-    a->DesenhaTranslucido(&parametros_desenho_);
+    if (usar_lotes && a->AdicionaAoLote(&parametros_desenho_, translucidas, lotes)) {
+      continue;
+    }
+    if (translucidas) {
+      a->DesenhaTranslucido(&parametros_desenho_);
+    } else {
+      a->Desenha(&parametros_desenho_);
+    }
+  }
+  if (usar_lotes) {
+    lotes->Desenha();
   }
 }
 
@@ -5534,6 +5790,7 @@ void Tabuleiro::AtualizaRaioOlho(float raio) {
 }
 
 void Tabuleiro::AtualizaEntidades(int intervalo_ms) {
+  PERFIL_ZONA("Tabuleiro::AtualizaEntidades");
   boost::timer::cpu_timer timer_todas;
   timer_todas.start();
   std::atomic<int> atualiza_sombras = 0;
@@ -5668,10 +5925,14 @@ void Tabuleiro::AtualizaIniciativas() {
 void Tabuleiro::AtualizaAcoes(int intervalo_ms) {
   // Qualquer acao adicionada aqui ja foi colocada na lista de desfazer durante a criacao.
   ignorar_lista_eventos_ = true;
-  std::vector<std::unique_ptr<Acao>> copia_acoes;
-  copia_acoes.swap(acoes_);
+  // Compactacao estavel no proprio vetor: as acoes que continuam sao movidas para frente, na ordem. As filhas geradas
+  // durante a atualizacao vao para o fim de acoes_ e so sao atualizadas no proximo quadro.
+  const size_t num_acoes = acoes_.size();
+  size_t num_mantidas = 0;
   bool limpar_salvacoes = false;
-  for (auto& acao : copia_acoes) {
+  for (size_t i = 0; i < num_acoes && i < acoes_.size(); ++i) {
+    // Sem referencia ao elemento: GeraAcaoFilha pode realocar acoes_.
+    Acao* acao = acoes_[i].get();
     acao->Atualiza(intervalo_ms, olho_);
     if (acao->EstadoAlvo() == Acao::ALVO_A_SER_ATINGIDO) {
       acao->AlvoProcessado();
@@ -5688,9 +5949,19 @@ void Tabuleiro::AtualizaAcoes(int intervalo_ms) {
     }
     // Apenas acoes nao finalizadas sao mantidas para a proxima iteracao.
     if (!acao->Finalizada()) {
-      acoes_.push_back(std::unique_ptr<Acao>(acao.release()));
+      if (num_mantidas != i) {
+        acoes_[num_mantidas] = std::move(acoes_[i]);
+      }
+      ++num_mantidas;
+    } else {
+      acoes_[i].reset();
     }
   }
+  // Remove os buracos, trazendo as filhas para logo apos as mantidas.
+  const size_t fim_buracos = std::min(num_acoes, acoes_.size());
+  if (num_mantidas < fim_buracos) {
+    acoes_.erase(acoes_.begin() + num_mantidas, acoes_.begin() + fim_buracos);
+  }
   if (limpar_salvacoes) {
     ntf::Notificacao ntf;
     ntf.set_tipo(ntf::TN_LIMPAR_SALVACOES);
@@ -6128,7 +6399,7 @@ void Tabuleiro::DeserializaRelevoCenario(const TabuleiroProto& novo_proto) {
     return;
   }
   *cenario->mutable_ponto_terreno() = novo_proto.ponto_terreno();
-  RegeraVboTabuleiro();
+  RegeraVboTerrenoAlterado();
 }
 
 ntf::Notificacao* Tabuleiro::SerializaTabuleiro(bool salvar_versoes, const std::string& nome) {
@@ -6168,9 +6439,21 @@ ntf::Notificacao* Tabuleiro::SerializaTabuleiro(bool salvar_versoes, const std::
   }
 }
 
+void Tabuleiro::SalvaAutomaticamente() {
+  PERFIL_ZONA("Tabuleiro::SalvaAutomaticamente");
+  // Apenas a copia dos protos acontece aqui. Sem versoes, que exigiriam serializar o tabuleiro nesta thread.
+  std::unique_ptr<ntf::Notificacao> instantaneo(SerializaTabuleiro(/*salvar_versoes=*/false));
+  if (instantaneo->tipo() == ntf::TN_ERRO) {
+    LOG(ERROR) << "Falha no instantaneo para salvamento automatico: " << instantaneo->erro();
+    return;
+  }
+  salvamento_automatico_.Agenda(std::move(instantaneo));
+}
+
 // Aqui ocorre a deserializacao do tabuleiro todo. As propriedades como iluminacao sao atualizadas
 // na funcao Tabuleiro::DeserializaPropriedades.
 void Tabuleiro::DeserializaTabuleiro(const ntf::Notificacao& notificacao) {
+  PERFIL_ZONA("Tabuleiro::DeserializaTabuleiro");
   const auto& novo_tabuleiro = notificacao.tabuleiro();
   const bool manter_entidades = novo_tabuleiro.manter_entidades();
   std::vector<EntidadeProto> entidades_mantidas;
@@ -6221,20 +6504,132 @@ void Tabuleiro::DeserializaTabuleiro(const ntf::Notificacao& notificacao) {
   // Recebe as entidades.
   entidades_mantidas.insert(entidades_mantidas.end(), novo_tabuleiro.entidade().begin(), novo_tabuleiro.entidade().end());
 
-  for (EntidadeProto ep : entidades_mantidas) {
-    if (BuscaEntidade(ep.id()) != nullptr) {
+  // As entidades so entram no mapa no final, entao os ids repetidos sao resolvidos antes.
+  std::unordered_set<unsigned int> ids;
+  for (EntidadeProto& ep : entidades_mantidas) {
+    if (ids.contains(ep.id())) {
       // Para manter as entidades, os ids tem que ser regerados para as entidades do tabuleiro,
       // senao pode dar conflito com as que ficaram.
-      ep.set_id(GeraIdEntidade(id_cliente_));
-    }
-    auto entidade = NovaEntidade(ep, tabelas_, this, texturas_, m3d_, central_, &parametros_desenho_);
-    if (!entidades_.insert(std::make_pair(entidade->Id(), std::move(entidade))).second) {
-      LOG(ERROR) << "Erro adicionando entidade: " << ep.ShortDebugString();
+      unsigned int id;
+      do {
+        id = GeraIdEntidade(id_cliente_);
+      } while (ids.contains(id));
+      ep.set_id(id);
     }
+    ids.insert(ep.id());
   }
+  CriaEntidadesDeserializadas(entidades_mantidas);
   VLOG(1) << "Foram adicionadas " << novo_tabuleiro.entidade_size() << " entidades";
 }
 
+namespace {
+
+// Central que apenas guarda as notificacoes, para entidades criadas fora da thread principal.
+class CentralAdiada : public ntf::CentralNotificacoes {
+ public:
+  // As notificacoes sobrevivem a esta central, entao nao podem estar nas arenas dela.
+  CentralAdiada() { AlteraUsoArenas(false); }
+
+  // Move as notificacoes guardadas para central, na ordem em que foram adicionadas.
+  void RepassaPara(ntf::CentralNotificacoes* central) {
+    for (auto& n : notificacoes_) {
+      central->AdicionaNotificacao(n.release());
+    }
+    for (auto& n : notificacoes_remotas_) {
+      central->AdicionaNotificacaoRemota(n.release());
+    }
+    notificacoes_.clear();
+    notificacoes_remotas_.clear();
+  }
+};
+
+// Abaixo disso, a criacao de threads custa mais que a carga.
+constexpr int kMinimoEntidadesPorThread = 16;
+
+}  // namespace
+
+void Tabuleiro::CriaEntidadesDeserializadas(const std::vector<EntidadeProto>& protos) {
+  PERFIL_ZONA("Tabuleiro::CriaEntidadesDeserializadas");
+  const int num_entidades = protos.size();
+  if (num_entidades == 0) return;
+  boost::timer::cpu_timer timer;
+
+  struct Carga {
+    std::unique_ptr<Entidade> entidade;
+    CentralAdiada central;
+    std::exception_ptr erro;
+  };
+  std::vector<Carga> cargas(num_entidades);
+  std::atomic<int> proxima{0};
+  std::atomic<int> prontas{0};
+  // Fase 1: nada aqui pode tocar em OpenGL, na central, no estado mutavel do tabuleiro ou rolar dados.
+  auto carrega = [&]() {
+    for (int i = proxima++; i < num_entidades; i = proxima++) {
+      PERFIL_ZONA("Tabuleiro::CarregaEntidade");
+      try {
+        cargas[i].entidade = NovaEntidadeParaCargaParalela(
+            protos[i], tabelas_, this, texturas_, m3d_, central_ == nullptr ? nullptr : &cargas[i].central, &parametros_desenho_);
+      } catch (...) {
+        cargas[i].erro = std::current_exception();
+      }
+      const int total_prontas = ++prontas;
+      // Progresso a cada quarto da carga.
+      if (num_entidades >= kMinimoEntidadesPorThread && (total_prontas * 4) / num_entidades != ((total_prontas - 1) * 4) / num_entidades) {
+        LOG(INFO) << "Carregando entidades: " << total_prontas << "/" << num_entidades;
+      }
+    }
+  };
+  const int num_threads = std::max(1, std::min<int>(
+      num_threads_carga_ > 0 ? num_threads_carga_ : std::max(1u, std::thread::hardware_concurrency()),
+      num_entidades / kMinimoEntidadesPorThread));
+  {
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; ++i) {
+      threads.emplace_back(carrega);
+    }
+    // A thread principal tambem carrega.
+    carrega();
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+
+  // Fase 2, na ordem original: notificacoes de texturas e modelos e insercao. A finalizacao (dados e RecomputaDependencias)
+  // so depois de todas inseridas, porque o recomputa busca outras entidades (montaria).
+  std::vector<Entidade*> inseridas;
+  inseridas.reserve(num_entidades);
+  for (auto& carga : cargas) {
+    if (carga.erro) {
+      std::rethrow_exception(carga.erro);
+    }
+    if (central_ != nullptr) {
+      carga.central.RepassaPara(central_);
+    }
+    const unsigned int id = carga.entidade->Id();
+    Entidade* entidade = carga.entidade.get();
+    if (!entidades_.insert(std::make_pair(id, std::move(carga.entidade))).second) {
+      LOG(ERROR) << "Erro adicionando entidade: " << id;
+      continue;
+    }
+    inseridas.push_back(entidade);
+  }
+  // Fase 3, na ordem original: gravacao dos VBOs, dados e dependencias. Os dados rolados nao dependem das threads.
+  // Quem monta outras entidades usa os valores ja recomputados delas, entao fica para o fim.
+  for (auto* entidade : inseridas) {
+    if (entidade->Proto().entidades_montadas().empty()) {
+      entidade->FinalizaCargaParalela(central_);
+    }
+  }
+  for (auto* entidade : inseridas) {
+    if (!entidade->Proto().entidades_montadas().empty()) {
+      entidade->FinalizaCargaParalela(central_);
+    }
+  }
+  timer.stop();
+  VLOG(1) << "Carga de " << num_entidades << " entidades com " << num_threads << " threads: "
+          << (timer.elapsed().wall / 1000000ULL) << "ms";
+}
+
 ntf::Notificacao* Tabuleiro::SerializaEntidadesSelecionaveis() const {
   // O motivo de ser TN_DESERIALIZAR_ENTIDADES_SELECIONAVEIS eh para os clientes poderem receber a
   // notificacao gerada pela funcao.
@@ -6383,7 +6778,7 @@ void Tabuleiro::CriaSubCenarioNotificando(const ntf::Notificacao& notificacao) {
     return;
   }
   // Envia para clientes.
-  central_->AdicionaNotificacaoRemota(new ntf::Notificacao(notificacao));
+  central_->AdicionaNotificacaoRemota(ntf::CopiaNotificacao(notificacao, central_->ArenaCiclo()));
   // Para desfazer.
   AdicionaNotificacaoListaEventos(notificacao);
 }
@@ -6426,7 +6821,7 @@ void Tabuleiro::RemoveSubCenarioNotificando(const ntf::Notificacao& notificacao)
     // A remocao das entidades vira pela rede.
     return;
   }
-  central_->AdicionaNotificacaoRemota(new ntf::Notificacao(notificacao));
+  central_->AdicionaNotificacaoRemota(ntf::CopiaNotificacao(notificacao, central_->ArenaCiclo()));
 
   // Remove entidades do cenario.
   ntf::Notificacao grupo_notificacoes;
@@ -6455,6 +6850,8 @@ void Tabuleiro::RemoveSubCenarioNotificando(const ntf::Notificacao& notificacao)
 
 void Tabuleiro::AtualizaSerializaOpcoes(const ent::OpcoesProto& novo_proto) {
   opcoes_.CopyFrom(novo_proto);
+  salvamento_automatico_.AlteraNumCopias(opcoes_.num_copias_salvamento_automatico());
+  temporizador_salvamento_automatico_ms_ = opcoes_.intervalo_salvamento_automatico_s() * 1000;
   dfb_principal_.Apaga();
   dfb_oclusao_.Apaga();
   dfb_luz_direcional_.Apaga();
@@ -6501,6 +6898,32 @@ void Tabuleiro::CarregaSubCenario(int id_cenario, const Posicao& camera) {
   variaveis_clima_ = VariaveisClima(cenario_clima.neve() > 0.0f || cenario_clima.chuva() > 0.0f ? 1.0f : 0.0f);
 }
 
+void Tabuleiro::InformaInteresseSeMudou() {
+  ntf::InteresseCliente interesse;
+  if (EmModoMestreIncluindoSecundario()) {
+    interesse.set_sem_filtro(true);
+  } else {
+    interesse.set_id_cenario(IdCenario());
+    if (camera_presa_ && IdCameraPresa() != Entidade::IdInvalido) {
+      interesse.set_id_entidade_camera(IdCameraPresa());
+    }
+  }
+  if (interesse_informado_valido_ &&
+      interesse.sem_filtro() == interesse_informado_.sem_filtro() &&
+      interesse.id_cenario() == interesse_informado_.id_cenario() &&
+      interesse.has_id_entidade_camera() == interesse_informado_.has_id_entidade_camera() &&
+      interesse.id_entidade_camera() == interesse_informado_.id_entidade_camera()) {
+    return;
+  }
+  // Sem conexao, a central descarta a notificacao remota.
+  auto n = ntf::NovaNotificacao(ntf::TN_INFORMAR_INTERESSE);
+  n->set_servidor_apenas(true);
+  *n->mutable_interesse() = interesse;
+  central_->AdicionaNotificacaoRemota(n.release());
+  interesse_informado_.Swap(&interesse);
+  interesse_informado_valido_ = true;
+}
+
 Entidade* Tabuleiro::BuscaEntidade(unsigned int id) {
   auto it = entidades_.find(id);
   return (it != entidades_.end()) ? it->second.get() : nullptr;
@@ -6997,21 +7420,37 @@ void Tabuleiro::AdicionaLogEvento(const std::string& evento) {
   if (evento.empty()) {
     return;
   }
-  std::string copia = evento;
-  std::replace(copia.begin(), copia.end(), '\n', ' ');
-  log_eventos_.push_front(copia);
-  if (log_eventos_.size() > 30) {
-    log_eventos_.pop_back();
-  }
+  EventoLog e;
+  e.texto = evento;
+  log_eventos_.Adiciona(std::move(e));
 }
 
 void Tabuleiro::AdicionaLogEvento(unsigned int id, const std::string& texto) {
   if (texto.empty()) {
     return;
   }
-  auto* entidade_destino = BuscaEntidade(id);
-  AdicionaLogEvento(absl::StrFormat(
-          "entidade %s: %s", RotuloEntidade(entidade_destino).c_str(), texto.c_str()));
+  EventoLog e;
+  e.tipo = EventoLog::TEXTO_ENTIDADE;
+  e.texto = texto;
+  e.entidades.emplace_back(id, RotuloEntidade(BuscaEntidade(id)));
+  log_eventos_.Adiciona(std::move(e));
+}
+
+void Tabuleiro::AdicionaLogEventoNotificacao(EventoLog::Tipo tipo, const ntf::Notificacao& notificacao) {
+  // Guarda apenas o necessario para o resumo, que sera formatado se e quando o log for exibido.
+  auto reduzida = std::make_shared<ntf::Notificacao>();
+  std::vector<unsigned int> ids;
+  if (!ReduzNotificacaoParaResumo(notificacao, reduzida.get(), &ids) && tipo == EventoLog::NOTIFICACAO) {
+    return;
+  }
+  EventoLog e;
+  e.tipo = tipo;
+  e.notificacao = std::move(reduzida);
+  for (unsigned int id : ids) {
+    if (e.EnvolveEntidade(id)) continue;
+    e.entidades.emplace_back(id, RotuloEntidade(BuscaEntidade(id)));
+  }
+  log_eventos_.Adiciona(std::move(e));
 }
 
 void Tabuleiro::AdicionaNotificacaoListaEventos(const ntf::Notificacao& notificacao) {
@@ -7023,7 +7462,7 @@ void Tabuleiro::AdicionaNotificacaoListaEventos(const ntf::Notificacao& notifica
     // Remove tudo do corrente para a frente.
     lista_eventos_.erase(evento_corrente_, lista_eventos_.end());
   }
-  AdicionaLogEvento(ResumoNotificacao(*this, notificacao));
+  AdicionaLogEventoNotificacao(EventoLog::NOTIFICACAO, notificacao);
 
   lista_eventos_.emplace_back(notificacao);
   evento_corrente_ = lista_eventos_.end();
@@ -7097,6 +7536,11 @@ const ntf::Notificacao InverteNotificacao(const ntf::Notificacao& n_original) {
       n_inversa.mutable_tabuleiro()->CopyFrom(n_original.tabuleiro());
       break;
     }
+    case ntf::TN_PASSAR_RODADA_EM_LOTE:
+      VLOG(1) << "Invertendo TN_PASSAR_RODADA_EM_LOTE";
+      n_inversa.set_tipo(ntf::TN_PASSAR_RODADA_EM_LOTE);
+      InverteDeltaRodada(n_original.delta_rodada(), n_inversa.mutable_delta_rodada());
+      break;
     case ntf::TN_ATUALIZAR_RODADAS:
       VLOG(1) << "Invertendo TN_ATUALIZAR_RODADAS";
       n_inversa.set_tipo(ntf::TN_ATUALIZAR_RODADAS);
@@ -7192,7 +7636,7 @@ void Tabuleiro::TrataComandoDesfazer() {
   const ntf::Notificacao& n_original = *evento_corrente_;
   ntf::Notificacao n_inversa = InverteNotificacao(n_original);
   if (n_inversa.tipo() != ntf::TN_ERRO) {
-    AdicionaLogEvento(absl::StrFormat("desfazendo: %s", ResumoNotificacao(*this, n_inversa).c_str()));
+    AdicionaLogEventoNotificacao(EventoLog::DESFAZENDO, n_inversa);
     TrataNotificacao(n_inversa);
   } else {
     LOG(ERROR) << "Nao consegui desfazer notificacao: " << n_original.ShortDebugString();
@@ -7217,7 +7661,7 @@ void Tabuleiro::TrataComandoRefazer() {
   }
   ignorar_lista_eventos_ = true;
   const ntf::Notificacao& n_original = *evento_corrente_;
-  AdicionaLogEvento(absl::StrFormat("refazendo: %s", ResumoNotificacao(*this, n_original).c_str()));
+  AdicionaLogEventoNotificacao(EventoLog::REFAZENDO, n_original);
   TrataNotificacao(n_original);
   ignorar_lista_eventos_ = false;
   ++evento_corrente_;
@@ -7266,7 +7710,7 @@ void Tabuleiro::MoveEntidadeNotificando(const ntf::Notificacao& notificacao) {
   }
 
   if (notificacao.local()) {
-    central_->AdicionaNotificacaoRemota(new ntf::Notificacao(notificacao));
+    central_->AdicionaNotificacaoRemota(ntf::CopiaNotificacao(notificacao, central_->ArenaCiclo()));
     // Para desfazer: salva a posicao original e destino.
     ntf::Notificacao n_desfazer;
     n_desfazer.set_tipo(ntf::TN_MOVER_ENTIDADE);
@@ -7358,7 +7802,7 @@ void Tabuleiro::AtualizaEntidadeNotificando(const ntf::Notificacao& notificacao)
   if (notificacao.local()) {
     // So repassa a notificacao pros clientes se a origem dela for local,
     // para evitar ficar enviando infinitamente.
-    central_->AdicionaNotificacaoRemota(new ntf::Notificacao(notificacao));
+    central_->AdicionaNotificacaoRemota(ntf::CopiaNotificacao(notificacao, central_->ArenaCiclo()));
     // Para desfazer.
     ntf::Notificacao n_desfazer(notificacao);
     n_desfazer.mutable_entidade_antes()->Swap(&proto_antes);
@@ -7814,7 +8258,7 @@ void Tabuleiro::DesenhaGrade() {
   gl::HabilitaEscopo offset_escopo(GL_POLYGON_OFFSET_FILL);
   MudaCor(COR_PRETA);
   gl::DesvioProfundidade(OFFSET_GRADE_ESCALA_DZ, OFFSET_GRADE_ESCALA_R);
-  vbos_grade_.Desenha();
+  DesenhaPedacosTerreno(/*grade=*/true);
 }
 
 void Tabuleiro::DesenhaListaGenerica(
@@ -8025,7 +8469,8 @@ void Tabuleiro::DesenhaLogEventos() {
 
   //MudaCor(COR_AMARELA);
   std::vector<std::string> lista;
-  for (const auto& log : log_eventos_) lista.push_back(StringSemUtf8(log));
+  lista.reserve(log_eventos_.Tamanho());
+  for (int i = 0; i < log_eventos_.Tamanho(); ++i) lista.push_back(StringSemUtf8(log_eventos_.Texto(i)));
 
   DesenhaListaGenerica(0, kNumLinhas,
                        pagina_log_eventos_, pagina_horizontal_log_eventos_, StringSemUtf8("Log de Eventos Locais").c_str(), COR_AMARELA,
@@ -8110,7 +8555,7 @@ void Tabuleiro::DesenhaInfoGeral() {
   }
 }
 
-void Tabuleiro::DesenhaTempo(int linha, const std::string& prefixo, const std::list<uint64_t>& ultimos_tempos) {
+void Tabuleiro::DesenhaTempo(int linha, const std::string& prefixo, const boost::circular_buffer<uint64_t>& ultimos_tempos) {
   // Acha o maior.
   uint64_t maior_tempo_ms = 0;
   for (uint64_t tempo_ms : ultimos_tempos) {
@@ -8118,6 +8563,10 @@ void Tabuleiro::DesenhaTempo(int linha, const std::string& prefixo, const std::l
       maior_tempo_ms = tempo_ms;
     }
   }
+  DesenhaTempo(linha, prefixo, maior_tempo_ms);
+}
+
+void Tabuleiro::DesenhaTempo(int linha, const std::string& prefixo, uint64_t maior_tempo_ms) {
 
   int largura_fonte, altura_fonte;
   float escala;
@@ -8179,9 +8628,10 @@ void Tabuleiro::DesenhaTempos() {
   DesenhaTempo(3, "atualizacao", tempos_uma_atualizacao_);
   DesenhaTempo(4, "at parcial ", tempos_atualiza_parcial_);
   DesenhaTempo(5, "cont virt  ", tempos_uma_renderizacao_controle_virtual_);
-  DesenhaTempo(6, "num objetos", {entidades_ordenadas_.size()});
-  DesenhaTempo(7, "mem GPU total MB", {mem_total_kb / 1024ULL});
-  DesenhaTempo(8, "mem GPU usado MB", {mem_disp_kb / 1024ULL});
+  DesenhaTempo(6, "num objetos", entidades_ordenadas_.size());
+  DesenhaTempo(7, "visiveis   ", indices_visiveis_.size());
+  DesenhaTempo(8, "mem GPU total MB", mem_total_kb / 1024ULL);
+  DesenhaTempo(9, "mem GPU usado MB", mem_disp_kb / 1024ULL);
   V_ERRO("tempo de renderizacao");
 }
 
@@ -8401,6 +8851,37 @@ std::vector<const Entidade*> Tabuleiro::EntidadesSelecionadas() const {
 void Tabuleiro::AlternaModoDebug() {
   gl::AlternaModoDebug();
   modo_debug_ = !modo_debug_;
+  if (modo_debug_) {
+    perfil_ligado_pelo_debug_ = !perfil::Ligado();
+    if (perfil_ligado_pelo_debug_) {
+      perfil::Limpa();
+      perfil::Liga(true);
+    }
+  } else if (perfil::Ligado()) {
+    ExportaPerfil();
+    if (perfil_ligado_pelo_debug_) {
+      perfil::Liga(false);
+    }
+    perfil_ligado_pelo_debug_ = false;
+  }
+}
+
+std::string Tabuleiro::ExportaPerfil() {
+  for (const auto& ez : perfil::Estatisticas()) {
+    LOG(INFO) << absl::StrFormat(
+        "perfil %s: n=%d, media=%.3fms, p50=%.3fms, p95=%.3fms, p99=%.3fms, max=%.3fms",
+        ez.nome, ez.num, ez.media_ns / 1e6, ez.p50_ns / 1e6, ez.p95_ns / 1e6, ez.p99_ns / 1e6, ez.maximo_ns / 1e6);
+  }
+  std::string nome_arquivo = absl::StrFormat(
+      "perfil_%s.json", boost::posix_time::to_iso_string(boost::posix_time::second_clock::local_time()));
+  try {
+    arq::EscreveArquivo(arq::TIPO_CONFIGURACOES, nome_arquivo, perfil::TraceChrome());
+  } catch (const std::logic_error& e) {
+    LOG(ERROR) << "Falha exportando perfil: " << e.what();
+    return "";
+  }
+  LOG(INFO) << "Perfil exportado para: " << nome_arquivo;
+  return nome_arquivo;
 }
 
 std::string PreencheNotificacaoFimConjuracao(
@@ -8648,18 +9129,41 @@ void Tabuleiro::PreenchePassaUmaRodada(bool passar_para_todos, ntf::Notificacao*
   }
   VLOG(1) << "passando rodada para " << (passar_para_todos ? "todos" : "entidades com iniciativa");
 
+  PERFIL_ZONA("Tabuleiro::PreenchePassaUmaRodada");
+  // Entidades que ja tem atualizacao de ataque no grupo (por exemplo, a da iniciativa anterior) vao pelo caminho
+  // completo, que reaproveita a notificacao.
+  std::unordered_set<unsigned int> ids_com_ataque_no_grupo;
+  for (const auto& n : grupo->notificacao()) {
+    if (!n.entidade().dados_ataque().empty()) ids_com_ataque_no_grupo.insert(n.entidade().id());
+  }
+  // O caso comum (so decrementar eventos e refrescar ataques) vai em uma unica notificacao compacta. O resto segue
+  // o caminho completo, com uma notificacao parcial por mudanca.
+  std::vector<DeltaRodadaEntidade> deltas;
+  deltas.reserve(entidades_.size());
   for (auto& id_entidade : entidades_) {
     auto& entidade = *id_entidade.second.get();
-    if (passar_para_todos || !entidade.TemIniciativa()) {
+    if (!passar_para_todos && entidade.TemIniciativa()) continue;
+    DeltaRodadaEntidade delta;
+    if (ids_com_ataque_no_grupo.count(entidade.Id()) == 0 &&
+        CalculaDeltaRodadaEntidade(entidade.Proto(), expira_eventos_zerados, &delta)) {
+      deltas.push_back(std::move(delta));
+    } else {
       std::vector<int> ids_unicos(IdsUnicosEntidade(entidade));
       AtualizaEventosAoPassarRodada(entidade, &ids_unicos, grupo, grupo_desfazer, expira_eventos_zerados);
-      AtualizaEsquivaAoPassarRodada(entidade, grupo, grupo_desfazer);
-      AtualizaMovimentoAoPassarRodada(entidade, grupo, grupo_desfazer);
-      AtualizaCuraAceleradaAoPassarRodada(entidade, grupo, grupo_desfazer);
-      AtualizaRegeneracaoAoPassarRodada(entidade, grupo, grupo_desfazer);
       PreencheNotificacaoAtaqueAoPassarRodada(entidade, grupo, grupo_desfazer);
       ReiniciaAtaqueAoPassarRodada(entidade, grupo, grupo_desfazer);
     }
+    AtualizaEsquivaAoPassarRodada(entidade, grupo, grupo_desfazer);
+    AtualizaMovimentoAoPassarRodada(entidade, grupo, grupo_desfazer);
+    AtualizaCuraAceleradaAoPassarRodada(entidade, grupo, grupo_desfazer);
+    AtualizaRegeneracaoAoPassarRodada(entidade, grupo, grupo_desfazer);
+  }
+  if (!deltas.empty()) {
+    auto* nd = NovaNotificacaoFilha(ntf::TN_PASSAR_RODADA_EM_LOTE, grupo);
+    CompactaDeltaRodada(deltas, /*reiniciar_ataque=*/true, nd->mutable_delta_rodada());
+    if (grupo_desfazer != nullptr) {
+      *grupo_desfazer->add_notificacao() = *nd;
+    }
   }
 
   {
@@ -9059,22 +9563,25 @@ void Tabuleiro::ReativaWatchdog() {
 #endif
 }
 
-float Tabuleiro::ZChao(float x, float y) const {
-  if (proto_corrente_->ponto_terreno_size() == 0) {
-    return 0.0f;
+const CacheAlturasTerreno& Tabuleiro::CacheAlturas() const {
+  const int num_pontos = proto_corrente_->ponto_terreno_size();
+  if (!cache_alturas_.Valido(proto_corrente_->id_cenario(), TamanhoX(), TamanhoY(), num_pontos)) {
+    cache_alturas_.Atualiza(
+        proto_corrente_->id_cenario(), TamanhoX(), TamanhoY(), proto_corrente_->ponto_terreno().data(), num_pontos);
   }
-  return Terreno::ZChao(x, y, TamanhoX(), TamanhoY(), proto_corrente_->ponto_terreno().data());
+  return cache_alturas_;
+}
+
+float Tabuleiro::ZChao(float x, float y) const {
+  return CacheAlturas().ZChao(x, y);
+}
+
+void Tabuleiro::ZChao(std::span<const float> x, std::span<const float> y, std::span<float> z) const {
+  CacheAlturas().ZChao(x, y, z);
 }
 
 float Tabuleiro::AlturaPonto(int x_quad, int y_quad) const {
-  if (proto_corrente_->ponto_terreno_size() == 0) {
-    return 0.0f;
-  }
-  try {
-    return Terreno::AlturaPonto(x_quad, y_quad, TamanhoX(), TamanhoY(), proto_corrente_->ponto_terreno().data());
-  } catch (...) {
-    return 0.0f;
-  }
+  return CacheAlturas().AlturaPonto(x_quad, y_quad);
 }
 
 void Tabuleiro::SalvaOpcoes() const {
@@ -2,20 +2,29 @@
 #define ENT_TABULEIRO_H
 
 #include <algorithm>
+#include <boost/circular_buffer.hpp>
 #include <boost/timer/timer.hpp>
 #include <functional>
 #include <memory>
 #include <set>
+#include <span>
 #include <unordered_map>
 #include <unordered_set>
 #include <list>
 #include <vector>
+#include "ent/acoes.h"
 #include "ent/acoes.pb.h"
 #include "ent/constantes.h"
 #include "ent/controle_virtual.pb.h"
+#include "ent/controle_virtual_retido.h"
 #include "ent/entidade.h"
 #include "ent/entidade.pb.h"
+#include "ent/interesse_clientes.h"
+#include "ent/log_eventos.h"
+#include "ent/salvamento_automatico.h"
 #include "ent/tabuleiro.pb.h"
+#include "ent/tabuleiro_terreno.h"
+#include "ent/util.h"
 #if USAR_WATCHDOG
 #include "ent/watchdog.h"
 #endif
@@ -128,6 +137,9 @@ class Tabuleiro : public ntf::Receptor {
 
   void AtualizaClima(unsigned int passou_ms);
 
+  /** No cliente, informa ao servidor o cenario sendo visto e a entidade da camera, se mudaram desde a ultima vez. */
+  void InformaInteresseSeMudou();
+
   /** Atualiza uma entidade, notificando clientes. */
   void AtualizaEntidadeNotificando(const ntf::Notificacao& notificacao);
 
@@ -494,10 +506,13 @@ class Tabuleiro : public ntf::Receptor {
 
   /** Adiciona um evento ao log. */
   void AdicionaLogEvento(const std::string& evento);
-  /** Formata a entidade e concatena com texto antes de mandar pro log de eventos. */
+  /** Adiciona ao log um evento de texto sobre a entidade ("entidade <rotulo>: <texto>"). */
   void AdicionaLogEvento(unsigned int id, const std::string& texto);
-  /** Retorna o log de eventos. */
-  const std::list<std::string>& LogEventos() const { return log_eventos_; }
+  /** Adiciona ao log o resumo da notificacao (ver ResumoNotificacao), se houver. */
+  void AdicionaLogEventoNotificacao(EventoLog::Tipo tipo, const ntf::Notificacao& notificacao);
+  /** Retorna o log de eventos. Os textos sao formatados apenas quando consultados. */
+  const BufferLogEventos& LogEventos() const { return log_eventos_; }
+  BufferLogEventos* MutableLogEventos() { return &log_eventos_; }
   /** Incrementa para o proximo cliente e retorna tudo como log. */
   const std::unordered_map<std::string, std::string>& LogEventosClientes() const { return log_eventos_clientes_; } 
 
@@ -507,9 +522,61 @@ class Tabuleiro : public ntf::Receptor {
   /** refaz a ultima acao desfeita. */
   void TrataComandoRefazer();
 
-  /** Altera o desenho entre os modos de debug (para OpenGL ES). */
+  /** Altera o desenho entre os modos de debug (para OpenGL ES). Liga o perfilador (log/perfil.h) junto; ao desligar,
+  * loga as estatisticas das zonas e exporta o trace (ver ExportaPerfil). Se o perfilador ja estava ligado
+  * (por --perfil), ele continua ligado ao sair do modo. */
   void AlternaModoDebug();
 
+  /** Escreve as zonas do perfilador em formato trace event do Chrome no diretorio de configuracoes do usuario,
+  * e loga as estatisticas por zona. Retorna o nome do arquivo escrito, ou vazio em caso de falha.
+  */
+  std::string ExportaPerfil();
+
+  /** Liga ou desliga o desenho instanciado das entidades solidas (ligado por padrao). */
+  void AlteraDesenhoInstanciado(bool ligado) { desenho_instanciado_ = ligado; }
+  /** Liga ou desliga o descarte das entidades fora do tronco de visao de cada passo de desenho (ligado por padrao). */
+  void AlteraDescarteTroncoVisao(bool ligado) { descarte_tronco_visao_ = ligado; }
+  /** Entidades desenhadas no ultimo passo de DesenhaEntidadesBase, apos o descarte. */
+  int NumEntidadesVisiveis() const { return static_cast<int>(indices_visiveis_.size()); }
+  /** Sem grafico (servidor dedicado), nao ha contexto OpenGL: o tabuleiro nao inicia nem regera objetos graficos.
+  * Deve ser ligado antes da primeira notificacao.
+  */
+  void AlteraSemGrafico(bool sem_grafico) { sem_grafico_ = sem_grafico; }
+  bool SemGrafico() const { return sem_grafico_; }
+  /** Com passo fixo (> 0), cada TN_TEMPORIZADOR avanca a simulacao exatamente passo_ms, em vez do tempo real desde o
+  * anterior. Para o laco com Escalonador, que roda os passos atrasados em sequencia.
+  */
+  void AlteraPassoFixoMs(int passo_ms) { passo_fixo_ms_ = passo_ms; }
+  /** Fracao do proximo passo de simulacao ja decorrida quando o quadro eh desenhado (ver Escalonador::Fracao). A camera eh
+  * desenhada interpolada entre a posicao do passo anterior e a atual. 1 desliga a interpolacao.
+  */
+  void AlteraFracaoPassoDesenho(float fracao) { fracao_passo_desenho_ = fracao; }
+  /** O cliente com este id de rede eh promovido a mestre secundario ao conectar (servidor dedicado, onde o mestre
+  * joga como cliente). Vazio desliga.
+  */
+  void AlteraIdRedeMestreAutomatico(const std::string& id_rede) { id_rede_mestre_automatico_ = id_rede; }
+  /** Lotes do ultimo desenho instanciado, para depuracao e benchmark. */
+  const LotesInstancias& UltimosLotesInstancias() const { return lotes_instancias_; }
+  /** Idem, para as acoes solidas. */
+  const LotesAcoes& UltimosLotesAcoes() const { return lotes_acoes_; }
+  /** Numero de acoes em andamento. */
+  int NumAcoes() const { return static_cast<int>(acoes_.size()); }
+  /** Acao em andamento de indice i, na ordem de criacao. */
+  const Acao& AcaoEmAndamento(int i) const { return *acoes_[i]; }
+
+  /** Numero de threads usadas por DeserializaTabuleiro para criar as entidades. Zero (padrao) usa o numero de nucleos. */
+  void AlteraNumThreadsCarga(int num_threads) { num_threads_carga_ = num_threads; }
+
+  /** Tira um instantaneo do tabuleiro e agenda sua escrita em segundo plano. Chamada periodicamente pelo mestre,
+  * a cada opcoes_.intervalo_salvamento_automatico_s().
+  */
+  void SalvaAutomaticamente();
+  const SalvamentoAutomatico& Salvamento() const { return salvamento_automatico_; }
+  SalvamentoAutomatico* MutableSalvamento() { return &salvamento_automatico_; }
+
+  // Filtro de interesse dos clientes, para o servidor (ver net::Servidor::AlteraFiltroInteresse).
+  InteresseClientes* MutableInteresseClientes() { return &interesse_clientes_; }
+
   /** Entra no modo clique de pericia com as informações passadas. */
   void EntraModoPericia(const std::string& id_pericia, const ntf::Notificacao& notificacao);
 
@@ -607,6 +674,7 @@ class Tabuleiro : public ntf::Receptor {
   /** O contador de eventos de todas as entidades sera decrementado em 1. Nenhum
    * ficara negativo.
    * Caso o parametro expira_eventos_zerados seja verdadeiro, eventos que estejam em zero serão removidos.
+   * Entidades sem efeitos especiais vao todas em uma unica TN_PASSAR_RODADA_EM_LOTE, cujo desfazer vem dos mesmos dados.
    */
   void PreenchePassaUmaRodada(bool passar_para_todos, ntf::Notificacao* grupo, ntf::Notificacao* grupo_desfazer, bool expira_eventos_zerados = false);
   /** Zera o contador de rodadas do tabuleiro. */
@@ -651,6 +719,8 @@ class Tabuleiro : public ntf::Receptor {
 
   /** Retorna o nivel do solo na coordenada ou zero se nao for valida. */
   float ZChao(float x, float y) const;
+  /** Versao em lote: z[i] = ZChao(x[i], y[i]). Os spans devem ter o mesmo tamanho. */
+  void ZChao(std::span<const float> x, std::span<const float> y, std::span<float> z) const;
 
   /** Em algumas ocasioes eh interessante parar o watchdog (dialogos por exemplo). */
   void DesativaWatchdogSeMestre() { if (EmModoMestre()) DesativaWatchdog(); }
@@ -785,15 +855,23 @@ class Tabuleiro : public ntf::Receptor {
   /** Desenha os elos das entidades agarradas. */
   void DesenhaElosAgarrar();
 
-  /** Desenha as entidades. */
-  void DesenhaEntidadesBase(const std::function<void (Entidade*, ParametrosDesenho*)>& f);
-  void DesenhaEntidades() { DesenhaEntidadesBase(&Entidade::Desenha); }
+  /** Desenha as entidades. Com usar_lotes, as entidades sao desenhadas por Entidade::DesenhaComLotes e os objetos
+  * que compartilham VBO e textura, em uma chamada instanciada no final (ver AlteraDesenhoInstanciado).
+  * Antes, descarta as que estao fora do tronco de visao corrente (ver FiltraEntidadesVisiveis).
+  */
+  void DesenhaEntidadesBase(const std::function<void (Entidade*, ParametrosDesenho*)>& f, bool usar_lotes = false);
+  void DesenhaEntidades() { DesenhaEntidadesBase(&Entidade::Desenha, /*usar_lotes=*/true); }
   void DesenhaEntidadesTranslucidas() { DesenhaEntidadesBase(&Entidade::DesenhaTranslucido); }
   /** Retorna a posicao de referencia, id do cenario e a funcao de ordenacao. */
   std::pair<int, std::function<bool(const Entidade* lhs, const Entidade* rhs)>>
       IdCenarioComFuncaoOrdenacao(const ParametrosDesenho& pd) const;
-  /** Ordena as entidades de acordo com os parametros de desenho. Preenche entidades_ordenadas_. */
+  /** Ordena as entidades de acordo com os parametros de desenho. Preenche entidades_ordenadas_ e suas esferas. */
   void OrdenaEntidades(const ParametrosDesenho& pd);
+  /** Preenche indices_visiveis_ com as entidades ordenadas que podem aparecer no passo corrente: as que tocam o tronco
+  * de visao das matrizes correntes (camera, luz direcional, face do cubo ou picking) e, no mapa de uma luz pontual,
+  * que estao ao alcance da luz.
+  */
+  void FiltraEntidadesVisiveis();
 
   /** Detecta se havera colisao no movimento da entidade. */
   struct ResultadoColisao {
@@ -819,6 +897,7 @@ class Tabuleiro : public ntf::Receptor {
   /** Desenha as acoes do tabuleiro (como misseis magicos). */
   void DesenhaAcoes();
   void DesenhaAcoesTranslucidas();
+  void DesenhaAcoesBase(bool translucidas);
 
   void DesenhaAuras();
 
@@ -827,8 +906,9 @@ class Tabuleiro : public ntf::Receptor {
 
   /** Desenha os tempos de renderizacao, atualizacao, etc. */
   void DesenhaTempos();
-  /** Funcao auxiliar usada por DesenhaTempos. */
-  void DesenhaTempo(int linha, const std::string& prefixo, const std::list<uint64_t>& ultimos_tempos);
+  /** Funcao auxiliar usada por DesenhaTempos. Desenha o maior dos ultimos tempos. */
+  void DesenhaTempo(int linha, const std::string& prefixo, const boost::circular_buffer<uint64_t>& ultimos_tempos);
+  void DesenhaTempo(int linha, const std::string& prefixo, uint64_t valor);
 
   void DesenhaLogEventos();
 
@@ -1003,8 +1083,14 @@ class Tabuleiro : public ntf::Receptor {
   /** Alguns estados podem ser interrompidos por outros. Esta funcao finaliza o corrente antes de mudar para um novo. */
   void FinalizaEstadoCorrente();
 
-  /** Envia atualizacoes de movimento para clientes. */
+  /** Envia atualizacoes de movimento para clientes, uma unica notificacao compactada com as entidades que mudaram
+  * desde o ultimo envio.
+  */
   void RefrescaMovimentosParciais();
+  /** Trata TN_MOVER_ENTIDADES_COMPACTO remota. As posicoes viram destinos, para as entidades interpolarem entre envios. */
+  void AplicaMovimentosCompactados(const MovimentosEntidadesProto& proto);
+  /** Trata TN_PASSAR_RODADA_EM_LOTE. */
+  void AplicaDeltaRodada(const DeltaRodadaProto& proto);
 
   /** Envia atualizacoes de terreno para clientes. */
   void RefrescaTerrenoParaClientes();
@@ -1049,6 +1135,11 @@ class Tabuleiro : public ntf::Receptor {
   * Se manter_entidades for true, as entidades do tabuleiro corrente serao mantidas e as da notificacao serao ignoradas.
   */
   void DeserializaTabuleiro(const ntf::Notificacao& notificacao);
+  /** Cria as entidades da deserializacao em duas fases: primeiro em paralelo (copia do proto e extracao dos VBOs), depois
+  * na thread principal (notificacoes e insercao no mapa; com todas inseridas, gravacao dos VBOs, dados e
+  * RecomputaDependencias, na ordem da notificacao). Os ids ja devem ser unicos.
+  */
+  void CriaEntidadesDeserializadas(const std::vector<EntidadeProto>& protos);
 
   /** Deserializa apenas a parte de propriedades. */
   void DeserializaPropriedades(const ent::TabuleiroProto& novo_proto);
@@ -1145,6 +1236,10 @@ class Tabuleiro : public ntf::Receptor {
 
   /** Faz o picking do controle virtual, recebendo o id do objeto pressionado. */
   void PickingControleVirtual(int x, int y, bool alterna_selecao, bool duplo, int id, bool forca_selecao);
+  /** Se o picking dos botoes do controle virtual pode ser feito pelos retangulos do ultimo quadro, sem desenho de
+  * selecao. Nao pode se o controle nao estiver sendo desenhado ou se houver interface grafica aberta por cima.
+  */
+  bool UsaPickingControleVirtual2d() const;
   void ModificarLuminanciaTabuleiro(const DadosBotao& db, int x, TabuleiroProto* tabuleiro) const;
   void ModificarInclinacaoLuzDirecionalTabuleiro(const DadosBotao& db, int x, TabuleiroProto* tabuleiro) const;
 
@@ -1158,6 +1253,8 @@ class Tabuleiro : public ntf::Receptor {
   bool AtualizaBotaoControleVirtual(
       DadosBotao* db,
       const std::unordered_map<int, std::function<bool(const Entidade*)>>& mapa_botoes, const Entidade* entidade);
+  /** Mapeia id do botao para a funcao de estado. A entidade recebida vem da funcao EntidadePrimeiraPessoaOuSelecionada. */
+  std::unordered_map<int, std::function<bool(const Entidade*)>> MapaEstadoBotoesControleVirtual();
   /** Alguns botoes ficam invisiveis em algumas situacoes, por exemplo, ataque automatico. */
   bool BotaoVisivel(const DadosBotao& db) const;
   /** Caso o botao tenha um estado associado (como uma variavel booleana), retorna. Caso contrario, retorna false. */
@@ -1167,11 +1264,6 @@ class Tabuleiro : public ntf::Receptor {
   /** Retorna o rotulo de um botao do controle virtual. */
   std::string RotuloBotaoControleVirtual(const DadosBotao& db, const Entidade* entidade) const;
 
-  void DesenhaBotaoControleVirtual(
-      const DadosBotao& db, const GLint* viewport, float padding, float largura_botao, float altura_botao, const Entidade* entidade);
-  void DesenhaRotuloBotaoControleVirtual(
-      const DadosBotao& db, const GLint* viewport, float fonte_x, float fonte_y, float padding,
-      float largura_botao, float altura_botao, const Entidade* entidade);
   void DesenhaDicaBotaoControleVirtual(
       const DadosBotao& db, const GLint* viewport, float fonte_x, float fonte_y, float padding, float largura_botao, float altura_botao,
       const Entidade* entidade);
@@ -1218,6 +1310,10 @@ class Tabuleiro : public ntf::Receptor {
   void ConfiguraProjecaoMapeamentoOclusaoLuzes();
   /** Configura o olho, de acordo com o tipo de camera. */
   void ConfiguraOlhar();
+  /** Posicao e alvo do olho para o desenho: interpolados entre o passo anterior e o atual (ver
+  * AlteraFracaoPassoDesenho), ou os atuais. Em picking, sempre os atuais.
+  */
+  void OlhoParaDesenho(Posicao* pos, Posicao* alvo) const;
   void ConfiguraOlharMapeamentoSombrasLuzDirecional();
   void ConfiguraOlharMapeamentoNeve();
   void ConfiguraOlharMapeamentoOclusao();
@@ -1230,6 +1326,14 @@ class Tabuleiro : public ntf::Receptor {
 
   /** Regera o Vertex Buffer Object do tabuleiro. Deve ser chamado sempre que houver uma alteracao de tamanho ou textura. */
   void RegeraVboTabuleiro();
+  /** Regera apenas os pedacos do terreno cujos pontos (ou vizinhos, por causa das normais) mudaram desde a ultima
+  * gravacao. Usado pelas edicoes de relevo. Se a topologia mudou, regera tudo.
+  */
+  void RegeraVboTerrenoAlterado();
+  /** Regera os VBOs de terreno e grade de um pedaco. */
+  void RegeraVboPedacoTerreno(int indice_pedaco);
+  /** Desenha os pedacos do terreno (ou da grade) que estiverem dentro do tronco de visao corrente. */
+  void DesenhaPedacosTerreno(bool grade) const;
 
   /** Ggera o Vbo da caixa do ceu, chamado apenas uma vez ja que o objeto da caixa nao muda (apenas a textura pode mudar). */
   void GeraVboCaixaCeu();
@@ -1252,6 +1356,8 @@ class Tabuleiro : public ntf::Receptor {
 
   /** Retorna a altura de um ponto de quadrado do tabuleiro (SW) ou zero se invalido. */
   float AlturaPonto(int x_quad, int y_quad) const;
+  /** Retorna o cache de alturas do cenario corrente, regerando se necessario. */
+  const CacheAlturasTerreno& CacheAlturas() const;
 
   /** Retorna a acao padrao especificada ou proto vazio se nao houver indice. */
   const AcaoProto& AcaoPadrao(int indice) const;
@@ -1288,6 +1394,20 @@ class Tabuleiro : public ntf::Receptor {
   // Chamado ao atacar um alvo, possivelmente alterando a esquiva.
   void AtualizaEsquivaAoAtacar(const Entidade& entidade_origem, unsigned int id_destino, ntf::Notificacao* grupo_desfazer);
 
+  // O terreno eh dividido em pedacos de TAMANHO_PEDACO_TERRENO quadrados de lado, cada um com seus VBOs.
+  struct PedacoTerreno {
+    // Quadrados cobertos pelo pedaco: [x_inicial, x_final) e [y_inicial, y_final).
+    int x_inicial = 0;
+    int y_inicial = 0;
+    int x_final = 0;
+    int y_final = 0;
+    // Limites de altura do pedaco, para o teste contra o tronco de visao.
+    float z_min = 0.0f;
+    float z_max = 0.0f;
+    gl::VbosGravados vbos_terreno;
+    gl::VbosGravados vbos_grade;
+  };
+
   struct DadosFramebuffer {
     ~DadosFramebuffer();
     void Apaga();
@@ -1350,7 +1470,7 @@ class Tabuleiro : public ntf::Receptor {
   /** Entidade detalhada: mouse parado sobre ela. */
   unsigned int id_entidade_detalhada_;
   unsigned int tipo_entidade_detalhada_;
-  // TODO sera que da pra usar ciclos_para_atualizar aqui?
+  // TODO sera que da pra usar ms_para_atualizar aqui?
   int temporizador_detalhamento_ms_;
 
   /** quadrado selecionado (pelo id de desenho). */
@@ -1381,8 +1501,11 @@ class Tabuleiro : public ntf::Receptor {
   float primeiro_y_3d_;
   float primeiro_z_3d_;
 
-  /** Quantos ciclos faltam para atualizar posicoes parciais. Atualiza em zero. -1 desliga. */
-  int ciclos_para_atualizar_;
+  /** Quanto tempo de simulacao (passou_ms de AtualizaPorTemporizacao) falta para atualizar posicoes parciais ou o
+  * terreno para os clientes. Atualiza ao chegar a zero, independente do fps. -1 desliga. */
+  int ms_para_atualizar_;
+  constexpr static int kIntervaloMovimentosParciaisMs = 333;
+  constexpr static int kIntervaloTerrenoParaClientesMs = 1000;
 
   /** Dimensoes do viewport. */
   int largura_;
@@ -1434,7 +1557,7 @@ class Tabuleiro : public ntf::Receptor {
   std::list<unsigned int> ids_camera_presa_;  // A quais entidade a camera esta presa.
   std::map<unsigned int, Olho> camera_por_id_;  // A camera de cada identificador.
 
-  std::list<std::string> log_eventos_;
+  BufferLogEventos log_eventos_;
   std::unordered_map<std::string, std::string> log_eventos_clientes_;
   int pagina_log_eventos_;
   int pagina_horizontal_log_eventos_;
@@ -1460,6 +1583,35 @@ class Tabuleiro : public ntf::Receptor {
   } translacao_rotacao_;
   // Para desfazer translacao rotacao escalas.
   std::unordered_map<unsigned int, EntidadeProto> translacoes_rotacoes_escalas_antes_;
+  // Ultimo movimento enviado por RefrescaMovimentosParciais, por entidade, para nao reenviar o que nao mudou.
+  std::unordered_map<unsigned int, MovimentoQuantizado> movimentos_replicados_;
+  // Ver AlteraNumThreadsCarga.
+  int num_threads_carga_ = 0;
+  // Ver AlteraDesenhoInstanciado.
+  bool desenho_instanciado_ = true;
+  // Ver AlteraDescarteTroncoVisao.
+  bool descarte_tronco_visao_ = true;
+  // Ver AlteraSemGrafico.
+  bool sem_grafico_ = false;
+  // Ver AlteraPassoFixoMs e AlteraFracaoPassoDesenho.
+  int passo_fixo_ms_ = 0;
+  float fracao_passo_desenho_ = 1.0f;
+  // Olho no inicio do ultimo passo de simulacao, para a interpolacao.
+  Posicao olho_pos_anterior_;
+  Posicao olho_alvo_anterior_;
+  bool olho_anterior_valido_ = false;
+  // Ver AlteraIdRedeMestreAutomatico.
+  std::string id_rede_mestre_automatico_;
+  LotesInstancias lotes_instancias_;
+  // Lotes das acoes solidas e translucidas (ver DesenhaAcoes).
+  LotesAcoes lotes_acoes_;
+  LotesAcoes lotes_acoes_translucidas_;
+  SalvamentoAutomatico salvamento_automatico_;
+  int temporizador_salvamento_automatico_ms_ = 0;
+  InteresseClientes interesse_clientes_;
+  // Ultimo interesse informado ao servidor pelo cliente (ver InformaInteresseSeMudou).
+  ntf::InteresseCliente interesse_informado_;
+  bool interesse_informado_valido_ = false;
 
   // Usada para notificacoes de desfazer que comecam em um estado e terminam em outro.
   ntf::Notificacao notificacao_desfazer_;
@@ -1494,16 +1646,19 @@ class Tabuleiro : public ntf::Receptor {
   /** Histograma de timer por entidade. */
   std::unordered_map<std::string, Histograma> histograma_por_entidade_;
 
-  // Listas que armazenam os ultimos tempos computados pelos timers.
-  std::list<uint64_t> tempos_entre_cenas_;    // timer_entre_cenas_
-  std::list<uint64_t> tempos_uma_renderizacao_completa_;  // timer_uma_renderizacao_completa_
-  std::list<uint64_t> tempos_renderizacao_mapas_;   // timer_renderizacao_mapas_.
-  std::list<uint64_t> tempos_uma_atualizacao_;   // timer_uma_atualizacao_
-  std::list<uint64_t> tempos_uma_renderizacao_controle_virtual_;   // timer_uma_atualizacao_controle_virtual_.
-  std::list<uint64_t> tempos_atualiza_parcial_;
+  // Buffers circulares com os ultimos tempos computados pelos timers (mais recente na frente).
+  constexpr static unsigned int kMaximoTamTempos = 10;
+  boost::circular_buffer<uint64_t> tempos_entre_cenas_{kMaximoTamTempos};    // timer_entre_cenas_
+  boost::circular_buffer<uint64_t> tempos_uma_renderizacao_completa_{kMaximoTamTempos};  // timer_uma_renderizacao_completa_
+  boost::circular_buffer<uint64_t> tempos_renderizacao_mapas_{kMaximoTamTempos};   // timer_renderizacao_mapas_.
+  boost::circular_buffer<uint64_t> tempos_uma_atualizacao_{kMaximoTamTempos};   // timer_uma_atualizacao_
+  boost::circular_buffer<uint64_t> tempos_uma_renderizacao_controle_virtual_{kMaximoTamTempos};   // timer_uma_atualizacao_controle_virtual_.
+  boost::circular_buffer<uint64_t> tempos_atualiza_parcial_{kMaximoTamTempos};
 
   // Modo de depuracao do tabuleiro.
   bool modo_debug_ = false;
+  // Se o perfilador foi ligado pelo modo de depuracao (e nao por --perfil), para desliga-lo ao sair dele.
+  bool perfil_ligado_pelo_debug_ = false;
 
   // Se verdadeiro, todas entidades serao consideradas detalhadas durante o desenho. */
   bool detalhar_todas_entidades_ = false;
@@ -1524,8 +1679,15 @@ class Tabuleiro : public ntf::Receptor {
   // Se o botão de luz do tabuleiro controla ambiente ou direcional.
   bool mostrar_luz_ambiente_ = false;
 
-  gl::VbosGravados vbos_tabuleiro_;
-  gl::VbosGravados vbos_grade_;
+  std::vector<PedacoTerreno> pedacos_terreno_;
+  int num_pedacos_terreno_x_ = 0;
+  // Topologia e pontos usados na ultima gravacao dos pedacos, para saber o que mudou.
+  int id_cenario_pedacos_terreno_ = CENARIO_INVALIDO;
+  int tam_x_pedacos_terreno_ = 0;
+  int tam_y_pedacos_terreno_ = 0;
+  std::vector<double> pontos_terreno_gravados_;
+  // Alturas do terreno do cenario corrente, invalidado a cada alteracao de relevo. Ver CacheAlturas.
+  mutable CacheAlturasTerreno cache_alturas_;
   gl::VboGravado vbo_caixa_ceu_;
   gl::VboGravado vbo_cubo_;
   gl::VboGravado vbo_rosa_;
@@ -1562,6 +1724,9 @@ class Tabuleiro : public ntf::Receptor {
   // Controle virtual.
   ControleVirtualProto controle_virtual_;
   std::map<IdBotao, const DadosBotao*> mapa_botoes_controle_virtual_;
+  std::unordered_map<int, std::function<bool(const Entidade*)>> mapa_estado_botoes_controle_virtual_;
+  // Geometria dos botoes do ultimo quadro, refeita apenas para os que mudaram.
+  ControleVirtualRetido controle_virtual_retido_;
   struct DeslizeControleVirtual {
     int id_controle;
   };
@@ -1583,6 +1748,10 @@ class Tabuleiro : public ntf::Receptor {
   int temporizador_info_geral_ms_ = 0;
 
   std::vector<Entidade*> entidades_ordenadas_;
+  // Esferas de desenho de entidades_ordenadas_, calculadas uma vez por ordenacao e usadas por todos os passos.
+  std::vector<EsferaEnvolvente> esferas_ordenadas_;
+  // Indices em entidades_ordenadas_ do passo corrente (ver FiltraEntidadesVisiveis).
+  std::vector<int> indices_visiveis_;
 
   ntf::Notificacao notificacao_selecao_transicao_;
   ntf::Notificacao notificacao_doacao_;
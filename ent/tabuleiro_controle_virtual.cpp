@@ -95,6 +95,7 @@ void CorBotao(const DadosBotao& db, float cor[3]) {
 }  // namespace
 
 void Tabuleiro::IniciaGlControleVirtual() {
+  controle_virtual_retido_.Limpa();
   for (auto& pagina : *controle_virtual_.mutable_pagina()) {
     for (auto& db : *pagina.mutable_dados_botoes()) {
       db.clear_id_textura();
@@ -107,6 +108,8 @@ void Tabuleiro::IniciaGlControleVirtual() {
 
 void Tabuleiro::CarregaControleVirtual() {
   const char* ARQUIVO_CONTROLE_VIRTUAL = "controle_virtual.asciiproto";
+  // Os botoes retidos apontam para o controle antigo.
+  controle_virtual_retido_.Limpa();
   try {
     arq::LeArquivoAsciiProto(arq::TIPO_DADOS, ARQUIVO_CONTROLE_VIRTUAL, &controle_virtual_);
   } catch (const arq::ParseProtoException& erro) {
@@ -271,6 +274,139 @@ Matrix4 MatrizSlider(const DadosBotao& db, float estado, const GLint* viewport,
   return m;
 }
 
+// Rotulo centralizado em (x, y), como pontos, no formato de gl::DesenhaString.
+gl::VbosNaoGravados VbosRotulo(
+    const std::string& rotulo, int x, int y, int largura_fonte, float escala, const float cor[4]) {
+  std::vector<gl::VboNaoGravado> vbos;
+  vbos.reserve(rotulo.size());
+  const float translacao_x = -static_cast<float>(rotulo.size() * largura_fonte) / 2.0f;
+  for (unsigned int i = 0; i < rotulo.size(); ++i) {
+    gl::VboNaoGravado vbo = gl::VboCaractere(static_cast<unsigned char>(rotulo[i]));
+    vbo.Translada(translacao_x + i * largura_fonte, 0.0f, 0.0f);
+    vbo.Escala(escala, escala, 1.0f);
+    vbo.Translada(x, y, 0.0f);
+    vbo.AtribuiCor(cor[0], cor[1], cor[2], cor[3]);
+    vbos.emplace_back(std::move(vbo));
+  }
+  gl::VbosNaoGravados ret;
+  for (auto& vbo : vbos) {
+    ret.Concatena(&vbo);
+  }
+  return ret;
+}
+
+// Gera a geometria do botao em coordenadas de janela, a partir do estado. Eh o que antes era feito a cada quadro, com
+// matrizes e chamadas de desenho por botao.
+void GeraGeometriaBotaoControleVirtual(const LeiauteControleVirtual& leiaute, BotaoRetido* botao) {
+  const auto& estado = botao->estado;
+  const DadosBotao& db = *estado.db;
+  const GLint viewport[4] = { 0, 0, leiaute.largura, leiaute.altura };
+  const float fonte_x = static_cast<int>(leiaute.largura_fonte * leiaute.escala);
+  const float fonte_y = static_cast<int>(leiaute.altura_fonte * leiaute.escala);
+  const float unidade_altura = fonte_y * MULTIPLICADOR_ALTURA;
+  const float unidade_largura = fonte_x * MULTIPLICADOR_LARGURA;
+  const float padding = fonte_x / 4;
+  const bool escondido = db.mestre_apenas() && !leiaute.visao_mestre;
+
+  botao->selecionavel = !escondido && db.forma() != FORMA_NULA;
+  botao->id_textura = GL_INVALID_VALUE;
+  botao->fundo = gl::VboNaoGravado();
+  botao->marcador = gl::VboNaoGravado();
+  botao->rotulo = gl::VbosNaoGravados();
+  if (!botao->selecionavel) {
+    return;
+  }
+  float cor[4] = { estado.cor[0], estado.cor[1], estado.cor[2], 1.0f };
+  if (leiaute.modo_debug) {
+    cor[0] = 1.0f; cor[1] = 0.0f; cor[2] = 0.0f; cor[3] = 0.2f;
+  }
+  if (db.forma() == FORMA_RETANGULO || db.forma() == FORMA_SLIDER) {
+    // Retangulo de picking sem padding, como no desenho de selecao.
+    Matrix4 matriz_picking = MatrizBotao(db, viewport, /*padding=*/0, unidade_largura, unidade_altura);
+    Vector4 bl = matriz_picking * Vector4(-0.5f, -0.5f, 0.0f, 1.0f);
+    Vector4 ur = matriz_picking * Vector4(0.5f, 0.5f, 0.0f, 1.0f);
+    botao->retangulo[0] = bl.x;
+    botao->retangulo[1] = bl.y;
+    botao->retangulo[2] = ur.x;
+    botao->retangulo[3] = ur.y;
+    botao->fundo = gl::VboRetangulo(1.0f);
+    botao->fundo.Multiplica(MatrizBotao(db, viewport, padding, unidade_largura, unidade_altura));
+    botao->id_textura = estado.id_textura;
+    if (db.forma() == FORMA_SLIDER) {
+      botao->marcador = gl::VboTriangulo(1.0f);
+      botao->marcador.Multiplica(MatrizSlider(db, estado.slider, viewport, padding, unidade_largura, unidade_altura));
+      botao->marcador.AtribuiCor(1.0f, 0.0f, 0.0f, 1.0f);
+    }
+  } else {
+    float xi, xf, yi, yf;
+    xi = TranslacaoX(db, viewport, unidade_largura);
+    float largura_botao = db.has_tamanho() ? db.tamanho() : db.largura();
+    float altura_botao = db.has_tamanho() ? db.tamanho() : db.altura();
+    xf = xi + largura_botao * unidade_largura;
+    yi = TranslacaoY(db, viewport, unidade_altura);
+    yf = yi + altura_botao * unidade_altura;
+    const float transx = ((xi + xf) / 2.0f) + (db.translacao_x() * unidade_largura);
+    const float transy = ((yi + yf) / 2.0f) + (db.translacao_y() * unidade_altura);
+    const float lado_2 = (xf - xi) / 2.0f;
+    botao->retangulo[0] = transx - lado_2;
+    botao->retangulo[1] = transy - lado_2;
+    botao->retangulo[2] = transx + lado_2;
+    botao->retangulo[3] = transy + lado_2;
+    Matrix4 m;
+    m.rotateZ(db.rotacao_graus());
+    m.scale(xf - xi, xf - xi, 1.0f);
+    m.translate(transx, transy, 0.0f);
+    if (db.forma() == FORMA_TRIANGULO) {
+      botao->fundo = gl::VboTriangulo(1.0f);
+      botao->id_textura = estado.id_textura;
+    } else {
+      botao->fundo = gl::VboDisco(0.5f, 12);
+    }
+    botao->fundo.Multiplica(m);
+  }
+  if (db.picking_apenas()) {
+    botao->fundo = gl::VboNaoGravado();
+    botao->id_textura = GL_INVALID_VALUE;
+  } else {
+    botao->fundo.AtribuiCor(cor[0], cor[1], cor[2], cor[3]);
+  }
+}
+
+// Rotulo do botao, se houver. Separado da geometria porque botoes sem forma tambem podem ter rotulo.
+void GeraRotuloBotaoControleVirtual(const LeiauteControleVirtual& leiaute, BotaoRetido* botao) {
+  const auto& estado = botao->estado;
+  const DadosBotao& db = *estado.db;
+  if (leiaute.modo_debug || estado.rotulo.empty() || estado.id_textura != GL_INVALID_VALUE ||
+      (db.mestre_apenas() && !leiaute.visao_mestre)) {
+    return;
+  }
+  const GLint viewport[4] = { 0, 0, leiaute.largura, leiaute.altura };
+  const float fonte_x = static_cast<int>(leiaute.largura_fonte * leiaute.escala);
+  const float fonte_y = static_cast<int>(leiaute.altura_fonte * leiaute.escala);
+  const float unidade_altura = fonte_y * MULTIPLICADOR_ALTURA;
+  const float unidade_largura = fonte_x * MULTIPLICADOR_LARGURA;
+  float largura_botao = db.has_largura() ? db.largura() : db.tamanho();
+  float altura_botao = db.has_altura() ? db.altura() : db.tamanho();
+  float xi, xf, yi, yf;
+  xi = TranslacaoX(db, viewport, unidade_largura);
+  xf = xi + largura_botao * unidade_largura;
+  yi = TranslacaoY(db, viewport, unidade_altura);
+  yf = yi + altura_botao * unidade_altura;
+  float x_meio = (xi + xf) / 2.0f;
+  float y_meio = (yi + yf) / 2.0f;
+  float y_base = y_meio - (fonte_y / 4.0f);
+  float cor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+  if (db.cor_rotulo().has_r() || db.cor_rotulo().has_g() || db.cor_rotulo().has_b()) {
+    cor[0] = db.cor_rotulo().r();
+    cor[1] = db.cor_rotulo().g();
+    cor[2] = db.cor_rotulo().b();
+  }
+  int max_caracteres = (largura_botao * unidade_largura) / fonte_x;
+  botao->rotulo = VbosRotulo(
+      estado.rotulo.substr(0, std::max(max_caracteres, 0)), static_cast<int>(x_meio), static_cast<int>(y_base),
+      leiaute.largura_fonte, leiaute.escala, cor);
+}
+
 }  // namespace
 
 void Tabuleiro::PickingControleVirtual(int x, int y, bool alterna_selecao, bool duplo, int id, bool forcar_selecao) {
@@ -714,18 +850,18 @@ void Tabuleiro::PickingControleVirtual(int x, int y, bool alterna_selecao, bool
       break;
     case CONTROLE_RODADA:
       if (!alterna_selecao) {
+        ntf::ArenaAcao arena(central_);
         if (!duplo) {
-          auto grupo = NovoGrupoNotificacoes();
+          auto grupo = NovoGrupoNotificacoes(arena.arena());
           PreenchePassaUmaRodada(/*passar_para_todos=*/true, grupo.get(), nullptr, /*expira_eventos_zerados=*/false);
           TrataNotificacao(*grupo);
           AdicionaNotificacaoListaEventos(*grupo);
         } else {
           // O clique duplo tera passado uma rodada já.
           // Tem um bug aqui que precisara de 2 desfazer para desfazer o duplo clique, mas ok.
-          auto grupo = NovoGrupoNotificacoes();
-          auto grupo_desfazer = NovoGrupoNotificacoes();
+          auto grupo_desfazer = NovoGrupoNotificacoes(arena.arena());
           for (int i = 0; i < 9; ++i) {
-            auto grupo = NovoGrupoNotificacoes();
+            auto grupo = NovoGrupoNotificacoes(arena.arena());
             PreenchePassaUmaRodada(/*passar_para_todos=*/true, grupo.get(), grupo_desfazer.get(), /*expira_eventos_zerados=*/false);
             // Tem que ir fazendo rodada a rodada para as entidades irem sendo atualizadas corretamente.
             TrataNotificacao(*grupo);
@@ -1196,84 +1332,6 @@ unsigned int Tabuleiro::TexturaBotao(const DadosBotao& db, const Entidade* entid
   return GL_INVALID_VALUE;
 }
 
-void Tabuleiro::DesenhaBotaoControleVirtual(
-    const DadosBotao& db, const GLint* viewport, float padding, float unidade_largura, float unidade_altura, const Entidade* entidade) {
-  if ((db.picking_apenas() && !parametros_desenho_.has_picking_x()) ||
-      (db.mestre_apenas() && !VisaoMestre()) ||
-      db.forma() == FORMA_NULA) {
-    return;
-  }
-  gl::CarregaNome(db.id());
-  gl::MatrizEscopo salva;
-  if (db.forma() == FORMA_RETANGULO) {
-    unsigned int id_textura = TexturaBotao(db, entidade);
-    if (parametros_desenho_.desenha_texturas() && id_textura != GL_INVALID_VALUE) {
-      gl::Habilita(GL_TEXTURE_2D);
-      gl::LigacaoComTextura(GL_TEXTURE_2D, id_textura);
-    }
-    Matrix4 matriz_botao = MatrizBotao(db, viewport, padding, unidade_largura, unidade_altura);
-    gl::MultiplicaMatriz(matriz_botao.get());
-    gl::AtualizaMatrizes();
-    gl::RetanguloUnitario();
-    gl::LigacaoComTextura(GL_TEXTURE_2D, 0);
-    gl::Desabilita(GL_TEXTURE_2D);
-  } else if (db.forma() == FORMA_SLIDER) {
-    {
-      gl::MatrizEscopo salva;
-      unsigned int id_textura = TexturaBotao(db, entidade);
-      if (parametros_desenho_.desenha_texturas() && id_textura != GL_INVALID_VALUE) {
-        gl::Habilita(GL_TEXTURE_2D);
-        gl::LigacaoComTextura(GL_TEXTURE_2D, id_textura);
-      }
-      Matrix4 matriz_botao = MatrizBotao(db, viewport, padding, unidade_largura, unidade_altura);
-      gl::MultiplicaMatriz(matriz_botao.get());
-      gl::AtualizaMatrizes();
-      gl::RetanguloUnitario();
-      gl::LigacaoComTextura(GL_TEXTURE_2D, 0);
-      gl::Desabilita(GL_TEXTURE_2D);
-    }
-    gl::MudaCor(1.0f, 0.0f, 0.0f, 1.0f);
-    Matrix4 matriz_slider = MatrizSlider(db, EstadoSlider(db.id()), viewport, padding, unidade_largura, unidade_altura);
-    gl::MultiplicaMatriz(matriz_slider.get());
-    gl::AtualizaMatrizes();
-    gl::TrianguloUnitario();     
-  } else {
-    float xi, xf, yi, yf;
-    xi = TranslacaoX(db, viewport, unidade_largura);
-    float largura_botao = db.has_tamanho() ? db.tamanho() : db.largura();
-    float altura_botao = db.has_tamanho() ? db.tamanho() : db.altura();
-    xf = xi + largura_botao * unidade_largura;
-    yi = TranslacaoY(db, viewport, unidade_altura);
-    yf = yi + altura_botao * unidade_altura;
-
-    Matrix4 m;
-    float transx = ((xi + xf) / 2.0f) + (db.translacao_x() * unidade_largura);
-    float transy = ((yi + yf) / 2.0f) + (db.translacao_y() * unidade_altura);
-    if (db.forma() == FORMA_TRIANGULO) {
-      unsigned int id_textura = TexturaBotao(db, entidade);
-      if (parametros_desenho_.desenha_texturas() && id_textura != GL_INVALID_VALUE) {
-        gl::Habilita(GL_TEXTURE_2D);
-        gl::LigacaoComTextura(GL_TEXTURE_2D, id_textura);
-      }
-      m.rotateZ(db.rotacao_graus());
-      m.scale(xf - xi, xf - xi, 1.0f);
-      m.translate(transx, transy, 0.0f);
-      gl::MultiplicaMatriz(m.get());
-      gl::AtualizaMatrizes();
-      gl::TrianguloUnitario();
-      gl::LigacaoComTextura(GL_TEXTURE_2D, 0);
-      gl::Desabilita(GL_TEXTURE_2D);
-    } else {
-      m.rotateZ(db.rotacao_graus());
-      m.scale((xf - xi), (xf - xi), 1.0f);
-      m.translate(transx, transy, 0.0f);
-      gl::MultiplicaMatriz(m.get());
-      gl::AtualizaMatrizes();
-      gl::DiscoUnitario();
-    }
-  }
-}
-
 bool Tabuleiro::EstadoBotao(IdBotao id) const {
   switch (id) {
     case CONTROLE_DANO_AUTOMATICO:
@@ -1524,39 +1582,6 @@ void Tabuleiro::DesenhaDicaBotaoControleVirtual(
   gl::DesenhaString(dica, false);
 }
 
-void Tabuleiro::DesenhaRotuloBotaoControleVirtual(
-    const DadosBotao& db, const GLint* viewport, float fonte_x, float fonte_y, float padding,
-    float unidade_largura, float unidade_altura, const Entidade* entidade) {
-  unsigned int id_textura = TexturaBotao(db, entidade);
-  if (parametros_desenho_.has_picking_x() || id_textura != GL_INVALID_VALUE || (db.mestre_apenas() && !VisaoMestre())) {
-    return;
-  }
-  std::string rotulo = StringSemUtf8(RotuloBotaoControleVirtual(db, entidade));
-  if (rotulo.empty()) {
-    return;
-  }
-
-  float largura_botao = db.has_largura() ? db.largura() : db.tamanho();
-  float altura_botao = db.has_altura() ? db.altura() : db.tamanho();
-  float xi, xf, yi, yf;
-  xi = TranslacaoX(db, viewport, unidade_largura);
-  xf = xi + largura_botao * unidade_largura;
-  yi = TranslacaoY(db, viewport, unidade_altura);
-  yf = yi + altura_botao * unidade_altura;
-  float x_meio = (xi + xf) / 2.0f;
-  float y_meio = (yi + yf) / 2.0f;
-  float y_base = y_meio - (fonte_y / 4.0f);
-  if (db.cor_rotulo().has_r() || db.cor_rotulo().has_g() || db.cor_rotulo().has_b()) {
-    gl::MudaCor(db.cor_rotulo().r(), db.cor_rotulo().g(), db.cor_rotulo().b(), 1.0f);
-  } else {
-    gl::MudaCor(0.0f, 0.0f, 0.0f, 1.0f);
-  }
-  // Adiciona largura de um botao por causa do paginador inicial.
-  int max_caracteres = (largura_botao * unidade_largura) / fonte_x;
-  PosicionaRaster2d(x_meio, y_base);
-  gl::DesenhaString(rotulo.substr(0, max_caracteres));
-}
-
 void Tabuleiro::DesenhaIniciativas() {
   if (indice_iniciativa_ < 0 || iniciativas_.empty()) {
     //LOG(INFO) << "Nao " << indice_iniciativa_ << ", iniciativas_.size " << iniciativas_.size();
@@ -1698,21 +1723,8 @@ void Tabuleiro::DesenhaListaPontosVida() {
   }
 }
 
-void Tabuleiro::DesenhaControleVirtual() {
-  int fonte_x_int, fonte_y_int;
-  float escala;
-  gl::TamanhoFonte(&fonte_x_int, &fonte_y_int, &escala);
-  fonte_x_int *= escala;
-  fonte_y_int *= escala;
-  const float fonte_x = fonte_x_int;
-  const float fonte_y = fonte_y_int;
-  const float altura_botao = fonte_y * MULTIPLICADOR_ALTURA;
-  const float largura_botao = fonte_x * MULTIPLICADOR_LARGURA;
-  //const float largura_botao = altura_botao;
-  const float padding = parametros_desenho_.has_picking_x() ? 0 : fonte_x / 4;
-
-  // Mapeia id do botao para a funcao de estado. A entidade recebida vem da funcao EntidadePrimeiraPessoaOuSelecionada.
-  static const std::unordered_map<int, std::function<bool(const Entidade* entidade)>> mapa_botoes = {
+std::unordered_map<int, std::function<bool(const Entidade*)>> Tabuleiro::MapaEstadoBotoesControleVirtual() {
+  return {
     { CONTROLE_DERRUBAR,          [this] (const Entidade* entidade) {
        return entidade != nullptr && entidade->DadoCorrenteNaoNull().ataque_derrubar();
     } },
@@ -1925,15 +1937,53 @@ void Tabuleiro::DesenhaControleVirtual() {
       return bonus_dano_negativo_;
     }, },
   };
+}
+
+bool Tabuleiro::UsaPickingControleVirtual2d() const {
+  // DetectaColisao desliga o controle nos parametros: o ponto de colisao nao pode acertar um botao.
+  if (!parametros_desenho_.desenha_controle_virtual() || !opcoes_.desenha_controle_virtual() ||
+      controle_virtual_retido_.Vazio()) {
+    return false;
+  }
+  return gui_ == nullptr || !gui_->ElementoAberto();
+}
+
+void Tabuleiro::DesenhaControleVirtual() {
+  int fonte_x_int, fonte_y_int;
+  float escala;
+  gl::TamanhoFonte(&fonte_x_int, &fonte_y_int, &escala);
+  LeiauteControleVirtual leiaute;
+  leiaute.largura_fonte = fonte_x_int;
+  leiaute.altura_fonte = fonte_y_int;
+  leiaute.escala = escala;
+  fonte_x_int *= escala;
+  fonte_y_int *= escala;
+  const float fonte_x = fonte_x_int;
+  const float fonte_y = fonte_y_int;
+  const float altura_botao = fonte_y * MULTIPLICADOR_ALTURA;
+  const float largura_botao = fonte_x * MULTIPLICADOR_LARGURA;
+  const float padding = fonte_x / 4;
+
+  if (mapa_estado_botoes_controle_virtual_.empty()) {
+    mapa_estado_botoes_controle_virtual_ = MapaEstadoBotoesControleVirtual();
+  }
 
   GLint viewport[4];
   gl::Le(GL_VIEWPORT, viewport);
+  leiaute.largura = viewport[2];
+  leiaute.altura = viewport[3];
+  leiaute.modo_debug = controle_virtual_.modo_debug();
+  leiaute.visao_mestre = VisaoMestre();
   gl::MatrizEscopo salva_matriz_2(gl::MATRIZ_MODELAGEM);
 
   // Todos botoes, mapeados por id.
   std::vector<DadosBotao*> botoes;
-  {
-
+  if (parametros_desenho_.has_picking_x()) {
+    // Normalmente o picking dos botoes nem passa por aqui (UsaPickingControleVirtual2d).
+    if (!UsaPickingControleVirtual2d()) {
+      controle_virtual_retido_.DesenhaParaPicking();
+    }
+  } else {
     std::unique_ptr<gl::HabilitaEscopo> blend_escopo;
     if (controle_virtual_.modo_debug()) {
       blend_escopo.reset(new gl::HabilitaEscopo(GL_BLEND));
@@ -1951,29 +2001,35 @@ void Tabuleiro::DesenhaControleVirtual() {
       if (!controle_virtual_.modo_debug() && !BotaoVisivel(db)) continue;
       botoes.push_back(&db);
     }
+    // Estado compacto de cada botao. So os que mudaram desde o ultimo quadro tem a geometria refeita.
     auto* entidade = EntidadePrimeiraPessoaOuSelecionada();
-    for (auto* db : botoes) {
-      float ajuste = AtualizaBotaoControleVirtual(db, mapa_botoes, entidade) ? 0.5f : 1.0f;
-      float cor[3];
-      CorBotao(*db, cor);
-      cor[0] *= ajuste;
-      cor[1] *= ajuste;
-      cor[2] *= ajuste;
-      if (!controle_virtual_.modo_debug()) {
-        gl::MudaCor(cor[0], cor[1], cor[2], 1.0f);
-      } else {
-        gl::MudaCor(1.0f, 0.0f, 0.0f, 0.2f);
+    std::vector<EstadoBotaoControleVirtual> estados(botoes.size());
+    for (unsigned int i = 0; i < botoes.size(); ++i) {
+      auto* db = botoes[i];
+      auto& estado = estados[i];
+      estado.db = db;
+      estado.pressionado = AtualizaBotaoControleVirtual(db, mapa_estado_botoes_controle_virtual_, entidade);
+      float ajuste = estado.pressionado ? 0.5f : 1.0f;
+      CorBotao(*db, estado.cor);
+      estado.cor[0] *= ajuste;
+      estado.cor[1] *= ajuste;
+      estado.cor[2] *= ajuste;
+      estado.id_textura = TexturaBotao(*db, entidade);
+      if (db->forma() == FORMA_SLIDER) {
+        estado.slider = EstadoSlider(db->id());
       }
-      DesenhaBotaoControleVirtual(*db, viewport, padding, largura_botao, altura_botao, entidade);
-      //LOG(INFO) << "timer: " << ((int)(timer_uma_renderizacao_completa_.elapsed().wall / DIV_NANO_PARA_SEGUNDOS)) << ", botao: " << db->dica();
-    }
-
-    // Rotulos dos botoes.
-    if (!controle_virtual_.modo_debug()) {
-      for (const auto* db : botoes) {
-        DesenhaRotuloBotaoControleVirtual(*db, viewport, fonte_x, fonte_y, padding, largura_botao, altura_botao, entidade);
+      if (!controle_virtual_.modo_debug() && estado.id_textura == GL_INVALID_VALUE) {
+        estado.rotulo = StringSemUtf8(RotuloBotaoControleVirtual(*db, entidade));
       }
     }
+    int refeitos = controle_virtual_retido_.Atualiza(leiaute, &estados, [] (const LeiauteControleVirtual& leiaute, BotaoRetido* botao) {
+      GeraGeometriaBotaoControleVirtual(leiaute, botao);
+      GeraRotuloBotaoControleVirtual(leiaute, botao);
+    });
+    if (refeitos > 0) {
+      VLOG(2) << "Controle virtual: " << refeitos << " botoes refeitos";
+    }
+    controle_virtual_retido_.Desenha(parametros_desenho_.desenha_texturas());
   }
 
   // Informacao da entidade primeira pessoa. Uma barra na esquerda, com número abaixo.
@@ -1990,7 +2046,7 @@ void Tabuleiro::DesenhaControleVirtual() {
     DesenhaIniciativas();
   }
 
-  // Desenha dicas por ultimo.
+  // Desenha dicas por ultimo (botoes so eh preenchido fora do picking).
   if (tipo_entidade_detalhada_ == OBJ_CONTROLE_VIRTUAL) {
     auto* entidade = EntidadePrimeiraPessoaOuSelecionada();
     // Dicas.
@@ -77,6 +77,7 @@ class InterfaceGraficaOpengl : public ifg::InterfaceGrafica {
   void FechaElemento() {
     elemento_.reset();
   }
+  bool ElementoAberto() const { return elemento_ != nullptr; }
 
  protected:
   void EscolheItemLista(
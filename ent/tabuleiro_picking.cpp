@@ -126,6 +126,20 @@ void Tabuleiro::EncontraHits(int x, int y, unsigned int* numero_hits, unsigned i
 // Operacoes de picking neste modulo.
 void Tabuleiro::BuscaHitMaisProximo(
     int x, int y, unsigned int* id, unsigned int* tipo_objeto, float* profundidade) {
+  // Botoes do controle virtual: busca nos retangulos do ultimo quadro, sem desenhar a cena.
+  if (UsaPickingControleVirtual2d()) {
+    auto id_botao = controle_virtual_retido_.IdBotaoEm(x, y);
+    if (id_botao.has_value()) {
+      VLOG(1) << "Picking 2d no controle virtual, id: " << *id_botao;
+      *tipo_objeto = OBJ_CONTROLE_VIRTUAL;
+      *id = *id_botao;
+      if (profundidade != nullptr) {
+        // Profundidade do plano z=0 na projecao ortogonal do controle.
+        *profundidade = 0.5f;
+      }
+      return;
+    }
+  }
   GLuint buffer_hits[100] = {0};
   GLuint numero_hits = 0;
   EncontraHits(x, y, &numero_hits, buffer_hits);
@@ -4,106 +4,19 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
-#include <map>
 #include <random>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
 #include "ent/constantes.h"
-#include "log/log.h"
 #include "matrix/matrices.h"
-#include "net/util.h"
 
 namespace ent {
 
-// Coordenada baseada em quadrados. 0,0 esquerda embaixo. 1,1 direita em cima.
-struct XYQuad {
-  int xquad;
-  int yquad;
-  bool xorigem;
-  bool yorigem;
-
-  std::string ParaString() {
-    return std::string("(") + net::to_string(xquad) + ", " + net::to_string(yquad) + "; " +
-            net::to_string(xorigem) + ", " + net::to_string(yorigem) + ")";
-  }
-  bool operator<(const XYQuad& rhs) const {
-    if (xquad < rhs.xquad) {
-      return true;
-    } else if (xquad > rhs.xquad) {
-      return false;
-    } else if (yquad < rhs.yquad) {
-      return true;
-    } else if (yquad > rhs.yquad) {
-      return false;
-    } else if (xorigem && !rhs.xorigem) {
-      return true;
-    } else if (!xorigem && rhs.xorigem) {
-      return false;
-    } else if (yorigem && !rhs.yorigem) {
-      return true;
-    } else if (!yorigem && rhs.yorigem) {
-      return false;
-    } else {
-      // Tudo igual.
-      return false;
-    }
-  }
-};
-
-// Cada XYquad tem seus dados.
-struct DadosPonto {
-  int indice;
-  float x;
-  float y;
-  float z;
-  // normais.
-  float nx;
-  float ny;
-  float nz;
-  // Textura.
-  float s;
-  float t;
-};
-
-// Wrapper sobre vector, repeater_field etc.
-template <class Container>
-class Wrapper {
- public:
-  Wrapper(const Container& c) : c_(c) {}
-  Wrapper(const Wrapper& rhs) : c_(rhs.c_) {}
-  size_t size() const { return c_.size(); }
-  bool empty() const { return c_.empty(); }
-
-  typename Container::value_type operator[] (size_t indice) const {
-    if (c_.empty()) {
-      return 0.0f;
-    }
-    return c_.data()[indice];
-  }
-
- private:
-  Wrapper();
-  const Container& c_;
-};
-
 class Terreno {
  public:
-  // Constroi um terreno flat, com o numero de quadrados passado. O numero de pontos deve incluir a coluna final
-  // leste e a linha final norte, para cobrir o tabuleiro todo.
-  template <class Container>
-  Terreno(int num_x_quad, int num_y_quad, const Wrapper<Container> pontos) {
-    if (!pontos.empty() && pontos.size() != size_t((num_y_quad + 1) * (num_x_quad + 1))) {
-      throw std::logic_error("Numero de pontos invalido.");
-    }
-    inc_s_ = (1.0f / num_x_quad);
-    inc_t_ = (1.0f / num_y_quad);
-    CriaPontos(num_x_quad, num_y_quad, pontos);
-    ComputaNormais(num_x_quad, num_y_quad);
-    CriaMalha(num_x_quad, num_y_quad);
-  }
-
   // Retorna um conjunto de pontos aleatorios para o tamanho passado. Note que o vetor retornado tera um ponto a mais
   // para cada linha, e uma linha a mais no norte.
   static std::vector<double> CriaPontosAleatorios(int num_x_quad, int num_y_quad) {
@@ -119,182 +32,90 @@ class Terreno {
     return pontos;
   }
 
-  // Preenche os vetores de coordenadas dos pontos para OpenGL.
-  void Preenche(std::vector<unsigned short>* indices,
-                std::vector<float>* coordenadas,
-                std::vector<float>* normais,
-                std::vector<float>* texturas) const {
-    indices->insert(indices->end(), indices_.cbegin(), indices_.cend());
-    for (const auto* const ponto : pontos_) {
-      coordenadas->push_back(ponto->x);
-      coordenadas->push_back(ponto->y);
-      coordenadas->push_back(ponto->z);
-      normais->push_back(ponto->nx);
-      normais->push_back(ponto->ny);
-      normais->push_back(ponto->nz);
-      texturas->push_back(ponto->s);
-      texturas->push_back(ponto->t);
-    }
-  }
-
-  // Retorna o indice de um ponto no tabuleiro no proto ponto_terreno.
-  static int IndicePontoTabuleiro(int x_quad, int y_quad, int num_x_quad) {
-    int num_x = num_x_quad + 1;  // borda.
-    return y_quad * num_x + x_quad;
-  }
-
-  /** Retorna a altura de um ponto do tabuleiro, sem interpolar. O ponto eh dado por um x y de quadrado. */
-  static float AlturaPonto(
-      int x_quad, int y_quad, int num_x_quad, int num_y_quad, const double* pontos) {
-    if (x_quad > num_x_quad || y_quad > num_y_quad) {
-      throw std::logic_error("ponto invalido para altura");
-    }
-    return static_cast<float>(pontos[y_quad * (num_x_quad + 1) + x_quad]);
-  }
-
-  /** Retorna a altura do chao em determinado ponto do terreno. Retorna 0 se ponto for invalido. */
-  static float ZChao(float x, float y, int num_x_quad, int num_y_quad, const double* pontos) {
-    // Limites.
-    float lim_x = num_x_quad * TAMANHO_LADO_QUADRADO_2;
-    float lim_y = num_y_quad * TAMANHO_LADO_QUADRADO_2;
-    if (fabs(x) >= lim_x || fabs(y) >= lim_y) {
-      return 0.0f;
-    }
-    try {
-      // Poe x e y com origem em 0,0.
-      x += lim_x;
-      y += lim_y;
-      int x_quad0 = static_cast<int>(x / TAMANHO_LADO_QUADRADO);
-      int x_quad1 = static_cast<int>(std::min<int>(x_quad0 + 1, num_x_quad));
-      int y_quad0 = static_cast<int>(y / TAMANHO_LADO_QUADRADO);
-      int y_quad1 = std::min<int>(y_quad0 + 1, num_y_quad);
-      float zx0y0 = AlturaPonto(x_quad0, y_quad0, num_x_quad, num_y_quad, pontos);
-      float zx1y0 = AlturaPonto(x_quad1, y_quad0, num_x_quad, num_y_quad, pontos);
-      float zx0y1 = AlturaPonto(x_quad0, y_quad1, num_x_quad, num_y_quad, pontos);
-      float zx1y1 = AlturaPonto(x_quad1, y_quad1, num_x_quad, num_y_quad, pontos);
-
-      float dx = fmod(x, TAMANHO_LADO_QUADRADO) / TAMANHO_LADO_QUADRADO;
-      float dy = fmod(y, TAMANHO_LADO_QUADRADO) / TAMANHO_LADO_QUADRADO;
-      //LOG(INFO) << "zx0y0: " << zx0y0 << ", zx1y0: " << zx1y0 << ", zx0y1: " << zx0y1 << ", zx1y1: " << zx1y1
-      //  << ", dx: " << dx << ", dy: " << dy;
-      float z_sul   = (zx1y0 * dx) + (zx0y0 * (1.0f - dx));
-      float z_norte = (zx1y1 * dx) + (zx0y1 * (1.0f - dx));
-      float z_norte_sul = (z_norte * dy) + (z_sul * (1.0f - dy));
-      return z_norte_sul;
-    } catch (const std::logic_error& e) {
-      LOG(ERROR) << e.what();
-      return 0.0f;
-    }
-  }
-
-  static bool Inverte(int x_quad, int y_quad) {
-    return ((x_quad + y_quad) % 2) != 0;
-  }
-
- private:
-  // Verifica se um ponto existe.
-  bool PontoExiste(int x_quad, int y_quad, bool xorigem, bool yorigem) const {
-    return mapa_pontos_.find({x_quad, y_quad, xorigem, yorigem}) != mapa_pontos_.end();
-  }
-
-  // Insere os dados de um ponto na base de dados.
-  void InserePonto(int x_quad, int y_quad, double altura, bool xorigem, bool yorigem) {
-    XYQuad xy = { x_quad, y_quad, xorigem, yorigem };
-    if (PontoExiste(x_quad, y_quad, xorigem, yorigem)) {
-      throw std::logic_error(std::string("Ponto ja existe: ") + xy.ParaString());
+  /** Preenche os vetores de coordenadas OpenGL de um pedaco do terreno, dado pelos pontos [x_inicial, x_final] e
+  * [y_inicial, y_final] (inclusive). As normais dos pontos da borda usam os vizinhos de fora do pedaco, para nao haver
+  * emendas entre pedacos. Os indices sao relativos ao inicio do pedaco. Se pontos for nullptr, o terreno eh plano.
+  */
+  static void PreenchePedaco(
+      int num_x_quad, int num_y_quad, const double* pontos,
+      int x_inicial, int y_inicial, int x_final, int y_final,
+      std::vector<unsigned short>* indices,
+      std::vector<float>* coordenadas,
+      std::vector<float>* normais,
+      std::vector<float>* texturas) {
+    if (x_inicial < 0 || y_inicial < 0 || x_final > num_x_quad || y_final > num_y_quad ||
+        x_inicial >= x_final || y_inicial >= y_final) {
+      throw std::logic_error("Pedaco de terreno invalido.");
     }
-    DadosPonto dp;
-    dp.x = ConverteXQuad(x_quad);
-    dp.y = ConverteYQuad(y_quad);
-    dp.z = static_cast<float>(altura);
-    dp.s = x_quad * inc_s_;
-    dp.t = 1.0f - (y_quad * inc_t_);
-    dp.indice = static_cast<int>(pontos_.size());
-    mapa_pontos_[xy] = std::move(dp);
-    pontos_.push_back(&mapa_pontos_[xy]);
-  }
-
-  // Percorre os pontos, inserindo os dados de cada um.
-  template <class Container>
-  void CriaPontos(int num_x_quad, int num_y_quad, const Wrapper<Container> pontos) {
-    int num_x = num_x_quad + 1;
-    int num_y = num_y_quad + 1;
-    VLOG(1) << "CriaPontos " << num_x << ", " << num_y;
-    if (!pontos.empty() && pontos.size() != size_t(num_x * num_y)) {
-      throw std::logic_error("Numero de pontos invalido na criacao");
-    }
-    // Preenche todas.
-    for (int ytab = 0; ytab < num_y; ++ytab) {
-      for (int xtab = 0; xtab < num_x; ++xtab) {
-        InserePonto(xtab, ytab, pontos[ytab * num_x + xtab], true, true);
-      }
-    }
-  }
-
-  void ComputaNormais(int num_x_quad, int num_y_quad) {
-    int num_x = num_x_quad + 1;
-    int num_y = num_y_quad + 1;
-    for (int ytab = 0; ytab < num_y; ++ytab) {
-      for (int xtab = 0; xtab < num_x; ++xtab) {
-        float esq = mapa_pontos_.find({std::max(xtab - 1, 0), ytab, true, true})->second.z;
-        float dir = mapa_pontos_.find({std::min(xtab + 1, num_x - 1), ytab, true, true})->second.z;
-        float baixo = mapa_pontos_.find({xtab, std::max(ytab - 1, 0), true, true})->second.z;
-        float cima = mapa_pontos_.find({xtab, std::min(ytab + 1, num_y - 1), true, true})->second.z;
+    const int num_x = num_x_quad + 1;
+    const int num_y = num_y_quad + 1;
+    const float inc_s = 1.0f / num_x_quad;
+    const float inc_t = 1.0f / num_y_quad;
+    auto altura = [pontos, num_x] (int x_quad, int y_quad) {
+      return pontos == nullptr ? 0.0f : static_cast<float>(pontos[y_quad * num_x + x_quad]);
+    };
+    const int largura_pedaco = x_final - x_inicial + 1;
+    const int base = static_cast<int>(coordenadas->size() / 3);
+    for (int ytab = y_inicial; ytab <= y_final; ++ytab) {
+      for (int xtab = x_inicial; xtab <= x_final; ++xtab) {
+        coordenadas->push_back(ConverteXQuad(xtab));
+        coordenadas->push_back(ConverteYQuad(ytab));
+        coordenadas->push_back(altura(xtab, ytab));
+        float esq = altura(std::max(xtab - 1, 0), ytab);
+        float dir = altura(std::min(xtab + 1, num_x - 1), ytab);
+        float baixo = altura(xtab, std::max(ytab - 1, 0));
+        float cima = altura(xtab, std::min(ytab + 1, num_y - 1));
         Vector3 n(esq - dir, baixo - cima, 2.0f);
         n.normalize();
-        auto it = mapa_pontos_.find({xtab, ytab, true, true});
-        it->second.nx = n.x;
-        it->second.ny = n.y;
-        it->second.nz = n.z;
+        normais->push_back(n.x);
+        normais->push_back(n.y);
+        normais->push_back(n.z);
+        texturas->push_back(xtab * inc_s);
+        texturas->push_back(1.0f - (ytab * inc_t));
       }
     }
-  }
-
-  void CriaMalha(int num_x_quad, int num_y_quad) {
-    int num_x = num_x_quad + 1;
-    int num_y = num_y_quad + 1;
-    VLOG(1) << "Criando malha " << num_x << ", " << num_y;
-    for (int ytab = 0; ytab < (num_y - 1); ++ytab) {
-      for (int xtab = 0; xtab < (num_x - 1); ++xtab) {
-        VLOG(2) << "Criando quadrado " << xtab << ", " << ytab;
-        bool b0 = true;
-        bool b1 = true;
-        int x0y0 = IndicePonto(xtab,     ytab,     b0, b0);
-        int x1y0 = IndicePonto(xtab + 1, ytab,     b1, b0);
-        int x1y1 = IndicePonto(xtab + 1, ytab + 1, b1, b1);
-        int x0y1 = IndicePonto(xtab    , ytab + 1, b0, b1);
-        indices_.push_back(x0y0);
-        indices_.push_back(x1y0);
+    auto indice = [base, largura_pedaco, x_inicial, y_inicial] (int x_quad, int y_quad) {
+      return static_cast<unsigned short>(base + (y_quad - y_inicial) * largura_pedaco + (x_quad - x_inicial));
+    };
+    for (int ytab = y_inicial; ytab < y_final; ++ytab) {
+      for (int xtab = x_inicial; xtab < x_final; ++xtab) {
+        unsigned short x0y0 = indice(xtab,     ytab);
+        unsigned short x1y0 = indice(xtab + 1, ytab);
+        unsigned short x1y1 = indice(xtab + 1, ytab + 1);
+        unsigned short x0y1 = indice(xtab,     ytab + 1);
+        indices->push_back(x0y0);
+        indices->push_back(x1y0);
         if (Inverte(xtab, ytab)) {
-          indices_.push_back(x0y1);
-          indices_.push_back(x1y0);
+          indices->push_back(x0y1);
+          indices->push_back(x1y0);
         } else {
-          indices_.push_back(x1y1);
-          indices_.push_back(x0y0);
+          indices->push_back(x1y1);
+          indices->push_back(x0y0);
         }
-        indices_.push_back(x1y1);
-        indices_.push_back(x0y1);
+        indices->push_back(x1y1);
+        indices->push_back(x0y1);
       }
     }
   }
 
-  int IndicePonto(int x_quad, int y_quad, bool xorigem, bool yorigem) const {
-    XYQuad xy = { x_quad, y_quad, xorigem, yorigem };
-    auto it = mapa_pontos_.find(xy);
-    if (it == mapa_pontos_.end()) {
-      LOG(ERROR) << "ponto " << x_quad << ", " << y_quad << ", " << xorigem << ", " << yorigem << " nao existe";
-      throw std::logic_error(std::string("Ponto nao existe: ") + net::to_string(x_quad) + " " + net::to_string(y_quad));
-    }
-    return it->second.indice;
+  // Retorna o indice de um ponto no tabuleiro no proto ponto_terreno.
+  static int IndicePontoTabuleiro(int x_quad, int y_quad, int num_x_quad) {
+    int num_x = num_x_quad + 1;  // borda.
+    return y_quad * num_x + x_quad;
   }
 
+  static bool Inverte(int x_quad, int y_quad) {
+    return ((x_quad + y_quad) % 2) != 0;
+  }
+
+ private:
   // Converte um x_quad em uma coordenada.
-  float ConverteXQuad(int x_quad) const {
+  static float ConverteXQuad(int x_quad) {
     return x_quad * TAMANHO_LADO_QUADRADO;
   }
 
   // Converte um y_quad em uma coordenada.
-  float ConverteYQuad(int y_quad) const {
+  static float ConverteYQuad(int y_quad) {
     return y_quad * TAMANHO_LADO_QUADRADO;
   }
 
@@ -319,14 +140,114 @@ class Terreno {
     }
     return mod >= 50 ? -res : res;
   }
+};
+
+/** Cache das alturas do terreno de um cenario, em float. Para cada quadrado, guarda os coeficientes da interpolacao
+* bilinear z = a + b * dx + c * dy + d * dx * dy (dx e dy em [0, 1)), para a consulta nao precisar ler os quatro cantos.
+* Deve ser invalidado sempre que o relevo mudar.
+*/
+class CacheAlturasTerreno {
+ public:
+  /** Retorna true se o cache foi gerado para o cenario e topologia passados e nao foi invalidado. */
+  bool Valido(int id_cenario, int num_x_quad, int num_y_quad, int num_pontos) const {
+    return valido_ && id_cenario == id_cenario_ && num_x_quad == num_x_quad_ && num_y_quad == num_y_quad_ &&
+           num_pontos == num_pontos_;
+  }
+  void Invalida() { valido_ = false; }
+
+  /** Regera o cache a partir dos pontos do proto. Se num_pontos for zero, o terreno eh plano. */
+  void Atualiza(int id_cenario, int num_x_quad, int num_y_quad, const double* pontos, int num_pontos) {
+    valido_ = true;
+    id_cenario_ = id_cenario;
+    num_x_quad_ = num_x_quad;
+    num_y_quad_ = num_y_quad;
+    num_pontos_ = num_pontos;
+    lim_x_ = num_x_quad * TAMANHO_LADO_QUADRADO_2;
+    lim_y_ = num_y_quad * TAMANHO_LADO_QUADRADO_2;
+    alturas_.clear();
+    coeficientes_.clear();
+    if (num_pontos == 0 || num_x_quad <= 0 || num_y_quad <= 0 || num_pontos != (num_x_quad + 1) * (num_y_quad + 1)) {
+      return;
+    }
+    alturas_.assign(pontos, pontos + num_pontos);
+    const int num_x = num_x_quad + 1;
+    coeficientes_.resize(num_x_quad * num_y_quad);
+    for (int y_quad = 0; y_quad < num_y_quad; ++y_quad) {
+      for (int x_quad = 0; x_quad < num_x_quad; ++x_quad) {
+        const float zx0y0 = alturas_[y_quad * num_x + x_quad];
+        const float zx1y0 = alturas_[y_quad * num_x + x_quad + 1];
+        const float zx0y1 = alturas_[(y_quad + 1) * num_x + x_quad];
+        const float zx1y1 = alturas_[(y_quad + 1) * num_x + x_quad + 1];
+        auto& c = coeficientes_[y_quad * num_x_quad + x_quad];
+        c.a = zx0y0;
+        c.b = zx1y0 - zx0y0;
+        c.c = zx0y1 - zx0y0;
+        c.d = zx1y1 - zx1y0 - zx0y1 + zx0y0;
+      }
+    }
+  }
+
+  /** Retorna a altura de um ponto do tabuleiro, sem interpolar, ou zero se invalido. */
+  float AlturaPonto(int x_quad, int y_quad) const {
+    if (alturas_.empty() || x_quad < 0 || y_quad < 0 || x_quad > num_x_quad_ || y_quad > num_y_quad_) {
+      return 0.0f;
+    }
+    return alturas_[y_quad * (num_x_quad_ + 1) + x_quad];
+  }
+
+  /** Retorna a altura do chao em determinado ponto do terreno, interpolando os cantos do quadrado. Retorna 0 fora
+  * do tabuleiro.
+  */
+  float ZChao(float x, float y) const {
+    if (coeficientes_.empty() || fabsf(x) >= lim_x_ || fabsf(y) >= lim_y_) {
+      return 0.0f;
+    }
+    return ZChaoDentro(x, y);
+  }
+
+  /** Versao em lote de ZChao: z[i] = ZChao(x[i], y[i]). Os tres spans devem ter o mesmo tamanho. */
+  void ZChao(std::span<const float> x, std::span<const float> y, std::span<float> z) const {
+    const size_t n = std::min({x.size(), y.size(), z.size()});
+    if (coeficientes_.empty()) {
+      std::fill(z.begin(), z.begin() + n, 0.0f);
+      return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      z[i] = (fabsf(x[i]) >= lim_x_ || fabsf(y[i]) >= lim_y_) ? 0.0f : ZChaoDentro(x[i], y[i]);
+    }
+  }
 
  private:
-  std::map<XYQuad, DadosPonto> mapa_pontos_;  // mapa de pontos, mapeia id quadrado para os dados do ponto.
-  std::vector<DadosPonto*> pontos_;  // pontos de forma sequencia (como ficarao na saida).
-  std::vector<unsigned short> indices_;  // aponta para pontos_.
-  // textura.
-  float inc_s_ = 0.0f;
-  float inc_t_ = 0.0f;
+  // Assume que x, y estao dentro do tabuleiro.
+  float ZChaoDentro(float x, float y) const {
+    constexpr float kInversoLado = 1.0f / TAMANHO_LADO_QUADRADO;
+    const float fx = (x + lim_x_) * kInversoLado;
+    const float fy = (y + lim_y_) * kInversoLado;
+    const int x_quad = std::min(static_cast<int>(fx), num_x_quad_ - 1);
+    const int y_quad = std::min(static_cast<int>(fy), num_y_quad_ - 1);
+    const float dx = fx - x_quad;
+    const float dy = fy - y_quad;
+    const auto& c = coeficientes_[y_quad * num_x_quad_ + x_quad];
+    return c.a + c.b * dx + (c.c + c.d * dx) * dy;
+  }
+
+  // Alinhado para que cada quadrado ocupe meia linha de cache, sem atravessar duas.
+  struct alignas(16) CoeficientesQuadrado {
+    float a;
+    float b;
+    float c;
+    float d;
+  };
+
+  bool valido_ = false;
+  int id_cenario_ = 0;
+  int num_x_quad_ = 0;
+  int num_y_quad_ = 0;
+  int num_pontos_ = 0;
+  float lim_x_ = 0.0f;
+  float lim_y_ = 0.0f;
+  std::vector<float> alturas_;
+  std::vector<CoeficientesQuadrado> coeficientes_;
 };
 
 }  // namespace ent
@@ -326,7 +326,7 @@ void Tabuleiro::TrataInicioPinca(int x1, int y1, int x2, int y2) {
       *proto.mutable_pos() = e->Pos();
       translacoes_rotacoes_escalas_antes_.clear();
       translacoes_rotacoes_escalas_antes_[id].Swap(&proto);
-      ciclos_para_atualizar_ = opcoes_.fps() / 3;
+      ms_para_atualizar_ = kIntervaloMovimentosParciaisMs;
     }
   }
 }
@@ -511,7 +511,7 @@ bool Tabuleiro::TrataMovimentoMouse(int x, int y) {
           return false;
         }
         // Se chegou aqui eh pq mudou de estado. Comeca a temporizar.
-        ciclos_para_atualizar_ = opcoes_.fps() / 3;
+        ms_para_atualizar_ = kIntervaloMovimentosParciaisMs;
       }
       // Deltas desde o ultimo movimento.
       float delta_x = (x - ultimo_x_);
@@ -725,7 +725,7 @@ bool Tabuleiro::TrataMovimentoMouse(int x, int y) {
     case ETAB_QUAD_PRESSIONADO:
       if (modo_clique_ == MODO_TERRENO) {
         estado_ = ETAB_RELEVO;
-        ciclos_para_atualizar_ = opcoes_.fps();
+        ms_para_atualizar_ = kIntervaloTerrenoParaClientesMs;
         notificacao_desfazer_.set_tipo(ntf::TN_ATUALIZAR_RELEVO_TABULEIRO);
         auto* cenario_antes = notificacao_desfazer_.mutable_tabuleiro_antes();
         cenario_antes->set_id_cenario(proto_corrente_->id_cenario());
@@ -798,7 +798,9 @@ void Tabuleiro::FinalizaEstadoCorrente() {
   switch (estado_) {
     case ETAB_ENTS_TRANSLACAO_ROTACAO:
     case ETAB_ESCALANDO_ROTACIONANDO_ENTIDADE_PINCA: {
-      ciclos_para_atualizar_ = -1;
+      ms_para_atualizar_ = -1;
+      // Fim do arrasto: o estado final vai pelas notificacoes normais, e o proximo arrasto reenvia tudo.
+      movimentos_replicados_.clear();
       if (estado_ == ETAB_ENTS_TRANSLACAO_ROTACAO && translacao_rotacao_ == TR_NENHUM) {
         // Nada a fazer.
       } else {
@@ -853,7 +855,8 @@ void Tabuleiro::FinalizaEstadoCorrente() {
       estado_ = estado_anterior_;
       return;
     case ETAB_ENTS_PRESSIONADAS: {
-      ciclos_para_atualizar_ = -1;
+      ms_para_atualizar_ = -1;
+      movimentos_replicados_.clear();
       if (primeiro_x_3d_ == ultimo_x_3d_ &&
           primeiro_y_3d_ == ultimo_y_3d_) {
         // Nao houve movimento.
@@ -943,7 +946,7 @@ void Tabuleiro::FinalizaEstadoCorrente() {
     }
     case ETAB_RELEVO: {
       estado_ = estado_anterior_;
-      ciclos_para_atualizar_ = -1;
+      ms_para_atualizar_ = -1;
       RefrescaTerrenoParaClientes();
       auto* cenario_depois = notificacao_desfazer_.mutable_tabuleiro();
       cenario_depois->set_id_cenario(proto_corrente_->id_cenario());
@@ -2531,23 +2534,24 @@ float Tabuleiro::TrataAcaoUmaEntidade(
     return atraso_s;
   }
 
-  ntf::Notificacao grupo_desfazer;
-  grupo_desfazer.set_tipo(ntf::TN_GRUPO_NOTIFICACOES);
+  // O grupo de desfazer so vive ate ser copiado para a lista de eventos, ao final.
+  ntf::ArenaAcao arena(central_);
+  auto grupo_desfazer = NovoGrupoNotificacoes(arena.arena());
   atraso_s = TrataPreAcaoComum(
-      atraso_s, pos_entidade_destino, pos_tabuleiro, entidade_origem_nao_null, id_entidade_destino, &acao_proto, &grupo_desfazer);
+      atraso_s, pos_entidade_destino, pos_tabuleiro, entidade_origem_nao_null, id_entidade_destino, &acao_proto, grupo_desfazer.get());
 
   if (acao_proto.bem_sucedida()) {
-    auto n = ntf::NovaNotificacao(ntf::TN_ADICIONAR_ACAO);
+    auto n = ntf::NovaNotificacao(ntf::TN_ADICIONAR_ACAO, central_->ArenaCiclo());
     if (acao_proto.tipo() == ACAO_EXPULSAR_FASCINAR_MORTOS_VIVOS) {
-      atraso_s = TrataAcaoExpulsarFascinarMortosVivos(atraso_s, entidade_origem, &acao_proto, n.get(), &grupo_desfazer);
+      atraso_s = TrataAcaoExpulsarFascinarMortosVivos(atraso_s, entidade_origem, &acao_proto, n.get(), grupo_desfazer.get());
     } else if (acao_proto.tipo() == ACAO_CRIACAO_ENTIDADE) {
-      atraso_s = TrataAcaoCriacao(atraso_s, pos_tabuleiro, entidade_origem, &acao_proto, n.get(), &grupo_desfazer);
+      atraso_s = TrataAcaoCriacao(atraso_s, pos_tabuleiro, entidade_origem, &acao_proto, n.get(), grupo_desfazer.get());
     } else if (acao_proto.efeito_projetil_area()) {
-      atraso_s = TrataAcaoProjetilArea(id_entidade_destino, atraso_s, pos_entidade_destino, entidade_origem, &acao_proto, n.get(), &grupo_desfazer);
+      atraso_s = TrataAcaoProjetilArea(id_entidade_destino, atraso_s, pos_entidade_destino, entidade_origem, &acao_proto, n.get(), grupo_desfazer.get());
     } else if (EfeitoArea(acao_proto)) {
-      atraso_s = TrataAcaoEfeitoArea(id_entidade_destino, atraso_s, pos_entidade_destino, entidade_origem, &acao_proto, n.get(), &grupo_desfazer);
+      atraso_s = TrataAcaoEfeitoArea(id_entidade_destino, atraso_s, pos_entidade_destino, entidade_origem, &acao_proto, n.get(), grupo_desfazer.get());
     } else {
-      atraso_s = TrataAcaoIndividual(id_entidade_destino, atraso_s, pos_entidade_destino, entidade_origem, &acao_proto, n.get(), &grupo_desfazer);
+      atraso_s = TrataAcaoIndividual(id_entidade_destino, atraso_s, pos_entidade_destino, entidade_origem, &acao_proto, n.get(), grupo_desfazer.get());
     }
     if (n->has_acao()) {
       // Aqui é importante tratar pela central porque se abriu a UI para preencher alguma coisa,
@@ -2561,8 +2565,8 @@ float Tabuleiro::TrataAcaoUmaEntidade(
 
   // Mesmo nao havendo acao, tem que adicionar a lista de desfazer porque ha efeitos que independem disso.
   // Exemplo: o ataque foi falha critica, gerando uma queda.
-  if (!grupo_desfazer.notificacao().empty()) {
-    AdicionaNotificacaoListaEventos(grupo_desfazer);
+  if (!grupo_desfazer->notificacao().empty()) {
+    AdicionaNotificacaoListaEventos(*grupo_desfazer);
   }
   return atraso_s;
 }
@@ -2952,7 +2956,8 @@ void Tabuleiro::TrataBotaoTransicaoPressionadoPosPicking(int x, int y, bool forc
       return;
     }
     if (forcar) {
-      auto grupo = NovoGrupoNotificacoes();
+      ntf::ArenaAcao arena(central_);
+      auto grupo = NovoGrupoNotificacoes(arena.arena());
       PreencheNotificacoesTransicaoTesouro(tabelas_, *doador, *receptor, grupo.get(), /*n_desfazer=*/nullptr);
       TrataNotificacao(*grupo);
       AdicionaNotificacaoListaEventos(*grupo);
@@ -3397,7 +3402,7 @@ void Tabuleiro::TrataBotaoEsquerdoPressionado(int x, int y, bool alterna_selecao
         rastros_movimento_[id].push_back(pos);
       }
       if (ha_entidades_selecionadas) {
-        ciclos_para_atualizar_ = static_cast<int>(opcoes_.fps() / 3);
+        ms_para_atualizar_ = kIntervaloMovimentosParciaisMs;
         estado_ = ETAB_ENTS_PRESSIONADAS;
       } else {
         MousePara3dParaleloZero(x, y, &x3d, &y3d, &z3d);
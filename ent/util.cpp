@@ -10,6 +10,7 @@
 #include <cstdlib>
 #include <google/protobuf/text_format.h>
 #include <limits>
+#include <mutex>
 #include <queue>
 #include <random>
 #include <set>
@@ -25,6 +26,7 @@
 #include "absl/strings/str_replace.h"
 #include "ent/acoes.h"
 #include "ent/acoes.pb.h"
+#include "ent/bonus.h"
 #include "ent/comum.pb.h"
 #include "ent/constantes.h"
 #include "ent/entidade.h"
@@ -156,6 +158,10 @@ std::unique_ptr<ntf::Notificacao> NovoGrupoNotificacoes() {
   return n;
 }
 
+ntf::PtrNotificacao NovoGrupoNotificacoes(google::protobuf::Arena* arena) {
+  return ntf::NovaNotificacao(ntf::TN_GRUPO_NOTIFICACOES, arena);
+}
+
 std::unique_ptr<ntf::Notificacao> NovaNotificacao(ntf::Tipo tipo, const EntidadeProto& proto) {
   auto n = std::unique_ptr<ntf::Notificacao>(ntf::NovaNotificacao(tipo));
   n->mutable_entidade_antes()->set_id(proto.id());
@@ -163,6 +169,13 @@ std::unique_ptr<ntf::Notificacao> NovaNotificacao(ntf::Tipo tipo, const Entidade
   return n;
 }
 
+ntf::PtrNotificacao NovaNotificacao(ntf::Tipo tipo, const EntidadeProto& proto, google::protobuf::Arena* arena) {
+  auto n = ntf::NovaNotificacao(tipo, arena);
+  n->mutable_entidade_antes()->set_id(proto.id());
+  n->mutable_entidade()->set_id(proto.id());
+  return n;
+}
+
 ntf::Notificacao* NovaNotificacaoFilha(ntf::Tipo tipo, ntf::Notificacao* pai) {
   if (pai->tipo() != ntf::TN_GRUPO_NOTIFICACOES) {
     LOG(WARNING) << "Notificacao pai nao eh grupo, conferir se chamou errado usando pai->add_notificacao().";
@@ -403,6 +416,366 @@ Matrix4 MatrizRotacao(const Vector3& vn) {
   return Matrix4().rotate(acosf(cosang) * RAD_PARA_GRAUS, axis);
 }
 
+TroncoVisao ExtraiTroncoVisao(const Matrix4& matriz) {
+  // Matriz column major: a linha i eh (m[i], m[4 + i], m[8 + i], m[12 + i]).
+  const float* m = matriz.get();
+  auto linha = [m] (int i) { return Vector4(m[i], m[4 + i], m[8 + i], m[12 + i]); };
+  const Vector4 l0 = linha(0), l1 = linha(1), l2 = linha(2), l3 = linha(3);
+  TroncoVisao tronco;
+  tronco.planos[0] = l3 + l0;  // esquerda.
+  tronco.planos[1] = l3 - l0;  // direita.
+  tronco.planos[2] = l3 + l1;  // baixo.
+  tronco.planos[3] = l3 - l1;  // cima.
+  tronco.planos[4] = l3 + l2;  // perto.
+  tronco.planos[5] = l3 - l2;  // longe.
+  for (auto& p : tronco.planos) {
+    float tam = sqrtf(p.x * p.x + p.y * p.y + p.z * p.z);
+    if (tam > 0.0f) {
+      p /= tam;
+    }
+  }
+  return tronco;
+}
+
+bool CaixaForaTroncoVisao(const TroncoVisao& tronco, const Vector3& min, const Vector3& max) {
+  for (const auto& p : tronco.planos) {
+    // Vertice da caixa mais na direcao da normal do plano. Se ele estiver fora, a caixa toda esta.
+    float x = p.x >= 0.0f ? max.x : min.x;
+    float y = p.y >= 0.0f ? max.y : min.y;
+    float z = p.z >= 0.0f ? max.z : min.z;
+    if (p.x * x + p.y * y + p.z * z + p.w < 0.0f) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool EsferaForaTroncoVisao(const TroncoVisao& tronco, const Vector3& centro, float raio) {
+  for (const auto& p : tronco.planos) {
+    if (p.x * centro.x + p.y * centro.y + p.z * centro.z + p.w < -raio) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void FiltraEsferasVisiveis(
+    const TroncoVisao& tronco, const std::vector<EsferaEnvolvente>& esferas, const Vector3& referencia,
+    float distancia_maxima, std::vector<int>* visiveis) {
+  visiveis->clear();
+  for (int i = 0; i < static_cast<int>(esferas.size()); ++i) {
+    const auto& esfera = esferas[i];
+    if (distancia_maxima > 0.0f) {
+      // Compara os quadrados para evitar a raiz.
+      const Vector3 delta = esfera.centro - referencia;
+      const float alcance = distancia_maxima + esfera.raio;
+      if (delta.dot(delta) > alcance * alcance) continue;
+    }
+    if (EsferaForaTroncoVisao(tronco, esfera.centro, esfera.raio)) continue;
+    visiveis->push_back(i);
+  }
+}
+
+MovimentoQuantizado QuantizaMovimento(unsigned int id, const Posicao& pos, float rotacao_z_graus, const Escala& escala) {
+  MovimentoQuantizado m;
+  m.id = id;
+  m.x_cm = static_cast<int>(lroundf(pos.x() * 100.0f));
+  m.y_cm = static_cast<int>(lroundf(pos.y() * 100.0f));
+  m.z_cm = static_cast<int>(lroundf(pos.z() * 100.0f));
+  m.rotacao_z_decigraus = static_cast<int>(lroundf(rotacao_z_graus * 10.0f));
+  m.escala_x_cent = static_cast<int>(lroundf(escala.x() * 100.0f));
+  m.escala_y_cent = static_cast<int>(lroundf(escala.y() * 100.0f));
+  m.escala_z_cent = static_cast<int>(lroundf(escala.z() * 100.0f));
+  return m;
+}
+
+void CompactaMovimentos(
+    const std::vector<MovimentoQuantizado>& movimentos, bool com_rotacao_escala, MovimentosEntidadesProto* proto) {
+  proto->set_com_rotacao_escala(com_rotacao_escala);
+  MovimentoQuantizado anterior;
+  for (const auto& m : movimentos) {
+    // Ids sao sem sinal: o delta eh modular e o inverso tambem.
+    proto->add_delta_id(m.id - anterior.id);
+    proto->add_delta_x_cm(m.x_cm - anterior.x_cm);
+    proto->add_delta_y_cm(m.y_cm - anterior.y_cm);
+    proto->add_delta_z_cm(m.z_cm - anterior.z_cm);
+    if (com_rotacao_escala) {
+      proto->add_delta_rotacao_z_decigraus(m.rotacao_z_decigraus - anterior.rotacao_z_decigraus);
+      proto->add_delta_escala_x_cent(m.escala_x_cent - anterior.escala_x_cent);
+      proto->add_delta_escala_y_cent(m.escala_y_cent - anterior.escala_y_cent);
+      proto->add_delta_escala_z_cent(m.escala_z_cent - anterior.escala_z_cent);
+    }
+    anterior = m;
+  }
+}
+
+std::vector<MovimentoQuantizado> DescompactaMovimentos(const MovimentosEntidadesProto& proto) {
+  const int n = proto.delta_id_size();
+  if (proto.delta_x_cm_size() != n || proto.delta_y_cm_size() != n || proto.delta_z_cm_size() != n) {
+    LOG(ERROR) << "Movimentos compactados inconsistentes: " << proto.ShortDebugString();
+    return {};
+  }
+  if (proto.com_rotacao_escala() &&
+      (proto.delta_rotacao_z_decigraus_size() != n || proto.delta_escala_x_cent_size() != n ||
+       proto.delta_escala_y_cent_size() != n || proto.delta_escala_z_cent_size() != n)) {
+    LOG(ERROR) << "Rotacao e escala compactadas inconsistentes: " << proto.ShortDebugString();
+    return {};
+  }
+  std::vector<MovimentoQuantizado> movimentos(n);
+  MovimentoQuantizado anterior;
+  for (int i = 0; i < n; ++i) {
+    auto& m = movimentos[i];
+    m.id = anterior.id + proto.delta_id(i);
+    m.x_cm = anterior.x_cm + proto.delta_x_cm(i);
+    m.y_cm = anterior.y_cm + proto.delta_y_cm(i);
+    m.z_cm = anterior.z_cm + proto.delta_z_cm(i);
+    if (proto.com_rotacao_escala()) {
+      m.rotacao_z_decigraus = anterior.rotacao_z_decigraus + proto.delta_rotacao_z_decigraus(i);
+      m.escala_x_cent = anterior.escala_x_cent + proto.delta_escala_x_cent(i);
+      m.escala_y_cent = anterior.escala_y_cent + proto.delta_escala_y_cent(i);
+      m.escala_z_cent = anterior.escala_z_cent + proto.delta_escala_z_cent(i);
+    }
+    anterior = m;
+  }
+  return movimentos;
+}
+
+Posicao PosicaoMovimento(const MovimentoQuantizado& movimento) {
+  Posicao pos;
+  pos.set_x(movimento.x_cm / 100.0f);
+  pos.set_y(movimento.y_cm / 100.0f);
+  pos.set_z(movimento.z_cm / 100.0f);
+  return pos;
+}
+
+float RotacaoZGrausMovimento(const MovimentoQuantizado& movimento) {
+  return movimento.rotacao_z_decigraus / 10.0f;
+}
+
+Escala EscalaMovimento(const MovimentoQuantizado& movimento) {
+  Escala escala;
+  escala.set_x(movimento.escala_x_cent / 100.0f);
+  escala.set_y(movimento.escala_y_cent / 100.0f);
+  escala.set_z(movimento.escala_z_cent / 100.0f);
+  return escala;
+}
+
+bool CalculaDeltaRodadaEntidade(const EntidadeProto& proto, bool expira_eventos_zerados, DeltaRodadaEntidade* delta) {
+  delta->id = proto.id();
+  delta->eventos.clear();
+  delta->ataques.clear();
+  for (const auto& evento : proto.evento()) {
+    if (evento.continuo()) continue;
+    if (evento.rodadas() < 0 || (evento.rodadas() == 0 && !expira_eventos_zerados)) continue;
+    if (!evento.has_id_unico()) return false;
+    const int rodadas_depois = evento.rodadas() - 1;
+    // Mesmos casos especiais de AtualizaEventosAoPassarRodada.
+    switch (evento.id_efeito()) {
+      case EFEITO_VENENO:
+      case EFEITO_FLECHA_ACIDA:
+      case EFEITO_PARALISIA:
+        return false;
+      case EFEITO_CONJURANDO:
+      case EFEITO_FURIA_BARBARO:
+      case EFEITO_QUEIMANDO_FOGO_ALQUIMICO:
+        if (rodadas_depois == 0) return false;
+        break;
+      default:
+        break;
+    }
+    DeltaRodadaEntidade::Evento e;
+    e.id_unico = evento.id_unico();
+    e.rodadas_antes = evento.rodadas();
+    e.rodadas_depois = rodadas_depois;
+    if (rodadas_depois < 0) {
+      e.encerrado = evento;
+    }
+    delta->eventos.push_back(std::move(e));
+  }
+
+  // Todas as recusas vem antes de qualquer rolagem: se o caminho completo for usado, os dados rolados aqui
+  // seriam descartados e a sequencia de dados divergiria da reproducao.
+  for (const auto& da : proto.dados_ataque()) {
+    if (da.usos() > 0 && !da.varinha().empty()) return false;
+    // -1 representa ausencia no delta.
+    if (da.disponivel_em() < 0 || da.limite_vezes() < 0) return false;
+  }
+  // Mesma logica de PreencheNotificacaoAtaqueAoPassarRodada, menos varinhas.
+  for (int i = 0; i < proto.dados_ataque_size(); ++i) {
+    const auto& da = proto.dados_ataque(i);
+    DeltaRodadaEntidade::Ataque a;
+    a.indice = i;
+    a.disponivel_em_antes = a.disponivel_em_depois = da.has_disponivel_em() ? da.disponivel_em() : -1;
+    a.limite_vezes_antes = a.limite_vezes_depois = da.has_limite_vezes() ? da.limite_vezes() : -1;
+    a.usado_rodada_antes = a.usado_rodada_depois = da.has_usado_rodada() ? da.usado_rodada() : -1;
+    if (da.has_taxa_refrescamento() && da.usado_rodada() && (!da.has_limite_vezes() || da.limite_vezes() == 0)) {
+      // Trata o caso de ataques consumidos so ao fim da rodada.
+      int valor = 0;
+      try {
+        valor = RolaValor(da.taxa_refrescamento());
+      } catch (const std::exception& e) {
+        LOG(ERROR) << "valor mal formado: " << da.taxa_refrescamento() << ", excecao: " << e.what();
+        valor = 0;
+      }
+      a.disponivel_em_depois = std::max(0, valor);
+      a.usado_rodada_depois = -1;
+    }
+    // Decrementa numero de rodadas que faltam para disponibilizar ataque.
+    if (a.disponivel_em_depois > 0) {
+      --a.disponivel_em_depois;
+      if (a.disponivel_em_depois == 0 && da.has_limite_vezes_original()) {
+        a.limite_vezes_depois = da.limite_vezes_original();
+      }
+    }
+    if (a.disponivel_em_antes != a.disponivel_em_depois || a.limite_vezes_antes != a.limite_vezes_depois ||
+        a.usado_rodada_antes != a.usado_rodada_depois) {
+      delta->ataques.push_back(a);
+    }
+  }
+  return true;
+}
+
+void CompactaDeltaRodada(const std::vector<DeltaRodadaEntidade>& deltas, bool reiniciar_ataque, DeltaRodadaProto* proto) {
+  if (reiniciar_ataque) {
+    proto->set_reiniciar_ataque(true);
+  }
+  unsigned int id_anterior = 0;
+  for (const auto& d : deltas) {
+    // Ids sao sem sinal: o delta eh modular e o inverso tambem.
+    proto->add_delta_id(d.id - id_anterior);
+    id_anterior = d.id;
+    proto->add_num_eventos(d.eventos.size());
+    for (const auto& e : d.eventos) {
+      proto->add_id_unico_evento(e.id_unico);
+      proto->add_rodadas_antes(e.rodadas_antes);
+      proto->add_rodadas_depois(e.rodadas_depois);
+      if (e.encerrado.has_value()) {
+        *proto->add_evento_encerrado() = *e.encerrado;
+      }
+    }
+    proto->add_num_ataques(d.ataques.size());
+    for (const auto& a : d.ataques) {
+      proto->add_indice_ataque(a.indice);
+      proto->add_disponivel_em_antes(a.disponivel_em_antes);
+      proto->add_disponivel_em_depois(a.disponivel_em_depois);
+      proto->add_limite_vezes_antes(a.limite_vezes_antes);
+      proto->add_limite_vezes_depois(a.limite_vezes_depois);
+      proto->add_usado_rodada_antes(a.usado_rodada_antes);
+      proto->add_usado_rodada_depois(a.usado_rodada_depois);
+    }
+  }
+}
+
+std::vector<DeltaRodadaEntidade> DescompactaDeltaRodada(const DeltaRodadaProto& proto) {
+  const int n = proto.delta_id_size();
+  if (proto.num_eventos_size() != n || proto.num_ataques_size() != n) {
+    LOG(ERROR) << "Delta de rodada inconsistente: " << proto.ShortDebugString();
+    return {};
+  }
+  int64_t total_eventos = 0;
+  int64_t total_ataques = 0;
+  for (int i = 0; i < n; ++i) {
+    total_eventos += proto.num_eventos(i);
+    total_ataques += proto.num_ataques(i);
+  }
+  if (proto.id_unico_evento_size() != total_eventos || proto.rodadas_antes_size() != total_eventos ||
+      proto.rodadas_depois_size() != total_eventos) {
+    LOG(ERROR) << "Eventos do delta de rodada inconsistentes: " << proto.ShortDebugString();
+    return {};
+  }
+  if (proto.indice_ataque_size() != total_ataques ||
+      proto.disponivel_em_antes_size() != total_ataques || proto.disponivel_em_depois_size() != total_ataques ||
+      proto.limite_vezes_antes_size() != total_ataques || proto.limite_vezes_depois_size() != total_ataques ||
+      proto.usado_rodada_antes_size() != total_ataques || proto.usado_rodada_depois_size() != total_ataques) {
+    LOG(ERROR) << "Ataques do delta de rodada inconsistentes: " << proto.ShortDebugString();
+    return {};
+  }
+  std::vector<DeltaRodadaEntidade> deltas(n);
+  unsigned int id = 0;
+  int ie = 0;
+  int ia = 0;
+  int iencerrado = 0;
+  for (int i = 0; i < n; ++i) {
+    auto& d = deltas[i];
+    id += proto.delta_id(i);
+    d.id = id;
+    d.eventos.resize(proto.num_eventos(i));
+    for (auto& e : d.eventos) {
+      e.id_unico = proto.id_unico_evento(ie);
+      e.rodadas_antes = proto.rodadas_antes(ie);
+      e.rodadas_depois = proto.rodadas_depois(ie);
+      ++ie;
+      if (e.rodadas_antes < 0 || e.rodadas_depois < 0) {
+        if (iencerrado >= proto.evento_encerrado_size()) {
+          LOG(ERROR) << "Delta de rodada sem evento encerrado: " << proto.ShortDebugString();
+          return {};
+        }
+        e.encerrado = proto.evento_encerrado(iencerrado++);
+      }
+    }
+    d.ataques.resize(proto.num_ataques(i));
+    for (auto& a : d.ataques) {
+      a.indice = proto.indice_ataque(ia);
+      a.disponivel_em_antes = proto.disponivel_em_antes(ia);
+      a.disponivel_em_depois = proto.disponivel_em_depois(ia);
+      a.limite_vezes_antes = proto.limite_vezes_antes(ia);
+      a.limite_vezes_depois = proto.limite_vezes_depois(ia);
+      a.usado_rodada_antes = proto.usado_rodada_antes(ia);
+      a.usado_rodada_depois = proto.usado_rodada_depois(ia);
+      ++ia;
+    }
+  }
+  return deltas;
+}
+
+void InverteDeltaRodada(const DeltaRodadaProto& proto, DeltaRodadaProto* inverso) {
+  *inverso = proto;
+  inverso->clear_reiniciar_ataque();
+  inverso->mutable_rodadas_antes()->Swap(inverso->mutable_rodadas_depois());
+  inverso->mutable_disponivel_em_antes()->Swap(inverso->mutable_disponivel_em_depois());
+  inverso->mutable_limite_vezes_antes()->Swap(inverso->mutable_limite_vezes_depois());
+  inverso->mutable_usado_rodada_antes()->Swap(inverso->mutable_usado_rodada_depois());
+}
+
+void AplicaDeltaRodadaEntidade(const DeltaRodadaEntidade& delta, EntidadeProto* proto) {
+  for (const auto& e : delta.eventos) {
+    auto* evento = AchaEvento(e.id_unico, proto);
+    if (evento != nullptr) {
+      // Rodadas negativas: o evento sera removido na recomputacao.
+      evento->set_rodadas(e.rodadas_depois);
+    } else if (e.rodadas_depois >= 0 && e.encerrado.has_value()) {
+      // Desfazendo um evento encerrado.
+      auto* novo = proto->add_evento();
+      *novo = *e.encerrado;
+      novo->set_rodadas(e.rodadas_depois);
+    } else {
+      VLOG(1) << "nao achei evento id unico: " << e.id_unico;
+    }
+  }
+  for (const auto& a : delta.ataques) {
+    if (a.indice < 0 || a.indice >= proto->dados_ataque_size()) {
+      LOG(ERROR) << "Indice de ataque invalido no delta de rodada: " << a.indice << ", entidade: " << delta.id;
+      continue;
+    }
+    auto* da = proto->mutable_dados_ataque(a.indice);
+    if (a.disponivel_em_depois >= 0) {
+      da->set_disponivel_em(a.disponivel_em_depois);
+    } else {
+      da->clear_disponivel_em();
+    }
+    if (a.limite_vezes_depois >= 0) {
+      da->set_limite_vezes(a.limite_vezes_depois);
+    } else {
+      da->clear_limite_vezes();
+    }
+    if (a.usado_rodada_depois >= 0) {
+      da->set_usado_rodada(a.usado_rodada_depois != 0);
+    } else {
+      da->clear_usado_rodada();
+    }
+  }
+}
+
 float DistanciaEmMetrosAoQuadrado(const Posicao& pos1, const Posicao& pos2) {
   float distancia = powf(pos1.x() - pos2.x(), 2) + powf(pos1.y() - pos2.y(), 2) + powf(pos1.z() - pos2.z(), 2);
   VLOG(4) << "Distancia: " << distancia;
@@ -769,29 +1142,69 @@ std::optional<DadoTesteOuForcado> TemDadoDeTesteOuForcado(int nfaces) {
   return g_dados_teste.empty() ? std::nullopt : std::make_optional(DadoTesteOuForcado::TESTE);
 }
 
+namespace {
+
+// Gerador de RolaDado. Entidades podem ser recomputadas fora da thread principal (carga paralela do tabuleiro), por
+// isso o mutex.
+struct GeradorDados {
+  GeradorDados()
+      : semente(static_cast<uint32_t>(std::chrono::system_clock::now().time_since_epoch().count())), motor(semente) {}
+  std::mutex mutex;
+  uint32_t semente;
+  std::default_random_engine motor;
+  ObservadorDados observador;
+};
+
+GeradorDados& Gerador() {
+  static GeradorDados gerador;
+  return gerador;
+}
+
+}  // namespace
+
+void AlteraSementeDados(uint32_t semente) {
+  auto& gerador = Gerador();
+  std::lock_guard<std::mutex> trava(gerador.mutex);
+  gerador.semente = semente;
+  gerador.motor.seed(semente);
+}
+
+uint32_t SementeDados() {
+  auto& gerador = Gerador();
+  std::lock_guard<std::mutex> trava(gerador.mutex);
+  return gerador.semente;
+}
+
+void AlteraObservadorDados(ObservadorDados observador) {
+  auto& gerador = Gerador();
+  std::lock_guard<std::mutex> trava(gerador.mutex);
+  gerador.observador = std::move(observador);
+}
+
 // Rola um dado de nfaces.
 int RolaDado(unsigned int nfaces, bool ignora_forcado) {
-  // TODO inicializacao do motor de baseada no timestamp.
-  static std::default_random_engine motor(std::chrono::system_clock::now().time_since_epoch().count());
+  auto& gerador = Gerador();
+  std::lock_guard<std::mutex> trava(gerador.mutex);
+  // O motor anda mesmo quando o valor eh forcado, para que a sequencia dele dependa apenas dos dados rolados (a
+  // reproducao de uma gravacao forca os dados que foram aleatorios na sessao original).
+  std::uniform_int_distribution<int> distribution(1, nfaces);
+  int valor = distribution(gerador.motor);
   if (std::optional<DadoTesteOuForcado> tof = TemDadoDeTesteOuForcado(nfaces);
       tof.has_value() && !ignora_forcado) {
     if (*tof == DadoTesteOuForcado::TESTE) {
-      int valor = g_dados_teste.front();
+      valor = g_dados_teste.front();
       g_dados_teste.pop();
-      VLOG(1) << "retornando valor forcado: " << valor;
-      return valor;
     } else {
-      int valor = g_dados_forcados[nfaces].front();
+      valor = g_dados_forcados[nfaces].front();
       g_dados_forcados[nfaces].pop();
-      VLOG(1) << "retornando valor forcado: " << valor;
-      return valor;
     }
+    VLOG(1) << "retornando valor forcado: " << valor;
+  } else {
+    g_dados_rolados[nfaces][valor]++;
+  }
+  if (gerador.observador) {
+    gerador.observador(nfaces, valor);
   }
-  std::uniform_int_distribution<int> distribution(1, nfaces);
-  //static int min = motor_aleatorio.min();
-  //static int max = motor_aleatorio.max();
-  int valor = distribution(motor);
-  g_dados_rolados[nfaces][valor]++;
   return valor;
 }
 
@@ -2024,15 +2437,6 @@ std::tuple<bool, std::string> AtaqueVsResistenciaMagia(
       true, absl::StrFormat("RM: ataque bem sucedido; %d >= %d (d20=%d, mod=%d)", total, rm, d20, mod));
 }
 
-namespace {
-
-std::string EntidadeNotificacao(const Tabuleiro& tabuleiro, const ntf::Notificacao& n) {
-  auto* entidade = tabuleiro.BuscaEntidade(n.entidade().id());
-  return RotuloEntidade(entidade);
-}
-
-}  // namespace
-
 std::string RotuloEntidade(const Entidade* entidade) {
   if (entidade == nullptr) {
     return "null";
@@ -2056,11 +2460,15 @@ std::string RotuloEntidade(const Entidade& entidade) {
 }
 
 std::string ResumoNotificacao(const Tabuleiro& tabuleiro, const ntf::Notificacao& n) {
+  return ResumoNotificacao(n, [&tabuleiro](unsigned int id) { return RotuloEntidade(tabuleiro.BuscaEntidade(id)); });
+}
+
+std::string ResumoNotificacao(const ntf::Notificacao& n, const std::function<std::string(unsigned int)>& rotulo_por_id) {
   switch (n.tipo()) {
     case ntf::TN_GRUPO_NOTIFICACOES: {
       std::string resumo = "GRUPO: ";
       for (const auto& nf : n.notificacao()) {
-        auto resumo_parcial = ResumoNotificacao(tabuleiro, nf);
+        auto resumo_parcial = ResumoNotificacao(nf, rotulo_por_id);
         if (!resumo_parcial.empty()) {
           resumo += resumo_parcial + ", ";
         }
@@ -2071,16 +2479,49 @@ std::string ResumoNotificacao(const Tabuleiro& tabuleiro, const ntf::Notificacao
       return "";
     }
     case ntf::TN_ATUALIZAR_PARCIAL_ENTIDADE_NOTIFICANDO_SE_LOCAL: {
-      return std::string("ATUALIZAR_PARCIAL_ENTIDADE_NOTIFICANDO: entidade ") + EntidadeNotificacao(tabuleiro, n) + " atualizada: " + n.entidade().ShortDebugString();
+      return std::string("ATUALIZAR_PARCIAL_ENTIDADE_NOTIFICANDO: entidade ") + rotulo_por_id(n.entidade().id()) + " atualizada: " + n.entidade().ShortDebugString();
     }
     case ntf::TN_MOVER_ENTIDADE: {
-      return std::string("MOVER_ENTIDADE: entidade ") + EntidadeNotificacao(tabuleiro, n) + " pos: " + n.entidade().pos().ShortDebugString() + ", destino: " + n.entidade().destino().ShortDebugString() + ", rota: " + n.entidade().rota().ShortDebugString();
+      return std::string("MOVER_ENTIDADE: entidade ") + rotulo_por_id(n.entidade().id()) + " pos: " + n.entidade().pos().ShortDebugString() + ", destino: " + n.entidade().destino().ShortDebugString() + ", rota: " + n.entidade().rota().ShortDebugString();
     }
     default:
       return "";
   }
 }
 
+bool ReduzNotificacaoParaResumo(const ntf::Notificacao& n, ntf::Notificacao* reduzida, std::vector<unsigned int>* ids) {
+  switch (n.tipo()) {
+    case ntf::TN_GRUPO_NOTIFICACOES: {
+      // O grupo sempre tem resumo, mesmo sem filhos com resumo.
+      reduzida->set_tipo(n.tipo());
+      for (const auto& nf : n.notificacao()) {
+        if (!ReduzNotificacaoParaResumo(nf, reduzida->add_notificacao(), ids)) {
+          reduzida->mutable_notificacao()->RemoveLast();
+        }
+      }
+      return true;
+    }
+    case ntf::TN_ATUALIZAR_PARCIAL_ENTIDADE_NOTIFICANDO_SE_LOCAL: {
+      reduzida->set_tipo(n.tipo());
+      *reduzida->mutable_entidade() = n.entidade();
+      ids->push_back(n.entidade().id());
+      return true;
+    }
+    case ntf::TN_MOVER_ENTIDADE: {
+      reduzida->set_tipo(n.tipo());
+      auto* e = reduzida->mutable_entidade();
+      e->set_id(n.entidade().id());
+      if (n.entidade().has_pos()) *e->mutable_pos() = n.entidade().pos();
+      if (n.entidade().has_destino()) *e->mutable_destino() = n.entidade().destino();
+      if (n.entidade().has_rota()) *e->mutable_rota() = n.entidade().rota();
+      ids->push_back(n.entidade().id());
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
 namespace {
 void PreencheCargasVarinha(bool decrementa, int limite_vezes, const ItemTesouroProto& varinha_tabelada, const Entidade& entidade, EntidadeProto* proto) {
   bool atualizou = false;
@@ -2705,25 +3146,6 @@ void PreencheNotificacaoEventoParaVenenoSecundario(
   }
 }
 
-// Retorna se os bonus sao cumulativos.
-bool BonusCumulativo(TipoBonus tipo) {
-  switch (tipo) {
-    case TB_CIRCUNSTANCIA:
-    case TB_CLASSE:
-    case TB_ESQUIVA:
-    case TB_FAMILIAR:
-    case TB_NIVEIS_NEGATIVOS:
-    case TB_NIVEL:
-    case TB_RACIAL:
-    case TB_TEMPLATE:
-    case TB_TALENTO:
-    case TB_SEM_NOME:
-    case TB_SINERGIA:
-      return true;
-    default: return false;
-  }
-}
-
 std::vector<TipoBonus> ExclusaoEscudo(bool permite_escudo) {
   std::vector<TipoBonus> exclusao;
   if (!permite_escudo) {
@@ -2803,53 +3225,13 @@ void CombinaAtributos(const Atributos& atributos_novos, Atributos* atributos) {
   CombinaBonus(atributos_novos.carisma(), atributos->mutable_carisma());
 }
 
-std::string ChaveMapaPorOrigem(const BonusIndividual::PorOrigem& por_origem) {
-  if (por_origem.valor() >= 0) {
-    return absl::StrFormat("%s:positivo", por_origem.origem().c_str());
-  } else {
-    return absl::StrFormat("%s:negativo", por_origem.origem().c_str());
-  }
-}
-
 // Retorna o total de um bonus individual, contabilizando acumulo caso as origens sejam diferentes.
 int BonusIndividualTotal(const BonusIndividual& bonus_individual) {
-  if (BonusCumulativo(bonus_individual.tipo())) {
-    std::unordered_map<std::string, int> mapa_por_origem;
-    for (const auto& por_origem : bonus_individual.por_origem()) {
-      std::string chave = ChaveMapaPorOrigem(por_origem);
-      auto it = mapa_por_origem.find(chave);
-      if (it == mapa_por_origem.end()) {
-        // Origem nao existe no mapa, pode usar.
-        mapa_por_origem[chave] = por_origem.valor();
-      } else {
-        // Origem existe no mapa. Usa o maior para positivos, menor para negativos.
-        int valor = por_origem.valor();
-        if ((valor < 0 && valor < it->second) || (valor >= 0 && valor > it->second)) {
-          mapa_por_origem[chave] = por_origem.valor();
-        }
-      }
-    }
-    int total = 0;
-    for (const auto& par : mapa_por_origem) {
-      total += par.second;
-    }
-    return total;
-  } else {
-    // Bonus nao cumulativo, nao importa origem, apenas o maior e menor se aplicam.
-    int maior = 0;
-    int menor = 0;
-    for (const auto& por_origem : bonus_individual.por_origem()) {
-      if (por_origem.valor() > 0) {
-        // Bonus.
-        maior = std::max(maior, por_origem.valor());
-      } else if (por_origem.valor() < 0) {
-        // Penalidade.
-        menor = std::min(menor, por_origem.valor());
-      }
-    }
-    // Atencao, menor é negativo, entao aqui deve ser soma.
-    return maior + menor;
-  }
+  const auto& por_origem = bonus_individual.por_origem();
+  return TotalBonusIndividual(
+      BonusCumulativo(bonus_individual.tipo()), por_origem.size(),
+      [&por_origem](int i) { return por_origem.Get(i).valor(); },
+      [&por_origem](int i, int j) { return por_origem.Get(i).origem() == por_origem.Get(j).origem(); });
 }
 
 // Retorna o total para um tipo de bonus.
@@ -3731,9 +4113,14 @@ const Bonus& BonusPericia(const std::string& id, const EntidadeProto& proto) {
 }
 
 bool PericiaDeClasse(const Tabelas& tabelas, const std::string& chave_pericia, const EntidadeProto& proto) {
+  const int indice_pericia = tabelas.IndicePericia(chave_pericia);
   for (const auto& ic : proto.info_classes()) {
-    const auto& ct = tabelas.Classe(ic.id());
-    if (c_any(ct.pericias(), chave_pericia)) {
+    const int indice_classe = tabelas.IndiceClasse(ic.id());
+    if (indice_pericia >= 0 && indice_classe >= 0) {
+      if (tabelas.PericiaDeClasse(indice_classe, indice_pericia)) {
+        return true;
+      }
+    } else if (c_any(tabelas.Classe(ic.id()).pericias(), chave_pericia)) {
       return true;
     }
     if (c_any(ic.pericias_monstro(), chave_pericia)) {
@@ -3743,6 +4130,43 @@ bool PericiaDeClasse(const Tabelas& tabelas, const std::string& chave_pericia, c
   return false;
 }
 
+std::vector<bool> PericiasDeClassePorIndice(const Tabelas& tabelas, const EntidadeProto& proto) {
+  std::vector<bool> pericias(tabelas.NumPericias(), false);
+  for (const auto& ic : proto.info_classes()) {
+    if (const int indice_classe = tabelas.IndiceClasse(ic.id()); indice_classe >= 0) {
+      for (int i = 0; i < tabelas.NumPericias(); ++i) {
+        if (tabelas.PericiaDeClasse(indice_classe, i)) pericias[i] = true;
+      }
+    }
+    for (const auto& id_pericia : ic.pericias_monstro()) {
+      if (const int i = tabelas.IndicePericia(id_pericia); i >= 0) pericias[i] = true;
+    }
+  }
+  return pericias;
+}
+
+std::vector<bool> TalentosPorIndice(const Tabelas& tabelas, const EntidadeProto& proto) {
+  std::vector<bool> talentos(tabelas.NumTalentos(), false);
+  for (const auto* lista : {&proto.info_talentos().gerais(), &proto.info_talentos().outros(), &proto.info_talentos().automaticos()}) {
+    for (const auto& t : *lista) {
+      if (const int i = tabelas.IndiceTalento(t.id()); i >= 0) talentos[i] = true;
+    }
+  }
+  return talentos;
+}
+
+std::vector<bool> PericiasComplementoTalentoPorIndice(
+    const Tabelas& tabelas, const std::string& chave_talento, const EntidadeProto& proto) {
+  std::vector<bool> pericias(tabelas.NumPericias(), false);
+  for (const auto* lista : {&proto.info_talentos().gerais(), &proto.info_talentos().outros(), &proto.info_talentos().automaticos()}) {
+    for (const auto& t : *lista) {
+      if (t.id() != chave_talento) continue;
+      if (const int i = tabelas.IndicePericia(t.complemento()); i >= 0) pericias[i] = true;
+    }
+  }
+  return pericias;
+}
+
 bool PodeUsarPericia(const Tabelas& tabelas, const std::string& id_pericia, const EntidadeProto& proto) {
   auto* pt = &tabelas.Pericia(id_pericia);
   if (!pt->derivada_de().empty()) {
@@ -129,8 +129,13 @@ void IniciaUtil();
 
 /** Cria uma notificacao do tipo TN_GRUPO_NOTIFICACOES. */
 std::unique_ptr<ntf::Notificacao> NovoGrupoNotificacoes();
+/** Como acima, mas na arena (ntf::ArenaAcao ou CentralNotificacoes::ArenaCiclo), ou no heap se arena for nullptr.
+* Os filhos criados por NovaNotificacaoFilha ficam na mesma arena.
+*/
+ntf::PtrNotificacao NovoGrupoNotificacoes(google::protobuf::Arena* arena);
 /** Cria uma nova notificacao do tipo passado para a entidade, preenchendo id antes e depois dela. */
 std::unique_ptr<ntf::Notificacao> NovaNotificacao(ntf::Tipo tipo, const EntidadeProto& proto);
+ntf::PtrNotificacao NovaNotificacao(ntf::Tipo tipo, const EntidadeProto& proto, google::protobuf::Arena* arena);
 /** Retorna a notificacao filha, com proto antes e depois preenchidos pelo id de proto. */
 std::tuple<ntf::Notificacao*, EntidadeProto*, EntidadeProto*> NovaNotificacaoFilha(
     ntf::Tipo tipo, const EntidadeProto& proto, ntf::Notificacao* pai);
@@ -226,6 +231,14 @@ void LimpaDadosAcumulados(int nfaces);
 
 /** Gera um aleatorio de 1 a nfaces. */
 int RolaDado(unsigned int nfaces, bool ignora_forcado = false);
+/** Reinicia o gerador de RolaDado com a semente. Por padrao, a semente vem do relogio. */
+void AlteraSementeDados(uint32_t semente);
+uint32_t SementeDados();
+/** Chamado a cada valor retornado por RolaDado, inclusive os forcados (para gravacao de sessoes). Roda com o gerador
+* travado: nao pode rolar dados. Nullptr desliga.
+*/
+using ObservadorDados = std::function<void(unsigned int nfaces, int valor)>;
+void AlteraObservadorDados(ObservadorDados observador);
 /** Gera um aleatorio entre [0.0 e 1.0]. Os valores tem precisao de duas casas. */
 float Aleatorio();
 inline Vector3 Aleatorio3() { return Vector3{Aleatorio(), Aleatorio(), Aleatorio()};}
@@ -285,6 +298,88 @@ float VetorParaRotacaoGraus(float x, float y, float* tamanho = nullptr);
 /** Matriz de rotacao para se chegar ao vetor v a partir do eixo X. */
 Matrix4 MatrizRotacao(const Vector3& v);
 
+/** Planos do tronco de visao (frustum), na forma ax + by + cz + d >= 0 para pontos dentro. */
+struct TroncoVisao {
+  Vector4 planos[6];
+};
+/** Extrai o tronco de visao da matriz (normalmente projecao * camera * modelagem). Os planos sao normalizados. */
+TroncoVisao ExtraiTroncoVisao(const Matrix4& matriz);
+/** @return true se a caixa alinhada aos eixos [min, max] estiver completamente fora do tronco. */
+bool CaixaForaTroncoVisao(const TroncoVisao& tronco, const Vector3& min, const Vector3& max);
+/** @return true se a esfera estiver completamente fora do tronco. */
+bool EsferaForaTroncoVisao(const TroncoVisao& tronco, const Vector3& centro, float raio);
+
+/** Esfera que envolve o desenho de um objeto, em coordenadas de mundo. */
+struct EsferaEnvolvente {
+  Vector3 centro;
+  float raio = 0.0f;
+};
+/** Preenche visiveis com os indices das esferas que nao estao completamente fora do tronco. Se distancia_maxima > 0,
+* descarta tambem as que nao alcancam a esfera de raio distancia_maxima em torno de referencia.
+*/
+void FiltraEsferasVisiveis(
+    const TroncoVisao& tronco, const std::vector<EsferaEnvolvente>& esferas, const Vector3& referencia,
+    float distancia_maxima, std::vector<int>* visiveis);
+
+/** Movimento de uma entidade quantizado para replicacao (ver MovimentosEntidadesProto). */
+struct MovimentoQuantizado {
+  unsigned int id = 0;
+  int x_cm = 0;
+  int y_cm = 0;
+  int z_cm = 0;
+  int rotacao_z_decigraus = 0;
+  int escala_x_cent = 0;
+  int escala_y_cent = 0;
+  int escala_z_cent = 0;
+  bool operator==(const MovimentoQuantizado&) const = default;
+};
+MovimentoQuantizado QuantizaMovimento(unsigned int id, const Posicao& pos, float rotacao_z_graus, const Escala& escala);
+/** Codifica os movimentos em proto, como deltas entre entidades consecutivas. */
+void CompactaMovimentos(
+    const std::vector<MovimentoQuantizado>& movimentos, bool com_rotacao_escala, MovimentosEntidadesProto* proto);
+/** Inverso de CompactaMovimentos. Se o proto for inconsistente (campos de tamanhos diferentes), retorna vazio. */
+std::vector<MovimentoQuantizado> DescompactaMovimentos(const MovimentosEntidadesProto& proto);
+/** Posicao, rotacao e escala desquantizadas. */
+Posicao PosicaoMovimento(const MovimentoQuantizado& movimento);
+float RotacaoZGrausMovimento(const MovimentoQuantizado& movimento);
+Escala EscalaMovimento(const MovimentoQuantizado& movimento);
+
+/** Mudancas de uma entidade ao passar uma rodada (ver DeltaRodadaProto). Nos ataques, -1 indica campo ausente. */
+struct DeltaRodadaEntidade {
+  struct Evento {
+    int id_unico = 0;
+    int rodadas_antes = 0;
+    int rodadas_depois = 0;
+    // Presente se o evento encerrou (antes ou depois negativo).
+    std::optional<EntidadeProto::Evento> encerrado;
+  };
+  struct Ataque {
+    int indice = 0;
+    int disponivel_em_antes = -1;
+    int disponivel_em_depois = -1;
+    int limite_vezes_antes = -1;
+    int limite_vezes_depois = -1;
+    int usado_rodada_antes = -1;
+    int usado_rodada_depois = -1;
+  };
+  unsigned int id = 0;
+  std::vector<Evento> eventos;
+  std::vector<Ataque> ataques;
+};
+/** Calcula a passagem de rodada de proto: decremento dos eventos e refrescamento dos ataques. Nao altera nada nem usa
+* estado do tabuleiro, entao pode ser chamada fora da thread principal.
+* @return false se a entidade precisar do tratamento completo (AtualizaEventosAoPassarRodada e
+* PreencheNotificacaoAtaqueAoPassarRodada): eventos com efeito ao expirar, veneno, paralisia, flecha acida ou varinhas.
+*/
+bool CalculaDeltaRodadaEntidade(const EntidadeProto& proto, bool expira_eventos_zerados, DeltaRodadaEntidade* delta);
+void CompactaDeltaRodada(const std::vector<DeltaRodadaEntidade>& deltas, bool reiniciar_ataque, DeltaRodadaProto* proto);
+/** Inverso de CompactaDeltaRodada. Se o proto for inconsistente, retorna vazio. */
+std::vector<DeltaRodadaEntidade> DescompactaDeltaRodada(const DeltaRodadaProto& proto);
+/** Delta para desfazer: antes e depois trocados, sem reiniciar ataques. */
+void InverteDeltaRodada(const DeltaRodadaProto& proto, DeltaRodadaProto* inverso);
+/** Aplica o delta em proto (no sentido antes -> depois). Nao recomputa dependencias. */
+void AplicaDeltaRodadaEntidade(const DeltaRodadaEntidade& delta, EntidadeProto* proto);
+
 /** @return quadrado da distancia entre as posicoes. */
 float DistanciaEmMetrosAoQuadrado(const Posicao& pos1, const Posicao& pos2);
 
@@ -433,6 +528,11 @@ std::tuple<bool, std::string> AtaqueVsResistenciaMagia(
 
 // Gera um resumo sobre a notificacao, ou vazio.
 std::string ResumoNotificacao(const Tabuleiro& tabuleiro, const ntf::Notificacao& n);
+// Idem, com o rotulo das entidades dado por rotulo_por_id.
+std::string ResumoNotificacao(const ntf::Notificacao& n, const std::function<std::string(unsigned int)>& rotulo_por_id);
+// Copia para reduzida apenas o que ResumoNotificacao usa, preenchendo ids com as entidades referenciadas.
+// Retorna false se o resumo seria vazio.
+bool ReduzNotificacaoParaResumo(const ntf::Notificacao& n, ntf::Notificacao* reduzida, std::vector<unsigned int>* ids);
 
 inline Vector2 PosParaVector2(const Posicao& pos) { return Vector2(pos.x(), pos.y()); }
 inline Vector3 PosParaVector3(const Posicao& pos) { return Vector3(pos.x(), pos.y(), pos.z()); }
@@ -762,6 +862,14 @@ bool PossuiHabilidadeEspecial(const std::string& chave, const EntidadeProto& pro
 
 // Retorna se a pericia eh considerada de classe para o proto.
 bool PericiaDeClasse(const Tabelas& tabelas, const std::string& chave_pericia, const EntidadeProto& proto);
+// Versoes por indice de tabela (ver Tabelas::IndicePericia e Tabelas::IndiceTalento), para quem consulta todas as
+// pericias ou talentos: resolve os ids da entidade uma vez so.
+std::vector<bool> PericiasDeClassePorIndice(const Tabelas& tabelas, const EntidadeProto& proto);
+std::vector<bool> TalentosPorIndice(const Tabelas& tabelas, const EntidadeProto& proto);
+// Pericias (por indice) que sao complemento do talento na entidade, como foco_em_pericia: equivale a
+// PossuiTalento(chave_talento, id_pericia, proto) para todas as pericias.
+std::vector<bool> PericiasComplementoTalentoPorIndice(
+    const Tabelas& tabelas, const std::string& chave_talento, const EntidadeProto& proto);
 // Retorna o total de pontos de pericia permitido para e entidade.
 int TotalPontosPericiaPermitidos(const Tabelas& tabelas, const EntidadeProto& proto);
 
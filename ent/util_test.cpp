@@ -1,18 +1,51 @@
+#include <boost/filesystem.hpp>
+#include <fstream>
 #include <gtest/gtest.h>
 
 #include <google/protobuf/text_format.h>
 #include <queue>
+#include <thread>
 #include "arq/arquivo.h"
 #include "ent/acoes.pb.h"
+#include "ent/bonus.h"
 #include "ent/constantes.h"
+#include "ent/controle_virtual_retido.h"
 #include "ent/entidade.h"
+#include "ent/escalonador.h"
+#include "ent/gravacao_notificacoes.h"
 #include "ent/recomputa.h"
+#include "ent/salvamento_automatico.h"
 #include "ent/tabelas.h"
 #include "ent/tabuleiro.h"
+#include "ent/tabuleiro_terreno.h"
 #include "ent/util.h"
+#include "gltab/gl.h"
 #include "log/log.h"
+#include "log/perfil.h"
+#include "net/compressao.h"
+#include "net/fila_envio.h"
+#include "net/util.h"
 #include "ntf/notificacao.h"
 
+#if __linux__ && !USAR_OPENGL_ES
+// Os testes rodam sem contexto OpenGL, onde gerar objetos graficos nao faz nada. Estas definicoes substituem as da
+// libGL no binario de teste, com o mesmo efeito, para contar as chamadas (ver TesteTabuleiro.SemGraficoNaoChamaGl).
+namespace {
+int g_objetos_gl_gerados = 0;
+void GeraNomesNulos(GLsizei n, GLuint* nomes) {
+  ++g_objetos_gl_gerados;
+  std::fill(nomes, nomes + n, 0u);
+}
+}  // namespace
+extern "C" {
+void glGenBuffers(GLsizei n, GLuint* buffers) { GeraNomesNulos(n, buffers); }
+void glGenFramebuffers(GLsizei n, GLuint* framebuffers) { GeraNomesNulos(n, framebuffers); }
+void glGenRenderbuffers(GLsizei n, GLuint* renderbuffers) { GeraNomesNulos(n, renderbuffers); }
+void glGenTextures(GLsizei n, GLuint* texturas) { GeraNomesNulos(n, texturas); }
+}  // extern "C"
+#define CONTA_OBJETOS_GL 1
+#endif
+
 namespace ent {
 
 extern std::queue<int> g_dados_teste;
@@ -26,8 +59,8 @@ class CentralColetora : public ntf::CentralNotificacoes {
     // Para ter notificacao remota coletada.
     RegistraEmissorRemoto(&emissor_remoto_);
   }
-  std::vector<std::unique_ptr<ntf::Notificacao>>& Notificacoes() { return notificacoes_; }
-  std::vector<std::unique_ptr<ntf::Notificacao>>& NotificacoesRemotas() { return notificacoes_remotas_; }
+  std::vector<ntf::PtrNotificacao>& Notificacoes() { return notificacoes_; }
+  std::vector<ntf::PtrNotificacao>& NotificacoesRemotas() { return notificacoes_remotas_; }
 
  private:
   class EmissorFake : public ntf::EmissorRemoto {
@@ -8508,6 +8541,1528 @@ TEST(TesteTendenciaAleatoria, QualquerLeal) {
   }
 }
 
+TEST(TesteTroncoVisao, CaixaForaDentro) {
+  // Ortografica cobrindo [-10, 10] em x e y, [-10, 10] em z.
+  Matrix4 prj;
+  prj.scale(0.1f);
+  const TroncoVisao tronco = ExtraiTroncoVisao(prj);
+  EXPECT_FALSE(CaixaForaTroncoVisao(tronco, Vector3(-1.0f, -1.0f, -1.0f), Vector3(1.0f, 1.0f, 1.0f)));
+  // Parcialmente dentro.
+  EXPECT_FALSE(CaixaForaTroncoVisao(tronco, Vector3(9.0f, 9.0f, 0.0f), Vector3(11.0f, 11.0f, 1.0f)));
+  EXPECT_TRUE(CaixaForaTroncoVisao(tronco, Vector3(11.0f, -1.0f, -1.0f), Vector3(12.0f, 1.0f, 1.0f)));
+  EXPECT_TRUE(CaixaForaTroncoVisao(tronco, Vector3(-1.0f, -12.0f, -1.0f), Vector3(1.0f, -11.0f, 1.0f)));
+  EXPECT_TRUE(CaixaForaTroncoVisao(tronco, Vector3(-1.0f, -1.0f, 11.0f), Vector3(1.0f, 1.0f, 12.0f)));
+}
+
+TEST(TesteTroncoVisao, EsferasVisiveis) {
+  Matrix4 prj;
+  prj.scale(0.1f);
+  const TroncoVisao tronco = ExtraiTroncoVisao(prj);
+  EXPECT_TRUE(EsferaForaTroncoVisao(tronco, Vector3(11.5f, 0.0f, 0.0f), 1.0f));
+  EXPECT_FALSE(EsferaForaTroncoVisao(tronco, Vector3(11.5f, 0.0f, 0.0f), 2.0f));
+
+  const std::vector<EsferaEnvolvente> esferas = {
+      {Vector3(0.0f, 0.0f, 0.0f), 1.0f}, {Vector3(5.0f, 0.0f, 0.0f), 1.0f}, {Vector3(20.0f, 0.0f, 0.0f), 1.0f}};
+  std::vector<int> visiveis = {7};
+  FiltraEsferasVisiveis(tronco, esferas, Vector3(), /*distancia_maxima=*/0.0f, &visiveis);
+  EXPECT_EQ(visiveis, std::vector<int>({0, 1}));
+  // Alcanca a borda da esfera 1.
+  FiltraEsferasVisiveis(tronco, esferas, Vector3(), 4.0f, &visiveis);
+  EXPECT_EQ(visiveis, std::vector<int>({0, 1}));
+  FiltraEsferasVisiveis(tronco, esferas, Vector3(), 3.0f, &visiveis);
+  EXPECT_EQ(visiveis, std::vector<int>({0}));
+}
+
+TEST(TesteTroncoVisao, EsferaDesenhoEntidades) {
+  EntidadeProto proto;
+  proto.set_tipo(TE_FORMA);
+  proto.set_sub_tipo(TF_CUBO);
+  proto.mutable_pos()->set_x(10.0f);
+  proto.mutable_escala()->set_x(1.0f);
+  proto.mutable_escala()->set_y(2.0f);
+  proto.mutable_escala()->set_z(2.0f);
+  auto forma = NovaEntidadeParaTestes(proto, TabelasCriando());
+  const auto esfera_forma = forma->EsferaDesenho();
+  EXPECT_FLOAT_EQ(esfera_forma.centro.x, 10.0f);
+  // Contem o cubo inteiro: [9.5, 10.5] x [-1, 1] x [0, 2].
+  EXPECT_GE(esfera_forma.raio, Vector3(0.5f, 1.0f, 2.0f).length());
+
+  proto.Clear();
+  proto.set_tipo(TE_ENTIDADE);
+  proto.set_tamanho(TM_MEDIO);
+  auto media = NovaEntidadeParaTestes(proto, TabelasCriando());
+  proto.set_tamanho(TM_ENORME);
+  auto enorme = NovaEntidadeParaTestes(proto, TabelasCriando());
+  EXPECT_GE(media->EsferaDesenho().raio, TAMANHO_LADO_QUADRADO * 1.5f);
+  EXPECT_GT(enorme->EsferaDesenho().raio, media->EsferaDesenho().raio);
+}
+
+TEST(TesteTerreno, PedacosIguaisAoTerrenoInteiro) {
+  const int kTamX = 5, kTamY = 4;
+  std::vector<double> pontos = Terreno::CriaPontosAleatorios(kTamX, kTamY);
+  std::vector<unsigned short> indices_inteiro;
+  std::vector<float> coordenadas_inteiro, normais_inteiro, texturas_inteiro;
+  Terreno::PreenchePedaco(kTamX, kTamY, pontos.data(), 0, 0, kTamX, kTamY,
+                          &indices_inteiro, &coordenadas_inteiro, &normais_inteiro, &texturas_inteiro);
+  ASSERT_EQ(coordenadas_inteiro.size(), 3u * (kTamX + 1) * (kTamY + 1));
+  ASSERT_EQ(indices_inteiro.size(), 6u * kTamX * kTamY);
+  // Pedaco interno: a normal da borda deve considerar os vizinhos de fora do pedaco.
+  std::vector<unsigned short> indices;
+  std::vector<float> coordenadas, normais, texturas;
+  Terreno::PreenchePedaco(kTamX, kTamY, pontos.data(), 2, 1, 4, 3, &indices, &coordenadas, &normais, &texturas);
+  ASSERT_EQ(coordenadas.size(), 3u * 3 * 3);
+  ASSERT_EQ(indices.size(), 6u * 2 * 2);
+  for (int y = 1; y <= 3; ++y) {
+    for (int x = 2; x <= 4; ++x) {
+      int i_pedaco = (y - 1) * 3 + (x - 2);
+      int i_inteiro = y * (kTamX + 1) + x;
+      for (int c = 0; c < 3; ++c) {
+        EXPECT_FLOAT_EQ(coordenadas[i_pedaco * 3 + c], coordenadas_inteiro[i_inteiro * 3 + c]);
+        EXPECT_FLOAT_EQ(normais[i_pedaco * 3 + c], normais_inteiro[i_inteiro * 3 + c]);
+      }
+      EXPECT_FLOAT_EQ(texturas[i_pedaco * 2], texturas_inteiro[i_inteiro * 2]);
+      EXPECT_FLOAT_EQ(texturas[i_pedaco * 2 + 1], texturas_inteiro[i_inteiro * 2 + 1]);
+    }
+  }
+  EXPECT_THROW(Terreno::PreenchePedaco(kTamX, kTamY, pontos.data(), 4, 0, 6, 2, &indices, &coordenadas, &normais, &texturas),
+               std::logic_error);
+}
+
+TEST(TesteTerreno, CacheAlturas) {
+  const int kTamX = 4, kTamY = 3;
+  std::vector<double> pontos = Terreno::CriaPontosAleatorios(kTamX, kTamY);
+  CacheAlturasTerreno cache;
+  EXPECT_FALSE(cache.Valido(CENARIO_PRINCIPAL, kTamX, kTamY, pontos.size()));
+  cache.Atualiza(CENARIO_PRINCIPAL, kTamX, kTamY, pontos.data(), pontos.size());
+  EXPECT_TRUE(cache.Valido(CENARIO_PRINCIPAL, kTamX, kTamY, pontos.size()));
+  EXPECT_FALSE(cache.Valido(0, kTamX, kTamY, pontos.size()));
+  // Bilinear de referencia.
+  auto altura = [&pontos] (int x, int y) { return static_cast<float>(pontos[y * (kTamX + 1) + x]); };
+  std::vector<float> xs, ys, esperados;
+  for (float fx = 0.05f; fx < kTamX; fx += 0.3f) {
+    for (float fy = 0.05f; fy < kTamY; fy += 0.3f) {
+      int x0 = static_cast<int>(fx), y0 = static_cast<int>(fy);
+      float dx = fx - x0, dy = fy - y0;
+      float z_sul = altura(x0 + 1, y0) * dx + altura(x0, y0) * (1.0f - dx);
+      float z_norte = altura(x0 + 1, y0 + 1) * dx + altura(x0, y0 + 1) * (1.0f - dx);
+      float x = fx * TAMANHO_LADO_QUADRADO - kTamX * TAMANHO_LADO_QUADRADO_2;
+      float y = fy * TAMANHO_LADO_QUADRADO - kTamY * TAMANHO_LADO_QUADRADO_2;
+      EXPECT_NEAR(cache.ZChao(x, y), z_norte * dy + z_sul * (1.0f - dy), 1e-4);
+      xs.push_back(x);
+      ys.push_back(y);
+      esperados.push_back(cache.ZChao(x, y));
+    }
+  }
+  // Fora do tabuleiro.
+  xs.push_back(kTamX * TAMANHO_LADO_QUADRADO);
+  ys.push_back(0.0f);
+  esperados.push_back(0.0f);
+  EXPECT_EQ(cache.ZChao(xs.back(), ys.back()), 0.0f);
+  std::vector<float> zs(xs.size());
+  cache.ZChao(xs, ys, zs);
+  for (unsigned int i = 0; i < zs.size(); ++i) {
+    EXPECT_FLOAT_EQ(zs[i], esperados[i]);
+  }
+  EXPECT_FLOAT_EQ(cache.AlturaPonto(kTamX, kTamY), altura(kTamX, kTamY));
+  EXPECT_EQ(cache.AlturaPonto(kTamX + 1, 0), 0.0f);
+  // Plano.
+  cache.Atualiza(CENARIO_PRINCIPAL, kTamX, kTamY, nullptr, 0);
+  EXPECT_EQ(cache.ZChao(0.1f, 0.1f), 0.0f);
+}
+
+TEST(TesteTabelas, IndicesInternados) {
+  const auto& tabelas = TabelasCriando();
+  const int indice_ladino = tabelas.IndiceClasse("ladino");
+  const int indice_avaliacao = tabelas.IndicePericia("avaliacao");
+  const int indice_prontidao = tabelas.IndiceTalento("prontidao");
+  ASSERT_GE(indice_ladino, 0);
+  ASSERT_GE(indice_avaliacao, 0);
+  ASSERT_GE(indice_prontidao, 0);
+  EXPECT_EQ(tabelas.IndiceClasse("inexistente"), -1);
+  EXPECT_EQ(tabelas.ClassePorIndice(indice_ladino).id(), "ladino");
+  EXPECT_EQ(tabelas.PericiaPorIndice(indice_avaliacao).id(), "avaliacao");
+  EXPECT_EQ(tabelas.TalentoPorIndice(indice_prontidao).id(), "prontidao");
+  EXPECT_EQ(tabelas.PericiaPorIndice(-1).id(), "");
+  EXPECT_TRUE(tabelas.PericiaDeClasse(indice_ladino, indice_avaliacao));
+  EXPECT_FALSE(tabelas.PericiaDeClasse(tabelas.IndiceClasse("guerreiro"), indice_avaliacao));
+  EXPECT_FALSE(tabelas.PericiaDeClasse(-1, indice_avaliacao));
+  const int indice_ouvir = tabelas.IndicePericia("ouvir");
+  EXPECT_TRUE(c_any_of(tabelas.TalentosComBonusPericia(indice_ouvir), [indice_prontidao](const BonusTalentoPericia& bt) {
+    return bt.indice_talento == indice_prontidao && bt.valor == 2;
+  }));
+  EXPECT_TRUE(tabelas.TalentosComBonusPericia(-1).empty());
+  EXPECT_TRUE(c_any(tabelas.SinergiasPericia(tabelas.IndicePericia("adestrar_animais")), tabelas.IndicePericia("cavalgar")));
+  EXPECT_TRUE(tabelas.SinergiasPericia(-1).empty());
+
+  EntidadeProto proto;
+  proto.add_info_classes()->set_id("ladino");
+  proto.mutable_info_talentos()->add_outros()->set_id("prontidao");
+  EXPECT_TRUE(PericiaDeClasse(tabelas, "avaliacao", proto));
+  EXPECT_TRUE(PericiasDeClassePorIndice(tabelas, proto)[indice_avaliacao]);
+  EXPECT_TRUE(TalentosPorIndice(tabelas, proto)[indice_prontidao]);
+  auto* foco = proto.mutable_info_talentos()->add_gerais();
+  foco->set_id("foco_em_pericia");
+  foco->set_complemento("ouvir");
+  EXPECT_TRUE(PericiasComplementoTalentoPorIndice(tabelas, "foco_em_pericia", proto)[indice_ouvir]);
+  EXPECT_FALSE(PericiasComplementoTalentoPorIndice(tabelas, "foco_em_pericia", proto)[indice_avaliacao]);
+  RecomputaDependencias(tabelas, TT_NENHUM, &proto);
+  const auto& ouvir = Pericia("ouvir", proto);
+  EXPECT_EQ(BonusIndividualTotal(TB_TALENTO, ouvir.bonus()), 2);
+  EXPECT_EQ(BonusIndividualPorOrigem(TB_SEM_NOME, "foco_em_pericia", ouvir.bonus()), 3);
+  // Pericias na ordem da tabela.
+  ASSERT_EQ(proto.info_pericias_size(), tabelas.NumPericias());
+  for (int i = 0; i < tabelas.NumPericias(); ++i) {
+    EXPECT_EQ(proto.info_pericias(i).id(), tabelas.PericiaPorIndice(i).id());
+  }
+}
+
+TEST(TestePerfil, EstatisticasETrace) {
+  perfil::Liga(false);
+  perfil::GravaZona("desligado", 0, 1000);
+  perfil::Liga(true);
+  perfil::Limpa();
+  // 100 zonas de 1 a 100 us.
+  for (int i = 1; i <= 100; ++i) {
+    perfil::GravaZona("zona \"teste\"", 0, i * 1000);
+  }
+  std::thread t([] { perfil::GravaZona("outra thread", 0, 5000); });
+  t.join();
+  auto estatisticas = perfil::Estatisticas();
+  ASSERT_EQ(estatisticas.size(), 2U);
+  EXPECT_EQ(estatisticas[0].nome, "zona \"teste\"");
+  EXPECT_EQ(estatisticas[0].num, 100);
+  EXPECT_EQ(estatisticas[0].media_ns, 50500);
+  EXPECT_EQ(estatisticas[0].p50_ns, 50000);
+  EXPECT_EQ(estatisticas[0].p95_ns, 95000);
+  EXPECT_EQ(estatisticas[0].p99_ns, 99000);
+  EXPECT_EQ(estatisticas[0].maximo_ns, 100000);
+  EXPECT_EQ(estatisticas[1].nome, "outra thread");
+  EXPECT_EQ(estatisticas[1].num, 1);
+
+  std::string trace = perfil::TraceChrome();
+  EXPECT_NE(trace.find("\"traceEvents\""), std::string::npos);
+  EXPECT_NE(trace.find("\"name\":\"zona \\\"teste\\\"\""), std::string::npos) << trace.substr(0, 200);
+  EXPECT_NE(trace.find("\"dur\":100.000"), std::string::npos);
+  EXPECT_EQ(trace.find("desligado"), std::string::npos);
+
+  perfil::Limpa();
+  EXPECT_TRUE(perfil::Estatisticas().empty());
+  {
+    PERFIL_ZONA("escopo");
+  }
+  ASSERT_EQ(perfil::Estatisticas().size(), 1U);
+
+  // Threads que terminam devolvem o buffer, reusado pela proxima sem herdar suas zonas.
+  perfil::Limpa();
+  std::thread([] { perfil::GravaZona("thread antiga", 0, 1000); }).join();
+  const int num_buffers = perfil::NumBuffers();
+  for (int i = 0; i < 10; ++i) {
+    std::thread([] { perfil::GravaZona("thread nova", 0, 1000); }).join();
+  }
+  EXPECT_EQ(perfil::NumBuffers(), num_buffers);
+  estatisticas = perfil::Estatisticas();
+  ASSERT_EQ(estatisticas.size(), 1U);
+  EXPECT_EQ(estatisticas[0].nome, "thread nova");
+  EXPECT_EQ(estatisticas[0].num, 1);
+  perfil::Liga(false);
+  perfil::Limpa();
+}
+
+TEST(TesteMovimentos, CompactaDescompacta) {
+  Escala escala;
+  escala.set_x(1.234f);
+  escala.set_y(0.5f);
+  escala.set_z(2.0f);
+  std::vector<MovimentoQuantizado> movimentos;
+  for (unsigned int id : {7U, 3U, 1000U}) {
+    Posicao pos;
+    pos.set_x(id * 0.333f);
+    pos.set_y(-1.005f * id);
+    pos.set_z(0.1f);
+    movimentos.push_back(QuantizaMovimento(id, pos, -45.36f, escala));
+  }
+  EXPECT_EQ(movimentos[0].rotacao_z_decigraus, -454);
+  EXPECT_EQ(movimentos[0].escala_x_cent, 123);
+  EXPECT_NEAR(PosicaoMovimento(movimentos[1]).x(), 0.999f, 0.005f);
+  EXPECT_NEAR(RotacaoZGrausMovimento(movimentos[1]), -45.4f, 1e-4);
+  EXPECT_NEAR(EscalaMovimento(movimentos[1]).x(), 1.23f, 1e-4);
+
+  MovimentosEntidadesProto proto;
+  CompactaMovimentos(movimentos, /*com_rotacao_escala=*/true, &proto);
+  EXPECT_EQ(DescompactaMovimentos(proto), movimentos);
+  // Segunda e terceira entidade tem a mesma rotacao e escala: delta zero.
+  EXPECT_EQ(proto.delta_rotacao_z_decigraus(1), 0);
+  EXPECT_EQ(proto.delta_escala_x_cent(2), 0);
+
+  // Sem rotacao e escala, esses campos nao trafegam.
+  MovimentosEntidadesProto proto_pos;
+  CompactaMovimentos(movimentos, /*com_rotacao_escala=*/false, &proto_pos);
+  EXPECT_TRUE(proto_pos.delta_rotacao_z_decigraus().empty());
+  EXPECT_LT(proto_pos.ByteSizeLong(), proto.ByteSizeLong());
+  auto descompactados = DescompactaMovimentos(proto_pos);
+  ASSERT_EQ(descompactados.size(), movimentos.size());
+  for (unsigned int i = 0; i < movimentos.size(); ++i) {
+    EXPECT_EQ(descompactados[i].id, movimentos[i].id);
+    EXPECT_EQ(descompactados[i].x_cm, movimentos[i].x_cm);
+    EXPECT_EQ(descompactados[i].z_cm, movimentos[i].z_cm);
+  }
+
+  // Inconsistente.
+  proto.add_delta_x_cm(1);
+  EXPECT_TRUE(DescompactaMovimentos(proto).empty());
+}
+
+TEST(TesteDeltaRodada, CalculaAplicaInverte) {
+  EntidadeProto proto;
+  proto.set_id(5);
+  {
+    auto* e = proto.add_evento();
+    e->set_id_efeito(EFEITO_BENCAO);
+    e->set_id_unico(1);
+    e->set_rodadas(2);
+    e = proto.add_evento();
+    e->set_id_efeito(EFEITO_BENCAO);
+    e->set_id_unico(2);
+    e->set_rodadas(0);
+    e->set_origem("teste");
+    e = proto.add_evento();
+    e->set_id_efeito(EFEITO_BENCAO);
+    e->set_id_unico(3);
+    e->set_rodadas(1);
+    e->set_continuo(true);
+  }
+  {
+    auto* da = proto.add_dados_ataque();
+    da->set_rotulo("sem mudanca");
+    da = proto.add_dados_ataque();
+    da->set_disponivel_em(1);
+    da->set_limite_vezes(0);
+    da->set_limite_vezes_original(3);
+    da = proto.add_dados_ataque();
+    da->set_taxa_refrescamento("3");
+    da->set_usado_rodada(true);
+  }
+
+  DeltaRodadaEntidade delta;
+  ASSERT_TRUE(CalculaDeltaRodadaEntidade(proto, /*expira_eventos_zerados=*/true, &delta));
+  ASSERT_EQ(delta.eventos.size(), 2U);
+  EXPECT_EQ(delta.eventos[0].rodadas_depois, 1);
+  EXPECT_FALSE(delta.eventos[0].encerrado.has_value());
+  EXPECT_EQ(delta.eventos[1].rodadas_depois, -1);
+  ASSERT_TRUE(delta.eventos[1].encerrado.has_value());
+  ASSERT_EQ(delta.ataques.size(), 2U);
+  EXPECT_EQ(delta.ataques[0].indice, 1);
+  EXPECT_EQ(delta.ataques[0].disponivel_em_depois, 0);
+  EXPECT_EQ(delta.ataques[0].limite_vezes_depois, 3);
+  EXPECT_EQ(delta.ataques[1].indice, 2);
+  // Rolou 3 e ja decrementou.
+  EXPECT_EQ(delta.ataques[1].disponivel_em_depois, 2);
+  EXPECT_EQ(delta.ataques[1].usado_rodada_depois, -1);
+
+  DeltaRodadaProto delta_proto;
+  CompactaDeltaRodada({delta}, /*reiniciar_ataque=*/true, &delta_proto);
+  auto deltas = DescompactaDeltaRodada(delta_proto);
+  ASSERT_EQ(deltas.size(), 1U);
+  EXPECT_EQ(deltas[0].id, 5U);
+
+  auto depois = proto;
+  AplicaDeltaRodadaEntidade(deltas[0], &depois);
+  EXPECT_EQ(depois.evento(0).rodadas(), 1);
+  EXPECT_EQ(depois.evento(1).rodadas(), -1);
+  EXPECT_EQ(depois.evento(2).rodadas(), 1);
+  EXPECT_EQ(depois.dados_ataque(1).limite_vezes(), 3);
+  EXPECT_FALSE(depois.dados_ataque(2).has_usado_rodada());
+  // Simula a recomputacao removendo o evento encerrado.
+  depois.mutable_evento()->DeleteSubrange(1, 1);
+
+  DeltaRodadaProto inverso;
+  InverteDeltaRodada(delta_proto, &inverso);
+  EXPECT_FALSE(inverso.reiniciar_ataque());
+  AplicaDeltaRodadaEntidade(DescompactaDeltaRodada(inverso)[0], &depois);
+  EXPECT_EQ(depois.evento(0).rodadas(), 2);
+  ASSERT_EQ(depois.evento_size(), 3);
+  // O encerrado volta ao final, igual ao original.
+  EXPECT_EQ(depois.evento(2).id_unico(), 2);
+  EXPECT_EQ(depois.evento(2).rodadas(), 0);
+  EXPECT_EQ(depois.evento(2).origem(), "teste");
+  depois.mutable_evento()->SwapElements(1, 2);
+  EXPECT_EQ(depois.DebugString(), proto.DebugString());
+
+  // Veneno e varinhas usadas vao pelo caminho completo.
+  auto com_veneno = proto;
+  auto* veneno = com_veneno.add_evento();
+  veneno->set_id_efeito(EFEITO_VENENO);
+  veneno->set_id_unico(4);
+  veneno->set_rodadas(5);
+  EXPECT_FALSE(CalculaDeltaRodadaEntidade(com_veneno, /*expira_eventos_zerados=*/false, &delta));
+  auto com_varinha = proto;
+  com_varinha.mutable_dados_ataque(0)->set_varinha("curar_ferimentos_leves");
+  com_varinha.mutable_dados_ataque(0)->set_usos(1);
+  EXPECT_FALSE(CalculaDeltaRodadaEntidade(com_varinha, /*expira_eventos_zerados=*/false, &delta));
+
+  // Recusa depois de um ataque com rolagem nao pode consumir dados: o caminho completo rola de novo.
+  auto rolagem_e_varinha = proto;
+  rolagem_e_varinha.mutable_dados_ataque(2)->set_taxa_refrescamento("1d1000");
+  auto* varinha = rolagem_e_varinha.add_dados_ataque();
+  varinha->set_varinha("curar_ferimentos_leves");
+  varinha->set_usos(1);
+  const uint32_t semente = SementeDados();
+  AlteraSementeDados(semente);
+  const int esperado = RolaValor("1d1000");
+  AlteraSementeDados(semente);
+  EXPECT_FALSE(CalculaDeltaRodadaEntidade(rolagem_e_varinha, /*expira_eventos_zerados=*/false, &delta));
+  EXPECT_EQ(RolaValor("1d1000"), esperado);
+
+  // Inconsistente.
+  delta_proto.add_rodadas_antes(1);
+  EXPECT_TRUE(DescompactaDeltaRodada(delta_proto).empty());
+}
+
+TEST(TesteDeltaRodada, PassaRodadaEmLoteEDesfaz) {
+  std::vector<Entidade*> entidades;
+  for (int i = 0; i < 10; ++i) {
+    EntidadeProto proto = TabelasCriando().ModeloEntidade("Humano Plebeu 1").entidade();
+    proto.set_id(i + 1);
+    auto* e = proto.add_evento();
+    e->set_id_efeito(i == 0 ? EFEITO_VENENO : EFEITO_BENCAO);
+    e->set_id_unico(10);
+    e->set_rodadas(3);
+    e = proto.add_evento();
+    e->set_id_efeito(EFEITO_BENCAO);
+    e->set_id_unico(11);
+    e->set_rodadas(0);
+    entidades.push_back(NovaEntidadeParaTestes(proto, TabelasCriando()).release());
+  }
+  TabuleiroTeste tabuleiro(entidades);
+  auto grupo = NovoGrupoNotificacoes();
+  auto grupo_desfazer = NovoGrupoNotificacoes();
+  tabuleiro.PreenchePassaUmaRodada(/*passar_para_todos=*/true, grupo.get(), grupo_desfazer.get(), /*expira_eventos_zerados=*/true);
+  // Uma notificacao compacta para as 9 entidades simples; a envenenada vai pelo caminho completo.
+  int num_lote = 0;
+  for (const auto& n : grupo->notificacao()) {
+    if (n.tipo() == ntf::TN_PASSAR_RODADA_EM_LOTE) {
+      ++num_lote;
+      EXPECT_EQ(n.delta_rodada().delta_id_size(), 9);
+    } else if (n.tipo() == ntf::TN_ATUALIZAR_PARCIAL_ENTIDADE_NOTIFICANDO_SE_LOCAL) {
+      EXPECT_EQ(n.entidade().id(), 1U);
+    }
+  }
+  EXPECT_EQ(num_lote, 1);
+
+  tabuleiro.TrataNotificacao(*grupo);
+  for (unsigned int id = 1; id <= 10; ++id) {
+    const auto& proto = tabuleiro.BuscaEntidade(id)->Proto();
+    ASSERT_NE(AchaEvento(10, proto), nullptr) << "id: " << id;
+    EXPECT_EQ(AchaEvento(10, proto)->rodadas(), 2) << "id: " << id;
+    EXPECT_EQ(AchaEvento(11, proto), nullptr) << "id: " << id;
+  }
+
+  tabuleiro.AdicionaNotificacaoListaEventos(*grupo_desfazer);
+  tabuleiro.TrataComandoDesfazer();
+  for (unsigned int id = 1; id <= 10; ++id) {
+    const auto& proto = tabuleiro.BuscaEntidade(id)->Proto();
+    EXPECT_EQ(AchaEvento(10, proto)->rodadas(), 3) << "id: " << id;
+    ASSERT_NE(AchaEvento(11, proto), nullptr) << "id: " << id;
+    EXPECT_EQ(AchaEvento(11, proto)->rodadas(), 0) << "id: " << id;
+  }
+}
+
+TEST(TesteArenaNotificacoes, CicloEAcao) {
+  ntf::CentralNotificacoes central;
+  class Receptor : public ntf::Receptor {
+   public:
+    bool TrataNotificacao(const ntf::Notificacao& notificacao) override {
+      if (notificacao.tipo() == ntf::TN_ATUALIZAR_PARCIAL_ENTIDADE_NOTIFICANDO_SE_LOCAL) {
+        ids.push_back(notificacao.entidade().id());
+      }
+      return true;
+    }
+    std::vector<unsigned int> ids;
+  } receptor;
+  central.RegistraReceptor(&receptor);
+
+  // Notificacoes do ciclo: na arena, nao sao apagadas pela central e chegam intactas aos receptores.
+  for (int ciclo = 0; ciclo < 3; ++ciclo) {
+    auto* arena = central.ArenaCiclo();
+    ASSERT_NE(arena, nullptr);
+    EntidadeProto proto;
+    proto.set_id(ciclo + 1);
+    auto n = NovaNotificacao(ntf::TN_ATUALIZAR_PARCIAL_ENTIDADE_NOTIFICANDO_SE_LOCAL, proto, arena);
+    EXPECT_EQ(n->GetArena(), arena);
+    EXPECT_EQ(n->entidade().GetArena(), arena);
+    central.AdicionaNotificacao(std::move(n));
+    central.AdicionaNotificacao(ntf::NovaNotificacao(ntf::TN_TEMPORIZADOR));
+    central.Notifica();
+  }
+  EXPECT_EQ(receptor.ids, (std::vector<unsigned int>{1, 2, 3}));
+  // Pendentes na arena quando a central morre tambem nao sao apagadas.
+  central.AdicionaNotificacao(ntf::CopiaNotificacao(ntf::Notificacao::default_instance(), central.ArenaCiclo()));
+
+  // Arenas de acao sao reaproveitadas.
+  google::protobuf::Arena* arena_acao = nullptr;
+  {
+    ntf::ArenaAcao arena(&central);
+    arena_acao = arena.arena();
+    auto grupo = NovoGrupoNotificacoes(arena.arena());
+    EXPECT_EQ(grupo->GetArena(), arena_acao);
+    grupo->add_notificacao()->set_tipo(ntf::TN_ADICIONAR_ACAO);
+  }
+  {
+    ntf::ArenaAcao arena(&central);
+    EXPECT_EQ(arena.arena(), arena_acao);
+  }
+  EXPECT_EQ(ntf::ArenaAcao(nullptr).arena(), nullptr);
+
+  central.AlteraUsoArenas(false);
+  EXPECT_EQ(central.ArenaCiclo(), nullptr);
+  EXPECT_EQ(ntf::ArenaAcao(&central).arena(), nullptr);
+  EXPECT_EQ(NovoGrupoNotificacoes(nullptr)->GetArena(), nullptr);
+}
+
+TEST(TesteLoteRemoto, EmissorVeOLoteDoNotifica) {
+  ntf::CentralNotificacoes central;
+  // Registra cada evento: inicio de lote, remota e fim de lote.
+  class Emissor : public ntf::EmissorRemoto {
+   public:
+    bool TrataNotificacaoRemota(const ntf::Notificacao& notificacao) override {
+      eventos.push_back(ntf::Tipo_Name(notificacao.tipo()));
+      return true;
+    }
+    void InicioLoteRemoto() override { eventos.push_back("inicio"); }
+    void FimLoteRemoto() override { eventos.push_back("fim"); }
+    std::vector<std::string> eventos;
+  } emissor;
+  // Como um cliente de rede: gera remotas ao tratar locais (por exemplo, repasses recebidos no temporizador).
+  class Receptor : public ntf::Receptor {
+   public:
+    explicit Receptor(ntf::CentralNotificacoes* central) : central(central) {}
+    bool TrataNotificacao(const ntf::Notificacao& notificacao) override {
+      if (notificacao.tipo() == ntf::TN_TEMPORIZADOR) {
+        central->AdicionaNotificacaoRemota(ntf::NovaNotificacao(ntf::TN_MOVER_ENTIDADE));
+      }
+      return true;
+    }
+    ntf::CentralNotificacoes* central;
+  } receptor(&central);
+  central.RegistraEmissorRemoto(&emissor);
+  central.RegistraReceptor(&receptor);
+
+  central.AdicionaNotificacaoRemota(ntf::NovaNotificacao(ntf::TN_ADICIONAR_ACAO));
+  central.AdicionaNotificacao(ntf::NovaNotificacao(ntf::TN_TEMPORIZADOR));
+  central.Notifica();
+  EXPECT_EQ(emissor.eventos,
+            (std::vector<std::string>{"inicio", "TN_ADICIONAR_ACAO", "TN_MOVER_ENTIDADE", "fim"}));
+  // Notifica vazio tambem abre e fecha o lote.
+  emissor.eventos.clear();
+  central.Notifica();
+  EXPECT_EQ(emissor.eventos, (std::vector<std::string>{"inicio", "fim"}));
+}
+
+TEST(TesteLoteRemoto, LoteFechaMesmoComTrocaDeEmissores) {
+  ntf::CentralNotificacoes central;
+  class Emissor : public ntf::EmissorRemoto {
+   public:
+    bool TrataNotificacaoRemota(const ntf::Notificacao& notificacao) override {
+      eventos.push_back(ntf::Tipo_Name(notificacao.tipo()));
+      return true;
+    }
+    void InicioLoteRemoto() override { eventos.push_back("inicio"); }
+    void FimLoteRemoto() override { eventos.push_back("fim"); }
+    std::vector<std::string> eventos;
+  } antigo, novo;
+  // Troca os emissores no meio do Notifica, como uma conexao que cai enquanto outra entra.
+  class Receptor : public ntf::Receptor {
+   public:
+    Receptor(ntf::CentralNotificacoes* central, Emissor* antigo, Emissor* novo)
+        : central(central), antigo(antigo), novo(novo) {}
+    bool TrataNotificacao(const ntf::Notificacao& notificacao) override {
+      central->DesregistraEmissorRemoto(antigo);
+      central->RegistraEmissorRemoto(novo);
+      return true;
+    }
+    ntf::CentralNotificacoes* central;
+    Emissor* antigo;
+    Emissor* novo;
+  } receptor(&central, &antigo, &novo);
+  central.RegistraEmissorRemoto(&antigo);
+  central.RegistraReceptor(&receptor);
+
+  central.AdicionaNotificacaoRemota(ntf::NovaNotificacao(ntf::TN_ADICIONAR_ACAO));
+  central.AdicionaNotificacao(ntf::NovaNotificacao(ntf::TN_TEMPORIZADOR));
+  central.Notifica();
+  // O antigo abriu o lote e tem que fecha-lo; o novo recebe fora de lote.
+  EXPECT_EQ(antigo.eventos, (std::vector<std::string>{"inicio", "fim"}));
+  EXPECT_EQ(novo.eventos, (std::vector<std::string>{"TN_ADICIONAR_ACAO"}));
+}
+
+TEST(TesteGravacaoNotificacoes, ReproduzComOsMesmosDados) {
+  const std::string caminho = arq::Diretorio(arq::TIPO_TESTE) + "/teste_gravacao_notificacoes.tvgn";
+  // Como o tabuleiro: rola dados (forcaveis e nao) ao tratar acoes.
+  class Receptor : public ntf::Receptor {
+   public:
+    explicit Receptor(bool rola) : rola(rola) {}
+    bool TrataNotificacao(const ntf::Notificacao& notificacao) override {
+      if (notificacao.tipo() == ntf::TN_ADICIONAR_ACAO) {
+        ids.push_back(notificacao.acao().id_entidade_origem());
+        if (rola) {
+          valores.push_back(RolaDado(20));
+          aleatorios.push_back(Aleatorio());
+        }
+      }
+      return true;
+    }
+    const bool rola;
+    std::vector<unsigned int> ids;
+    std::vector<int> valores;
+    std::vector<float> aleatorios;
+  };
+
+  Receptor original(/*rola=*/true);
+  {
+    ntf::CentralNotificacoes central;
+    GravadorNotificacoes gravador(caminho, &central);
+    central.RegistraReceptor(&original);
+    for (int i = 0; i < 3; ++i) {
+      auto n = ntf::NovaNotificacao(ntf::TN_ADICIONAR_ACAO);
+      n->mutable_acao()->set_id_entidade_origem(i + 1);
+      central.AdicionaNotificacaoRemota(ntf::NovaNotificacao(ntf::TN_ADICIONAR_ACAO));
+      central.AdicionaNotificacao(std::move(n));
+      central.Notifica();
+    }
+    central.AdicionaNotificacao(ntf::NovaNotificacao(ntf::TN_TEMPORIZADOR));
+    central.Notifica();
+    central.DesregistraReceptor(&original);
+    EXPECT_EQ(gravador.NumRegistros(), 4 + 3 + 6);
+  }
+
+  {
+    // Por ciclo: a local, os dados rolados no tratamento dela e a remota.
+    LeitorGravacao leitor(caminho);
+    std::vector<RegistroGravacao::Tipo> tipos;
+    RegistroGravacao registro;
+    int64_t tempo_us = 0;
+    while (leitor.Le(&registro)) {
+      tipos.push_back(registro.tipo);
+      EXPECT_GE(registro.tempo_us, tempo_us);
+      tempo_us = registro.tempo_us;
+    }
+    ASSERT_EQ(tipos.size(), 13U);
+    EXPECT_EQ(tipos[0], RegistroGravacao::LOCAL);
+    EXPECT_EQ(tipos[1], RegistroGravacao::DADO);
+    EXPECT_EQ(tipos[2], RegistroGravacao::DADO);
+    EXPECT_EQ(tipos[3], RegistroGravacao::REMOTA);
+    EXPECT_EQ(tipos[12], RegistroGravacao::LOCAL);
+  }
+
+  // Outra semente: a reproducao tem que usar a gravada.
+  AlteraSementeDados(SementeDados() + 1);
+  RolaDado(6);
+  Receptor reproduzido(/*rola=*/true);
+  auto estatisticas = ReproduzGravacao(caminho, &reproduzido, /*tempo_real=*/false);
+  EXPECT_EQ(reproduzido.ids, original.ids);
+  EXPECT_EQ(reproduzido.valores, original.valores);
+  EXPECT_EQ(reproduzido.aleatorios, original.aleatorios);
+  EXPECT_EQ(estatisticas.notificacoes_locais, 4);
+  EXPECT_EQ(estatisticas.notificacoes_remotas, 3);
+  EXPECT_EQ(estatisticas.dados, 6);
+  EXPECT_EQ(estatisticas.dados_divergentes, 0);
+  EXPECT_EQ(estatisticas.dados_nao_rolados, 0);
+  EXPECT_GT(estatisticas.NotificacoesPorSegundo(), 0.0);
+
+  // Quem nao rola os dados gravados diverge.
+  Receptor divergente(/*rola=*/false);
+  estatisticas = ReproduzGravacao(caminho, &divergente, /*tempo_real=*/false);
+  EXPECT_EQ(estatisticas.dados_nao_rolados, 6);
+  EXPECT_FALSE(TemDadoDeTesteOuForcado(20).has_value());
+  boost::filesystem::remove(caminho);
+}
+
+TEST(TesteTabuleiro, CargaParalela) {
+  auto n = ntf::NovaNotificacao(ntf::TN_DESERIALIZAR_TABULEIRO);
+  const std::vector<std::string> modelos = {"Humano Plebeu 1", "Orc Capitão", "Humano Monge 5", "Tigre Atroz"};
+  constexpr int kNumEntidades = 80;
+  for (int i = 0; i < kNumEntidades; ++i) {
+    auto* e = n->mutable_tabuleiro()->add_entidade();
+    *e = TabelasCriando().ModeloEntidade(modelos[i % modelos.size()]).entidade();
+    // Metade dos ids repetidos, que devem ser regerados.
+    e->set_id(i % (kNumEntidades / 2));
+    // Pontos de vida rolados na carga.
+    e->clear_max_pontos_vida();
+    e->clear_pontos_vida();
+  }
+  // A balestra vem antes de quem a monta: o recomputa dela so acha o tenente se todas ja estiverem no tabuleiro.
+  {
+    auto* e = n->mutable_tabuleiro()->add_entidade();
+    *e = TabelasCriando().ModeloEntidade("Balestra").entidade();
+    e->set_id(100);
+    e->add_entidades_montadas(101);
+    e = n->mutable_tabuleiro()->add_entidade();
+    *e = TabelasCriando().ModeloEntidade("Humano Dragão Púrpura: Tenente 5").entidade();
+    e->set_id(101);
+  }
+  auto carrega = [&n] (int num_threads) {
+    auto tabuleiro = std::make_unique<TabuleiroTeste>();
+    tabuleiro->AlteraNumThreadsCarga(num_threads);
+    AlteraSementeDados(42);
+    tabuleiro->TrataNotificacao(*n);
+    return tabuleiro;
+  };
+  auto tabuleiro = carrega(4);
+  ASSERT_EQ(tabuleiro->TodasEntidades().size(), static_cast<size_t>(kNumEntidades + 2));
+  // Cada entidade foi recomputada como na carga sequencial.
+  auto sequencial = NovaEntidadeParaTestes(TabelasCriando().ModeloEntidade("Humano Monge 5").entidade(), TabelasCriando());
+  const auto* entidade = tabuleiro->BuscaEntidade(2);
+  ASSERT_NE(entidade, nullptr);
+  EXPECT_EQ(entidade->Proto().info_pericias_size(), sequencial->Proto().info_pericias_size());
+  EXPECT_EQ(BonusTotal(entidade->Proto().dados_defesa().ca()), BonusTotal(sequencial->Proto().dados_defesa().ca()));
+  const auto* balestra = tabuleiro->BuscaEntidade(100);
+  ASSERT_NE(balestra, nullptr);
+  EXPECT_EQ(DadosAtaquePorGrupo("flecha", balestra->Proto()).bonus_ataque_final(), 2);  // +6 tenente, -4 tamanho da arma.
+
+  // Os dados rolados na carga nao dependem do numero de threads.
+  auto tabuleiro_uma_thread = carrega(1);
+  for (const auto& [id, entidade] : tabuleiro->TodasEntidades()) {
+    const auto* outra = tabuleiro_uma_thread->BuscaEntidade(id);
+    ASSERT_NE(outra, nullptr);
+    EXPECT_EQ(entidade->MaximoPontosVida(), outra->MaximoPontosVida()) << "id: " << id;
+  }
+}
+
+TEST(TesteTabuleiro, SemGraficoNaoChamaGl) {
+  // Sem contexto, um caminho grafico que chega ao contexto (como GeraFramebuffer) derruba o teste. Os outros sao
+  // contados pelas definicoes de glGen* no inicio do arquivo.
+  auto n = ntf::NovaNotificacao(ntf::TN_DESERIALIZAR_TABULEIRO);
+  auto* proto = n->mutable_tabuleiro();
+  proto->set_largura(4);
+  proto->set_altura(4);
+  for (int i = 0; i < 25; ++i) proto->add_ponto_terreno(i % 3);
+  auto* sub_cenario = proto->add_sub_cenario();
+  sub_cenario->set_id_cenario(1);
+  sub_cenario->set_largura(2);
+  sub_cenario->set_altura(2);
+  for (int i = 0; i < 9; ++i) sub_cenario->add_ponto_terreno(i % 2);
+  // Camera no sub cenario, para a carga passar por CarregaSubCenario.
+  proto->mutable_camera_inicial()->mutable_alvo()->set_id_cenario(1);
+  proto->mutable_camera_inicial()->mutable_pos()->set_id_cenario(1);
+  {
+    auto* e = proto->add_entidade();
+    *e = TabelasCriando().ModeloEntidade("Orc Capitão").entidade();
+    e->set_id(1);
+    e = proto->add_entidade();
+    e->set_id(2);
+    e->set_tipo(TE_FORMA);
+    e->set_sub_tipo(TF_LIVRE);
+    e->add_ponto()->set_x(1.0f);
+    e->add_ponto()->set_y(1.0f);
+    e = proto->add_entidade();
+    e->set_id(3);
+    e->set_tipo(TE_COMPOSTA);
+    auto* sub_forma = e->add_sub_forma();
+    sub_forma->set_tipo(TE_FORMA);
+    sub_forma->set_sub_tipo(TF_CUBO);
+  }
+#if CONTA_OBJETOS_GL
+  {
+    // Controle: com grafico, a mesma carga grava VBOs.
+    TabuleiroTeste com_grafico;
+    const int antes = g_objetos_gl_gerados;
+    com_grafico.TrataNotificacao(*n);
+    EXPECT_GT(g_objetos_gl_gerados, antes);
+  }
+  const int antes = g_objetos_gl_gerados;
+#endif
+
+  TabuleiroTeste tabuleiro;
+  tabuleiro.AlteraSemGrafico(true);
+  tabuleiro.TrataNotificacao(*n);
+  ASSERT_EQ(tabuleiro.TodasEntidades().size(), 3U);
+
+  auto opcoes = ntf::NovaNotificacao(ntf::TN_ATUALIZAR_OPCOES);
+  *opcoes->mutable_opcoes() = OpcoesProto::default_instance();
+  opcoes->mutable_opcoes()->set_mapeamento_sombras(true);
+  tabuleiro.TrataNotificacao(*opcoes);
+
+  // Edicoes que regeram objetos graficos: relevo, forma livre nova e acao com VBO proprio.
+  auto relevo = ntf::NovaNotificacao(ntf::TN_ATUALIZAR_RELEVO_TABULEIRO);
+  relevo->mutable_tabuleiro()->set_id_cenario(1);
+  for (int i = 0; i < 9; ++i) relevo->mutable_tabuleiro()->add_ponto_terreno(1);
+  tabuleiro.TrataNotificacao(*relevo);
+  auto forma = ntf::NovaNotificacao(ntf::TN_ADICIONAR_ENTIDADE);
+  *forma->mutable_entidade() = n->tabuleiro().entidade(1);
+  forma->mutable_entidade()->set_id(4);
+  tabuleiro.TrataNotificacao(*forma);
+  auto acao = ntf::NovaNotificacao(ntf::TN_ADICIONAR_ACAO);
+  acao->mutable_acao()->set_tipo(ACAO_SINALIZACAO);
+  acao->mutable_acao()->mutable_pos_tabuleiro()->set_x(1.0f);
+  tabuleiro.TrataNotificacao(*acao);
+  EXPECT_EQ(tabuleiro.TodasEntidades().size(), 4U);
+  EXPECT_EQ(tabuleiro.NumAcoes(), 1);
+  for (int i = 0; i < 3; ++i) {
+    tabuleiro.TrataNotificacao(*ntf::NovaNotificacao(ntf::TN_TEMPORIZADOR));
+  }
+#if CONTA_OBJETOS_GL
+  EXPECT_EQ(g_objetos_gl_gerados, antes);
+#endif
+}
+
+TEST(TesteArquivo, MapeiaArquivo) {
+  std::string lido;
+  arq::LeArquivo(arq::TIPO_DADOS, "tabelas.asciiproto", &lido);
+  auto mapeado = arq::MapeiaArquivo(arq::TIPO_DADOS, "tabelas.asciiproto");
+  ASSERT_GT(mapeado->tamanho(), 0u);
+  EXPECT_EQ(mapeado->Visao(), lido);
+
+  const std::string diretorio = arq::Diretorio(arq::TIPO_TESTE);
+  boost::filesystem::create_directories(diretorio);
+  arq::EscreveArquivo(arq::TIPO_TESTE, "teste_vazio.txt", "");
+  EXPECT_EQ(arq::MapeiaArquivo(arq::TIPO_TESTE, "teste_vazio.txt")->tamanho(), 0u);
+  EXPECT_THROW(arq::MapeiaArquivo(arq::TIPO_TESTE, "teste_inexistente.txt"), std::logic_error);
+
+  // Proto binario lido do mapeamento.
+  ntf::Notificacao n;
+  n.set_tipo(ntf::TN_DESERIALIZAR_TABULEIRO);
+  n.mutable_tabuleiro()->set_nome("mapeado");
+  arq::EscreveArquivoBinProto(arq::TIPO_TESTE, "teste_mapeado.binproto", n);
+  ntf::Notificacao lida;
+  arq::LeArquivoBinProto(arq::TIPO_TESTE, "teste_mapeado.binproto", &lida);
+  EXPECT_EQ(lida.tabuleiro().nome(), "mapeado");
+}
+
+TEST(TesteArquivo, CacheDiretorioEMetadados) {
+  const std::string diretorio = arq::Diretorio(arq::TIPO_TESTE);
+  boost::filesystem::create_directories(diretorio);
+  boost::filesystem::remove(diretorio + "/teste_cache.txt");
+  boost::filesystem::remove(diretorio + "/teste_cache_externo.txt");
+  auto contem = [](const arq::Listagem& listagem, const std::string& nome) {
+    return std::find(listagem->begin(), listagem->end(), nome) != listagem->end();
+  };
+  arq::Listagem antes = arq::ConteudoDiretorioCompartilhado(arq::TIPO_TESTE);
+  EXPECT_FALSE(contem(antes, "teste_cache.txt"));
+  // Sem mudancas, a mesma listagem eh reaproveitada.
+  EXPECT_EQ(antes, arq::ConteudoDiretorioCompartilhado(arq::TIPO_TESTE));
+
+  arq::EscreveArquivo(arq::TIPO_TESTE, "teste_cache.txt", "abc");
+  EXPECT_TRUE(contem(arq::ConteudoDiretorioCompartilhado(arq::TIPO_TESTE), "teste_cache.txt"));
+  // A listagem antiga nao muda.
+  EXPECT_FALSE(contem(antes, "teste_cache.txt"));
+  // Nenhum temporario da escrita atomica aparece.
+  EXPECT_FALSE(contem(arq::ConteudoDiretorioCompartilhado(arq::TIPO_TESTE), "teste_cache.txt.tmp"));
+
+  const auto metadados = arq::Metadados(arq::TIPO_TESTE, "teste_cache.txt");
+  EXPECT_EQ(metadados.tamanho, 3u);
+  EXPECT_EQ(metadados.hash, arq::HashConteudo("abc"));
+  EXPECT_TRUE(arq::ConteudoIgual(arq::TIPO_TESTE, "teste_cache.txt", "abc"));
+  EXPECT_FALSE(arq::ConteudoIgual(arq::TIPO_TESTE, "teste_cache.txt", "abd"));
+  EXPECT_FALSE(arq::ConteudoIgual(arq::TIPO_TESTE, "teste_cache.txt", "abcd"));
+  EXPECT_FALSE(arq::ConteudoIgual(arq::TIPO_TESTE, "teste_inexistente.txt", "abc"));
+  arq::EscreveArquivo(arq::TIPO_TESTE, "teste_cache.txt", "abd");
+  EXPECT_TRUE(arq::ConteudoIgual(arq::TIPO_TESTE, "teste_cache.txt", "abd"));
+  // Reescrita de fora de arq, com o mesmo tamanho e logo em seguida: a data pode nem mudar, mas o conteudo novo eh visto.
+  { std::ofstream externo(diretorio + "/teste_cache.txt", std::ios::trunc); externo << "xyz"; }
+  EXPECT_FALSE(arq::ConteudoIgual(arq::TIPO_TESTE, "teste_cache.txt", "abd"));
+  EXPECT_TRUE(arq::ConteudoIgual(arq::TIPO_TESTE, "teste_cache.txt", "xyz"));
+
+#if __linux__
+  // Mudancas feitas fora de arq sao vistas pelo inotify.
+  { std::ofstream externo(diretorio + "/teste_cache_externo.txt"); }
+  EXPECT_TRUE(contem(arq::ConteudoDiretorioCompartilhado(arq::TIPO_TESTE), "teste_cache_externo.txt"));
+  boost::filesystem::remove(diretorio + "/teste_cache_externo.txt");
+  EXPECT_FALSE(contem(arq::ConteudoDiretorioCompartilhado(arq::TIPO_TESTE), "teste_cache_externo.txt"));
+#endif
+}
+
+TEST(TesteSalvamentoAutomatico, SalvaComCopiasRotativas) {
+  const std::string diretorio = arq::Diretorio(arq::TIPO_TESTE);
+  boost::filesystem::create_directories(diretorio);
+  const std::string nome = "teste_salvamento.binproto";
+  auto versao_salva = [](const std::string& nome_arquivo) {
+    ntf::Notificacao lida;
+    arq::LeArquivoBinProto(arq::TIPO_TESTE, nome_arquivo, &lida);
+    return lida.tabuleiro().nome();
+  };
+  auto instantaneo = [](int versao) {
+    auto n = ntf::NovaNotificacao(ntf::TN_DESERIALIZAR_TABULEIRO);
+    n->mutable_tabuleiro()->set_nome(absl::StrCat("versao ", versao));
+    for (int i = 0; i < 100; ++i) {
+      n->mutable_tabuleiro()->add_entidade()->set_id(i);
+    }
+    return n;
+  };
+  {
+    SalvamentoAutomatico salvamento(arq::TIPO_TESTE, nome, /*num_copias=*/2);
+    for (int i = 0; i <= 3; ++i) {
+      boost::filesystem::remove(diretorio + "/" + salvamento.NomeCopia(i == 0 ? 3 : i));
+    }
+    boost::filesystem::remove(diretorio + "/" + nome);
+    EXPECT_FALSE(salvamento.SalvaUltimoInstantaneo("teste_salvamento_watchdog.binproto"));
+    for (int versao = 1; versao <= 3; ++versao) {
+      salvamento.Agenda(instantaneo(versao));
+      salvamento.EsperaTermino();
+    }
+    EXPECT_EQ(versao_salva(nome), "versao 3");
+    EXPECT_EQ(versao_salva(salvamento.NomeCopia(1)), "versao 2");
+    EXPECT_EQ(versao_salva(salvamento.NomeCopia(2)), "versao 1");
+    EXPECT_FALSE(boost::filesystem::exists(diretorio + "/" + salvamento.NomeCopia(3)));
+    EXPECT_FALSE(boost::filesystem::exists(diretorio + "/" + nome + ".tmp"));
+    const auto metricas = salvamento.LeMetricas();
+    EXPECT_EQ(metricas.num_salvamentos, 3);
+    EXPECT_EQ(metricas.num_falhas, 0);
+    EXPECT_GT(metricas.ultimo_tamanho_bytes, metricas.ultimo_tamanho_comprimido_bytes);
+    EXPECT_GE(metricas.maior_latencia_ms, metricas.MediaLatenciaMs());
+
+    ASSERT_TRUE(salvamento.SalvaUltimoInstantaneo("teste_salvamento_watchdog.binproto"));
+    EXPECT_EQ(versao_salva("teste_salvamento_watchdog.binproto"), "versao 3");
+    // O pendente eh escrito mesmo se o salvamento for destruido logo apos agendar.
+    salvamento.Agenda(instantaneo(4));
+  }
+  EXPECT_EQ(versao_salva(nome), "versao 4");
+}
+
+TEST(TesteLogEventos, BufferCircularConsultaEFormatacaoPreguicosa) {
+  BufferLogEventos log(/*capacidade=*/3);
+  for (int i = 0; i < 5; ++i) {
+    EventoLog e;
+    e.tipo = i % 2 == 0 ? EventoLog::TEXTO_ENTIDADE : EventoLog::TEXTO;
+    e.texto = absl::StrCat("evento\n", i);
+    if (i % 2 == 0) e.entidades.emplace_back(i, absl::StrCat("e", i));
+    log.Adiciona(std::move(e));
+  }
+  ASSERT_EQ(log.Tamanho(), 3);
+  EXPECT_EQ(log.Texto(0), "entidade e4: evento 4");
+  EXPECT_EQ(log.Texto(1), "evento 3");
+  EXPECT_EQ(log.Texto(2), "entidade e2: evento 2");
+  FiltroLogEventos filtro;
+  filtro.id_entidade = 2;
+  EXPECT_EQ(log.Textos(filtro), std::vector<std::string>({"entidade e2: evento 2"}));
+  filtro = FiltroLogEventos();
+  filtro.max_eventos = 2;
+  EXPECT_EQ(log.Consulta(filtro), std::vector<int>({0, 1}));
+  filtro = FiltroLogEventos();
+  filtro.desde_ms = log.TempoMs() + 1000;
+  EXPECT_TRUE(log.Consulta(filtro).empty());
+  log.Limpa();
+  EXPECT_EQ(log.Tamanho(), 0);
+
+  // O resumo da notificacao eh o mesmo de ResumoNotificacao, com o rotulo do momento do evento.
+  EntidadeProto proto;
+  proto.set_id(7);
+  proto.set_rotulo("orc");
+  TabuleiroTeste tabuleiro({NovaEntidadeParaTestes(proto, TabelasCriando()).release()});
+  ntf::Notificacao grupo;
+  grupo.set_tipo(ntf::TN_GRUPO_NOTIFICACOES);
+  auto* n = grupo.add_notificacao();
+  n->set_tipo(ntf::TN_MOVER_ENTIDADE);
+  n->mutable_entidade()->set_id(7);
+  n->mutable_entidade()->mutable_pos()->set_x(1.0f);
+  n->mutable_entidade()->mutable_destino()->set_y(2.0f);
+  grupo.add_notificacao()->set_tipo(ntf::TN_ADICIONAR_ACAO);
+  const std::string resumo = ResumoNotificacao(tabuleiro, grupo);
+  tabuleiro.AdicionaNotificacaoListaEventos(grupo);
+  ASSERT_GT(tabuleiro.LogEventos().Tamanho(), 0);
+  const auto& evento = tabuleiro.LogEventos().Evento(0);
+  ASSERT_NE(evento.notificacao, nullptr);
+  EXPECT_EQ(evento.notificacao->notificacao_size(), 1);
+  EXPECT_TRUE(evento.EnvolveEntidade(7));
+  EntidadeProto parcial;
+  parcial.set_rotulo("outro");
+  tabuleiro.BuscaEntidade(7)->AtualizaParcial(parcial);
+  EXPECT_EQ(tabuleiro.LogEventos().Texto(0), resumo);
+}
+
+TEST(TesteLogEventos, EscreveArquivoDaSessao) {
+  const std::string diretorio = arq::Diretorio(arq::TIPO_TESTE);
+  boost::filesystem::create_directories(diretorio);
+  const std::string caminho = diretorio + "/teste_log_eventos.txt";
+  boost::filesystem::remove(caminho);
+  {
+    BufferLogEventos log(/*capacidade=*/2);
+    EventoLog e;
+    e.texto = "antes do arquivo";
+    log.Adiciona(e);
+    log.AlteraArquivoSessao(caminho);
+    for (int i = 0; i < 4; ++i) {
+      e.texto = absl::StrCat("evento ", i);
+      log.Adiciona(e);
+    }
+    log.EsperaEscrita();
+    // O arquivo tem todos os eventos desde a abertura, inclusive os que ja sairam do buffer.
+    std::string conteudo;
+    arq::LeArquivo(arq::TIPO_TESTE, "teste_log_eventos.txt", &conteudo);
+    EXPECT_EQ(conteudo.find("antes do arquivo"), std::string::npos);
+    for (int i = 0; i < 4; ++i) {
+      EXPECT_NE(conteudo.find(absl::StrCat("] evento ", i, "\n")), std::string::npos) << conteudo;
+    }
+    EXPECT_THROW(log.AlteraArquivoSessao(diretorio + "/nao_existe/log.txt"), std::logic_error);
+  }
+}
+
+TEST(TesteAcoesTabuleiro, CompactaMantendoOrdemEReusaPool) {
+  TabuleiroTeste tabuleiro;
+  tabuleiro.AlteraPassoFixoMs(1000);
+  const auto antes = LeEstatisticasPoolAcoes();
+  auto adiciona = [&tabuleiro](const std::string& texto, int duracao_s) {
+    ntf::Notificacao n;
+    n.set_tipo(ntf::TN_ADICIONAR_ACAO);
+    auto* acao = n.mutable_acao();
+    acao->set_tipo(ACAO_DELTA_PONTOS_VIDA);
+    acao->set_texto(texto);
+    acao->set_duracao_s(duracao_s);
+    acao->mutable_pos_entidade()->set_x(1.0f);
+    tabuleiro.TrataNotificacao(n);
+  };
+  adiciona("a", 10);
+  adiciona("b", 5);
+  adiciona("c", 20);
+  adiciona("d", 5);
+  ASSERT_EQ(tabuleiro.NumAcoes(), 4);
+  EXPECT_EQ(LeEstatisticasPoolAcoes().blocos_em_uso, antes.blocos_em_uso + 4);
+
+  // Primeiro ciclo apenas posiciona; as de 5s terminam no sexto.
+  ntf::Notificacao temporizador;
+  temporizador.set_tipo(ntf::TN_TEMPORIZADOR);
+  for (int i = 0; i < 6; ++i) {
+    tabuleiro.TrataNotificacao(temporizador);
+  }
+  ASSERT_EQ(tabuleiro.NumAcoes(), 2);
+  EXPECT_EQ(tabuleiro.AcaoEmAndamento(0).Proto().texto(), "a");
+  EXPECT_EQ(tabuleiro.AcaoEmAndamento(1).Proto().texto(), "c");
+  const auto depois = LeEstatisticasPoolAcoes();
+  EXPECT_EQ(depois.blocos_em_uso, antes.blocos_em_uso + 2);
+
+  // Novas acoes reaproveitam os blocos liberados.
+  adiciona("e", 5);
+  adiciona("f", 5);
+  ASSERT_EQ(tabuleiro.NumAcoes(), 4);
+  EXPECT_EQ(tabuleiro.AcaoEmAndamento(3).Proto().texto(), "f");
+  EXPECT_EQ(LeEstatisticasPoolAcoes().blocos_reservados, depois.blocos_reservados);
+  EXPECT_GT(LeEstatisticasPoolAcoes().alocacoes, depois.alocacoes);
+}
+
+TEST(TesteInteresseClientes, RemocaoERessincronizacaoLimpamEstado) {
+  auto cria = [](unsigned int id, int id_cenario) {
+    EntidadeProto proto;
+    proto.set_id(id);
+    proto.mutable_pos()->set_id_cenario(id_cenario);
+    proto.set_visivel(true);
+    proto.set_selecionavel_para_jogador(false);
+    return NovaEntidadeParaTestes(proto, TabelasCriando()).release();
+  };
+  TabuleiroTeste tabuleiro({cria(1, CENARIO_PRINCIPAL), cria(2, 1)});
+  InteresseClientes* interesse = tabuleiro.MutableInteresseClientes();
+  ntf::InteresseCliente principal;
+  principal.set_id_cenario(CENARIO_PRINCIPAL);
+  interesse->AtualizaInteresse("a", principal);
+  const std::vector<std::string> ids_clientes = {"a"};
+  auto filtra = [&](const ntf::Notificacao& n) -> bool {
+    std::vector<bool> interessa(ids_clientes.size(), true);
+    std::vector<net::FiltroInteresse::Recuperacao> recuperacoes;
+    interesse->Filtra(n, ids_clientes, &interessa, &recuperacoes);
+    return interessa[0];
+  };
+  auto parcial = [](unsigned int id) {
+    ntf::Notificacao n;
+    n.set_tipo(ntf::TN_ATUALIZAR_PARCIAL_ENTIDADE_NOTIFICANDO_SE_LOCAL);
+    n.mutable_entidade()->set_id(id);
+    return n;
+  };
+  filtra(parcial(1));
+  filtra(parcial(2));
+  EXPECT_FALSE(filtra(parcial(2)));
+  EXPECT_EQ(interesse->NumDefasadas("a"), 1);
+  EXPECT_EQ(interesse->NumEntidadesConhecidas(), 2);
+
+  // A remocao passa e apaga a entidade de tudo.
+  ntf::Notificacao remocao;
+  remocao.set_tipo(ntf::TN_REMOVER_ENTIDADE);
+  remocao.mutable_entidade()->set_id(2);
+  EXPECT_TRUE(filtra(remocao));
+  EXPECT_EQ(interesse->NumDefasadas("a"), 0);
+  EXPECT_EQ(interesse->NumEntidadesConhecidas(), 1);
+
+  // Quem vai receber o tabuleiro inteiro nao tem mais nada defasado.
+  filtra(parcial(2));
+  EXPECT_FALSE(filtra(parcial(2)));
+  EXPECT_EQ(interesse->NumDefasadas("a"), 1);
+  interesse->ClienteRessincronizado("a");
+  EXPECT_EQ(interesse->NumDefasadas("a"), 0);
+}
+
+TEST(TesteInteresseClientes, FiltraPorCenarioEVisibilidadeERecupera) {
+  // 1 visivel no principal, 2 visivel no cenario 1, 3 invisivel no principal, 4 de jogador no cenario 1.
+  auto cria = [](unsigned int id, int id_cenario, bool visivel, bool selecionavel) {
+    EntidadeProto proto;
+    proto.set_id(id);
+    proto.mutable_pos()->set_id_cenario(id_cenario);
+    proto.set_visivel(visivel);
+    proto.set_selecionavel_para_jogador(selecionavel);
+    return NovaEntidadeParaTestes(proto, TabelasCriando()).release();
+  };
+  TabuleiroTeste tabuleiro({
+      cria(1, CENARIO_PRINCIPAL, true, false), cria(2, 1, true, false),
+      cria(3, CENARIO_PRINCIPAL, false, false), cria(4, 1, true, true)});
+  auto& central = CentralColetoraCriandoZerando();
+  InteresseClientes* interesse = tabuleiro.MutableInteresseClientes();
+  ntf::InteresseCliente principal;
+  principal.set_id_cenario(CENARIO_PRINCIPAL);
+  interesse->AtualizaInteresse("a", principal);
+
+  // "b" nunca informou interesse e recebe tudo.
+  const std::vector<std::string> ids_clientes = {"a", "b"};
+  std::vector<net::FiltroInteresse::Recuperacao> recuperacoes;
+  auto filtra = [&](const ntf::Notificacao& n) {
+    std::vector<bool> interessa(ids_clientes.size(), true);
+    recuperacoes.clear();
+    interesse->Filtra(n, ids_clientes, &interessa, &recuperacoes);
+    return interessa;
+  };
+  auto parcial = [](unsigned int id) {
+    auto n = ntf::NovaNotificacao(ntf::TN_ATUALIZAR_PARCIAL_ENTIDADE_NOTIFICANDO_SE_LOCAL);
+    n->mutable_entidade()->set_id(id);
+    n->mutable_entidade()->set_pontos_vida(5);
+    return n;
+  };
+  const std::vector<bool> todos = {true, true};
+  const std::vector<bool> so_b = {false, true};
+  // Sem estado anterior conhecido, passa.
+  for (unsigned int id : {1, 2, 3, 4}) {
+    EXPECT_EQ(filtra(*parcial(id)), todos) << "id: " << id;
+  }
+  EXPECT_EQ(filtra(*parcial(1)), todos);
+  EXPECT_EQ(filtra(*parcial(2)), so_b);
+  EXPECT_EQ(filtra(*parcial(3)), so_b);
+  EXPECT_EQ(filtra(*parcial(4)), todos);
+  EXPECT_EQ(interesse->NumDefasadas("a"), 2);
+  // Estruturais passam sempre.
+  EXPECT_EQ(filtra(*ntf::NovaNotificacao(ntf::TN_REMOVER_ENTIDADE)), todos);
+
+  // Acoes passam se alguma entidade interessar, sem defasar nada.
+  auto acao = ntf::NovaNotificacao(ntf::TN_ADICIONAR_ACAO);
+  acao->mutable_acao()->set_id_entidade_origem(2);
+  EXPECT_EQ(filtra(*acao), so_b);
+  acao->mutable_acao()->add_por_entidade()->set_id(1);
+  EXPECT_EQ(filtra(*acao), todos);
+
+  // Mudando para o cenario 1, "a" recebe o estado de 2, mas nao o de 3, que continua invisivel.
+  ntf::InteresseCliente cenario_1;
+  cenario_1.set_id_cenario(1);
+  interesse->AtualizaInteresse("a", cenario_1);
+  ASSERT_EQ(central.NotificacoesRemotas().size(), 1U);
+  EXPECT_EQ(central.NotificacoesRemotas()[0]->tipo(), ntf::TN_ATUALIZAR_ENTIDADE);
+  EXPECT_EQ(central.NotificacoesRemotas()[0]->id_rede(), "a");
+  EXPECT_EQ(central.NotificacoesRemotas()[0]->entidade().id(), 2U);
+  EXPECT_EQ(interesse->NumDefasadas("a"), 1);
+  EXPECT_EQ(filtra(*parcial(1)), so_b);
+
+  // 3 ficando visivel no cenario 1: passa, precedida do estado completo, pois "a" perdeu atualizacoes.
+  auto aparece = parcial(3);
+  aparece->mutable_entidade()->set_visivel(true);
+  aparece->mutable_entidade()->mutable_pos()->set_id_cenario(1);
+  EXPECT_EQ(filtra(*aparece), todos);
+  ASSERT_EQ(recuperacoes.size(), 1U);
+  EXPECT_EQ(recuperacoes[0].indice_cliente, 0U);
+  EXPECT_EQ(recuperacoes[0].notificacao->id_rede(), "a");
+  EXPECT_EQ(recuperacoes[0].notificacao->entidade().id(), 3U);
+  // E a saida dela do cenario tambem passa, pelo estado anterior.
+  auto some = parcial(3);
+  some->mutable_entidade()->set_visivel(false);
+  EXPECT_EQ(filtra(*some), todos);
+  EXPECT_EQ(filtra(*some), so_b);
+
+  // Entidade da camera sempre interessa. Sem filtro, tudo passa.
+  cenario_1.set_id_entidade_camera(1);
+  interesse->AtualizaInteresse("a", cenario_1);
+  EXPECT_EQ(filtra(*parcial(1)), todos);
+  ntf::InteresseCliente sem_filtro;
+  sem_filtro.set_sem_filtro(true);
+  interesse->AtualizaInteresse("a", sem_filtro);
+  EXPECT_EQ(interesse->NumDefasadas("a"), 0);
+  EXPECT_EQ(filtra(*parcial(3)), todos);
+
+  interesse->RemoveCliente("a");
+  interesse->AtualizaInteresse("a", principal);
+  EXPECT_EQ(interesse->NumDefasadas("a"), 0);
+}
+
+TEST(TesteEscalonador, PassosFixosDescarteEFracao) {
+  using std::chrono::milliseconds;
+  Escalonador escalonador(/*passo_ms=*/10, /*max_passos_por_ciclo=*/3);
+  const auto t0 = Escalonador::Relogio::time_point() + std::chrono::hours(1);
+  // Primeiro ciclo so inicia o relogio.
+  EXPECT_EQ(escalonador.Passos(t0), 0);
+  EXPECT_EQ(escalonador.ProximoPrazo(), t0 + milliseconds(10));
+  EXPECT_EQ(escalonador.Passos(t0 + milliseconds(9)), 0);
+  EXPECT_EQ(escalonador.Passos(t0 + milliseconds(10)), 1);
+  // O resto nao se perde: 25ms depois do inicio sao 2 passos e meio.
+  EXPECT_EQ(escalonador.Passos(t0 + milliseconds(25)), 1);
+  EXPECT_NEAR(escalonador.Fracao(), 0.5f, 1e-3);
+  EXPECT_EQ(escalonador.ProximoPrazo(), t0 + milliseconds(30));
+  EXPECT_EQ(escalonador.Estatisticas().passos_atrasados, 0);
+  // Atraso: 5 passos pendentes, 3 rodam e 2 sao descartados.
+  EXPECT_EQ(escalonador.Passos(t0 + milliseconds(75)), 3);
+  const auto& e = escalonador.Estatisticas();
+  EXPECT_EQ(e.passos, 5);
+  EXPECT_EQ(e.passos_descartados, 2);
+  EXPECT_EQ(e.passos_atrasados, 2);
+  // Os descartados sao os mais antigos: o mais atrasado que rodou venceu em 50ms.
+  EXPECT_NEAR(e.atraso_maximo_ms, 25.0, 1e-6);
+  // Relogio voltando nao anda a simulacao.
+  EXPECT_EQ(escalonador.Passos(t0 + milliseconds(70)), 0);
+}
+
+TEST(TesteEscalonador, RitmoDeQuadrosETarefas) {
+  using std::chrono::milliseconds;
+  Escalonador escalonador(/*passo_ms=*/30);
+  const auto t0 = Escalonador::Relogio::time_point() + std::chrono::hours(1);
+  escalonador.Passos(t0);
+  // Sem intervalo de quadro, desenha apos passos.
+  EXPECT_FALSE(escalonador.DeveDesenhar(t0 + milliseconds(5)));
+  EXPECT_EQ(escalonador.Passos(t0 + milliseconds(30)), 1);
+  EXPECT_TRUE(escalonador.DeveDesenhar(t0 + milliseconds(30)));
+  EXPECT_FALSE(escalonador.DeveDesenhar(t0 + milliseconds(31)));
+
+  // Com intervalo, desenha no ritmo da tela, entre os passos.
+  escalonador.AlteraIntervaloQuadroMs(10);
+  EXPECT_TRUE(escalonador.DeveDesenhar(t0 + milliseconds(32)));
+  EXPECT_FALSE(escalonador.DeveDesenhar(t0 + milliseconds(35)));
+  EXPECT_EQ(escalonador.ProximoPrazo(), t0 + milliseconds(42));
+  EXPECT_TRUE(escalonador.DeveDesenhar(t0 + milliseconds(42)));
+  // Muito atrasado: um quadro so, e os perdidos sao contados.
+  EXPECT_TRUE(escalonador.DeveDesenhar(t0 + milliseconds(80)));
+  EXPECT_FALSE(escalonador.DeveDesenhar(t0 + milliseconds(85)));
+  EXPECT_EQ(escalonador.Estatisticas().quadros, 4);
+  EXPECT_EQ(escalonador.Estatisticas().quadros_perdidos, 2);
+
+  // Tarefas: sem orcamento, uma por ciclo; a incompleta volta a ser chamada.
+  std::vector<int> feitas;
+  int chamadas_longa = 0;
+  escalonador.AdicionaTarefa([&feitas]() { feitas.push_back(1); return true; });
+  escalonador.AdicionaTarefa([&feitas, &chamadas_longa]() { return ++chamadas_longa == 2 && (feitas.push_back(2), true); });
+  escalonador.AdicionaTarefa([&feitas]() { feitas.push_back(3); return true; });
+  const auto passado = Escalonador::Relogio::now() - std::chrono::seconds(1);
+  EXPECT_EQ(escalonador.ExecutaTarefas(passado), 1);
+  EXPECT_EQ(escalonador.NumTarefasPendentes(), 2u);
+  EXPECT_EQ(escalonador.Estatisticas().ciclos_orcamento_esgotado, 1);
+  escalonador.AlteraOrcamentoTarefasMs(1000);
+  EXPECT_EQ(escalonador.ExecutaTarefas(Escalonador::Relogio::now()), 2);
+  EXPECT_EQ(feitas, std::vector<int>({1, 2, 3}));
+  EXPECT_EQ(chamadas_longa, 2);
+  EXPECT_EQ(escalonador.Estatisticas().tarefas, 3);
+}
+
+TEST(TesteControleVirtualRetido, RefazApenasBotoesAlteradosEPickingPorRetangulo) {
+  DadosBotao db_a, db_b, db_c;
+  db_a.set_id(CONTROLE_AJUDA);
+  db_a.set_coluna(0);
+  db_b.set_id(CONTROLE_REGUA);
+  db_b.set_coluna(1);
+  db_c.set_id(CONTROLE_TRANSICAO);
+  db_c.set_coluna(1);
+  db_c.set_forma(FORMA_NULA);
+  // Botoes de 10x10 pixels, lado a lado.
+  std::vector<int> gerados;
+  auto gera = [&gerados] (const LeiauteControleVirtual& leiaute, BotaoRetido* botao) {
+    const auto& db = *botao->estado.db;
+    gerados.push_back(db.id());
+    botao->selecionavel = db.forma() != FORMA_NULA;
+    botao->retangulo[0] = db.coluna() * 10.0f;
+    botao->retangulo[1] = 0.0f;
+    botao->retangulo[2] = db.coluna() * 10.0f + 10.0f;
+    botao->retangulo[3] = 10.0f;
+  };
+  auto estados = [&db_a, &db_b, &db_c] (bool a_pressionado) {
+    std::vector<EstadoBotaoControleVirtual> ret(3);
+    ret[0].db = &db_a;
+    ret[0].pressionado = a_pressionado;
+    ret[1].db = &db_b;
+    ret[1].rotulo = "b";
+    ret[2].db = &db_c;
+    return ret;
+  };
+  LeiauteControleVirtual leiaute;
+  leiaute.largura = 800;
+  leiaute.altura = 600;
+
+  ControleVirtualRetido retido;
+  EXPECT_FALSE(retido.IdBotaoEm(5, 5).has_value());
+  auto e = estados(false);
+  EXPECT_EQ(retido.Atualiza(leiaute, &e, gera), 3);
+  // Mesmo estado: nada eh refeito.
+  e = estados(false);
+  EXPECT_EQ(retido.Atualiza(leiaute, &e, gera), 0);
+  // Apenas o botao alterado.
+  gerados.clear();
+  e = estados(true);
+  EXPECT_EQ(retido.Atualiza(leiaute, &e, gera), 1);
+  EXPECT_EQ(gerados, std::vector<int>({CONTROLE_AJUDA}));
+  EXPECT_TRUE(retido.Botoes()[0].estado.pressionado);
+  // Botao que some e volta: so ele eh refeito.
+  e = estados(true);
+  e.erase(e.begin() + 1);
+  EXPECT_EQ(retido.Atualiza(leiaute, &e, gera), 0);
+  e = estados(true);
+  EXPECT_EQ(retido.Atualiza(leiaute, &e, gera), 1);
+  // Leiaute novo refaz tudo.
+  leiaute.largura = 1024;
+  e = estados(true);
+  EXPECT_EQ(retido.Atualiza(leiaute, &e, gera), 3);
+
+  // Picking: o botao de forma nula nao eh selecionavel, mesmo desenhado por cima.
+  EXPECT_EQ(retido.IdBotaoEm(5, 5).value_or(-1), CONTROLE_AJUDA);
+  EXPECT_EQ(retido.IdBotaoEm(15, 5).value_or(-1), CONTROLE_REGUA);
+  EXPECT_FALSE(retido.IdBotaoEm(25, 5).has_value());
+  EXPECT_FALSE(retido.IdBotaoEm(5, 11).has_value());
+  retido.Limpa();
+  EXPECT_FALSE(retido.IdBotaoEm(5, 5).has_value());
+}
+
+// Cabecalho de uma mensagem codificada: tamanho dos dados e se estao comprimidos.
+std::pair<unsigned int, bool> CabecalhoMensagem(std::string mensagem) {
+  const unsigned int tamanho = net::DecodificaTamanho(mensagem.begin());
+  return std::make_pair(tamanho & ~net::BIT_COMPRIMIDO, (tamanho & net::BIT_COMPRIMIDO) != 0);
+}
+
+// Notificacao grande e compressivel, acima de qualquer limiar usado nos testes.
+ntf::Notificacao NotificacaoGrande() {
+  ntf::Notificacao n;
+  n.set_tipo(ntf::TN_ERRO);
+  for (int i = 0; i < 500; ++i) {
+    n.mutable_erro()->append("mensagem de erro repetida " + std::to_string(i % 10) + "; ");
+  }
+  return n;
+}
+
+TEST(TesteCompressaoRede, NegociacaoDeCodec) {
+  ntf::Notificacao anuncio;
+  anuncio.set_tipo(ntf::TN_RESPOSTA_CONEXAO);
+  // Cliente antigo: nao anuncia nada.
+  EXPECT_EQ(net::EscolheCodec(anuncio), ntf::CR_NENHUM);
+  // Codec desconhecido sozinho tambem nao serve.
+  anuncio.add_codecs_rede(ntf::CR_NENHUM);
+  EXPECT_EQ(net::EscolheCodec(anuncio), ntf::CR_NENHUM);
+  anuncio.clear_codecs_rede();
+  net::PreencheCodecsSuportados(&anuncio);
+  ASSERT_TRUE(net::CompressaoRedeHabilitada());
+  EXPECT_EQ(net::EscolheCodec(anuncio), ntf::CR_GZIP);
+}
+
+TEST(TesteCompressaoRede, NotificacaoAbaixoEAcimaDoLimiar) {
+  net::EstatisticasCompressao estatisticas;
+  ntf::Notificacao pequena;
+  pequena.set_tipo(ntf::TN_ERRO);
+  pequena.set_erro("curta");
+  const size_t kLimiar = 1024;
+  ASSERT_LT(pequena.ByteSizeLong(), kLimiar);
+
+  // Abaixo do limiar, vai como estava: cabecalho sem o bit e a notificacao serializada.
+  std::string mensagem = net::CodificaNotificacao(pequena, ntf::CR_GZIP, kLimiar, &estatisticas);
+  auto cabecalho = CabecalhoMensagem(mensagem);
+  EXPECT_FALSE(cabecalho.second);
+  EXPECT_EQ(mensagem, net::CodificaDados(pequena.SerializeAsString()));
+  ntf::Notificacao lida;
+  ASSERT_TRUE(net::DecodificaNotificacao(mensagem.substr(4), cabecalho.second, &lida, &estatisticas));
+  EXPECT_EQ(lida.SerializeAsString(), pequena.SerializeAsString());
+  EXPECT_EQ(estatisticas.mensagens_sem_compressao, 1);
+  EXPECT_EQ(estatisticas.mensagens_comprimidas, 0);
+
+  // Acima do limiar, comprimida e marcada.
+  const ntf::Notificacao grande = NotificacaoGrande();
+  ASSERT_GE(grande.ByteSizeLong(), kLimiar);
+  mensagem = net::CodificaNotificacao(grande, ntf::CR_GZIP, kLimiar, &estatisticas);
+  cabecalho = CabecalhoMensagem(mensagem);
+  EXPECT_TRUE(cabecalho.second);
+  EXPECT_EQ(cabecalho.first, mensagem.size() - 4);
+  EXPECT_LT(mensagem.size(), grande.ByteSizeLong());
+  ASSERT_TRUE(net::DecodificaNotificacao(mensagem.substr(4), cabecalho.second, &lida, &estatisticas));
+  EXPECT_EQ(lida.SerializeAsString(), grande.SerializeAsString());
+  EXPECT_EQ(estatisticas.mensagens_comprimidas, 1);
+  EXPECT_EQ(estatisticas.mensagens_descomprimidas, 1);
+  EXPECT_EQ(estatisticas.bytes_originais, static_cast<int64_t>(grande.ByteSizeLong()));
+  EXPECT_EQ(estatisticas.bytes_comprimidos, static_cast<int64_t>(mensagem.size() - 4));
+  EXPECT_LT(estatisticas.Razao(), 1.0);
+
+  // Sem codec negociado, nunca comprime.
+  mensagem = net::CodificaNotificacao(grande, ntf::CR_NENHUM, kLimiar, &estatisticas);
+  EXPECT_FALSE(CabecalhoMensagem(mensagem).second);
+  EXPECT_EQ(mensagem, net::CodificaDados(grande.SerializeAsString()));
+}
+
+TEST(TesteCompressaoRede, DadosSerializadosERepasse) {
+  net::EstatisticasCompressao estatisticas;
+  const size_t kLimiar = 1024;
+  const ntf::Notificacao grande = NotificacaoGrande();
+  const std::string dados = grande.SerializeAsString();
+
+  // Repasse de dados recebidos sem compressao, para um cliente com codec.
+  std::string mensagem = net::CodificaDadosComCodec(dados, ntf::CR_GZIP, kLimiar, &estatisticas);
+  auto cabecalho = CabecalhoMensagem(mensagem);
+  ASSERT_TRUE(cabecalho.second);
+  ntf::Notificacao lida;
+  ASSERT_TRUE(net::DecodificaNotificacao(mensagem.substr(4), cabecalho.second, &lida, &estatisticas));
+  EXPECT_EQ(lida.SerializeAsString(), dados);
+  // Abaixo do limiar ou sem codec, os dados vao como estao.
+  EXPECT_EQ(net::CodificaDadosComCodec(dados, ntf::CR_GZIP, dados.size() + 1, &estatisticas), net::CodificaDados(dados));
+  EXPECT_EQ(net::CodificaDadosComCodec(dados, ntf::CR_NENHUM, kLimiar, &estatisticas), net::CodificaDados(dados));
+
+  // Dados recebidos comprimidos sao repassados sem recomprimir, para clientes com o mesmo codec: o cabecalho refeito
+  // com o bit reproduz a mensagem original byte a byte.
+  const std::string recebida = net::CodificaNotificacao(grande, ntf::CR_GZIP, kLimiar, &estatisticas);
+  const std::string recebidos = recebida.substr(4);
+  EXPECT_EQ(net::CodificaDados(recebidos, /*comprimido=*/true), recebida);
+}
+
+TEST(TesteCompressaoRede, RejeitaGzipCorrompido) {
+  net::EstatisticasCompressao estatisticas;
+  const std::string mensagem = net::CodificaNotificacao(NotificacaoGrande(), ntf::CR_GZIP, 1024, &estatisticas);
+  ASSERT_TRUE(CabecalhoMensagem(mensagem).second);
+  const std::string dados = mensagem.substr(4);
+  ntf::Notificacao lida;
+  // Truncado.
+  EXPECT_FALSE(net::DecodificaNotificacao(dados.substr(0, dados.size() / 2), true, &lida, &estatisticas));
+  // Lixo no lugar do fluxo gzip.
+  EXPECT_FALSE(net::DecodificaNotificacao(std::string(64, '\x5a'), true, &lida, &estatisticas));
+  // Bytes alterados no meio do fluxo comprimido.
+  std::string alterados = dados;
+  for (size_t i = alterados.size() / 3; i < alterados.size() / 3 + 16; ++i) {
+    alterados[i] = static_cast<char>(~alterados[i]);
+  }
+  EXPECT_FALSE(net::DecodificaNotificacao(alterados, true, &lida, &estatisticas));
+}
+
+// Movimento de entidade, com posicao e, se com_destino, destino.
+ntf::Notificacao MovimentoEntidade(unsigned int id, float x, bool com_destino = false) {
+  ntf::Notificacao n;
+  n.set_tipo(ntf::TN_MOVER_ENTIDADE);
+  n.mutable_entidade()->set_id(id);
+  n.mutable_entidade()->mutable_pos()->set_x(x);
+  if (com_destino) {
+    n.mutable_entidade()->mutable_destino()->set_x(x);
+  }
+  return n;
+}
+
+TEST(TesteFilaEnvio, LimitesDeBytesEMensagens) {
+  net::EstatisticasFilasEnvio estatisticas;
+  net::FilaEnvio fila(&estatisticas);
+  const size_t kMaxBytes = 100;
+  const size_t kMaxMensagens = 4;
+  // O tabuleiro nao conta para os limites.
+  EXPECT_TRUE(fila.Enfileira(std::string(500, 't'), net::FilaEnvio::ENVIO_ESSENCIAL));
+  EXPECT_EQ(fila.Bytes(), 0u);
+  EXPECT_TRUE(fila.Enfileira(std::string(40, 'a'), net::FilaEnvio::ENVIO_NORMAL));
+  EXPECT_TRUE(fila.Enfileira(std::string(40, 'b'), net::FilaEnvio::ENVIO_REPASSE));
+  EXPECT_EQ(fila.Bytes(), 80u);
+  // Limite de bytes: exatamente no limite ainda cabe.
+  EXPECT_FALSE(fila.PassaDosLimites(20, net::FilaEnvio::ENVIO_NORMAL, kMaxBytes, kMaxMensagens));
+  EXPECT_TRUE(fila.PassaDosLimites(21, net::FilaEnvio::ENVIO_NORMAL, kMaxBytes, kMaxMensagens));
+  EXPECT_TRUE(fila.PassaDosLimites(21, net::FilaEnvio::ENVIO_REPASSE, kMaxBytes, kMaxMensagens));
+  EXPECT_FALSE(fila.PassaDosLimites(1000, net::FilaEnvio::ENVIO_ESSENCIAL, kMaxBytes, kMaxMensagens));
+  // Limite de mensagens: o tabuleiro enfileirado conta como mensagem.
+  EXPECT_TRUE(fila.Enfileira("c", net::FilaEnvio::ENVIO_NORMAL));
+  EXPECT_EQ(fila.NumMensagens(), kMaxMensagens);
+  EXPECT_TRUE(fila.PassaDosLimites(1, net::FilaEnvio::ENVIO_NORMAL, kMaxBytes, kMaxMensagens));
+  EXPECT_FALSE(fila.PassaDosLimites(1, net::FilaEnvio::ENVIO_NORMAL, kMaxBytes, kMaxMensagens + 1));
+  EXPECT_EQ(estatisticas.maior_fila, kMaxMensagens);
+  EXPECT_EQ(estatisticas.maiores_bytes, 81u);
+}
+
+TEST(TesteFilaEnvio, MovimentoSubstituiEnfileiradoIndoParaOFim) {
+  net::EstatisticasFilasEnvio estatisticas;
+  net::FilaEnvio fila(&estatisticas);
+  auto enfileira = [&fila](const ntf::Notificacao& n) {
+    fila.Enfileira(net::CodificaDados(n.SerializeAsString()), net::FilaEnvio::ENVIO_NORMAL, net::ChaveSubstituicao(n));
+  };
+  ntf::Notificacao parcial;
+  parcial.set_tipo(ntf::TN_ATUALIZAR_PARCIAL_ENTIDADE_NOTIFICANDO_SE_LOCAL);
+  parcial.mutable_entidade()->set_id(1);
+  parcial.mutable_entidade()->mutable_pos()->set_x(2.0f);
+  EXPECT_TRUE(net::ChaveSubstituicao(parcial).empty());
+  ntf::Notificacao sem_id = MovimentoEntidade(1, 0.0f);
+  sem_id.mutable_entidade()->clear_id();
+  EXPECT_TRUE(net::ChaveSubstituicao(sem_id).empty());
+
+  enfileira(MovimentoEntidade(1, 1.0f));
+  enfileira(MovimentoEntidade(2, 1.0f));
+  enfileira(parcial);
+  // Com destino, nao cobre o movimento so com posicao.
+  enfileira(MovimentoEntidade(1, 5.0f, /*com_destino=*/true));
+  EXPECT_EQ(estatisticas.substituidas, 0);
+  ASSERT_EQ(fila.NumMensagens(), 4u);
+  enfileira(MovimentoEntidade(1, 3.0f));
+  EXPECT_EQ(estatisticas.substituidas, 1);
+
+  // O movimento novo vai para o fim: no lugar do antigo, a atualizacao parcial (mais velha) o sobrescreveria.
+  std::vector<std::string> esperadas;
+  for (const auto& n : { MovimentoEntidade(2, 1.0f), parcial, MovimentoEntidade(1, 5.0f, true), MovimentoEntidade(1, 3.0f) }) {
+    esperadas.push_back(net::CodificaDados(n.SerializeAsString()));
+  }
+  ASSERT_EQ(fila.NumMensagens(), esperadas.size());
+  size_t bytes = 0;
+  for (size_t i = 0; i < esperadas.size(); ++i) {
+    EXPECT_EQ(fila.Dados(i), esperadas[i]) << "mensagem " << i;
+    bytes += esperadas[i].size();
+  }
+  EXPECT_EQ(fila.Bytes(), bytes);
+}
+
+TEST(TesteFilaEnvio, RessincronizacaoDescartaNormaisEAdiaRepasses) {
+  net::EstatisticasFilasEnvio estatisticas;
+  net::FilaEnvio fila(&estatisticas);
+  fila.Enfileira("normal0", net::FilaEnvio::ENVIO_NORMAL);
+  fila.Enfileira("repasse0", net::FilaEnvio::ENVIO_REPASSE);
+  fila.Ressincroniza();
+  EXPECT_TRUE(fila.AguardandoRessincronizacao());
+  EXPECT_EQ(fila.NumMensagens(), 0u);
+  EXPECT_EQ(fila.Bytes(), 0u);
+  EXPECT_EQ(estatisticas.ressincronizacoes, 1);
+  EXPECT_EQ(estatisticas.descartadas, 2);
+  EXPECT_EQ(estatisticas.bytes_descartados, 15);
+
+  // Durante a espera: o estado do que o servidor gera vai no tabuleiro; os repasses, aplicados depois da serializacao,
+  // esperam. Os limites nao valem, para nao ressincronizar de novo.
+  EXPECT_FALSE(fila.PassaDosLimites(1000, net::FilaEnvio::ENVIO_NORMAL, 1, 1));
+  EXPECT_FALSE(fila.Enfileira("normal1", net::FilaEnvio::ENVIO_NORMAL));
+  EXPECT_EQ(estatisticas.descartadas, 3);
+  EXPECT_FALSE(fila.Enfileira("repasse1", net::FilaEnvio::ENVIO_REPASSE));
+  EXPECT_FALSE(fila.Enfileira("repasse2", net::FilaEnvio::ENVIO_REPASSE));
+  EXPECT_EQ(estatisticas.descartadas, 3);
+  EXPECT_EQ(fila.NumMensagens(), 0u);
+  EXPECT_TRUE(fila.RetiraRepassesAdiados().empty());
+
+  // O tabuleiro encerra a espera, e os repasses saem depois dele, em ordem.
+  EXPECT_TRUE(fila.Enfileira("tabuleiro", net::FilaEnvio::ENVIO_ESSENCIAL));
+  EXPECT_FALSE(fila.AguardandoRessincronizacao());
+  ASSERT_EQ(fila.NumMensagens(), 1u);
+  EXPECT_EQ(fila.Dados(0), "tabuleiro");
+  EXPECT_EQ(fila.RetiraRepassesAdiados(), std::vector<std::string>({ "repasse1", "repasse2" }));
+  EXPECT_TRUE(fila.RetiraRepassesAdiados().empty());
+}
+
+TEST(TesteFilaEnvio, EscritaEmCurso) {
+  net::EstatisticasFilasEnvio estatisticas;
+  net::FilaEnvio fila(&estatisticas);
+  fila.Enfileira("a", net::FilaEnvio::ENVIO_NORMAL);
+  fila.Enfileira("b", net::FilaEnvio::ENVIO_NORMAL, "chave");
+  std::vector<const std::string*> partes;
+  fila.IniciaEscrita(&partes);
+  ASSERT_EQ(partes.size(), 2u);
+  EXPECT_EQ(*partes[0], "a");
+  EXPECT_EQ(*partes[1], "b");
+  EXPECT_TRUE(fila.EmEscrita());
+  EXPECT_EQ(fila.NumMensagens(), 0u);
+  EXPECT_EQ(fila.Bytes(), 0u);
+  EXPECT_EQ(estatisticas.escritas, 1);
+  EXPECT_EQ(estatisticas.mensagens_enviadas, 2);
+
+  // O que chega durante a escrita vai na proxima, sem substituir o que ja esta sendo escrito nem mexer nas partes.
+  fila.Enfileira("c", net::FilaEnvio::ENVIO_NORMAL, "chave");
+  fila.Ressincroniza();
+  EXPECT_EQ(estatisticas.substituidas, 0);
+  EXPECT_EQ(fila.NumMensagensEmEscrita(), 2u);
+  EXPECT_EQ(*partes[1], "b");
+  fila.FimEscrita();
+  EXPECT_FALSE(fila.EmEscrita());
+}
+
 }  // namespace ent.
 
 int main(int argc, char **argv) {
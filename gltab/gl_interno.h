@@ -123,6 +123,8 @@ class Contexto {
   std::stack<Matrix4> pilha_mvm_ajuste_textura;
 
   std::stack<Matrix4>* pilha_corrente = nullptr;
+  // Buffer de dados por instancia dos lotes instanciados (LoteInstancias), reescrito a cada lote.
+  GLuint buffer_instancias = 0;
   float plano_proximo;    // distancia de corte do plano proximo.
   float plano_distante;   // distancia de corte do plano distante.
 
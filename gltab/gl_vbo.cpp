@@ -6,6 +6,7 @@
 #include "gltab/gl_interno.h"
 #include "gltab/gl_vbo.h"
 #include "log/log.h"
+#include "log/perfil.h"
 
 extern bool g_hack;
 
@@ -249,12 +250,13 @@ std::string VbosNaoGravados::ParaString(bool completo) const {
 //-------------
 // VbosGravados
 //-------------
-void VbosGravados::Grava(const VbosNaoGravados& vbos_nao_gravados) {
+void VbosGravados::Grava(const VbosNaoGravados& vbos_nao_gravados, GLenum modo) {
+  PERFIL_ZONA("gl::VbosGravados::Grava");
   //LOG(ERROR) << "gravando vbos de nome '" << nome_ << "' atualmente com " << vbos_.size() << " vbos, recebendo " << vbos_nao_gravados.vbos_.size() << " vbos";
   vbos_.resize(vbos_nao_gravados.vbos_.size());
   for (unsigned int i = 0; i < vbos_nao_gravados.vbos_.size(); ++i) {
     //vbos_[i].Desgrava();
-    vbos_[i].Grava(GL_TRIANGLES, vbos_nao_gravados.vbos_[i]);
+    vbos_[i].Grava(modo, vbos_nao_gravados.vbos_[i]);
   }
   if (nome_.empty() && !vbos_nao_gravados.vbos_.empty() && !vbos_nao_gravados.vbos_[0].nome().empty()) {
     Nomeia(vbos_nao_gravados.vbos_[0].nome());
@@ -901,6 +903,69 @@ void ConfiguraVao(GLenum modo, const VboGravado& vbo, int shader) {
   DesabilitaAtributosVertice(tem_normais, tem_tangentes, tem_texturas, tem_cores, tem_matriz_modelagem, tem_matriz_normal);
 }
 
+// Retorna o buffer de instancias do contexto, gerando-o se necessario.
+GLuint BufferInstancias() {
+  auto* c = interno::BuscaContexto();
+  if (c->buffer_instancias == 0) {
+    gl::GeraBuffers(1, &c->buffer_instancias);
+    V_ERRO_RET("ao gerar buffer de instancias");
+  }
+  return c->buffer_instancias;
+}
+
+// Como ConfiguraVao, mas as matrizes (e a cor, se o vbo nao tiver) vem do buffer de instancias, com divisor 1.
+void ConfiguraVaoInstancia(GLuint vao, const VboGravado& vbo, int shader_tipo) {
+  const GLuint buffer_instancias = BufferInstancias();
+  LigacaoComObjetoVertices(vao);
+  gl::LigacaoComBuffer(GL_ARRAY_BUFFER, vbo.nome_coordenadas());
+  bool tem_normais = vbo.tem_normais();
+  bool tem_tangentes = vbo.tem_tangentes();
+  bool tem_texturas = vbo.tem_texturas();
+  bool tem_cores = shader_tipo == gl::TSH_PICKING ? false : vbo.tem_cores();
+  bool sem_matriz_modelagem = false;
+  bool sem_matriz_normal = false;
+  HabilitaAtributosVertice(
+      vbo.NumVertices(), vbo.NumDimensoes(), nullptr,
+      tem_normais, nullptr, vbo.DeslocamentoNormais(),
+      tem_tangentes, nullptr, vbo.DeslocamentoTangentes(),
+      tem_texturas, nullptr, vbo.DeslocamentoTexturas(),
+      tem_cores, nullptr, vbo.DeslocamentoCores(),
+      sem_matriz_modelagem, nullptr, 0,
+      sem_matriz_normal, nullptr, 0,
+      /*atualiza_matrizes=*/false);
+
+  gl::LigacaoComBuffer(GL_ARRAY_BUFFER, buffer_instancias);
+  const auto& shader = interno::BuscaShader();
+  const GLsizei passo = LoteInstancias::kFloatsPorInstancia * sizeof(float);
+  auto atributo_instancia = [passo](GLint indice, GLint dimensoes, int deslocamento_floats) {
+    HabilitaVetorAtributosVertice(indice);
+    PonteiroAtributosVertices(indice, dimensoes, GL_FLOAT, GL_FALSE, passo,
+                              reinterpret_cast<const void*>(deslocamento_floats * sizeof(float)));
+    DivisorAtributoVertice(indice, 1);
+  };
+  if (shader.atr_gltab_matriz_modelagem != -1) {
+    for (int i = 0; i < 4; ++i) {
+      atributo_instancia(shader.atr_gltab_matriz_modelagem + i, 4, i * 4);
+    }
+  }
+  if (shader.atr_gltab_matriz_normal != -1) {
+    for (int i = 0; i < 3; ++i) {
+      atributo_instancia(shader.atr_gltab_matriz_normal + i, 3, 16 + i * 3);
+    }
+  }
+  const bool cor_instancia = !tem_cores && shader_tipo != gl::TSH_PICKING && shader.atr_gltab_cor != -1;
+  if (cor_instancia) {
+    atributo_instancia(shader.atr_gltab_cor, 4, 25);
+  }
+  gl::LigacaoComBuffer(GL_ARRAY_BUFFER, 0);
+  gl::LigacaoComBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo.nome_indices());
+  LigacaoComObjetoVertices(0);
+  gl::LigacaoComBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  DesabilitaAtributosVertice(tem_normais, tem_tangentes, tem_texturas, tem_cores || cor_instancia,
+                             shader.atr_gltab_matriz_modelagem != -1, shader.atr_gltab_matriz_normal != -1);
+  V_ERRO("ConfiguraVaoInstancia");
+}
+
 }  // namespace
 
 //-----------
@@ -910,6 +975,20 @@ GLuint VboGravado::Vao() const {
   return vao_por_shader_[TipoShaderCorrente()];
 }
 
+GLuint VboGravado::VaoInstancia() const {
+  const int shader = TipoShaderCorrente();
+  GLuint& vao = vao_instancia_por_shader_[shader];
+  if (vao == 0) {
+    GeraObjetosVertices(1, &vao);
+    if (vao == 0) {
+      LOG(ERROR) << "ERRO GRAFICO SERIO!!!!!!!!: glGenVertexArrays gerou valor 0 para instancia de " << nome_;
+      return 0;
+    }
+    ConfiguraVaoInstancia(vao, *this, shader);
+  }
+  return vao;
+}
+
 void VboGravado::AtualizaMatrizes(const Matrix4& matriz_modelagem) {
   if (!gravado_) {
     LOG(ERROR) << "tentando atualizar a matriz de VBO nao gravado";
@@ -2274,6 +2353,65 @@ void DesenhaVboGravado(const VboGravado& vbo, bool atualiza_matrizes) {
   }
 }
 
+//---------------
+// LoteInstancias
+//---------------
+void LoteInstancias::Adiciona(const Matrix4& modelagem, const float cor[4]) {
+  dados_.insert(dados_.end(), modelagem.get(), modelagem.get() + 16);
+  const Matrix3 normal = interno::ExtraiMatrizNormal(modelagem);
+  dados_.insert(dados_.end(), normal.get(), normal.get() + 9);
+  dados_.insert(dados_.end(), cor, cor + 4);
+}
+
+void LoteInstancias::Envia() const {
+  gl::LigacaoComBuffer(GL_ARRAY_BUFFER, BufferInstancias());
+  // Redefinir o buffer inteiro evita esperar pelo desenho anterior que ainda o usa.
+  gl::BufferizaDados(GL_ARRAY_BUFFER, dados_.size() * sizeof(float), dados_.data(), GL_STREAM_DRAW);
+  gl::LigacaoComBuffer(GL_ARRAY_BUFFER, 0);
+  V_ERRO("LoteInstancias::Envia");
+}
+
+void LoteInstancias::DesenhaEnviado(const VboGravado& vbo) const {
+  if (!vbo.Gravado()) {
+    LOG(WARNING) << "ignorando vbo nao gravado: " << vbo.nome();
+    return;
+  }
+  if (vbo.tem_matriz_modelagem()) {
+    LOG(ERROR) << "vbo com matriz de modelagem propria nao pode ser instanciado: " << vbo.nome();
+    return;
+  }
+  if (g_hack) {
+    // Sem VAO: uma chamada por instancia.
+    for (int i = 0; i < NumInstancias(); ++i) {
+      const float* d = &dados_[i * kFloatsPorInstancia];
+      gl::MatrizEscopo salva_matriz(gl::MATRIZ_MODELAGEM);
+      gl::CarregaIdentidade();
+      gl::MultiplicaMatriz(d);
+      gl::MudaCor(d[25], d[26], d[27], d[28]);
+      DesenhaVboGravado(vbo);
+    }
+    return;
+  }
+  LigacaoComObjetoVertices(vbo.VaoInstancia());
+  gl::DesenhaElementosInstanciado(vbo.Modo(), vbo.NumVertices(), GL_UNSIGNED_SHORT, nullptr, NumInstancias());
+  LigacaoComObjetoVertices(0);
+  V_ERRO("LoteInstancias::DesenhaEnviado");
+}
+
+void LoteInstancias::Desenha(const VboGravado& vbo) const {
+  if (dados_.empty()) return;
+  Envia();
+  DesenhaEnviado(vbo);
+}
+
+void LoteInstancias::Desenha(const VbosGravados& vbos) const {
+  if (dados_.empty()) return;
+  Envia();
+  for (const auto& vbo : vbos.vbos_) {
+    DesenhaEnviado(vbo);
+  }
+}
+
 void DesenhaVboNaoGravado(const VboNaoGravado& vbo, GLenum modo, bool atualiza_matrizes) {
   LigacaoComObjetoVertices(0);
   DesenhaElementosComAtributos(
@@ -170,7 +170,8 @@ class VboGravado {
   bool tem_matriz_normal() const { return tem_normais() && tem_matriz_modelagem_; }
   // Retorna o vao para o shader corrente.
   GLuint Vao() const;
-  // Retorna o vao de instancia para o shader corrente.
+  // Retorna o vao de instancia para o shader corrente: atributos de vertice deste vbo e, por instancia,
+  // matrizes e cor do buffer de LoteInstancias.
   GLuint VaoInstancia() const;
 
   std::string ParaString() const {
@@ -199,7 +200,8 @@ class VboGravado {
   GLuint nome_coordenadas_ = 0;
   GLuint nome_indices_ = 0;
   std::vector<GLuint> vao_por_shader_;  // um VAO por shader.
-  std::vector<GLuint> vao_instancia_por_shader_;  // um VAO por shader.
+  // Um VAO por shader, configurado no primeiro desenho em lote (por isso mutable).
+  mutable std::vector<GLuint> vao_instancia_por_shader_;
   GLenum modo_ = GL_TRIANGLES;
 
   unsigned int deslocamento_normais_ = 0;
@@ -267,11 +269,11 @@ class VbosNaoGravados {
   friend class VbosGravados;
 };
 
-/** Conjunto de Vbos gravados. So pode ser GL_TRIANGLES. */
+/** Conjunto de Vbos gravados, todos no mesmo modo. */
 class VbosGravados {
  public:
-  // Grava os vbos usando GL_TRIANGLES.
-  void Grava(const VbosNaoGravados& vbos_nao_gravados);
+  // Grava os vbos usando o modo (GL_TRIANGLES por padrao).
+  void Grava(const VbosNaoGravados& vbos_nao_gravados, GLenum modo = GL_TRIANGLES);
   void Desgrava();
   void Desenha() const;
   bool Vazio() const { return vbos_.empty(); }
@@ -279,10 +281,37 @@ class VbosGravados {
   void AtualizaMatrizes(const Matrix4& matriz_modelagem);
 
  private:
+  friend class LoteInstancias;
+
   std::vector<VboGravado> vbos_;
   std::string nome_;
 };
 
+/** Instancias de um mesmo VBO (ou conjunto), desenhadas com uma chamada instanciada por VBO.
+* Cada instancia tem sua matriz de modelagem e cor. A cor da instancia so eh usada se o VBO nao tiver cores.
+* Os VBOs nao podem ter matriz de modelagem propria.
+*/
+class LoteInstancias {
+ public:
+  // Matriz de modelagem (16), matriz normal (9) e cor (4).
+  static constexpr int kFloatsPorInstancia = 29;
+
+  void Adiciona(const Matrix4& modelagem, const float cor[4]);
+  void Limpa() { dados_.clear(); }
+  bool Vazio() const { return dados_.empty(); }
+  int NumInstancias() const { return static_cast<int>(dados_.size()) / kFloatsPorInstancia; }
+
+  void Desenha(const VboGravado& vbo) const;
+  void Desenha(const VbosGravados& vbos) const;
+
+ private:
+  // Envia as instancias para o buffer de instancias do contexto.
+  void Envia() const;
+  void DesenhaEnviado(const VboGravado& vbo) const;
+
+  std::vector<float> dados_;
+};
+
 // Desenha o vbo, assumindo que ele ja tenha sido gravado.
 void DesenhaVboGravado(
     const VboGravado& vbo, bool atualiza_matrizes = true);
@@ -1,5 +1,8 @@
 /** @file ifg/Principal.cpp implementacao da classe principal. */
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <stdexcept>
 #include <stdlib.h>
 
@@ -10,6 +13,8 @@
 #include <QtCore/QTimer>
 #include <QtCore/QTranslator>
 #include <QtGui/QCloseEvent>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QScreen>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QDockWidget>
 #include <QtWidgets/QMenuBar>
@@ -58,6 +63,23 @@ Principal* Principal::Cria(
   return new Principal(tabelas, tabuleiro, m3d, texturas, teclado_mouse, central, q_app);
 }
 
+namespace {
+
+// Passo de simulacao inteiro, para a simulacao andar exatamente o que o escalonador mede.
+int PassoMs(const ent::OpcoesProto& opcoes) {
+  return std::max(1, static_cast<int>(std::lround(1000.0f / std::max(1.0f, opcoes.fps()))));
+}
+
+// Intervalo entre quadros: o de fps_desenho ou o da tela.
+double IntervaloQuadroMs(const ent::OpcoesProto& opcoes) {
+  if (opcoes.fps_desenho() > 0) return 1000.0 / opcoes.fps_desenho();
+  const auto* tela = QGuiApplication::primaryScreen();
+  const double taxa = tela == nullptr ? 0.0 : tela->refreshRate();
+  return taxa > 0 ? 1000.0 / taxa : 1000.0 / 60.0;
+}
+
+}  // namespace
+
 Principal::Principal(const ent::Tabelas& tabelas,
                      ent::Tabuleiro* tabuleiro,
                      m3d::Modelos3d* m3d,
@@ -68,8 +90,11 @@ Principal::Principal(const ent::Tabelas& tabelas,
     : QMainWindow(NULL), central_(central), q_app_(q_app),
       tabuleiro_(tabuleiro),
       v3d_(new Visualizador3d(tabelas, m3d, texturas, teclado_mouse, central, tabuleiro, this)),
-      menu_principal_(new MenuPrincipal(tabelas, tabuleiro, v3d_, central, this)) {
+      menu_principal_(new MenuPrincipal(tabelas, tabuleiro, v3d_, central, this)),
+      escalonador_(PassoMs(tabuleiro->Opcoes())) {
   central->RegistraReceptor(this);
+  tabuleiro->AlteraPassoFixoMs(escalonador_.PassoMs());
+  texturas->AlteraEscalonador(&escalonador_);
 }
 
 Principal::~Principal() {
@@ -84,9 +109,9 @@ void Principal::LogAlternado() {
 }
 
 namespace {
-std::string MontaStringLog(const std::list<std::string>& log) {
+std::string MontaStringLog(const ent::BufferLogEventos& log, const ent::FiltroLogEventos& filtro = ent::FiltroLogEventos()) {
   std::string str;
-  for (const auto& linha : log) {
+  for (const auto& linha : log.Textos(filtro)) {
     absl::StrAppendFormat(&str, "%s\n-----------------------------------------------\n", linha.c_str());
   }
   return str;
@@ -108,6 +133,8 @@ class MeuDock : public QDockWidget {
     rotulo_ = new QLabel("Log própio");
     botao_proprio_ = new QPushButton("Próprio");
     lambda_connect(botao_proprio_, SIGNAL(pressed()), [this] () { BotaoProprio(); });
+    botao_entidades_ = new QPushButton("Selecionadas");
+    lambda_connect(botao_entidades_, SIGNAL(pressed()), [this] () { BotaoEntidades(); });
     botao_requisitar_clientes_ = new QPushButton("Requisitar clientes");
     lambda_connect(botao_requisitar_clientes_, SIGNAL(pressed()), [this] () { BotaoRequisitarClientes(); });
     botao_alternar_cliente_ = new QPushButton("Alternar clientes");
@@ -116,6 +143,7 @@ class MeuDock : public QDockWidget {
     lambda_connect(botao_fechar_, SIGNAL(pressed()), [this] () { BotaoFechar(); });
     layout->addWidget(rotulo_);
     layout->addWidget(botao_proprio_);
+    layout->addWidget(botao_entidades_);
     layout->addWidget(botao_requisitar_clientes_);
     layout->addWidget(botao_alternar_cliente_);
     layout->addStretch();
@@ -138,6 +166,17 @@ class MeuDock : public QDockWidget {
     edit_->insertPlainText(MontaStringLog(tabuleiro_->LogEventos()).c_str());
   }
 
+  // Log proprio, apenas dos eventos envolvendo as entidades selecionadas.
+  void BotaoEntidades() {
+    rotulo_->setText("Log das selecionadas");
+    edit_->clear();
+    for (unsigned int id : tabuleiro_->IdsEntidadesSelecionadasOuPrimeiraPessoa()) {
+      ent::FiltroLogEventos filtro;
+      filtro.id_entidade = id;
+      edit_->insertPlainText(MontaStringLog(tabuleiro_->LogEventos(), filtro).c_str());
+    }
+  }
+
   void BotaoRequisitarClientes() {
     auto n = ntf::NovaNotificacao(ntf::TN_REQUISITAR_LOG_EVENTOS);
     central_->AdicionaNotificacaoRemota(std::move(n));
@@ -163,6 +202,7 @@ class MeuDock : public QDockWidget {
   QLabel* rotulo_;
   QTextEdit* edit_;
   QPushButton* botao_proprio_;
+  QPushButton* botao_entidades_;
   QPushButton* botao_requisitar_clientes_;
   QPushButton* botao_alternar_cliente_;
   QPushButton* botao_fechar_;
@@ -188,10 +228,9 @@ void Principal::Executa() {
   addDockWidget(Qt::BottomDockWidgetArea, dock_log_);
 
   const auto& opcoes = tabuleiro_->Opcoes();
-  float intervalo_notificacao_ms = 1000.0 / opcoes.fps();
-  LOG(INFO) << "Resolucao timer: " << intervalo_notificacao_ms;
-  LOG(INFO) << "FPS: " << opcoes.fps();
-  QTimer::singleShot(intervalo_notificacao_ms, this, &Principal::Temporizador);
+  LOG(INFO) << "FPS: " << opcoes.fps() << ", passo: " << PassoMs(opcoes) << "ms, intervalo quadro: "
+            << IntervaloQuadroMs(opcoes) << "ms";
+  QTimer::singleShot(0, Qt::PreciseTimer, this, &Principal::Temporizador);
 
   // mostra a janela e entra no loop do QT
   show();
@@ -214,34 +253,49 @@ void Principal::closeEvent(QCloseEvent *event) {
       tabuleiro_->TrataNotificacao(n);
     }
   }
+  LOG(INFO) << "Escalonador: " << escalonador_.ResumoEstatisticas();
   fechando_ = true;
   event->accept();
 }
 
 void Principal::Temporizador() {
-  //static boost::timer::cpu_timer timer;
-
-  //auto passou_ms = timer.elapsed().wall / 1000000ULL;
-  //LOG(ERROR) << "tempo_ms: " << (int)passou_ms;
-  //timer.start();
-
+  using Relogio = ent::Escalonador::Relogio;
   if (tabuleiro_->Opcoes().mostra_log_eventos() && !dock_log_->isVisible()) {
     dock_log_->show();
   } else if (!tabuleiro_->Opcoes().mostra_log_eventos() && dock_log_->isVisible()) {
     dock_log_->hide();
   }
 
-  // Realiza a notificação de todos.
-  auto* notificacao = new ntf::Notificacao;
-  notificacao->set_tipo(ntf::TN_TEMPORIZADOR);
-  central_->AdicionaNotificacao(notificacao);
+  // As opcoes podem ter mudado.
+  const auto& opcoes = tabuleiro_->Opcoes();
+  if (escalonador_.PassoMs() != PassoMs(opcoes)) {
+    escalonador_.AlteraPassoMs(PassoMs(opcoes));
+    tabuleiro_->AlteraPassoFixoMs(escalonador_.PassoMs());
+  }
+  escalonador_.AlteraIntervaloQuadroMs(IntervaloQuadroMs(opcoes));
+  escalonador_.AlteraOrcamentoTarefasMs(opcoes.orcamento_tarefas_ms());
+
+  // Passos de simulacao atrasados rodam em sequencia, cada um com sua notificacao.
   v3d_->PegaContexto();
-  central_->Notifica();
+  for (int passos = escalonador_.Passos(Relogio::now()); passos > 0; --passos) {
+    central_->AdicionaNotificacao(ntf::NovaNotificacao(ntf::TN_TEMPORIZADOR, central_->ArenaCiclo()));
+    central_->Notifica();
+  }
+  escalonador_.ExecutaTarefas(Relogio::now());
   v3d_->LiberaContexto();
 
-  const auto& opcoes = tabuleiro_->Opcoes();
-  float intervalo_notificacao_ms = 1000.0 / opcoes.fps();
-  QTimer::singleShot(intervalo_notificacao_ms, this, &Principal::Temporizador);
+  const auto agora = Relogio::now();
+  if (escalonador_.DeveDesenhar(agora)) {
+    tabuleiro_->AlteraFracaoPassoDesenho(escalonador_.Fracao());
+    v3d_->update();
+  }
+  if (agora - ultimo_log_escalonador_ > std::chrono::seconds(10)) {
+    VLOG(1) << "Escalonador: " << escalonador_.ResumoEstatisticas();
+    ultimo_log_escalonador_ = agora;
+  }
+
+  const auto espera = std::chrono::ceil<std::chrono::milliseconds>(escalonador_.ProximoPrazo() - Relogio::now());
+  QTimer::singleShot(std::max<int>(0, espera.count()), Qt::PreciseTimer, this, &Principal::Temporizador);
 }
 
 bool Principal::TrataNotificacao(const ntf::Notificacao& notificacao) {
@@ -5,6 +5,7 @@
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QWidget>
 #include <QtWidgets/QMainWindow>
+#include "ent/escalonador.h"
 #include "ntf/notificacao.h"
 
 /** @file ifg/qt/principal.h declaracao da interface grafica principal baseada em QT. */
@@ -67,7 +68,8 @@ class Principal : public QMainWindow, ntf::Receptor {
   void closeEvent(QCloseEvent * event) override;
 
  private slots:
-  /** Trata o evento de temporização. */
+  /** Trata o evento de temporização: roda os passos de simulacao devidos, as tarefas de fundo e pede o desenho,
+  * conforme o escalonador_. */
   void Temporizador();
   /** Indica que a visibilidade do dock de log foi alternada. */
   void LogAlternado();
@@ -90,6 +92,10 @@ class Principal : public QMainWindow, ntf::Receptor {
   QDockWidget* dock_log_ = nullptr;
   /** aplicação está sendo encerrada. */
   bool fechando_ = false;
+  /** Ritmo da simulacao, do desenho e das tarefas de fundo. */
+  ent::Escalonador escalonador_;
+  /** Ultimo log das estatisticas do escalonador. */
+  ent::Escalonador::Relogio::time_point ultimo_log_escalonador_;
 };
 
 } // namespace qt
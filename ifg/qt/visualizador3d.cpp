@@ -150,25 +150,8 @@ void Visualizador3d::resizeGL(int w, int h) {
   tabuleiro_->TrataRedimensionaJanela(w, h);
 }
 
-namespace {
-unsigned long TempoMs(const boost::timer::cpu_timer& timer) {
-  return timer.elapsed().wall / ent::DIV_NANO_PARA_MS;
-}
-
-}  // namespace
-
+// O ritmo dos quadros eh do Escalonador (ver Principal::Temporizador), que chama update().
 void Visualizador3d::paintGL() {
-  if (tabuleiro_->Opcoes().pular_frames() && skip_-- > 0) {
-    timer_.stop();
-    LOG(INFO) << "skipping: one frame, still " << skip_ << " left";
-    return;
-  }
-  glFinish();
-  timer_.stop();
-  unsigned long passou_ms = TempoMs(timer_);
-  timer_.start();
-  //LOG(INFO) << "passou " << passou_ms;
-  skip_ = std::min(passou_ms * (static_cast<unsigned long>(tabuleiro_->Opcoes().fps())) / 1000ULL, 10ULL);
   tabuleiro_->Desenha();
   glFlush();
 }
@@ -316,9 +299,6 @@ bool Visualizador3d::TrataNotificacao(const ntf::Notificacao& notificacao) {
       tabuleiro_->TrataNotificacao(*n);
       break;
     }
-    case ntf::TN_TEMPORIZADOR:
-      update();
-      break;
     default: ;
   }
   return true;
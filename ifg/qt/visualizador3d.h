@@ -13,7 +13,6 @@
 #endif
 #include <QtWidgets/QGestureEvent>
 #include <QtWidgets/QWidget>
-#include <boost/timer/timer.hpp>
 #include <list>
 #include "ent/tabuleiro.h"
 #include "ntf/notificacao.h"
@@ -121,8 +120,6 @@ class Visualizador3d :
   int x_antes_ = 0;
   int y_antes_ = 0;
   int contexto_cref_ = 0;
-  boost::timer::cpu_timer timer_;
-  int skip_ = 0;
   bool processando_gesto_ = false;
   bool dois_ou_mais_dedos_ = false;
   quint64 tap_timestamp_ = 0;
@@ -43,6 +43,15 @@ void LeArquivoAsset(tipo_e tipo, const std::string& nome_arquivo, std::string* d
   dados->assign(std::istreambuf_iterator<char>(arquivo), std::istreambuf_iterator<char>());
 }
 
+std::unique_ptr<ArquivoMapeado> MapeiaArquivoAsset(tipo_e tipo, const std::string& nome_arquivo) {
+  // Os assets ficam no bundle como arquivos normais.
+  try {
+    return interno::MapeiaArquivoNormal(interno::CaminhoArquivo(tipo, nome_arquivo));
+  } catch (const std::logic_error&) {
+    throw std::logic_error(std::string("Falha lendo asset: ") + nome_arquivo);
+  }
+}
+
 const std::vector<std::string> ConteudoDiretorioAsset(tipo_e tipo) {
   return interno::ConteudoDiretorioNormal(Diretorio(tipo));
 }
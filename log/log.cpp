@@ -1,4 +1,11 @@
 #include "log/log.h"
+#include "log/perfil.h"
+
+#if USAR_GLOG
+#include "absl/flags/flag.h"
+
+ABSL_FLAG(bool, perfil, false, "Liga o perfilador de zonas desde o inicio (ver log/perfil.h).");
+#endif
 
 namespace meulog {
 ABSL_ATTRIBUTE_NOINLINE
@@ -37,6 +44,7 @@ void Inicializa(int& argc, char**& argv) {
 #endif
   absl::InitializeLog();
   absl::ParseCommandLine(argc, argv);
+  perfil::Liga(absl::GetFlag(FLAGS_perfil));
 #endif
 }
 }  // namespace meulog
\ No newline at end of file
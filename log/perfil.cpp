@@ -0,0 +1,234 @@
+#include "log/perfil.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+namespace perfil {
+namespace {
+
+// Potencia de 2, para o indice ser uma mascara.
+constexpr uint64_t kTamanhoBuffer = 1 << 14;
+
+// Campos atomicos (relaxados) pois o leitor pode ler uma entrada sendo sobrescrita. Nesse caso, ela eh descartada.
+struct Evento {
+  std::atomic<const char*> nome{nullptr};
+  std::atomic<int64_t> inicio_ns{0};
+  std::atomic<int64_t> fim_ns{0};
+};
+
+struct BufferThread {
+  // Muda quando o buffer eh reciclado para outra thread.
+  std::atomic<int> id_thread{0};
+  // Escrito apenas pela thread dona.
+  std::atomic<uint64_t> num_escritos{0};
+  // Escrito apenas por Limpa: eventos antes deste indice sao ignorados.
+  std::atomic<uint64_t> inicio_valido{0};
+  Evento eventos[kTamanhoBuffer];
+};
+
+struct EventoCopiado {
+  const char* nome;
+  int id_thread;
+  int64_t inicio_ns;
+  int64_t fim_ns;
+};
+
+std::atomic<bool> g_ligado{false};
+
+std::mutex& MutexBuffers() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+// Todos os buffers ja criados, em uso ou livres. Buffers de threads que terminaram continuam legiveis ate serem
+// reciclados, pois ainda podem ter zonas a exportar.
+std::vector<BufferThread*>& Buffers() {
+  static std::vector<BufferThread*> buffers;
+  return buffers;
+}
+
+// Buffers de threads que terminaram, prontos para reuso. Assim o numero de buffers eh limitado pelo maximo de
+// threads simultaneas, e nao pelo total de threads criadas.
+std::vector<BufferThread*>& BuffersLivres() {
+  static std::vector<BufferThread*> livres;
+  return livres;
+}
+
+int& ProximoIdThread() {
+  static int proximo = 1;
+  return proximo;
+}
+
+BufferThread* ObtemBuffer() {
+  std::lock_guard<std::mutex> trava(MutexBuffers());
+  BufferThread* b = nullptr;
+  if (BuffersLivres().empty()) {
+    b = new BufferThread;
+    Buffers().push_back(b);
+  } else {
+    b = BuffersLivres().back();
+    BuffersLivres().pop_back();
+    // As zonas da thread anterior nao sao atribuidas a nova.
+    b->inicio_valido.store(b->num_escritos.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+  b->id_thread.store(ProximoIdThread()++, std::memory_order_relaxed);
+  return b;
+}
+
+// Devolve o buffer da thread quando ela termina.
+struct DonoBuffer {
+  BufferThread* buffer = nullptr;
+  ~DonoBuffer() {
+    if (buffer == nullptr) return;
+    std::lock_guard<std::mutex> trava(MutexBuffers());
+    BuffersLivres().push_back(buffer);
+  }
+};
+
+BufferThread* BufferThreadCorrente() {
+  thread_local DonoBuffer dono;
+  if (dono.buffer == nullptr) {
+    dono.buffer = ObtemBuffer();
+  }
+  return dono.buffer;
+}
+
+std::vector<EventoCopiado> CopiaEventos() {
+  std::vector<BufferThread*> buffers;
+  {
+    std::lock_guard<std::mutex> trava(MutexBuffers());
+    buffers = Buffers();
+  }
+  std::vector<EventoCopiado> copia;
+  for (auto* b : buffers) {
+    const uint64_t fim = b->num_escritos.load(std::memory_order_acquire);
+    const uint64_t inicio = std::max(b->inicio_valido.load(std::memory_order_relaxed),
+                                     fim > kTamanhoBuffer ? fim - kTamanhoBuffer : 0);
+    const int id_thread = b->id_thread.load(std::memory_order_relaxed);
+    const size_t inicio_copia = copia.size();
+    for (uint64_t i = inicio; i < fim; ++i) {
+      const Evento& e = b->eventos[i & (kTamanhoBuffer - 1)];
+      copia.push_back({e.nome.load(std::memory_order_relaxed), id_thread,
+                       e.inicio_ns.load(std::memory_order_relaxed), e.fim_ns.load(std::memory_order_relaxed)});
+    }
+    // Descarta o que a thread pode ter sobrescrito durante a copia.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // A escrita em andamento (indice fim_depois) tambem conta.
+    const uint64_t fim_depois = b->num_escritos.load(std::memory_order_relaxed) + 1;
+    if (fim_depois > kTamanhoBuffer && fim_depois - kTamanhoBuffer > inicio) {
+      const uint64_t sobrescritos = std::min(fim_depois - kTamanhoBuffer, fim) - inicio;
+      copia.erase(copia.begin() + inicio_copia, copia.begin() + inicio_copia + sobrescritos);
+    }
+  }
+  return copia;
+}
+
+// Percentil pelo metodo do posto mais proximo. Duracoes devem estar ordenadas.
+int64_t Percentil(const std::vector<int64_t>& duracoes, double p) {
+  int indice = static_cast<int>(std::ceil(p * duracoes.size())) - 1;
+  return duracoes[std::clamp(indice, 0, static_cast<int>(duracoes.size()) - 1)];
+}
+
+void EscreveStringJson(const char* s, std::ostream* saida) {
+  *saida << '"';
+  for (; *s != '\0'; ++s) {
+    if (*s == '"' || *s == '\\') {
+      *saida << '\\';
+    }
+    *saida << *s;
+  }
+  *saida << '"';
+}
+
+}  // namespace
+
+void Liga(bool ligado) {
+  g_ligado.store(ligado, std::memory_order_relaxed);
+}
+
+bool Ligado() {
+  return g_ligado.load(std::memory_order_relaxed);
+}
+
+int64_t AgoraNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void GravaZona(const char* nome, int64_t inicio_ns, int64_t fim_ns) {
+  if (!Ligado()) return;
+  BufferThread* b = BufferThreadCorrente();
+  const uint64_t i = b->num_escritos.load(std::memory_order_relaxed);
+  Evento& e = b->eventos[i & (kTamanhoBuffer - 1)];
+  e.nome.store(nome, std::memory_order_relaxed);
+  e.inicio_ns.store(inicio_ns, std::memory_order_relaxed);
+  e.fim_ns.store(fim_ns, std::memory_order_relaxed);
+  b->num_escritos.store(i + 1, std::memory_order_release);
+}
+
+int NumBuffers() {
+  std::lock_guard<std::mutex> trava(MutexBuffers());
+  return static_cast<int>(Buffers().size());
+}
+
+void Limpa() {
+  std::lock_guard<std::mutex> trava(MutexBuffers());
+  for (auto* b : Buffers()) {
+    b->inicio_valido.store(b->num_escritos.load(std::memory_order_acquire), std::memory_order_relaxed);
+  }
+}
+
+std::vector<EstatisticaZona> Estatisticas() {
+  // Agrupa pelo conteudo do nome, pois o mesmo literal pode ter enderecos diferentes em unidades diferentes.
+  std::map<std::string, std::vector<int64_t>> duracoes_por_nome;
+  for (const auto& e : CopiaEventos()) {
+    if (e.nome == nullptr) continue;
+    duracoes_por_nome[e.nome].push_back(e.fim_ns - e.inicio_ns);
+  }
+  std::vector<EstatisticaZona> estatisticas;
+  for (auto& [nome, duracoes] : duracoes_por_nome) {
+    std::sort(duracoes.begin(), duracoes.end());
+    EstatisticaZona ez;
+    ez.nome = nome;
+    ez.num = duracoes.size();
+    for (int64_t d : duracoes) ez.total_ns += d;
+    ez.media_ns = ez.total_ns / ez.num;
+    ez.p50_ns = Percentil(duracoes, 0.50);
+    ez.p95_ns = Percentil(duracoes, 0.95);
+    ez.p99_ns = Percentil(duracoes, 0.99);
+    ez.maximo_ns = duracoes.back();
+    estatisticas.push_back(std::move(ez));
+  }
+  std::sort(estatisticas.begin(), estatisticas.end(), [](const EstatisticaZona& lhs, const EstatisticaZona& rhs) {
+    return lhs.total_ns > rhs.total_ns;
+  });
+  return estatisticas;
+}
+
+std::string TraceChrome() {
+  std::ostringstream saida;
+  saida << std::fixed << std::setprecision(3);
+  saida << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool primeiro = true;
+  for (const auto& e : CopiaEventos()) {
+    if (e.nome == nullptr) continue;
+    if (!primeiro) saida << ",";
+    primeiro = false;
+    // Trace events usam microssegundos.
+    saida << "\n{\"name\":";
+    EscreveStringJson(e.nome, &saida);
+    saida << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.id_thread
+          << ",\"ts\":" << (e.inicio_ns / 1000.0)
+          << ",\"dur\":" << ((e.fim_ns - e.inicio_ns) / 1000.0) << "}";
+  }
+  saida << "\n]}\n";
+  return saida.str();
+}
+
+}  // namespace perfil
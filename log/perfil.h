@@ -0,0 +1,77 @@
+/** Perfilador de zonas nomeadas.
+* Cada thread grava suas zonas em um buffer circular proprio, sem trava. A leitura (estatisticas e exportacao)
+* copia os buffers e descarta o que possa ter sido sobrescrito durante a copia.
+*
+* Uso:
+*   void Tabuleiro::Desenha() {
+*     PERFIL_ZONA("Tabuleiro::Desenha");
+*     ...
+*   }
+*
+* Os nomes das zonas devem ser literais (ou ter duracao estatica), pois apenas o ponteiro eh guardado.
+*/
+#ifndef LOG_PERFIL_H
+#define LOG_PERFIL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace perfil {
+
+// Liga ou desliga a coleta. Desligado, cada zona custa apenas a leitura de um atomico.
+void Liga(bool ligado);
+bool Ligado();
+
+// Tempo monotonico em nanossegundos.
+int64_t AgoraNs();
+
+// Grava uma zona ja terminada na thread corrente. Nao faz nada se desligado.
+void GravaZona(const char* nome, int64_t inicio_ns, int64_t fim_ns);
+
+// Descarta todas as zonas gravadas ate agora, de todas as threads.
+void Limpa();
+
+// Numero de buffers de thread alocados. Buffers de threads terminadas sao reciclados por novas threads.
+int NumBuffers();
+
+struct EstatisticaZona {
+  std::string nome;
+  int num = 0;
+  int64_t total_ns = 0;
+  int64_t media_ns = 0;
+  int64_t p50_ns = 0;
+  int64_t p95_ns = 0;
+  int64_t p99_ns = 0;
+  int64_t maximo_ns = 0;
+};
+// Agrega as zonas presentes nos buffers por nome, ordenado por tempo total decrescente.
+std::vector<EstatisticaZona> Estatisticas();
+
+// Retorna as zonas gravadas no formato trace event do Chrome (chrome://tracing, perfetto).
+std::string TraceChrome();
+
+// Escopo que grava uma zona do construtor ao destrutor.
+class ZonaEscopo {
+ public:
+  explicit ZonaEscopo(const char* nome) : nome_(nome), inicio_ns_(Ligado() ? AgoraNs() : -1) {}
+  ~ZonaEscopo() {
+    if (inicio_ns_ >= 0) {
+      GravaZona(nome_, inicio_ns_, AgoraNs());
+    }
+  }
+  ZonaEscopo(const ZonaEscopo&) = delete;
+  ZonaEscopo& operator=(const ZonaEscopo&) = delete;
+
+ private:
+  const char* nome_;
+  int64_t inicio_ns_;
+};
+
+}  // namespace perfil
+
+#define PERFIL_CONCATENA_INTERNO(a, b) a##b
+#define PERFIL_CONCATENA(a, b) PERFIL_CONCATENA_INTERNO(a, b)
+#define PERFIL_ZONA(nome) perfil::ZonaEscopo PERFIL_CONCATENA(perfil_zona_, __LINE__)(nome)
+
+#endif  // LOG_PERFIL_H
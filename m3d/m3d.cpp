@@ -1,3 +1,4 @@
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include <string>
 #include <set>
 #define VLOG_NIVEL 1
@@ -17,29 +18,26 @@ namespace m3d {
 
 namespace {
 
-// Le o conteudo cru de um arquivo de modelo.
-void LeModelo3d(const std::string& nome_arquivo, std::vector<unsigned char>* dados) {
-  std::string dados_str;
+// Le o conteudo cru de um arquivo de modelo (mapeado, sem copia).
+std::unique_ptr<arq::ArquivoMapeado> LeModelo3d(const std::string& nome_arquivo) {
   try {
-    arq::LeArquivo(arq::TIPO_MODELOS_3D, nome_arquivo, &dados_str);
+    return arq::MapeiaArquivo(arq::TIPO_MODELOS_3D, nome_arquivo);
   } catch (...) {
     VLOG(1) << "Arquivo global de modelo 3d não encontrado: " << nome_arquivo << ", tentando fallback baixado";
     try {
-      arq::LeArquivo(arq::TIPO_MODELOS_3D_BAIXADOS, nome_arquivo, &dados_str);
+      return arq::MapeiaArquivo(arq::TIPO_MODELOS_3D_BAIXADOS, nome_arquivo);
     } catch (...) {
       LOG(ERROR) << "Falha lendo arquivo de modelo 3d: " << nome_arquivo;
       throw;
     }
   }
-  dados->assign(dados_str.begin(), dados_str.end());
 }
 
 // Le o proto de um arquivo de modelo.
 void LeModelo3d(const std::string& nome_arquivo, ntf::Notificacao* n) {
-  std::vector<unsigned char> dados;
-  LeModelo3d(nome_arquivo, &dados);
-  std::string dados_string(dados.begin(), dados.end());
-  if (!n->ParseFromString(dados_string)) {
+  auto arquivo = LeModelo3d(nome_arquivo);
+  google::protobuf::io::ArrayInputStream entrada(arquivo->dados(), arquivo->tamanho());
+  if (!n->ParseFromZeroCopyStream(&entrada)) {
     throw std::logic_error(std::string("Erro de parse do arquivo de modelo 3d") + nome_arquivo);
   }
 }
@@ -78,15 +76,12 @@ bool Modelos3d::TrataNotificacao(const ntf::Notificacao& notificacao) {
     }
     // Notificacao local: envia os ids de texturas locais para o servidor.
     auto n = ntf::NovaNotificacao(ntf::TN_REQUISITAR_MODELOS_3D);
-    // Percorre arquivos globais.
-    std::vector<std::string> globais(arq::ConteudoDiretorio(arq::TIPO_MODELOS_3D, ent::FiltroModelo3d));
-    for (const std::string& id : globais) {
-      n->add_info_modelo_3d()->set_id(id);
-    }
-    // Percorre arquivos baixados.
-    std::vector<std::string> baixados(arq::ConteudoDiretorio(arq::TIPO_MODELOS_3D_BAIXADOS, ent::FiltroModelo3d));
-    for (const std::string& id : baixados) {
-      n->add_info_modelo_3d()->set_id(id);
+    // Percorre arquivos globais e baixados.
+    for (arq::tipo_e tipo : { arq::TIPO_MODELOS_3D, arq::TIPO_MODELOS_3D_BAIXADOS }) {
+      for (const std::string& id : *arq::ConteudoDiretorioCompartilhado(tipo)) {
+        if (ent::FiltroModelo3d(id)) continue;
+        n->add_info_modelo_3d()->set_id(id);
+      }
     }
     n->set_id_rede(notificacao.id_rede());
     n->set_servidor_apenas(true);
@@ -102,12 +97,13 @@ bool Modelos3d::TrataNotificacao(const ntf::Notificacao& notificacao) {
     }
     VLOG(1) << "Recebendo de cliente TN_REQUISITAR_MODELOS_3D: " << notificacao.DebugString();
     std::unordered_set<std::string> ids;
-    // Percorre arquivos globais.
-    std::vector<std::string> globais(arq::ConteudoDiretorio(arq::TIPO_MODELOS_3D, ent::FiltroModelo3d));
-    ids.insert(globais.begin(), globais.end());
-    // Percorre arquivos baixados.
-    std::vector<std::string> baixados(arq::ConteudoDiretorio(arq::TIPO_MODELOS_3D_BAIXADOS, ent::FiltroModelo3d));
-    ids.insert(baixados.begin(), baixados.end());
+    // Percorre arquivos globais e baixados.
+    for (arq::tipo_e tipo : { arq::TIPO_MODELOS_3D, arq::TIPO_MODELOS_3D_BAIXADOS }) {
+      for (const std::string& id : *arq::ConteudoDiretorioCompartilhado(tipo)) {
+        if (ent::FiltroModelo3d(id)) continue;
+        ids.insert(id);
+      }
+    }
     std::set<std::string> ids_cliente;
     std::vector<std::string> ids_faltantes;
     for (const auto& info : notificacao.info_modelo_3d()) {
@@ -125,14 +121,14 @@ bool Modelos3d::TrataNotificacao(const ntf::Notificacao& notificacao) {
     }
     auto n = ntf::NovaNotificacao(ntf::TN_ENVIAR_MODELOS_3D);
     for (const auto& id : ids_faltantes) {
-      std::vector<unsigned char> dados;
+      std::unique_ptr<arq::ArquivoMapeado> arquivo;
       try {
-        LeModelo3d(id, &dados);
+        arquivo = LeModelo3d(id);
       } catch (...) {
         continue;
       }
       auto* info = n->add_info_modelo_3d();
-      info->mutable_bits_crus()->append(dados.begin(), dados.end());
+      info->mutable_bits_crus()->assign(arquivo->Visao());
       info->set_id(id);
     }
     n->set_id_rede(notificacao.id_rede());
@@ -146,10 +142,15 @@ bool Modelos3d::TrataNotificacao(const ntf::Notificacao& notificacao) {
     }
     VLOG(1) << "Recebendo TN_MODELOS_3D do servidor";
     for (const auto& info : notificacao.info_modelo_3d()) {
-      // Salva bits crus do modelo 3d.
+      // Salva bits crus do modelo 3d, se ainda nao tiver exatamente este conteudo.
+      if (arq::ConteudoIgual(arq::TIPO_MODELOS_3D_BAIXADOS, info.id(), info.bits_crus())) {
+        continue;
+      }
       arq::EscreveArquivo(arq::TIPO_MODELOS_3D_BAIXADOS, info.id(), info.bits_crus());
     }
     return true;
+  } else if (sem_grafico_) {
+    return false;
   } else if (notificacao.tipo() == ntf::TN_CARREGAR_MODELO_3D) {
     CarregaModelo3d(notificacao.entidade().modelo_3d().id());
   } else if (notificacao.tipo() == ntf::TN_DESCARREGAR_MODELO_3D) {
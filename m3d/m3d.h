@@ -38,6 +38,9 @@ class Modelos3d : public ntf::Receptor {
   void CarregaModelo3d(const std::string& id_interno);
   void DescarregaModelo3d(const std::string& id_interno);
 
+  // Sem grafico (servidor dedicado), os modelos nao sao carregados, apenas servidos aos clientes.
+  void AlteraSemGrafico(bool sem_grafico) { sem_grafico_ = sem_grafico; }
+
   /** Retorna a lista de modelos 3d disponiveis. */
   static std::vector<std::string> ModelosDisponiveis(bool global);
 
@@ -45,6 +48,7 @@ class Modelos3d : public ntf::Receptor {
   struct Interno;
   std::unique_ptr<Interno> interno_;
   ntf::CentralNotificacoes* central_;
+  bool sem_grafico_ = false;
 };
 
 }  // namespace m3d
@@ -17,10 +17,14 @@
 #include <boost/dll.hpp>
 #include <boost/filesystem.hpp>
 
+#if USAR_GLOG
+#include "absl/flags/flag.h"
+#endif
 #include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "arq/arquivo.h"
+#include "ent/gravacao_notificacoes.h"
 #include "ent/tabelas.h"
 #include "ent/tabuleiro.h"
 #include "ent/tabuleiro_interface.h"
@@ -33,11 +37,17 @@
 #include "net/servidor.h"
 #include "ntf/notificacao.h"
 #include "log/log.h"
+#include "log/perfil.h"
 #include "som/som.h"
 #include "tex/texturas.h"
 
 using namespace std;
 
+#if USAR_GLOG
+ABSL_FLAG(std::string, gravar_notificacoes, "", "Arquivo onde gravar as notificacoes da sessao, para reproducao.");
+ABSL_FLAG(std::string, log_eventos, "", "Arquivo onde escrever o log de eventos da sessao.");
+#endif
+
 #if 0
 // Para capturar excecoes do QT.
 class MyApp : public QApplication {
@@ -140,12 +150,33 @@ int main(int argc, char** argv) {
   boost::asio::io_service servico_io;
   net::Sincronizador sincronizador(&servico_io);
   ntf::CentralNotificacoes central;
+#if USAR_GLOG
+  // Antes dos outros receptores, para gravar cada notificacao antes dos dados rolados no tratamento dela.
+  std::unique_ptr<ent::GravadorNotificacoes> gravador;
+  if (const std::string arquivo_gravacao = absl::GetFlag(FLAGS_gravar_notificacoes); !arquivo_gravacao.empty()) {
+    try {
+      gravador = std::make_unique<ent::GravadorNotificacoes>(arquivo_gravacao, &central);
+    } catch (const std::logic_error& e) {
+      LOG(ERROR) << e.what();
+    }
+  }
+#endif
   ent::Tabelas tabelas(&central);
   net::Servidor servidor(&sincronizador, &central);
   net::Cliente cliente(&sincronizador, &central);
   tex::Texturas texturas(&central);
   m3d::Modelos3d modelos3d(&central);
   ent::Tabuleiro tabuleiro(opcoes, tabelas, &texturas, &modelos3d, &central);
+  servidor.AlteraFiltroInteresse(tabuleiro.MutableInteresseClientes());
+#if USAR_GLOG
+  if (const std::string arquivo_log = absl::GetFlag(FLAGS_log_eventos); !arquivo_log.empty()) {
+    try {
+      tabuleiro.MutableLogEventos()->AlteraArquivoSessao(arquivo_log);
+    } catch (const std::logic_error& e) {
+      LOG(ERROR) << e.what();
+    }
+  }
+#endif
   ifg::TratadorTecladoMouse teclado_mouse(&central, &tabuleiro);
   //ent::InterfaceGraficaOpengl guiopengl(tabelas, &teclado_mouse, &tabuleiro, &central);
   //tabuleiro.AtivaInterfaceOpengl(&guiopengl);
@@ -195,6 +226,9 @@ int main(int argc, char** argv) {
   return;
 #else
   ent::ImprimeDadosRolados();
+  if (perfil::Ligado()) {
+    tabuleiro.ExportaPerfil();
+  }
   return 0;
 #endif
 }
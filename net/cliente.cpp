@@ -8,7 +8,9 @@
 // para depurar android e ios.
 //#define VLOG_NIVEL 1
 #include "log/log.h"
+#include "log/perfil.h"
 #include "net/cliente.h"
+#include "net/compressao.h"
 #include "net/util.h"
 #include "ntf/notificacao.h"
 #include "ntf/notificacao.pb.h"
@@ -66,31 +68,55 @@ bool Cliente::TrataNotificacao(const ntf::Notificacao& notificacao) {
 }
 
 bool Cliente::TrataNotificacaoRemota(const ntf::Notificacao& notificacao) {
-  EnviaDados(notificacao.SerializeAsString());
+  EnviaDados(CodificaNotificacao(notificacao, codec_, LimiarCompressaoRede(), &estatisticas_));
   return true;
 }
 
-void Cliente::EnviaDados(const std::string& dados, bool sem_dados) {
-  if (!sem_dados) {
-    fifo_envio_.push(CodificaDados(dados));
-    if (fifo_envio_.size() > 1) {
-      return;
-    }
+void Cliente::EnviaDados(const std::string& mensagem) {
+  PERFIL_ZONA("Cliente::EnviaDados");
+  fifo_envio_.push_back(mensagem);
+  if (em_envio_.empty() && !em_lote_) {
+    EnviaFila();
+  }
+}
+
+void Cliente::EnviaFila() {
+  if (!Ligado()) {
+    return;
+  }
+  // A fila inteira vai em uma escrita. Fica em em_envio_, intocada, ate o fim dela.
+  em_envio_.swap(fifo_envio_);
+  std::vector<const std::string*> partes;
+  partes.reserve(em_envio_.size());
+  for (const auto& m : em_envio_) {
+    partes.push_back(&m);
   }
-  socket_->Envia(fifo_envio_.front(), [this] (const Erro& erro, std::size_t bytes_enviados) {
+  socket_->Envia(partes, [this] (const Erro& erro, std::size_t bytes_enviados) {
     // Importante nao usar o socket aqui em caso de erro, pode estar dangling.
     if (erro) {
       LOG(ERROR) << "Erro enviando: " << erro.mensagem() << ", enviado: " << bytes_enviados;
       return;
     }
-    fifo_envio_.pop();
-    VLOG(1) << "Enviei " << bytes_enviados << " bytes pro servidor.";
-    if (!fifo_envio_.empty()) {
-      EnviaDados("", true);
+    VLOG(1) << "Enviei " << em_envio_.size() << " mensagens, " << bytes_enviados << " bytes pro servidor.";
+    em_envio_.clear();
+    // Durante um lote, o resto sai no fim dele, junto com o que ainda vier.
+    if (!fifo_envio_.empty() && !em_lote_) {
+      EnviaFila();
     }
   });
 }
 
+void Cliente::InicioLoteRemoto() {
+  em_lote_ = true;
+}
+
+void Cliente::FimLoteRemoto() {
+  em_lote_ = false;
+  if (em_envio_.empty() && !fifo_envio_.empty()) {
+    EnviaFila();
+  }
+}
+
 void Cliente::AutoConecta(const std::string& id) {
   VLOG(1) << "Tentando auto conectar como " << id;
   if (socket_descobrimento_.get() != nullptr) {
@@ -184,6 +210,9 @@ void Cliente::Conecta(const std::string& id, const std::string& endereco_str, in
   }
   try {
     socket_.reset(new Socket(sincronizador_));
+    // O que sobrou de uma conexao anterior nao vai para esta.
+    fifo_envio_.clear();
+    em_envio_.clear();
     if (porta_local > 1024) {
       socket_->PortaLocal(porta_local);
     }
@@ -211,8 +240,10 @@ void Cliente::Conecta(const std::string& id, const std::string& endereco_str, in
     notificacao->set_id_rede(id);
     central_->AdicionaNotificacao(notificacao);
     central_->RegistraEmissorRemoto(this);
-    // Com o emissor remoto registrado, envia a notificacao remota.
+    // Com o emissor remoto registrado, envia a notificacao remota, anunciando os codecs de compressao.
+    codec_ = ntf::CR_NENHUM;
     auto* copia = new ntf::Notificacao(*notificacao);
+    PreencheCodecsSuportados(copia);
     central_->AdicionaNotificacaoRemota(copia);
     RecebeDados();
     VLOG(1) << "Conexão bem sucedida";
@@ -260,10 +291,11 @@ void Cliente::RecebeDados() {
       Desconecta(erro_str);
       return;
     }
+    PERFIL_ZONA("Cliente::RecebeDados");
     // Quantidade de dados recebida eh maior ou igual ao esperado (por exemplo, ao receber duas mensagens juntas).
     // Decodifica mensagem e poe na central.
     auto* notificacao = new ntf::Notificacao;
-    if (!notificacao->ParseFromString(buffer_)) {
+    if (!DecodificaNotificacao(buffer_, recepcao_comprimida_, notificacao, &estatisticas_)) {
       std::string erro_str;
       erro_str = "Erro ParseFromString recebendo dados do servidor. Tamanho buffer_notificacao: " +
                  to_string((int)buffer_.size());
@@ -271,6 +303,14 @@ void Cliente::RecebeDados() {
       Desconecta(erro_str);
       return;
     }
+    if (notificacao->tipo() == ntf::TN_RESPOSTA_CONEXAO && notificacao->has_codec_rede()) {
+      // Resposta do servidor a negociacao de compressao, tratada apenas neste nivel.
+      codec_ = notificacao->codec_rede();
+      LOG(INFO) << "Servidor escolheu codec " << ntf::CodecRede_Name(codec_);
+      delete notificacao;
+      RecebeDados();
+      return;
+    }
     notificacao->set_local(false);
     central_->AdicionaNotificacao(notificacao);
     VLOG(1) << "Tudo recebido";
@@ -296,6 +336,8 @@ void Cliente::RecebeDados() {
       return;
     }
     unsigned int tamanho = DecodificaTamanho(buffer_tamanho_.begin());
+    recepcao_comprimida_ = (tamanho & BIT_COMPRIMIDO) != 0;
+    tamanho &= ~BIT_COMPRIMIDO;
     // TODO verificar tamanho.
     if (tamanho > 50 * 1024 * 1024) {
       LOG(WARNING) << "TAMANHO GIGANTE!! " << tamanho;
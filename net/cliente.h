@@ -3,8 +3,9 @@
 
 #include <boost/timer/timer.hpp>
 #include <memory>
-#include <queue>
 #include <string>
+#include <vector>
+#include "net/compressao.h"
 #include "net/socket.h"
 #include "ntf/notificacao.h"
 
@@ -18,6 +19,12 @@ class Cliente : public ntf::Receptor, public ntf::EmissorRemoto {
 
   bool TrataNotificacao(const ntf::Notificacao& notificacao) override;
   bool TrataNotificacaoRemota(const ntf::Notificacao& notificacao) override;
+  // O que for enviado durante um Notifica vai em uma so escrita, no fim dele.
+  void InicioLoteRemoto() override;
+  void FimLoteRemoto() override;
+
+  // Compressao da conexao, nos dois sentidos.
+  const EstatisticasCompressao& Estatisticas() const { return estatisticas_; }
 
  private:
   // Conecta o cliente identificado por id ao servidor localizado em endereco, formato: <host:porta>.
@@ -34,8 +41,11 @@ class Cliente : public ntf::Receptor, public ntf::EmissorRemoto {
   // Recebe dados da conexao continuamente.
   void RecebeDados();
 
-  // Envia dados pela conexao de forma assincrona. Se sem dados for true, ignora dados e envia o primeiro da fifo_envio_.
-  void EnviaDados(const std::string& dados, bool sem_dados = false);
+  // Enfileira uma mensagem (ja com cabecalho) para envio assincrono. Se nao houver escrita em curso nem lote aberto,
+  // envia a fila.
+  void EnviaDados(const std::string& mensagem);
+  // Envia a fila inteira em uma escrita vetorizada; ao fim dela, envia o que tiver chegado (fora de lote).
+  void EnviaFila();
 
   // Retorna se o cliente esta conectado ou nao.
   bool Ligado() const;
@@ -45,7 +55,13 @@ class Cliente : public ntf::Receptor, public ntf::EmissorRemoto {
   std::unique_ptr<Socket> socket_;
   std::string buffer_tamanho_;  // Buffer para receber tamanho dos dados.
   std::string buffer_;  // Buffer de recepcao.
-  std::queue<std::string> fifo_envio_;  // FIFO para envio.
+  std::vector<std::string> fifo_envio_;  // FIFO para envio.
+  std::vector<std::string> em_envio_;  // Mensagens da escrita em curso.
+  bool em_lote_ = false;  // Entre InicioLoteRemoto e FimLoteRemoto: as escritas esperam o fim do lote.
+  bool recepcao_comprimida_ = false;  // Se a mensagem sendo recebida esta comprimida.
+  // Codec negociado com o servidor: nenhum ate o servidor responder a TN_RESPOSTA_CONEXAO.
+  ntf::CodecRede codec_ = ntf::CR_NENHUM;
+  EstatisticasCompressao estatisticas_;
 
   std::unique_ptr<SocketUdp> socket_descobrimento_;
   std::string buffer_descobrimento_;
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <ctime>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/gzip_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#if USAR_GFLAGS
+#include <gflags/gflags.h>
+#endif
+
+#include "log/log.h"
+#include "net/compressao.h"
+#include "net/util.h"
+
+#if USAR_GFLAGS
+DEFINE_bool(compressao_rede, true, "Negocia compressao das mensagens de rede.");
+DEFINE_int32(limiar_compressao_rede, 4096, "Tamanho minimo para comprimir uma mensagem de rede.");
+#endif
+
+namespace net {
+
+bool CompressaoRedeHabilitada() {
+#if USAR_GFLAGS
+  return FLAGS_compressao_rede;
+#else
+  return true;
+#endif
+}
+
+size_t LimiarCompressaoRede() {
+#if USAR_GFLAGS
+  return static_cast<size_t>(std::max(FLAGS_limiar_compressao_rede, 0));
+#else
+  return 4096;
+#endif
+}
+
+namespace {
+
+// Tempo de CPU desde inicio. std::clock tem resolucao de microssegundos, enquanto os tempos de CPU do
+// boost::timer tem a do tick do sistema (10ms), maior que a compressao da maioria das mensagens.
+double MsCpuDesde(std::clock_t inicio) {
+  return 1000.0 * (std::clock() - inicio) / CLOCKS_PER_SEC;
+}
+
+// Comprime o que escreve colocar no fluxo, apos o cabecalho. Retorna vazio em caso de falha.
+template <class Escreve>
+std::string ComprimeGzip(size_t tamanho_original, Escreve escreve, EstatisticasCompressao* estatisticas) {
+  const std::clock_t inicio = std::clock();
+  std::string mensagem(4, '\0');
+  {
+    // StringOutputStream adiciona ao final da string, depois do cabecalho.
+    google::protobuf::io::StringOutputStream saida(&mensagem);
+    google::protobuf::io::GzipOutputStream gzip(&saida);
+    if (!escreve(&gzip) || !gzip.Close()) {
+      LOG(ERROR) << "Falha comprimindo mensagem de " << tamanho_original << " bytes: "
+                 << (gzip.ZlibErrorMessage() == nullptr ? "" : gzip.ZlibErrorMessage());
+      return "";
+    }
+  }
+  const size_t tamanho_comprimido = mensagem.size() - 4;
+  CodificaTamanho(static_cast<unsigned int>(tamanho_comprimido), /*comprimido=*/true, &mensagem);
+  ++estatisticas->mensagens_comprimidas;
+  estatisticas->bytes_originais += tamanho_original;
+  estatisticas->bytes_comprimidos += tamanho_comprimido;
+  estatisticas->cpu_compressao_ms += MsCpuDesde(inicio);
+  VLOG(1) << "Comprimi " << tamanho_original << " bytes em " << tamanho_comprimido;
+  return mensagem;
+}
+
+}  // namespace
+
+void PreencheCodecsSuportados(ntf::Notificacao* resposta_conexao) {
+  if (!CompressaoRedeHabilitada()) return;
+  resposta_conexao->add_codecs_rede(ntf::CR_GZIP);
+}
+
+ntf::CodecRede EscolheCodec(const ntf::Notificacao& resposta_conexao) {
+  if (!CompressaoRedeHabilitada()) return ntf::CR_NENHUM;
+  for (int codec : resposta_conexao.codecs_rede()) {
+    if (codec == ntf::CR_GZIP) return ntf::CR_GZIP;
+  }
+  return ntf::CR_NENHUM;
+}
+
+std::string CodificaNotificacao(
+    const ntf::Notificacao& notificacao, ntf::CodecRede codec, size_t limiar, EstatisticasCompressao* estatisticas) {
+  const size_t tamanho = notificacao.ByteSizeLong();
+  if (codec == ntf::CR_GZIP && tamanho >= limiar) {
+    auto mensagem = ComprimeGzip(tamanho, [&notificacao](google::protobuf::io::ZeroCopyOutputStream* saida) {
+      return notificacao.SerializeToZeroCopyStream(saida);
+    }, estatisticas);
+    if (!mensagem.empty()) return mensagem;
+  }
+  ++estatisticas->mensagens_sem_compressao;
+  std::string mensagem(4, '\0');
+  notificacao.AppendToString(&mensagem);
+  CodificaTamanho(static_cast<unsigned int>(mensagem.size() - 4), /*comprimido=*/false, &mensagem);
+  return mensagem;
+}
+
+std::string CodificaDadosComCodec(
+    const std::string& dados, ntf::CodecRede codec, size_t limiar, EstatisticasCompressao* estatisticas) {
+  if (codec == ntf::CR_GZIP && dados.size() >= limiar) {
+    auto mensagem = ComprimeGzip(dados.size(), [&dados](google::protobuf::io::ZeroCopyOutputStream* saida) {
+      google::protobuf::io::CodedOutputStream cos(saida);
+      cos.WriteRaw(dados.data(), static_cast<int>(dados.size()));
+      return !cos.HadError();
+    }, estatisticas);
+    if (!mensagem.empty()) return mensagem;
+  }
+  ++estatisticas->mensagens_sem_compressao;
+  return CodificaDados(dados);
+}
+
+bool DecodificaNotificacao(
+    const std::string& dados, bool comprimido, ntf::Notificacao* notificacao, EstatisticasCompressao* estatisticas) {
+  if (!comprimido) {
+    return notificacao->ParseFromString(dados);
+  }
+  const std::clock_t inicio = std::clock();
+  google::protobuf::io::ArrayInputStream entrada(dados.data(), static_cast<int>(dados.size()));
+  google::protobuf::io::GzipInputStream gzip(&entrada);
+  // Um fluxo invalido termina a leitura como se fosse o fim dos dados, e o parse do que veio antes pode dar certo: so
+  // vale se o gzip chegou ao fim (o que inclui conferir o CRC).
+  const bool ok = notificacao->ParseFromZeroCopyStream(&gzip) && gzip.ZlibErrorCode() == Z_STREAM_END;
+  ++estatisticas->mensagens_descomprimidas;
+  estatisticas->cpu_descompressao_ms += MsCpuDesde(inicio);
+  if (!ok) {
+    LOG(ERROR) << "Falha descomprimindo mensagem de " << dados.size() << " bytes: "
+               << (gzip.ZlibErrorMessage() == nullptr ? "" : gzip.ZlibErrorMessage());
+  }
+  return ok;
+}
+
+}  // namespace net
@@ -0,0 +1,60 @@
+#ifndef NET_COMPRESSAO_H
+#define NET_COMPRESSAO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "ntf/notificacao.pb.h"
+
+namespace net {
+
+// Negociacao:
+// - Cliente anuncia em TN_RESPOSTA_CONEXAO os codecs que sabe decodificar (codecs_rede).
+// - Servidor escolhe um (EscolheCodec) e, se nao for CR_NENHUM, responde com TN_RESPOSTA_CONEXAO contendo
+// codec_rede antes de qualquer outra mensagem. O cliente intercepta a resposta e passa a usar o codec.
+// - Clientes e servidores antigos nao anunciam nem respondem, e a conexao segue sem compressao.
+// Mensagens a partir do limiar sao comprimidas e marcadas com BIT_COMPRIMIDO no cabecalho de tamanho.
+
+// Se o servidor negocia compressao e o cliente a anuncia.
+bool CompressaoRedeHabilitada();
+// Tamanho minimo, em bytes, para comprimir uma mensagem. Mensagens pequenas nao compensam.
+size_t LimiarCompressaoRede();
+
+struct EstatisticasCompressao {
+  int64_t mensagens_comprimidas = 0;
+  int64_t mensagens_sem_compressao = 0;
+  int64_t mensagens_descomprimidas = 0;
+  // Tamanhos das mensagens comprimidas, antes e depois da compressao.
+  int64_t bytes_originais = 0;
+  int64_t bytes_comprimidos = 0;
+  // Tempo de CPU do processo (std::clock).
+  double cpu_compressao_ms = 0;
+  double cpu_descompressao_ms = 0;
+
+  // Tamanho comprimido sobre o original: quanto menor, melhor. 1 se nada foi comprimido.
+  double Razao() const { return bytes_originais == 0 ? 1.0 : double(bytes_comprimidos) / bytes_originais; }
+};
+
+// Preenche codecs_rede com os codecs suportados. Nao faz nada se a compressao estiver desabilitada.
+void PreencheCodecsSuportados(ntf::Notificacao* resposta_conexao);
+// Codec a ser usado com o outro lado, a partir do que ele anunciou.
+ntf::CodecRede EscolheCodec(const ntf::Notificacao& resposta_conexao);
+
+/** Serializa a notificacao com o cabecalho de tamanho, pronta para o socket. Com codec e a partir do limiar, comprime
+* durante a serializacao, sem a copia intermediaria da mensagem serializada.
+*/
+std::string CodificaNotificacao(
+    const ntf::Notificacao& notificacao, ntf::CodecRede codec, size_t limiar, EstatisticasCompressao* estatisticas);
+// Como CodificaNotificacao, para dados ja serializados (repasse de mensagens pelo servidor).
+std::string CodificaDadosComCodec(
+    const std::string& dados, ntf::CodecRede codec, size_t limiar, EstatisticasCompressao* estatisticas);
+
+/** Decodifica dados recebidos (sem o cabecalho). Se comprimidos, descomprime em fluxo durante o parse.
+* @return false se os dados forem invalidos.
+*/
+bool DecodificaNotificacao(
+    const std::string& dados, bool comprimido, ntf::Notificacao* notificacao, EstatisticasCompressao* estatisticas);
+
+}  // namespace net
+
+#endif
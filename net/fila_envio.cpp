@@ -0,0 +1,95 @@
+#include <algorithm>
+
+#include "absl/strings/str_format.h"
+#include "net/fila_envio.h"
+
+namespace net {
+
+std::string ChaveSubstituicao(const ntf::Notificacao& notificacao) {
+  switch (notificacao.tipo()) {
+    case ntf::TN_MOVER_ENTIDADE: {
+      // Cada campo presente sobrescreve o estado (a rota sempre): a mais nova so cobre a anterior se tiver os mesmos.
+      const auto& e = notificacao.entidade();
+      if (!e.has_id()) return "";
+      return absl::StrFormat("%d:%d:%d%d%d", notificacao.tipo(), e.id(), e.pos().has_x(), e.destino().has_x(),
+                             e.has_apoiada());
+    }
+    default:
+      return "";
+  }
+}
+
+bool FilaEnvio::PassaDosLimites(size_t bytes, Tipo tipo, size_t max_bytes, size_t max_mensagens) const {
+  if (tipo == ENVIO_ESSENCIAL || aguardando_ressincronizacao_) return false;
+  return bytes_ + bytes > max_bytes || fifo_.size() >= max_mensagens;
+}
+
+bool FilaEnvio::Enfileira(const std::string& mensagem, Tipo tipo, const std::string& chave) {
+  if (aguardando_ressincronizacao_) {
+    if (tipo == ENVIO_NORMAL) {
+      ++estatisticas_->descartadas;
+      estatisticas_->bytes_descartados += mensagem.size();
+      return false;
+    } else if (tipo == ENVIO_REPASSE) {
+      repasses_adiados_.push_back(mensagem);
+      return false;
+    }
+    // O tabuleiro da ressincronizacao: o que estiver na fila esta obsoleto.
+    aguardando_ressincronizacao_ = false;
+    Descarta();
+  }
+  if (!chave.empty()) {
+    auto it = std::find_if(fifo_.begin(), fifo_.end(), [&chave](const Mensagem& m) { return m.chave == chave; });
+    if (it != fifo_.end()) {
+      bytes_ -= it->dados.size();
+      fifo_.erase(it);
+      ++estatisticas_->substituidas;
+    }
+  }
+  fifo_.push_back(Mensagem{mensagem, chave});
+  if (tipo != ENVIO_ESSENCIAL) {
+    bytes_ += mensagem.size();
+  }
+  estatisticas_->maior_fila = std::max(estatisticas_->maior_fila, fifo_.size());
+  estatisticas_->maiores_bytes = std::max(estatisticas_->maiores_bytes, bytes_);
+  return true;
+}
+
+void FilaEnvio::Ressincroniza() {
+  Descarta();
+  aguardando_ressincronizacao_ = true;
+  ++estatisticas_->ressincronizacoes;
+}
+
+std::vector<std::string> FilaEnvio::RetiraRepassesAdiados() {
+  std::vector<std::string> repasses;
+  if (!aguardando_ressincronizacao_) {
+    repasses.swap(repasses_adiados_);
+  }
+  return repasses;
+}
+
+void FilaEnvio::IniciaEscrita(std::vector<const std::string*>* partes) {
+  // Fica em em_escrita_, intocada, ate o fim dela.
+  em_escrita_.swap(fifo_);
+  fifo_.clear();
+  bytes_ = 0;
+  partes->clear();
+  partes->reserve(em_escrita_.size());
+  for (const auto& m : em_escrita_) {
+    partes->push_back(&m.dados);
+  }
+  ++estatisticas_->escritas;
+  estatisticas_->mensagens_enviadas += partes->size();
+}
+
+void FilaEnvio::Descarta() {
+  for (const auto& m : fifo_) {
+    ++estatisticas_->descartadas;
+    estatisticas_->bytes_descartados += m.dados.size();
+  }
+  fifo_.clear();
+  bytes_ = 0;
+}
+
+}  // namespace net
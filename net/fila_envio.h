@@ -0,0 +1,102 @@
+#ifndef NET_FILA_ENVIO_H
+#define NET_FILA_ENVIO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ntf/notificacao.pb.h"
+
+namespace net {
+
+// Chave de substituicao na fila de envio: uma notificacao mais nova com a mesma chave torna a enfileirada obsoleta.
+// Vazia se a notificacao nao pode ser substituida.
+std::string ChaveSubstituicao(const ntf::Notificacao& notificacao);
+
+// Acumuladas desde a criacao do servidor, somando as filas de todos os clientes.
+struct EstatisticasFilasEnvio {
+  // Mensagens retiradas da fila por uma mais nova com a mesma chave de substituicao.
+  int64_t substituidas = 0;
+  // Mensagens descartadas por ressincronizacao (o estado vai no tabuleiro enviado ao cliente).
+  int64_t descartadas = 0;
+  int64_t bytes_descartados = 0;
+  int64_t ressincronizacoes = 0;
+  // Escritas no socket e mensagens enviadas nelas (varias por escrita, em lote).
+  int64_t escritas = 0;
+  int64_t mensagens_enviadas = 0;
+  // Maiores fila e quantidade de bytes enfileirados para um cliente.
+  size_t maior_fila = 0;
+  size_t maiores_bytes = 0;
+};
+
+/** Fila de envio de um cliente do servidor: limites, substituicao e espera por ressincronizacao. Nao conhece o
+* socket: o servidor decide quando escrever (IniciaEscrita e FimEscrita) e o que fazer quando a fila passa do limite.
+*
+* Substituicao: a mensagem nova vai para o fim da fila e a enfileirada com a mesma chave sai. A nova foi gerada depois
+* de tudo o que esta na fila; no lugar da antiga, mensagens mais velhas que ela (por exemplo, uma atualizacao parcial
+* da mesma entidade) seriam aplicadas depois e sobrescreveriam o estado mais novo.
+*/
+class FilaEnvio {
+ public:
+  enum Tipo {
+    // Gerada pelo servidor: seu efeito ja esta no tabuleiro local.
+    ENVIO_NORMAL,
+    // Repasse de mensagem de outro cliente, aplicada localmente apenas depois do envio.
+    ENVIO_REPASSE,
+    // Handshake e tabuleiro: nao contam para o limite da fila e nao sao descartadas.
+    ENVIO_ESSENCIAL,
+  };
+
+  // Nao possui as estatisticas, que podem ser compartilhadas por varias filas.
+  explicit FilaEnvio(EstatisticasFilasEnvio* estatisticas) : estatisticas_(estatisticas) {}
+
+  // Se enfileirar uma mensagem de tamanho bytes passaria de algum dos limites. Nunca para essenciais ou durante a
+  // espera por ressincronizacao.
+  bool PassaDosLimites(size_t bytes, Tipo tipo, size_t max_bytes, size_t max_mensagens) const;
+
+  /** Enfileira a mensagem (ja com cabecalho), substituindo a enfileirada com a mesma chave (se nao vazia).
+  * Durante a espera por ressincronizacao, mensagens normais sao descartadas e repasses guardados para depois do
+  * tabuleiro (ver RetiraRepassesAdiados); a essencial encerra a espera, descartando o que houver na fila.
+  * @return true se a mensagem foi para a fila.
+  */
+  bool Enfileira(const std::string& mensagem, Tipo tipo, const std::string& chave = "");
+
+  // Descarta a fila e passa a esperar o tabuleiro da ressincronizacao. A escrita em curso nao eh afetada.
+  void Ressincroniza();
+  bool AguardandoRessincronizacao() const { return aguardando_ressincronizacao_; }
+  // Repasses guardados durante a espera, na ordem de chegada, depois que ela acabou. Vazio durante a espera.
+  std::vector<std::string> RetiraRepassesAdiados();
+
+  // Passa a fila inteira para a escrita em curso e preenche partes com as mensagens, que valem ate FimEscrita.
+  void IniciaEscrita(std::vector<const std::string*>* partes);
+  void FimEscrita() { em_escrita_.clear(); }
+  bool EmEscrita() const { return !em_escrita_.empty(); }
+
+  // Mensagens aguardando, sem contar a escrita em curso.
+  size_t NumMensagens() const { return fifo_.size(); }
+  const std::string& Dados(size_t indice) const { return fifo_[indice].dados; }
+  size_t NumMensagensEmEscrita() const { return em_escrita_.size(); }
+  // Bytes das mensagens nao essenciais na fila, comparados com o limite.
+  size_t Bytes() const { return bytes_; }
+
+ private:
+  void Descarta();
+
+  struct Mensagem {
+    std::string dados;
+    // Mensagens com a mesma chave (nao vazia) se substituem na fila.
+    std::string chave;
+  };
+
+  EstatisticasFilasEnvio* estatisticas_;
+  std::vector<Mensagem> fifo_;
+  size_t bytes_ = 0;
+  // Mensagens da escrita em curso: a fila inteira no momento em que ela comecou.
+  std::vector<Mensagem> em_escrita_;
+  bool aguardando_ressincronizacao_ = false;
+  std::vector<std::string> repasses_adiados_;
+};
+
+}  // namespace net
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef NET_INTERESSE_H
+#define NET_INTERESSE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ntf/notificacao.pb.h"
+
+namespace net {
+
+// Decide, por cliente, quem deve receber cada notificacao enviada ou repassada pelo servidor. Implementado por quem
+// conhece o estado do jogo (ent::InteresseClientes).
+class FiltroInteresse {
+ public:
+  // Notificacao a ser enviada a um cliente antes da filtrada, para repor o que ele perdeu.
+  struct Recuperacao {
+    size_t indice_cliente;
+    std::unique_ptr<ntf::Notificacao> notificacao;
+  };
+
+  virtual ~FiltroInteresse() {}
+  /** Chamada uma vez por notificacao sem id_rede, com interessa do tamanho de ids_clientes e todo true. Deve marcar
+  * false os clientes aos quais a notificacao nao interessa. Recuperacoes sao enviadas apenas aos seus clientes, antes
+  * da notificacao.
+  */
+  virtual void Filtra(const ntf::Notificacao& notificacao, const std::vector<std::string>& ids_clientes,
+                      std::vector<bool>* interessa, std::vector<Recuperacao>* recuperacoes) = 0;
+  /** O cliente vai receber o tabuleiro inteiro de novo (ressincronizacao): o que ele tinha perdido deixa de importar. */
+  virtual void ClienteRessincronizado(const std::string& id_rede) {}
+};
+
+}  // namespace net
+
+#endif
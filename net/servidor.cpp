@@ -6,14 +6,14 @@
 //#define VLOG_NIVEL 1
 #include "absl/strings/str_format.h"
 #include "log/log.h"
+#include "log/perfil.h"
+#include "net/compressao.h"
 #include "net/servidor.h"
 #include "net/util.h"
 #include "ntf/notificacao.h"
 #include "ntf/notificacao.pb.h"
 
 namespace net {
-namespace {
-}  // namespace
 
 Servidor::Servidor(Sincronizador* sincronizador, ntf::CentralNotificacoes* central) {
   sincronizador_ = sincronizador;
@@ -59,7 +59,15 @@ bool Servidor::TrataNotificacao(const ntf::Notificacao& notificacao) {
 }
 
 bool Servidor::TrataNotificacaoRemota(const ntf::Notificacao& notificacao) {
-  const std::string ns = notificacao.SerializeAsString();
+  // Codificada sob demanda, uma vez por codec, pois a mesma mensagem vai para varios clientes.
+  std::string codificadas[ntf::CodecRede_ARRAYSIZE];
+  auto codificada = [this, &notificacao, &codificadas](ntf::CodecRede codec) -> const std::string& {
+    auto& mensagem = codificadas[codec];
+    if (mensagem.empty()) {
+      mensagem = CodificaNotificacao(notificacao, codec, LimiarCompressaoRede(), &estatisticas_);
+    }
+    return mensagem;
+  };
   if (notificacao.clientes_pendentes()) {
     // Envia o tabuleiro para o cliente correto.
     Cliente* cliente_pendente = nullptr;
@@ -77,23 +85,58 @@ bool Servidor::TrataNotificacaoRemota(const ntf::Notificacao& notificacao) {
       cliente_pendente->socket->Fecha();
       return true;
     }
-    VLOG(1) << "Enviando primeira notificacao para cliente pendente";
-    EnviaDadosCliente(cliente_pendente, ns);
+    const auto& mensagem = codificada(cliente_pendente->codec);
+    LOG(INFO) << "Enviando primeira notificacao para cliente pendente '" << cliente_pendente->id << "': "
+              << notificacao.ByteSizeLong() << " bytes, " << (mensagem.size() - 4) << " enviados";
+    EnviaDadosCliente(cliente_pendente, mensagem, FilaEnvio::ENVIO_ESSENCIAL);
     clientes_.insert(cliente_pendente);
   } else {
+    FiltraInteresse(notificacao, nullptr);
+    const std::string chave = ChaveSubstituicao(notificacao);
+    size_t i = 0;
     for (auto* c : clientes_) {
+      const bool interessa = interessa_[i++];
       if (notificacao.has_id_rede() && c->id != notificacao.id_rede()) {
         LOG(INFO) << "Dropando notificacao por causa id cliente diferente. Destino: " << notificacao.id_rede() << " x cliente: " << c->id;
         continue;
       }
-      VLOG(1) << "Enviando notificacao para cliente, tam: " << ns.size();
-      EnviaDadosCliente(c, ns);
+      if (!interessa) {
+        ++notificacoes_filtradas_;
+        continue;
+      }
+      const auto& mensagem = codificada(c->codec);
+      VLOG(1) << "Enviando notificacao para cliente, tam: " << mensagem.size();
+      EnviaDadosCliente(c, mensagem, FilaEnvio::ENVIO_NORMAL, chave);
     }
   }
 
   return true;
 }
 
+void Servidor::FiltraInteresse(const ntf::Notificacao& notificacao, const Cliente* origem) {
+  clientes_filtro_.clear();
+  ids_filtro_.clear();
+  for (auto* c : clientes_) {
+    if (c == origem) continue;
+    clientes_filtro_.push_back(c);
+    ids_filtro_.push_back(c->id);
+  }
+  interessa_.assign(ids_filtro_.size(), true);
+  // Notificacoes com destino (inclusive as recuperacoes enviadas pelo filtro) sempre passam.
+  if (filtro_interesse_ == nullptr || notificacao.has_id_rede() || ids_filtro_.empty()) {
+    return;
+  }
+  PERFIL_ZONA("Servidor::FiltraInteresse");
+  recuperacoes_.clear();
+  filtro_interesse_->Filtra(notificacao, ids_filtro_, &interessa_, &recuperacoes_);
+  for (const auto& r : recuperacoes_) {
+    Cliente* c = clientes_filtro_[r.indice_cliente];
+    VLOG(1) << "Recuperando cliente " << c->id << ": " << ntf::Tipo_Name(r.notificacao->tipo());
+    EnviaDadosCliente(c, CodificaNotificacao(*r.notificacao, c->codec, LimiarCompressaoRede(), &estatisticas_));
+  }
+  recuperacoes_.clear();
+}
+
 bool Servidor::Ligado() const {
   return aceitador_->Ligado();
 }
@@ -165,7 +208,7 @@ void Servidor::AguardaClientesProxy() {
       return;
     }
     VLOG(1) << "Criando novo cliente de proxy";
-    Cliente* cliente_pendente = new Cliente(socket_mestre_cliente.release());
+    Cliente* cliente_pendente = new Cliente(socket_mestre_cliente.release(), &estatisticas_filas_);
     clientes_pendentes_.insert(cliente_pendente);
     RecebeDadosCliente(cliente_pendente);
     AguardaClientesProxy();
@@ -175,7 +218,7 @@ void Servidor::AguardaClientesProxy() {
 void Servidor::Liga() {
   VLOG(1) << "Ligando servidor.";
   try {
-    proximo_cliente_.reset(new Cliente(new Socket(sincronizador_)));
+    proximo_cliente_.reset(new Cliente(new Socket(sincronizador_), &estatisticas_filas_));
     central_->RegistraEmissorRemoto(this);
     aceitador_->Liga(PortaPadrao(), proximo_cliente_->socket.get(),
                      [this](const Erro& erro) -> Socket* {
@@ -200,7 +243,7 @@ void Servidor::Liga() {
       LOG(INFO) << "Buffer envio watermark: " << option3.value();
 #endif
       // Proximo cliente.
-      proximo_cliente_.reset(new Cliente(new Socket(sincronizador_)));
+      proximo_cliente_.reset(new Cliente(new Socket(sincronizador_), &estatisticas_filas_));
       RecebeDadosCliente(cliente_pendente);
       return proximo_cliente_->socket.get();
     });
@@ -235,36 +278,64 @@ void Servidor::Desliga() {
   central_->DesregistraEmissorRemoto(this);
   aceitador_->Desliga();
   anunciante_.reset();
-  for (auto* c : clientes_) {
-    delete c;
-  }
+  // Clientes promovidos continuam em clientes_pendentes_ (para checar ids repetidos): apaga cada um uma vez so.
   for (auto* c : clientes_pendentes_) {
+    if (clientes_.find(c) == clientes_.end()) {
+      delete c;
+    }
+  }
+  for (auto* c : clientes_) {
     delete c;
   }
+  clientes_pendentes_.clear();
+  clientes_.clear();
   VLOG(1) << "Servidor desligado.";
 }
 
-void Servidor::EnviaDadosCliente(Cliente* cliente, const std::string& dados, bool sem_dados) {
-  if (!sem_dados) {
-    cliente->fifo_envio.push(CodificaDados(dados));
-    if (cliente->fifo_envio.size() > 1) {
-      VLOG(1) << "Enfileirando dados, fila nao vazia";
-      return;
+void Servidor::EnviaDadosCliente(
+    Cliente* cliente, const std::string& mensagem, FilaEnvio::Tipo tipo, const std::string& chave) {
+  PERFIL_ZONA("Servidor::EnviaDadosCliente");
+  auto& fila = cliente->fila_envio;
+  if (fila.PassaDosLimites(mensagem.size(), tipo, max_bytes_fila_, max_mensagens_fila_) &&
+      clientes_.find(cliente) != clientes_.end()) {
+    Ressincroniza(cliente);
+  }
+  if (!fila.Enfileira(mensagem, tipo, chave)) {
+    return;
+  }
+  if (fila.EmEscrita() || em_lote_) {
+    // Vai na proxima escrita: ao fim do envio em curso ou do lote.
+    VLOG(1) << "Enfileirando dados, envio em curso ou lote aberto";
+  } else {
+    EnviaFilaCliente(cliente);
+  }
+  if (tipo == FilaEnvio::ENVIO_ESSENCIAL) {
+    // Repasses recebidos durante a ressincronizacao: sao aplicados depois da serializacao, entao vao depois do tabuleiro.
+    for (const auto& repasse : fila.RetiraRepassesAdiados()) {
+      EnviaDadosCliente(cliente, repasse, FilaEnvio::ENVIO_REPASSE);
     }
   }
+}
+
+void Servidor::EnviaFilaCliente(Cliente* cliente) {
+  // A fila inteira vai em uma escrita.
+  std::vector<const std::string*> partes;
+  cliente->fila_envio.IniciaEscrita(&partes);
   try {
     cliente->socket->Envia(
-        cliente->fifo_envio.front(),
+        partes,
         [this, cliente] (const Erro& erro, std::size_t bytes_enviados) {
       if (erro) {
         // Importante nao usar cliente aqui, pois o ponteiro pode estar dangling.
         LOG(ERROR) << "Erro enviando dados, mensagem: " << erro.mensagem();
         return;
       }
-      cliente->fifo_envio.pop();
-      VLOG(1) << "Enviei " << bytes_enviados << " bytes pro cliente.";
-      if (!cliente->fifo_envio.empty()) {
-        EnviaDadosCliente(cliente, "", true  /*sem_dados*/);
+      auto& fila = cliente->fila_envio;
+      VLOG(1) << "Enviei " << fila.NumMensagensEmEscrita() << " mensagens, " << bytes_enviados << " bytes pro cliente.";
+      fila.FimEscrita();
+      // Durante um lote, o resto sai no fim dele, junto com o que ainda vier.
+      if (fila.NumMensagens() > 0 && !em_lote_) {
+        EnviaFilaCliente(cliente);
       }
     });
  } catch (const std::exception& e) {
@@ -273,6 +344,46 @@ void Servidor::EnviaDadosCliente(Cliente* cliente, const std::string& dados, boo
  }
 }
 
+void Servidor::InicioLoteRemoto() {
+  em_lote_ = true;
+}
+
+void Servidor::FimLoteRemoto() {
+  em_lote_ = false;
+  // Clientes promovidos continuam nos pendentes: todos estao la.
+  for (auto* c : clientes_pendentes_) {
+    if (!c->fila_envio.EmEscrita() && c->fila_envio.NumMensagens() > 0) {
+      EnviaFilaCliente(c);
+    }
+  }
+}
+
+void Servidor::Ressincroniza(Cliente* cliente) {
+  LOG(WARNING) << "Cliente '" << cliente->id << "' atrasado (" << cliente->fila_envio.NumMensagens() << " mensagens, "
+               << cliente->fila_envio.Bytes() << " bytes na fila): ressincronizando";
+  cliente->fila_envio.Ressincroniza();
+  if (filtro_interesse_ != nullptr) {
+    filtro_interesse_->ClienteRessincronizado(cliente->id);
+  }
+  // Como para um cliente novo: o tabuleiro volta em TrataNotificacaoRemota, pois o cliente continua nos pendentes.
+  auto n = ntf::NovaNotificacao(ntf::TN_SERIALIZAR_TABULEIRO);
+  n->set_clientes_pendentes(true);
+  n->set_id_rede(cliente->id);
+  central_->AdicionaNotificacao(n.release());
+}
+
+Servidor::FilasEnvio Servidor::EstadoFilasEnvio() const {
+  FilasEnvio filas;
+  for (const auto* c : clientes_) {
+    ++filas.clientes;
+    const size_t mensagens = c->fila_envio.NumMensagens() + c->fila_envio.NumMensagensEmEscrita();
+    filas.mensagens += mensagens;
+    filas.bytes += c->fila_envio.Bytes();
+    filas.maior_fila = std::max(filas.maior_fila, mensagens);
+  }
+  return filas;
+}
+
 // deve ser usada apenas na funcao de RecebeDadosCliente.
 void Servidor::DesconectaCliente(Cliente* cliente) {
   // Notifica interessados na desconexao.
@@ -307,10 +418,11 @@ void Servidor::RecebeDadosCliente(Cliente* cliente) {
       return;
     }
     VLOG(1) << "Recebi " << bytes_recebidos << " bytes do cliente " << cliente->id;
+    PERFIL_ZONA("Servidor::RecebeDadosCliente");
 
     // Decodifica mensagem e poe na central.
     std::unique_ptr<ntf::Notificacao> notificacao(new ntf::Notificacao);
-    if (!notificacao->ParseFromString(cliente->buffer_recepcao)) {
+    if (!DecodificaNotificacao(cliente->buffer_recepcao, cliente->recepcao_comprimida, notificacao.get(), &estatisticas_)) {
       std::string erro_str(std::string("Erro ParseFromString recebendo dados do cliente '") + cliente->id + "'");
       LOG(ERROR) << erro_str << ", bytes_recebidos: " << bytes_recebidos;
       auto n = ntf::NovaNotificacao(ntf::TN_ERRO);
@@ -337,19 +449,52 @@ void Servidor::RecebeDadosCliente(Cliente* cliente) {
       }
       LOG(INFO) << "Recebi TN_RESPOSTA_CONEXAO de cliente: " << notificacao->id_rede() << ", IP: " << cliente->socket->IpString();
       cliente->id = notificacao->id_rede();
+      cliente->codec = EscolheCodec(*notificacao);
+      if (cliente->codec != ntf::CR_NENHUM) {
+        // Clientes antigos nao anunciam codecs e nunca recebem esta resposta.
+        auto resposta_codec = ntf::NovaNotificacao(ntf::TN_RESPOSTA_CONEXAO);
+        resposta_codec->set_codec_rede(cliente->codec);
+        EnviaDadosCliente(cliente, CodificaNotificacao(*resposta_codec, ntf::CR_NENHUM, 0, &estatisticas_),
+                          FilaEnvio::ENVIO_ESSENCIAL);
+        LOG(INFO) << "Cliente " << cliente->id << " usara codec " << ntf::CodecRede_Name(cliente->codec);
+      }
       auto resposta = ntf::NovaNotificacao(ntf::TN_SERIALIZAR_TABULEIRO);
       resposta->set_clientes_pendentes(true);
       resposta->set_id_rede(cliente->id);
       central_->AdicionaNotificacao(resposta.release());
+    } else if (notificacao->tipo() == ntf::TN_INFORMAR_INTERESSE) {
+      // O interesse eh do cliente que enviou, e so interessa ao servidor.
+      notificacao->set_id_rede(cliente->id);
+      notificacao->set_servidor_apenas(true);
     }
     // Envia a notificacao para os outros clientes.
     if (!notificacao->servidor_apenas()) {
+      // Dados recebidos comprimidos vao como estao para clientes com o mesmo codec. Os demais recebem a mensagem
+      // descomprimida, recodificada com o seu codec, uma vez por codec.
+      std::string repasses[ntf::CodecRede_ARRAYSIZE];
+      FiltraInteresse(*notificacao, cliente);
+      const std::string chave = ChaveSubstituicao(*notificacao);
+      size_t i = 0;
       for (auto* c : clientes_) {
         if (c == cliente) {
           // Nao envia para o cliente original.
           continue;
         }
-        EnviaDadosCliente(c, cliente->buffer_recepcao);
+        if (!interessa_[i++]) {
+          ++notificacoes_filtradas_;
+          continue;
+        }
+        auto& repasse = repasses[c->codec];
+        if (repasse.empty()) {
+          if (cliente->recepcao_comprimida && c->codec == cliente->codec) {
+            repasse = CodificaDados(cliente->buffer_recepcao, /*comprimido=*/true);
+          } else if (cliente->recepcao_comprimida) {
+            repasse = CodificaNotificacao(*notificacao, c->codec, LimiarCompressaoRede(), &estatisticas_);
+          } else {
+            repasse = CodificaDadosComCodec(cliente->buffer_recepcao, c->codec, LimiarCompressaoRede(), &estatisticas_);
+          }
+        }
+        EnviaDadosCliente(c, repasse, FilaEnvio::ENVIO_REPASSE, chave);
       }
     }
     // Processa localmente.
@@ -377,6 +522,8 @@ void Servidor::RecebeDadosCliente(Cliente* cliente) {
       return;
     }
     unsigned int tamanho = DecodificaTamanho(cliente->buffer_tamanho.begin());
+    cliente->recepcao_comprimida = (tamanho & BIT_COMPRIMIDO) != 0;
+    tamanho &= ~BIT_COMPRIMIDO;
     // TODO verificar tamanho.
     if (tamanho > 50 * 1024 * 1024) {
       LOG(WARNING) << "TAMANHO GIGANTE!! " << tamanho;
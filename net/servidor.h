@@ -2,9 +2,13 @@
 #define NET_SERVIDOR_H
 
 #include <memory>
-#include <queue>
 #include <set>
+#include <string>
+#include <vector>
 #include "ntf/notificacao.h"
+#include "net/compressao.h"
+#include "net/fila_envio.h"
+#include "net/interesse.h"
 #include "net/socket.h"
 
 namespace net {
@@ -21,6 +25,8 @@ namespace net {
 // - Servidor na funcao EsperaCliente cria o cliente como cliente pendente e espera novos clientes. Dados do
 // cliente serao recebidos na funcao RecebeDadosCliente.
 // - Servidor na funcao RecebeDadosCliente recebe TN_RESPOSTA_CONEXAO e atribui o id do cliente na camada net.
+// - Se o cliente anunciou codecs de compressao, o servidor escolhe um e o informa ao cliente com outra
+// TN_RESPOSTA_CONEXAO, antes de qualquer outra mensagem (ver net/compressao.h).
 // - Servidor cria no mesmo lugar TN_SERIALIZAR_TABULEIRO marcando a notificacao como para cliente pendente e
 // com o id net do cliente. Envia localmente.
 // - Tabuleiro recebe a notificacao local TN_SERIALIZAR_TABULEIRO e serializa o jogo criando
@@ -35,6 +41,17 @@ namespace net {
 // - Servidor na funcao DesconectaCliente o retira do mapa que estiver e deleta o ponteiro.
 // - Servidor envia TN_DESCONECTADO localmente.
 // - Tabuleiro trata a mensagem atualizando mapa de clientes.
+//
+// Interesse: o cliente informa com TN_INFORMAR_INTERESSE o cenario que ve e a entidade da camera. O servidor marca a
+// notificacao com o id do cliente e a processa localmente; o FiltroInteresse usa a informacao para descartar o que
+// nao interessa a cada cliente, tanto no envio quanto no repasse.
+//
+// Fila de envio (ver FilaEnvio): cada cliente tem uma fila limitada em bytes e mensagens. Movimentos de uma entidade
+// substituem o anterior ainda na fila. Se a fila de um cliente lento passar do limite, ela eh descartada e o servidor
+// pede o tabuleiro para ele, como para um cliente pendente (ressincronizacao); ate o tabuleiro sair, o que o servidor
+// gera eh descartado e os repasses esperam para ir depois dele.
+// O que um Notifica gera para um cliente (inclusive repasses recebidos nele) vai em uma so escrita, no fim dele. As
+// mensagens continuam uma apos a outra no fluxo, cada uma com seu cabecalho, e o receptor as le em ordem.
 class Servidor : public ntf::Receptor, public ntf::EmissorRemoto {
  public:
   // Nao possui os parametros.
@@ -43,20 +60,59 @@ class Servidor : public ntf::Receptor, public ntf::EmissorRemoto {
 
   virtual bool TrataNotificacao(const ntf::Notificacao& notificacao) override;
   virtual bool TrataNotificacaoRemota(const ntf::Notificacao& notificacao) override;
+  // O que for enviado a um cliente durante um Notifica vai em uma so escrita, no fim dele.
+  void InicioLoteRemoto() override;
+  void FimLoteRemoto() override;
+
+  // Compressao de todas as conexoes, nos dois sentidos.
+  const EstatisticasCompressao& Estatisticas() const { return estatisticas_; }
+
+  // Nao possui o filtro. nullptr desliga a filtragem.
+  void AlteraFiltroInteresse(FiltroInteresse* filtro) { filtro_interesse_ = filtro; }
+  // Envios a clientes evitados pelo filtro de interesse.
+  int64_t NotificacoesFiltradas() const { return notificacoes_filtradas_; }
+
+  // Mensagens aguardando envio nas filas dos clientes conectados, no momento.
+  struct FilasEnvio {
+    int clientes = 0;
+    size_t mensagens = 0;
+    size_t bytes = 0;
+    size_t maior_fila = 0;
+  };
+  FilasEnvio EstadoFilasEnvio() const;
+
+  // Acumuladas desde a criacao do servidor.
+  using EstatisticasFilasEnvio = net::EstatisticasFilasEnvio;
+  const EstatisticasFilasEnvio& EstatisticasFilas() const { return estatisticas_filas_; }
+
+  /** Limites da fila de envio de cada cliente conectado. Um cliente lento que passar de qualquer um deles tem a fila
+  * descartada e recebe o tabuleiro inteiro de novo (ressincronizacao), em vez do acumulado. O tabuleiro e as mensagens
+  * do handshake nao contam para o limite.
+  */
+  void AlteraLimitesFilaEnvio(size_t max_bytes, size_t max_mensagens) {
+    max_bytes_fila_ = max_bytes;
+    max_mensagens_fila_ = max_mensagens;
+  }
+  size_t MaxBytesFilaEnvio() const { return max_bytes_fila_; }
+  size_t MaxMensagensFilaEnvio() const { return max_mensagens_fila_; }
 
  private:
   struct Cliente {
     // tamanho maximo da mensagem: 1MB.
-    Cliente(Socket* socket) : socket(socket), buffer_tamanho(4, '\0') {}
-    Cliente() : Cliente(nullptr) {}
+    Cliente(Socket* socket, EstatisticasFilasEnvio* estatisticas)
+        : socket(socket), buffer_tamanho(4, '\0'), fila_envio(estatisticas) {}
     std::string id;
     std::unique_ptr<Socket> socket;
     // Buffer para receber tamanho dos dados.
     std::string buffer_tamanho;
     // Buffer de recepcao dos dados.
     std::string buffer_recepcao;
-    // Dados para enviar.
-    std::queue<std::string> fifo_envio;
+    // Se a mensagem sendo recebida esta comprimida.
+    bool recepcao_comprimida = false;
+    // Codec negociado com o cliente.
+    ntf::CodecRede codec = ntf::CR_NENHUM;
+    // Dados para enviar, ainda nao entregues ao socket.
+    FilaEnvio fila_envio;
   };
 
   // Liga o aceitador para receber clientes de forma assincrona e renova automaticamente sempre que um cliente aparece.
@@ -72,11 +128,23 @@ class Servidor : public ntf::Receptor, public ntf::EmissorRemoto {
 
   // Chama a funcao de recepcao de dados de forma assincrona para o cliente.
   void RecebeDadosCliente(Cliente* cliente);
-  // Envia ou enfileira dados a serem enviados para um cliente. Assincrono. Se sem dados for true, envia a primeira mensagem enfileirada.
-  void EnviaDadosCliente(Cliente* cliente, const std::string& dados, bool sem_dados = false);
+  /** Enfileira uma mensagem (ja com cabecalho) para um cliente. Assincrono. Se nao houver escrita em curso nem lote
+  * aberto, envia a fila. Uma mensagem com chave substitui a enfileirada com a mesma chave. Se a fila passar dos
+  * limites, ressincroniza.
+  */
+  void EnviaDadosCliente(Cliente* cliente, const std::string& mensagem,
+                         FilaEnvio::Tipo tipo = FilaEnvio::ENVIO_NORMAL, const std::string& chave = "");
+  // Envia a fila inteira em uma escrita vetorizada; ao fim dela, envia o que tiver chegado (fora de lote).
+  void EnviaFilaCliente(Cliente* cliente);
+  // Descarta a fila do cliente e pede o tabuleiro para ele.
+  void Ressincroniza(Cliente* cliente);
   // Desconecta um cliente do servidor, efetivamente destruindo sua estrutura e deletando o ponteiro.
   void DesconectaCliente(Cliente* cliente);
   void DesconectaProxy();
+  /** Preenche interessa_ com os clientes que devem receber a notificacao, na ordem de clientes_ (exceto origem), e
+  * envia as recuperacoes do filtro aos seus clientes.
+  */
+  void FiltraInteresse(const ntf::Notificacao& notificacao, const Cliente* origem);
 
   ntf::CentralNotificacoes* central_;
   Sincronizador* sincronizador_;
@@ -93,6 +161,19 @@ class Servidor : public ntf::Receptor, public ntf::EmissorRemoto {
   std::unique_ptr<Cliente> proximo_cliente_;
   std::set<Cliente*> clientes_pendentes_;
   std::set<Cliente*> clientes_;
+  EstatisticasCompressao estatisticas_;
+  FiltroInteresse* filtro_interesse_ = nullptr;
+  int64_t notificacoes_filtradas_ = 0;
+  EstatisticasFilasEnvio estatisticas_filas_;
+  size_t max_bytes_fila_ = 8 * 1024 * 1024;
+  size_t max_mensagens_fila_ = 4096;
+  // Entre InicioLoteRemoto e FimLoteRemoto: as escritas esperam o fim do lote.
+  bool em_lote_ = false;
+  // Reusados a cada filtragem.
+  std::vector<Cliente*> clientes_filtro_;
+  std::vector<std::string> ids_filtro_;
+  std::vector<bool> interessa_;
+  std::vector<FiltroInteresse::Recuperacao> recuperacoes_;
 };
 
 }  // namespace net
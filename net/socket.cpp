@@ -196,6 +196,21 @@ void Socket::Envia(const std::string& dados, CallbackEnvio callback_envio_client
 #endif
 }
 
+void Socket::Envia(const std::vector<const std::string*>& partes, CallbackEnvio callback_envio_cliente) {
+  std::vector<boost::asio::const_buffer> buffers;
+  buffers.reserve(partes.size());
+  for (const auto* parte : partes) {
+    buffers.push_back(boost::asio::buffer(*parte));
+  }
+  boost::asio::async_write(
+      *interno_->socket.get(),
+      buffers,
+      [callback_envio_cliente, num_partes = partes.size()] (const boost::system::error_code& ec, std::size_t bytes_enviados) {
+    VLOG(1) << "TCP Enviados " << bytes_enviados << " em " << num_partes << " partes, erro? " << ec.message();
+    callback_envio_cliente(ConverteErro(ec), bytes_enviados);
+  });
+}
+
 void Socket::Recebe(std::string* dados, CallbackRecepcao callback_recepcao_cliente) {
   boost::asio::async_read(
       *interno_->socket.get(),
@@ -5,6 +5,8 @@
 // O sincronizador garantira que todos os callbacks serao chamados na mesma thread onde Roda eh chamado.
 #include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace net {
 
@@ -127,6 +129,8 @@ class Socket {
   // Lanca std::exception em caso de erro.
   typedef std::function<void(const Erro& erro, std::size_t bytes_enviados)> CallbackEnvio;
   void Envia(const std::string& dados, CallbackEnvio callback_envio_cliente);
+  // Envia as partes em sequencia, em uma so escrita (vetorizada). Cada parte deve viver ate o fim.
+  void Envia(const std::vector<const std::string*>& partes, CallbackEnvio callback_envio_cliente);
 
   // Funcao assincrona para receber dados do socket.
   // Parametro 'dados' deve viver ate o fim e sera alterado para o tamanho certo.
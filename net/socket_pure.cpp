@@ -280,6 +280,16 @@ void Socket::Envia(const std::string& dados, CallbackEnvio callback_envio_client
   sincronizador_->interno_->EnfileiraDadosEnvioTcp(dtcp);
 }
 
+void Socket::Envia(const std::vector<const std::string*>& partes, CallbackEnvio callback_envio_cliente) {
+  auto* dtcp = new DadosParaEnviarTcp;
+  dtcp->desc = interno_->socket_;
+  for (const auto* parte : partes) {
+    dtcp->dados.append(*parte);
+  }
+  dtcp->callback = callback_envio_cliente;
+  sincronizador_->interno_->EnfileiraDadosEnvioTcp(dtcp);
+}
+
 void Socket::Recebe(std::string* dados, CallbackRecepcao callback_recepcao_cliente) {
   auto* dtcp = new DadosParaReceberTcp;
   dtcp->recebido = 0;
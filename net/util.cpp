@@ -19,17 +19,23 @@ int PortaPadrao() {
 #endif
 }
 
-const std::string CodificaDados(const std::string& dados) {
-  unsigned int tam_dados = static_cast<unsigned int>(dados.size());
+const std::string CodificaDados(const std::string& dados, bool comprimido) {
   std::string ret(4, '\0');
-  ret[0] = static_cast<char>(tam_dados & 0xFFUL);
-  ret[1] = static_cast<char>((tam_dados & 0xFF00UL) >> 8);
-  ret[2] = static_cast<char>((tam_dados & 0xFF0000UL) >> 16);
-  ret[3] = static_cast<char>((tam_dados & 0xFF000000UL) >> 24);
+  CodificaTamanho(static_cast<unsigned int>(dados.size()), comprimido, &ret);
   ret.insert(ret.end(), dados.begin(), dados.end());
   return ret;
 }
 
+void CodificaTamanho(unsigned int tam_dados, bool comprimido, std::string* mensagem) {
+  if (comprimido) {
+    tam_dados |= BIT_COMPRIMIDO;
+  }
+  (*mensagem)[0] = static_cast<char>(tam_dados & 0xFFUL);
+  (*mensagem)[1] = static_cast<char>((tam_dados & 0xFF00UL) >> 8);
+  (*mensagem)[2] = static_cast<char>((tam_dados & 0xFF0000UL) >> 16);
+  (*mensagem)[3] = static_cast<char>((tam_dados & 0xFF000000UL) >> 24);
+}
+
 unsigned int DecodificaTamanho(const std::string::iterator& buffer) {
   // Type casts para as operacoes nao criarem 1s a esquerda.
   return static_cast<unsigned char>(*buffer) |
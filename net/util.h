@@ -11,8 +11,13 @@ namespace net {
 
 constexpr int INTERVALO_ANUNCIO_MS = 100;
 
+// Bit mais alto do tamanho no cabecalho: dados comprimidos com o codec negociado na conexao (ver net/compressao.h).
+constexpr unsigned int BIT_COMPRIMIDO = 0x80000000U;
+
 // Codifica tamanho da mensagem em 4 bytes e usa de prefixo.
-const std::string CodificaDados(const std::string& dados);
+const std::string CodificaDados(const std::string& dados, bool comprimido = false);
+// Escreve o cabecalho nos 4 primeiros bytes de mensagem, que ja devem existir.
+void CodificaTamanho(unsigned int tamanho, bool comprimido, std::string* mensagem);
 // Decodifica tamanho (lendo 4 bytes do iterador).
 unsigned int DecodificaTamanho(const std::string::iterator& string);
 
@@ -2,6 +2,7 @@
 
 #include "absl/strings/str_cat.h"
 #include "log/log.h"
+#include "log/perfil.h"
 #include "ntf/notificacao.h"
 #include "ntf/notificacao.pb.h"
 
@@ -13,6 +14,18 @@ std::unique_ptr<Notificacao> NovaNotificacao(Tipo tipo) {
   return n;
 }
 
+PtrNotificacao NovaNotificacao(Tipo tipo, google::protobuf::Arena* arena) {
+  PtrNotificacao n(Notificacao::default_instance().New(arena));
+  n->set_tipo(tipo);
+  return n;
+}
+
+PtrNotificacao CopiaNotificacao(const Notificacao& notificacao, google::protobuf::Arena* arena) {
+  PtrNotificacao n(Notificacao::default_instance().New(arena));
+  n->CopyFrom(notificacao);
+  return n;
+}
+
 std::unique_ptr<Notificacao> NovaNotificacaoErroTipada(Tipo tipo, const std::string& erro) {
   auto n = NovaNotificacao(tipo);
   n->set_erro(erro);
@@ -25,6 +38,41 @@ std::unique_ptr<Notificacao> NovaNotificacaoErro(const std::string& erro) {
 
 CentralNotificacoes::CentralNotificacoes() {}
 CentralNotificacoes::~CentralNotificacoes() {
+  // As pendentes podem estar nas arenas, que sao destruidas antes das filas.
+  notificacoes_.clear();
+  notificacoes_remotas_.clear();
+}
+
+namespace {
+// Suficiente para um ciclo ou uma acao comum. Ciclos maiores alocam blocos extras, liberados no Reset.
+constexpr size_t kTamanhoBlocoArena = 64 * 1024;
+}  // namespace
+
+CentralNotificacoes::ArenaReutilizavel::ArenaReutilizavel()
+    : bloco(new char[kTamanhoBlocoArena]), arena(bloco.get(), kTamanhoBlocoArena) {}
+
+google::protobuf::Arena* CentralNotificacoes::ArenaCiclo() {
+  if (!usar_arenas_) return nullptr;
+  if (arenas_ciclo_[arena_corrente_] == nullptr) {
+    arenas_ciclo_[arena_corrente_].reset(new ArenaReutilizavel);
+  }
+  return &arenas_ciclo_[arena_corrente_]->arena;
+}
+
+ArenaAcao::ArenaAcao(CentralNotificacoes* central) : central_(central) {
+  if (central_ == nullptr || !central_->usar_arenas_) return;
+  if (central_->arenas_acao_livres_.empty()) {
+    arena_.reset(new CentralNotificacoes::ArenaReutilizavel);
+  } else {
+    arena_ = std::move(central_->arenas_acao_livres_.back());
+    central_->arenas_acao_livres_.pop_back();
+  }
+}
+
+ArenaAcao::~ArenaAcao() {
+  if (arena_ == nullptr) return;
+  arena_->arena.Reset();
+  central_->arenas_acao_livres_.push_back(std::move(arena_));
 }
 
 void CentralNotificacoes::RegistraReceptor(Receptor* receptor) {
@@ -76,24 +124,37 @@ void CentralNotificacoes::AdicionaNotificacao(Notificacao* notificacao) {
   if (notificacao->tipo() == TN_GRUPO_NOTIFICACOES) {
     LOG(ERROR) << "Nao se deve adicionar GRUPO a notificacoes da central: " << NotificacoesGrupo(*notificacao);
   }
-  notificacoes_.push_back(std::unique_ptr<ntf::Notificacao>(notificacao));
+  notificacoes_.emplace_back(notificacao);
 }
 
 void CentralNotificacoes::AdicionaNotificacaoRemota(Notificacao* notificacao) {
   if (emissores_remotos_.empty()) {
-    delete notificacao;
+    PtrNotificacao descartada(notificacao);
     return;
   }
   VLOG(3) << "Adicionando notificacao remota: " << notificacao->ShortDebugString();
   if (notificacao->tipo() == TN_GRUPO_NOTIFICACOES) {
     LOG(ERROR) << "Nao se deve adicionar GRUPO a notificacoes remotas da central: " << NotificacoesGrupo(*notificacao);
   }
-  notificacoes_remotas_.push_back(std::unique_ptr<ntf::Notificacao>(notificacao));
+  notificacoes_remotas_.emplace_back(notificacao);
 }
 
 void CentralNotificacoes::Notifica() {
+  PERFIL_ZONA("CentralNotificacoes::Notifica");
+  // Troca a arena do ciclo. A nova corrente so tem notificacoes despachadas no Notifica anterior; as que estao nas
+  // filas agora sao da outra, que continua valida ate o proximo Notifica.
+  arena_corrente_ = 1 - arena_corrente_;
+  if (arenas_ciclo_[arena_corrente_] != nullptr) {
+    arenas_ciclo_[arena_corrente_]->arena.Reset();
+  }
+  // Inicio e fim do lote vao para os mesmos emissores, mesmo que algum se registre ou desregistre durante o ciclo. Um
+  // emissor registrado no meio do ciclo recebe as remotas fora de lote, enviando cada uma na hora.
+  const std::vector<EmissorRemoto*> emissores_lote(emissores_remotos_);
+  for (auto* r : emissores_lote) {
+    r->InicioLoteRemoto();
+  }
   // Realiza a copia pq pode haver novas notificacoes durante o loop.
-  std::vector<std::unique_ptr<Notificacao>> copia_notificacoes;
+  std::vector<PtrNotificacao> copia_notificacoes;
   copia_notificacoes.swap(notificacoes_);
   // Copia receptores caso algum queira se desregistrar durante o loop.
   std::vector<Receptor*> copia_receptores(receptores_);
@@ -118,6 +179,9 @@ void CentralNotificacoes::Notifica() {
       r->TrataNotificacaoRemota(*n);
     }
   }
+  for (auto* r : emissores_lote) {
+    r->FimLoteRemoto();
+  }
 }
 
 }  // namespace ntf
@@ -3,15 +3,31 @@
 
 #include <memory>
 #include <vector>
+#include <google/protobuf/arena.h>
 #include "ntf/notificacao.pb.h"
 
 /** @file include/ifg/ntf/Notificacao.h declaracao da interface de notificacao. */
 
 namespace ntf {
 
+/** Apaga a notificacao apenas se ela estiver no heap. Notificacoes em arena pertencem a arena. */
+struct RemovedorNotificacao {
+  RemovedorNotificacao() = default;
+  RemovedorNotificacao(const std::default_delete<Notificacao>&) {}
+  void operator()(Notificacao* n) const {
+    if (n != nullptr && n->GetArena() == nullptr) delete n;
+  }
+};
+/** Ponteiro para notificacao no heap ou em arena. */
+using PtrNotificacao = std::unique_ptr<Notificacao, RemovedorNotificacao>;
+
 std::unique_ptr<Notificacao> NovaNotificacao(Tipo tipo);
 std::unique_ptr<Notificacao> NovaNotificacaoErro(const std::string& erro);
 std::unique_ptr<Notificacao> NovaNotificacaoErroTipada(Tipo tipo, const std::string& erro);
+/** Cria a notificacao na arena, ou no heap se arena for nullptr. Todas as sub mensagens ficam na mesma arena. */
+PtrNotificacao NovaNotificacao(Tipo tipo, google::protobuf::Arena* arena);
+/** Copia de notificacao na arena (ou no heap se arena for nullptr). */
+PtrNotificacao CopiaNotificacao(const Notificacao& notificacao, google::protobuf::Arena* arena);
 
 /** Interface para receber notificações. */
 class Receptor {
@@ -25,6 +41,13 @@ class EmissorRemoto {
  public:
   /** @return false se não tratar a notificação. */
   virtual bool TrataNotificacaoRemota(const Notificacao& notificacao) = 0;
+
+  /** Chamadas pela central no inicio e no fim de cada Notifica. O emissor pode acumular o que enviar entre elas
+  * (inclusive em callbacks de rede rodados durante o Notifica) e enviar tudo de uma vez no fim.
+  * Quem recebeu o inicio sempre recebe o fim, mesmo se desregistrado durante o Notifica.
+  */
+  virtual void InicioLoteRemoto() {}
+  virtual void FimLoteRemoto() {}
 };
 
 class CentralNotificacoes {
@@ -32,9 +55,10 @@ class CentralNotificacoes {
   CentralNotificacoes();
   virtual ~CentralNotificacoes();
 
-  /** Adiciona uma notificacao a central, que sera a dona dela. */
+  /** Adiciona uma notificacao a central, que sera a dona dela (ou a arena dela). */
   void AdicionaNotificacao(Notificacao* notificacao);
   void AdicionaNotificacao(std::unique_ptr<Notificacao> notificacao) { AdicionaNotificacao(notificacao.release()); }
+  void AdicionaNotificacao(PtrNotificacao notificacao) { AdicionaNotificacao(notificacao.release()); }
 
   /** Adiciona uma notificacao a ser processada apenas pelos emissores remotos.
   * A central possuirá a notificação. */
@@ -42,6 +66,21 @@ class CentralNotificacoes {
   void AdicionaNotificacaoRemota(std::unique_ptr<Notificacao> notificacao) {
     AdicionaNotificacaoRemota(notificacao.release());
   }
+  void AdicionaNotificacaoRemota(PtrNotificacao notificacao) { AdicionaNotificacaoRemota(notificacao.release()); }
+
+  /** Arena do ciclo corrente, para notificacoes que serao adicionadas a esta central. Ha duas arenas alternadas: a
+  * arena de um ciclo so eh liberada no inicio do segundo Notifica seguinte, quando tudo que foi criado nela ja foi
+  * despachado. Portanto, nada criado aqui pode ser guardado alem do proximo Notifica: receptores e emissores remotos
+  * devem copiar ou serializar a notificacao durante o tratamento.
+  * Retorna nullptr (heap) se as arenas estiverem desligadas.
+  */
+  google::protobuf::Arena* ArenaCiclo();
+
+  /** Liga ou desliga as arenas (padrao: ligadas). Centrais temporarias, que repassam as notificacoes para outra
+  * central, devem desligar, pois suas arenas morrem com elas.
+  */
+  void AlteraUsoArenas(bool usar) { usar_arenas_ = usar; }
+  bool UsaArenas() const { return usar_arenas_; }
 
   /** Registra um receptor com a central, que nao sera dono dele. */
   void RegistraReceptor(Receptor* receptor);
@@ -62,12 +101,49 @@ class CentralNotificacoes {
   void Notifica();
 
  protected:
-  std::vector<std::unique_ptr<Notificacao>> notificacoes_;
-  std::vector<std::unique_ptr<Notificacao>> notificacoes_remotas_;
+  std::vector<PtrNotificacao> notificacoes_;
+  std::vector<PtrNotificacao> notificacoes_remotas_;
 
  private:
+  friend class ArenaAcao;
+
   std::vector<Receptor*> receptores_;
   std::vector<EmissorRemoto*> emissores_remotos_;
+
+  // Arena com bloco inicial proprio, que sobrevive ao Reset: um ciclo que caiba nele nao aloca memoria.
+  struct ArenaReutilizavel {
+    ArenaReutilizavel();
+    std::unique_ptr<char[]> bloco;
+    google::protobuf::Arena arena;
+  };
+
+  bool usar_arenas_ = true;
+  std::unique_ptr<ArenaReutilizavel> arenas_ciclo_[2];
+  int arena_corrente_ = 0;
+  // Arenas de acao livres, ja zeradas.
+  std::vector<std::unique_ptr<ArenaReutilizavel>> arenas_acao_livres_;
+};
+
+/** Arena para as notificacoes de uma acao, montadas e tratadas dentro de um escopo (grupos e grupos de desfazer).
+* Vem de um conjunto mantido pela central e volta para ele, zerada, ao fim do escopo. Por isso, deve ser declarada
+* antes das notificacoes que a usam. Se central for nullptr ou tiver arenas desligadas, arena() eh nullptr (heap).
+*
+* Uso:
+*   ntf::ArenaAcao arena(central_);
+*   auto grupo = NovoGrupoNotificacoes(arena.arena());
+*/
+class ArenaAcao {
+ public:
+  explicit ArenaAcao(CentralNotificacoes* central);
+  ~ArenaAcao();
+  ArenaAcao(const ArenaAcao&) = delete;
+  ArenaAcao& operator=(const ArenaAcao&) = delete;
+
+  google::protobuf::Arena* arena() const { return arena_ == nullptr ? nullptr : &arena_->arena; }
+
+ private:
+  CentralNotificacoes* central_;
+  std::unique_ptr<CentralNotificacoes::ArenaReutilizavel> arena_;
 };
 
 } // namespace ntf
@@ -0,0 +1,604 @@
+/** @file tabvirt_carga.cpp Gerador de carga sintetica para o net::Servidor: quantos jogadores e espectadores um
+* anfitriao aguenta.
+*
+* Cada etapa sobe, no mesmo processo, um servidor como o tabvirt_server (tabuleiro sem grafico, com uma entidade por
+* jogador) em uma thread propria, e conecta N robos por loopback, cada um com sua central e seu net::Cliente. Apos o
+* handshake (TN_RESPOSTA_CONEXAO ate o tabuleiro chegar), cada jogador envia movimentos, atualizacoes parciais, rolagens
+* de dado e acoes nas taxas configuradas; espectadores apenas recebem. As notificacoes levam a marca de tempo do envio
+* (marca_carga_us), e o relatorio de cada etapa traz:
+* - latencia do envio ate a aplicacao no tabuleiro do servidor, e ate o despacho nos outros robos;
+* - ocupacao do laco do servidor (a unica thread do Sincronizador) e CPU dessa thread;
+* - passos de simulacao atrasados e profundidade das filas de envio (fifo_envio) do servidor.
+* Ao fim, indica a primeira etapa em que o laco do servidor saturou.
+*
+* Uso: tabvirt_carga [--etapas=1,2,4,8] [--espectadores=0] [--duracao_etapa_s=10] [--movimentos_por_s=4]
+*                    [--parciais_por_s=1] [--dados_por_s=0.5] [--acoes_por_s=0.5] [--max_mensagens_fila=0]
+* Rodar do diretorio com dados (como o servidor). Usa a porta padrao do servidor, que deve estar livre. Robos e servidor
+* dividem a maquina: para numeros absolutos, use uma maquina com mais de um nucleo.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/dll.hpp>
+#include <boost/filesystem.hpp>
+
+#if USAR_GLOG
+#include "absl/flags/flag.h"
+#endif
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "arq/arquivo.h"
+#include "ent/escalonador.h"
+#include "ent/tabelas.h"
+#include "ent/tabuleiro.h"
+#include "ent/util.h"
+#include "log/log.h"
+#include "m3d/m3d.h"
+#include "net/cliente.h"
+#include "net/servidor.h"
+#include "net/util.h"
+#include "ntf/notificacao.h"
+#include "tex/texturas.h"
+
+#if USAR_GLOG
+ABSL_FLAG(std::string, etapas, "1,2,4,8", "Numero de jogadores de cada etapa, separados por virgula.");
+ABSL_FLAG(int, espectadores, 0, "Robos que apenas recebem, somados aos jogadores de cada etapa.");
+ABSL_FLAG(int, duracao_etapa_s, 10, "Duracao da medicao de cada etapa, apos todos conectarem.");
+ABSL_FLAG(double, movimentos_por_s, 4.0, "Movimentos por segundo de cada jogador.");
+ABSL_FLAG(double, parciais_por_s, 1.0, "Atualizacoes parciais por segundo de cada jogador.");
+ABSL_FLAG(double, dados_por_s, 0.5, "Rolagens de dado por segundo de cada jogador.");
+ABSL_FLAG(double, acoes_por_s, 0.5, "Acoes por segundo de cada jogador.");
+ABSL_FLAG(int, max_mensagens_fila, 0, "Limite de mensagens da fila de envio de cada cliente; 0 mantem o padrao.");
+#endif
+
+namespace {
+
+using Relogio = std::chrono::steady_clock;
+
+// Saturacao: o laco do servidor ocupado em mais da fracao do tempo, ou atrasando passos de simulacao.
+constexpr double kOcupacaoSaturacao = 0.9;
+constexpr double kFracaoPassosAtrasadosSaturacao = 0.1;
+// Passo dos robos.
+constexpr int kPassoRobosMs = 10;
+constexpr int kEsperaConexaoS = 20;
+
+struct Configuracao {
+  std::vector<int> etapas;
+  int espectadores = 0;
+  int duracao_etapa_s = 10;
+  double movimentos_por_s = 4.0;
+  double parciais_por_s = 1.0;
+  double dados_por_s = 0.5;
+  double acoes_por_s = 0.5;
+  int max_mensagens_fila = 0;
+};
+
+#if !USAR_GLOG
+// Sem glog, faz o parsing das flags na mao.
+std::string ValorFlag(int argc, char** argv, const std::string& nome, const std::string& padrao) {
+  const std::string prefixo = absl::StrCat("--", nome, "=");
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (absl::StartsWith(arg, prefixo)) {
+      return arg.substr(prefixo.size());
+    }
+  }
+  return padrao;
+}
+#endif
+
+Configuracao LeConfiguracao(int argc, char** argv) {
+  Configuracao config;
+  std::string etapas;
+#if USAR_GLOG
+  etapas = absl::GetFlag(FLAGS_etapas);
+  config.espectadores = absl::GetFlag(FLAGS_espectadores);
+  config.duracao_etapa_s = absl::GetFlag(FLAGS_duracao_etapa_s);
+  config.movimentos_por_s = absl::GetFlag(FLAGS_movimentos_por_s);
+  config.parciais_por_s = absl::GetFlag(FLAGS_parciais_por_s);
+  config.dados_por_s = absl::GetFlag(FLAGS_dados_por_s);
+  config.acoes_por_s = absl::GetFlag(FLAGS_acoes_por_s);
+  config.max_mensagens_fila = absl::GetFlag(FLAGS_max_mensagens_fila);
+#else
+  etapas = ValorFlag(argc, argv, "etapas", "1,2,4,8");
+  auto le_int = [argc, argv](const std::string& nome, int padrao) {
+    int valor = padrao;
+    return absl::SimpleAtoi(ValorFlag(argc, argv, nome, ""), &valor) ? valor : padrao;
+  };
+  auto le_double = [argc, argv](const std::string& nome, double padrao) {
+    double valor = padrao;
+    return absl::SimpleAtod(ValorFlag(argc, argv, nome, ""), &valor) ? valor : padrao;
+  };
+  config.espectadores = le_int("espectadores", config.espectadores);
+  config.duracao_etapa_s = le_int("duracao_etapa_s", config.duracao_etapa_s);
+  config.movimentos_por_s = le_double("movimentos_por_s", config.movimentos_por_s);
+  config.parciais_por_s = le_double("parciais_por_s", config.parciais_por_s);
+  config.dados_por_s = le_double("dados_por_s", config.dados_por_s);
+  config.acoes_por_s = le_double("acoes_por_s", config.acoes_por_s);
+  config.max_mensagens_fila = le_int("max_mensagens_fila", config.max_mensagens_fila);
+#endif
+  for (absl::string_view s : absl::StrSplit(etapas, ',', absl::SkipEmpty())) {
+    int n = 0;
+    if (absl::SimpleAtoi(s, &n) && n > 0) {
+      config.etapas.push_back(n);
+    }
+  }
+  return config;
+}
+
+int64_t AgoraUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(Relogio::now().time_since_epoch()).count();
+}
+
+// CPU da thread corrente. Zero onde nao houver relogio por thread.
+double CpuThreadSegundos() {
+#if WIN32
+  return 0.0;
+#else
+  timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0.0;
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+// Latencias em us, de uma ponta da medicao.
+struct Latencias {
+  std::vector<int64_t> amostras_us;
+
+  void Adiciona(int64_t latencia_us) { amostras_us.push_back(std::max<int64_t>(0, latencia_us)); }
+  // Percentil em ms (p em [0, 1]).
+  double PercentilMs(double p) const {
+    if (amostras_us.empty()) return 0.0;
+    std::vector<int64_t> ordenadas(amostras_us);
+    size_t i = std::min(ordenadas.size() - 1, static_cast<size_t>(p * ordenadas.size()));
+    std::nth_element(ordenadas.begin(), ordenadas.begin() + i, ordenadas.end());
+    return ordenadas[i] / 1000.0;
+  }
+  std::string Resumo() const {
+    return absl::StrFormat("n=%d p50=%.2fms p95=%.2fms p99=%.2fms max=%.2fms", amostras_us.size(), PercentilMs(0.5),
+                           PercentilMs(0.95), PercentilMs(0.99), PercentilMs(1.0));
+  }
+  void ImprimeHistograma() const {
+    if (amostras_us.empty()) return;
+    // Em segundos, intervalos de 5ms ate 100ms.
+    ent::Histograma histograma(0.005f, 0.1f);
+    for (int64_t us : amostras_us) {
+      histograma.Adiciona(us / 1e6f);
+    }
+    histograma.Imprime();
+  }
+};
+
+// Medicoes do servidor, escritas apenas pela thread dele e lidas apos o join.
+struct MedicaoServidor {
+  double segundos = 0;
+  double segundos_ocupado = 0;
+  double cpu_segundos = 0;
+  ent::EstatisticasEscalonador escalonador;
+  int64_t amostras_filas = 0;
+  int64_t soma_mensagens_filas = 0;
+  size_t maior_fila = 0;
+  int64_t notificacoes_filtradas = 0;
+  net::Servidor::EstatisticasFilasEnvio filas;
+  Latencias aplicacao;
+  // Preenchido se o servidor nao subiu.
+  std::string erro;
+};
+
+// Receptor registrado depois do tabuleiro do servidor: ve as notificacoes dos robos ja aplicadas.
+class MedidorServidor : public ntf::Receptor {
+ public:
+  explicit MedidorServidor(const std::atomic<bool>* medindo, Latencias* latencias)
+      : medindo_(medindo), latencias_(latencias) {}
+
+  bool TrataNotificacao(const ntf::Notificacao& notificacao) override {
+    if (notificacao.local() || notificacao.marca_carga_us() == 0 || !*medindo_) return false;
+    latencias_->Adiciona(AgoraUs() - notificacao.marca_carga_us());
+    return true;
+  }
+
+ private:
+  const std::atomic<bool>* medindo_;
+  Latencias* latencias_;
+};
+
+void CarregaConfiguracoes(ent::OpcoesProto* proto) {
+  try {
+    arq::LeArquivoAsciiProto(arq::TIPO_CONFIGURACOES, "configuracoes.asciiproto", proto);
+  } catch (...) {
+    proto->CopyFrom(ent::OpcoesProto::default_instance());
+  }
+}
+
+// Thread do servidor: como o tabvirt_server, com num_entidades entidades no tabuleiro.
+void RodaServidor(int num_entidades, int max_mensagens_fila, const std::atomic<bool>* pronto_para_medir,
+                  std::atomic<bool>* servidor_pronto, const std::atomic<bool>* parar, MedicaoServidor* medicao) {
+  ent::OpcoesProto opcoes;
+  CarregaConfiguracoes(&opcoes);
+  boost::asio::io_service servico_io;
+  net::Sincronizador sincronizador(&servico_io);
+  ntf::CentralNotificacoes central;
+  ent::Tabelas tabelas(&central);
+  net::Servidor servidor(&sincronizador, &central);
+  tex::Texturas texturas(&central);
+  texturas.AlteraSemGrafico(true);
+  m3d::Modelos3d modelos3d(&central);
+  modelos3d.AlteraSemGrafico(true);
+  ent::Tabuleiro tabuleiro(opcoes, tabelas, &texturas, &modelos3d, &central);
+  tabuleiro.AlteraSemGrafico(true);
+  servidor.AlteraFiltroInteresse(tabuleiro.MutableInteresseClientes());
+  if (max_mensagens_fila > 0) {
+    servidor.AlteraLimitesFilaEnvio(servidor.MaxBytesFilaEnvio(), max_mensagens_fila);
+  }
+  MedidorServidor medidor(pronto_para_medir, &medicao->aplicacao);
+  central.RegistraReceptor(&medidor);
+  if (tabelas.todas().tabela_classes().info_classes().empty()) {
+    medicao->erro = "Erro carregando tabelas: rode do diretorio com dados.";
+    *servidor_pronto = true;
+    return;
+  }
+
+  central.AdicionaNotificacao(ntf::NovaNotificacao(ntf::TN_INICIAR));
+  for (int i = 0; i < num_entidades; ++i) {
+    auto n = ntf::NovaNotificacao(ntf::TN_ADICIONAR_ENTIDADE);
+    auto* e = n->mutable_entidade();
+    e->set_tipo(ent::TE_ENTIDADE);
+    e->set_selecionavel_para_jogador(true);
+    e->set_pontos_vida(100);
+    e->set_max_pontos_vida(100);
+    e->mutable_pos()->set_x((i % 10) * 2.0f);
+    e->mutable_pos()->set_y((i / 10) * 2.0f);
+    central.AdicionaNotificacao(std::move(n));
+  }
+  central.Notifica();
+  *servidor_pronto = true;
+
+  ent::Escalonador escalonador(std::max(1, static_cast<int>(std::lround(1000.0f / std::max(1.0f, opcoes.fps())))));
+  tabuleiro.AlteraPassoFixoMs(escalonador.PassoMs());
+  bool medindo = false;
+  Relogio::time_point inicio;
+  double cpu_inicio = 0;
+  while (!*parar) {
+    if (!medindo && *pronto_para_medir) {
+      medindo = true;
+      inicio = Relogio::now();
+      cpu_inicio = CpuThreadSegundos();
+      escalonador.ZeraEstatisticas();
+    }
+    for (int passos = escalonador.Passos(Relogio::now()); passos > 0; --passos) {
+      const auto antes = Relogio::now();
+      central.AdicionaNotificacao(ntf::NovaNotificacao(ntf::TN_TEMPORIZADOR, central.ArenaCiclo()));
+      central.Notifica();
+      if (!medindo) continue;
+      medicao->segundos_ocupado += std::chrono::duration<double>(Relogio::now() - antes).count();
+      const auto filas = servidor.EstadoFilasEnvio();
+      ++medicao->amostras_filas;
+      medicao->soma_mensagens_filas += filas.mensagens;
+      medicao->maior_fila = std::max(medicao->maior_fila, filas.maior_fila);
+    }
+    std::this_thread::sleep_until(escalonador.ProximoPrazo());
+  }
+  if (medindo) {
+    medicao->segundos = std::chrono::duration<double>(Relogio::now() - inicio).count();
+    medicao->cpu_segundos = CpuThreadSegundos() - cpu_inicio;
+    medicao->escalonador = escalonador.Estatisticas();
+    medicao->notificacoes_filtradas = servidor.NotificacoesFiltradas();
+    medicao->filas = servidor.EstatisticasFilas();
+  }
+  central.DesregistraReceptor(&medidor);
+  central.AdicionaNotificacao(ntf::NovaNotificacao(ntf::TN_SAIR));
+  central.Notifica();
+}
+
+// Um cliente sintetico, com central e net::Cliente proprios.
+class Robo : public ntf::Receptor {
+ public:
+  Robo(int indice, bool espectador, const Configuracao& config, net::Sincronizador* sincronizador,
+       const std::atomic<bool>* medindo, Latencias* latencias)
+      : indice_(indice), espectador_(espectador), config_(config), cliente_(sincronizador, &central_),
+        medindo_(medindo), latencias_(latencias) {
+    central_.RegistraReceptor(this);
+  }
+
+  void Conecta() {
+    auto n = ntf::NovaNotificacao(ntf::TN_CONECTAR);
+    n->set_id_rede(absl::StrCat(espectador_ ? "espectador" : "jogador", indice_));
+    n->set_endereco(absl::StrCat("localhost:", net::PortaPadrao()));
+    central_.AdicionaNotificacao(std::move(n));
+  }
+
+  // Gera o trafego de dt_s segundos e despacha a central (o que tambem roda o Sincronizador).
+  void Passo(double dt_s) {
+    if (conectado_ && !espectador_ && !ids_entidades_.empty()) {
+      Gera(config_.movimentos_por_s * dt_s, &acumulado_movimentos_, [this]() { Move(); });
+      Gera(config_.parciais_por_s * dt_s, &acumulado_parciais_, [this]() { AtualizaParcial(); });
+      Gera(config_.dados_por_s * dt_s, &acumulado_dados_, [this]() { RolaDado(); });
+      Gera(config_.acoes_por_s * dt_s, &acumulado_acoes_, [this]() { Age(); });
+    }
+    central_.AdicionaNotificacao(ntf::NovaNotificacao(ntf::TN_TEMPORIZADOR, central_.ArenaCiclo()));
+    central_.Notifica();
+  }
+
+  bool TrataNotificacao(const ntf::Notificacao& notificacao) override {
+    if (notificacao.local()) {
+      if (notificacao.tipo() == ntf::TN_DESCONECTADO) {
+        conectado_ = false;
+        desconectado_ = true;
+      }
+      return false;
+    }
+    if (notificacao.tipo() == ntf::TN_DESERIALIZAR_TABULEIRO) {
+      ids_entidades_.clear();
+      for (const auto& e : notificacao.tabuleiro().entidade()) {
+        ids_entidades_.push_back(e.id());
+      }
+      conectado_ = true;
+    }
+    if (notificacao.marca_carga_us() > 0 && *medindo_) {
+      latencias_->Adiciona(AgoraUs() - notificacao.marca_carga_us());
+    }
+    return true;
+  }
+
+  bool Conectado() const { return conectado_; }
+  bool Desconectado() const { return desconectado_; }
+  int64_t Enviadas() const { return enviadas_; }
+  void ZeraEnviadas() { enviadas_ = 0; }
+
+ private:
+  static void Gera(double quantidade, double* acumulado, const std::function<void()>& gera) {
+    *acumulado += quantidade;
+    // Tolerancia para a soma dos passos nao perder eventos por arredondamento.
+    while (*acumulado >= 1.0 - 1e-6) {
+      *acumulado -= 1.0;
+      gera();
+    }
+  }
+
+  unsigned int IdProprio() const { return ids_entidades_[indice_ % ids_entidades_.size()]; }
+  unsigned int IdOutro() const { return ids_entidades_[ent::RolaDado(ids_entidades_.size()) - 1]; }
+
+  void Envia(std::unique_ptr<ntf::Notificacao> n) {
+    n->set_marca_carga_us(AgoraUs());
+    central_.AdicionaNotificacaoRemota(std::move(n));
+    ++enviadas_;
+  }
+
+  void Move() {
+    auto n = ntf::NovaNotificacao(ntf::TN_MOVER_ENTIDADE);
+    auto* e = n->mutable_entidade();
+    e->set_id(IdProprio());
+    e->mutable_pos()->set_x(ent::Aleatorio() * 20.0f);
+    e->mutable_pos()->set_y(ent::Aleatorio() * 20.0f);
+    Envia(std::move(n));
+  }
+
+  void AtualizaParcial() {
+    auto n = ntf::NovaNotificacao(ntf::TN_ATUALIZAR_PARCIAL_ENTIDADE_NOTIFICANDO_SE_LOCAL);
+    n->mutable_entidade_antes()->set_id(IdProprio());
+    n->mutable_entidade()->set_id(IdProprio());
+    n->mutable_entidade()->set_pontos_vida(ent::RolaDado(100));
+    Envia(std::move(n));
+  }
+
+  // Como o cliente: rola localmente e envia o resultado como texto sobre a entidade.
+  void RolaDado() {
+    const int valor = ent::RolaDado(20);
+    auto n = ntf::NovaNotificacao(ntf::TN_ADICIONAR_ACAO);
+    auto* acao = n->mutable_acao();
+    acao->set_tipo(ent::ACAO_DELTA_PONTOS_VIDA);
+    acao->set_id_entidade_origem(IdProprio());
+    auto* por_entidade = acao->add_por_entidade();
+    por_entidade->set_id(IdProprio());
+    por_entidade->set_texto(absl::StrCat("d20: ", valor));
+    Envia(std::move(n));
+  }
+
+  void Age() {
+    auto n = ntf::NovaNotificacao(ntf::TN_ADICIONAR_ACAO);
+    auto* acao = n->mutable_acao();
+    acao->set_tipo(ent::ACAO_PROJETIL);
+    acao->set_id_entidade_origem(IdProprio());
+    const unsigned int destino = IdOutro();
+    acao->set_id_entidade_destino(destino);
+    auto* por_entidade = acao->add_por_entidade();
+    por_entidade->set_id(destino);
+    por_entidade->set_delta(-ent::RolaDado(8));
+    Envia(std::move(n));
+  }
+
+  const int indice_;
+  const bool espectador_;
+  const Configuracao& config_;
+  ntf::CentralNotificacoes central_;
+  net::Cliente cliente_;
+  const std::atomic<bool>* medindo_;
+  Latencias* latencias_;
+  bool conectado_ = false;
+  bool desconectado_ = false;
+  std::vector<unsigned int> ids_entidades_;
+  double acumulado_movimentos_ = 0;
+  double acumulado_parciais_ = 0;
+  double acumulado_dados_ = 0;
+  double acumulado_acoes_ = 0;
+  int64_t enviadas_ = 0;
+};
+
+struct ResultadoEtapa {
+  int jogadores = 0;
+  int espectadores = 0;
+  bool falhou = false;
+  int desconectados = 0;
+  double enviadas_por_s = 0;
+  MedicaoServidor servidor;
+  // Do envio ate o despacho nos outros robos.
+  Latencias repasse;
+
+  double Ocupacao() const { return servidor.segundos <= 0 ? 0.0 : servidor.segundos_ocupado / servidor.segundos; }
+  double FracaoPassosAtrasados() const {
+    const auto& e = servidor.escalonador;
+    return e.passos == 0 ? 0.0 : static_cast<double>(e.passos_atrasados + e.passos_descartados) / e.passos;
+  }
+  bool Saturado() const {
+    return falhou || Ocupacao() >= kOcupacaoSaturacao || FracaoPassosAtrasados() >= kFracaoPassosAtrasadosSaturacao;
+  }
+};
+
+ResultadoEtapa RodaEtapa(int jogadores, const Configuracao& config) {
+  ResultadoEtapa resultado;
+  resultado.jogadores = jogadores;
+  resultado.espectadores = config.espectadores;
+  std::atomic<bool> medindo(false);
+  std::atomic<bool> servidor_pronto(false);
+  std::atomic<bool> parar(false);
+  std::thread thread_servidor(RodaServidor, jogadores, config.max_mensagens_fila, &medindo, &servidor_pronto, &parar,
+                              &resultado.servidor);
+  while (!servidor_pronto) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  if (!resultado.servidor.erro.empty()) {
+    thread_servidor.join();
+    resultado.falhou = true;
+    return resultado;
+  }
+
+  {
+    // Sincronizador proprio dos robos, destruido depois deles.
+    boost::asio::io_service servico_io;
+    net::Sincronizador sincronizador(&servico_io);
+    std::vector<std::unique_ptr<Robo>> robos;
+    for (int i = 0; i < jogadores + config.espectadores; ++i) {
+      robos.emplace_back(new Robo(i, /*espectador=*/i >= jogadores, config, &sincronizador, &medindo,
+                                  &resultado.repasse));
+      robos.back()->Conecta();
+    }
+    auto passo = [&robos](double dt_s) {
+      for (auto& robo : robos) {
+        robo->Passo(dt_s);
+      }
+    };
+    // Handshake: espera todos receberem o tabuleiro.
+    const auto limite_conexao = Relogio::now() + std::chrono::seconds(kEsperaConexaoS);
+    auto proximo = Relogio::now();
+    while (Relogio::now() < limite_conexao &&
+           !std::all_of(robos.begin(), robos.end(), [](const auto& r) { return r->Conectado(); })) {
+      passo(0.0);
+      proximo += std::chrono::milliseconds(kPassoRobosMs);
+      std::this_thread::sleep_until(proximo);
+    }
+    if (!std::all_of(robos.begin(), robos.end(), [](const auto& r) { return r->Conectado(); })) {
+      LOG(ERROR) << "Nem todos os robos conectaram em " << kEsperaConexaoS << "s";
+      resultado.falhou = true;
+    } else {
+      for (auto& robo : robos) {
+        robo->ZeraEnviadas();
+      }
+      medindo = true;
+      const auto inicio = Relogio::now();
+      const auto fim = inicio + std::chrono::seconds(config.duracao_etapa_s);
+      proximo = inicio;
+      auto ultimo = inicio;
+      while (Relogio::now() < fim) {
+        const auto agora = Relogio::now();
+        passo(std::chrono::duration<double>(agora - ultimo).count());
+        ultimo = agora;
+        proximo += std::chrono::milliseconds(kPassoRobosMs);
+        std::this_thread::sleep_until(proximo);
+      }
+      const double segundos = std::chrono::duration<double>(Relogio::now() - inicio).count();
+      int64_t enviadas = 0;
+      for (const auto& robo : robos) {
+        enviadas += robo->Enviadas();
+        resultado.desconectados += robo->Desconectado() ? 1 : 0;
+      }
+      resultado.enviadas_por_s = enviadas / segundos;
+    }
+    parar = true;
+    thread_servidor.join();
+  }
+  return resultado;
+}
+
+void ImprimeEtapa(const ResultadoEtapa& r) {
+  const auto& s = r.servidor;
+  std::cout << absl::StrFormat("== %d jogadores, %d espectadores%s", r.jogadores, r.espectadores,
+                               r.Saturado() ? " (SATURADO)" : "") << std::endl;
+  if (!s.erro.empty()) {
+    std::cout << s.erro << std::endl;
+    return;
+  }
+  std::cout << absl::StrFormat(
+      "enviadas: %.1f/s, desconectados: %d\n"
+      "laco do servidor: ocupacao %.1f%%, cpu %.1f%%, passos %d (atrasados %d, descartados %d, atraso max %.1fms)\n"
+      "filas de envio: media %.1f mensagens, maior fila %d; filtradas pelo interesse: %d\n"
+      "substituidas na fila: %d, descartadas: %d (%d bytes), ressincronizacoes: %d\n"
+      "escritas do servidor: %d, %.2f mensagens por escrita\n"
+      "envio -> aplicacao no servidor: %s\n"
+      "envio -> despacho nos outros robos: %s",
+      r.enviadas_por_s, r.desconectados, 100.0 * r.Ocupacao(),
+      s.segundos <= 0 ? 0.0 : 100.0 * s.cpu_segundos / s.segundos, s.escalonador.passos,
+      s.escalonador.passos_atrasados, s.escalonador.passos_descartados, s.escalonador.atraso_maximo_ms,
+      s.amostras_filas == 0 ? 0.0 : static_cast<double>(s.soma_mensagens_filas) / s.amostras_filas, s.maior_fila,
+      s.notificacoes_filtradas, s.filas.substituidas, s.filas.descartadas, s.filas.bytes_descartados,
+      s.filas.ressincronizacoes, s.filas.escritas,
+      s.filas.escritas == 0 ? 0.0 : static_cast<double>(s.filas.mensagens_enviadas) / s.filas.escritas,
+      s.aplicacao.Resumo(), r.repasse.Resumo()) << std::endl;
+  std::cout << "Histograma envio -> outros robos (s):" << std::endl;
+  r.repasse.ImprimeHistograma();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  meulog::Inicializa(argc, argv);
+  boost::filesystem::path app_dir = boost::dll::program_location().parent_path();
+  arq::Inicializa(app_dir.string());
+
+  const Configuracao config = LeConfiguracao(argc, argv);
+  if (config.etapas.empty()) {
+    std::cerr << "Nenhuma etapa valida em --etapas" << std::endl;
+    return 1;
+  }
+  std::vector<ResultadoEtapa> resultados;
+  for (int jogadores : config.etapas) {
+    LOG(INFO) << "Etapa: " << jogadores << " jogadores";
+    resultados.push_back(RodaEtapa(jogadores, config));
+    ImprimeEtapa(resultados.back());
+    if (!resultados.back().servidor.erro.empty()) return 1;
+  }
+
+  std::cout << std::endl << "jogadores | ocupacao | cpu    | passos atrasados | maior fila | p99 servidor | p99 robos"
+            << std::endl;
+  const ResultadoEtapa* saturacao = nullptr;
+  for (const auto& r : resultados) {
+    const auto& s = r.servidor;
+    std::cout << absl::StrFormat("%9d | %7.1f%% | %5.1f%% | %15.1f%% | %10d | %10.2fms | %7.2fms%s", r.jogadores,
+                                 100.0 * r.Ocupacao(), s.segundos <= 0 ? 0.0 : 100.0 * s.cpu_segundos / s.segundos,
+                                 100.0 * r.FracaoPassosAtrasados(), s.maior_fila, s.aplicacao.PercentilMs(0.99),
+                                 r.repasse.PercentilMs(0.99), r.Saturado() ? " <- saturado" : "")
+              << std::endl;
+    if (saturacao == nullptr && r.Saturado()) {
+      saturacao = &r;
+    }
+  }
+  if (saturacao != nullptr) {
+    std::cout << "O laco do servidor (Sincronizador) satura com " << saturacao->jogadores << " jogadores e "
+              << saturacao->espectadores << " espectadores." << std::endl;
+  } else {
+    std::cout << "O laco do servidor nao saturou ate " << resultados.back().jogadores << " jogadores." << std::endl;
+  }
+  return 0;
+}
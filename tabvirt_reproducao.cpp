@@ -0,0 +1,108 @@
+/** @file tabvirt_reproducao.cpp Reproduz uma gravacao de notificacoes (ver ent/gravacao_notificacoes.h) em um
+* tabuleiro sem grafico, para medir o desempenho de uma sessao real fora dela e comparar comportamento entre versoes.
+*
+* Uso: tabvirt_reproducao [--tempo_real] <gravacao>. Sem --tempo_real, reproduz o mais rapido possivel. Ao fim, imprime
+* as notificacoes por segundo e os dados divergentes (diferentes da sessao gravada). Retorna 2 se houve divergencia.
+* A gravacao eh feita com --gravar_notificacoes=<arquivo> no tabvirt ou no tabvirt_server.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <string>
+
+#include <boost/dll.hpp>
+#include <boost/filesystem.hpp>
+
+#if USAR_GLOG
+#include "absl/flags/flag.h"
+#endif
+#include "arq/arquivo.h"
+#include "ent/gravacao_notificacoes.h"
+#include "ent/tabelas.h"
+#include "ent/tabuleiro.h"
+#include "log/log.h"
+#include "m3d/m3d.h"
+#include "ntf/notificacao.h"
+#include "tex/texturas.h"
+
+#if USAR_GLOG
+ABSL_FLAG(bool, tempo_real, false, "Reproduz respeitando os tempos gravados, em vez do mais rapido possivel.");
+#endif
+
+namespace {
+
+void CarregaConfiguracoes(ent::OpcoesProto* proto) {
+  try {
+    arq::LeArquivoAsciiProto(arq::TIPO_CONFIGURACOES, "configuracoes.asciiproto", proto);
+  } catch (...) {
+    proto->CopyFrom(ent::OpcoesProto::default_instance());
+  }
+}
+
+// Com glog, --tempo_real eh uma flag do absl. Sem, faz o parsing na mao.
+bool TempoReal(int argc, char** argv) {
+#if USAR_GLOG
+  return absl::GetFlag(FLAGS_tempo_real);
+#else
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]) == "--tempo_real") return true;
+  }
+  return false;
+#endif
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  meulog::Inicializa(argc, argv);
+  boost::filesystem::path app_dir = boost::dll::program_location().parent_path();
+  arq::Inicializa(app_dir.string());
+
+  std::string caminho;
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i][0] == '-') continue;
+    caminho = argv[i];
+    break;
+  }
+  if (caminho.empty()) {
+    std::cerr << "Uso: " << argv[0] << " [--tempo_real] <gravacao>" << std::endl;
+    return 1;
+  }
+
+  ent::OpcoesProto opcoes;
+  CarregaConfiguracoes(&opcoes);
+  // A reproducao nao pode sobrescrever nem rodar os salvamentos automaticos do usuario.
+  opcoes.set_intervalo_salvamento_automatico_s(0);
+  ntf::CentralNotificacoes central;
+  ent::Tabelas tabelas(&central);
+  tex::Texturas texturas(&central);
+  texturas.AlteraSemGrafico(true);
+  m3d::Modelos3d modelos3d(&central);
+  modelos3d.AlteraSemGrafico(true);
+  ent::Tabuleiro tabuleiro(opcoes, tabelas, &texturas, &modelos3d, &central);
+  tabuleiro.AlteraSemGrafico(true);
+  // Como na gravacao (tabvirt_server): a carga de entidades em uma thread so, para os dados sairem na mesma ordem.
+  tabuleiro.AlteraNumThreadsCarga(1);
+  tabuleiro.AlteraPassoFixoMs(std::max(1, static_cast<int>(std::lround(1000.0f / std::max(1.0f, opcoes.fps())))));
+  if (tabelas.todas().tabela_classes().info_classes().empty()) {
+    LOG(ERROR) << "Erro carregando tabelas, diretorio: " << app_dir.string();
+    return 1;
+  }
+  // O tabuleiro recebe apenas as notificacoes gravadas: as que ele gera ja estao na gravacao. A central dele continua
+  // despachando para texturas e modelos.
+  central.DesregistraReceptor(&tabuleiro);
+
+  ent::EstatisticasReproducao estatisticas;
+  try {
+    estatisticas = ent::ReproduzGravacao(
+        caminho, &tabuleiro, TempoReal(argc, argv), [&central]() { central.Notifica(); });
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  tabuleiro.MutableSalvamento()->EsperaTermino();
+  std::cout << caminho << ": " << estatisticas.Resumo() << std::endl;
+  return estatisticas.dados_divergentes > 0 || estatisticas.dados_nao_rolados > 0 ? 2 : 0;
+}
@@ -0,0 +1,196 @@
+/** @file tabvirt_server.cpp Servidor dedicado: tabuleiro, tabelas e servidor de rede, sem interface grafica nem
+* contexto OpenGL. Permite hospedar o jogo em uma maquina sem tela; o mestre entra como cliente e eh promovido a
+* mestre secundario.
+*
+* Uso: tabvirt_server [--mestre=<id de rede>] [tabuleiro]. Sem tabuleiro, comeca vazio. O cliente conectado com o id
+* de rede do mestre eh promovido a mestre secundario. O estado eh salvo ao sair (SIGINT ou SIGTERM) em
+* ultimo_tabuleiro_automatico.binproto, e periodicamente pelo salvamento automatico das opcoes.
+* --gravar_notificacoes=<arquivo> grava a sessao para o tabvirt_reproducao. --log_eventos=<arquivo> escreve o log de
+* eventos do tabuleiro no arquivo.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <boost/asio.hpp>
+#include <boost/dll.hpp>
+#include <boost/filesystem.hpp>
+
+#if USAR_GLOG
+#include "absl/flags/flag.h"
+#endif
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "arq/arquivo.h"
+#include "ent/escalonador.h"
+#include "ent/gravacao_notificacoes.h"
+#include "ent/tabelas.h"
+#include "ent/tabuleiro.h"
+#include "log/log.h"
+#include "m3d/m3d.h"
+#include "net/servidor.h"
+#include "ntf/notificacao.h"
+#include "tex/texturas.h"
+
+#if USAR_GLOG
+ABSL_FLAG(std::string, mestre, "", "Id de rede do cliente promovido a mestre secundario ao conectar.");
+ABSL_FLAG(std::string, gravar_notificacoes, "", "Arquivo onde gravar as notificacoes da sessao, para reproducao.");
+ABSL_FLAG(std::string, log_eventos, "", "Arquivo onde escrever o log de eventos da sessao.");
+#endif
+
+namespace {
+
+std::atomic<bool> g_sair(false);
+
+void TrataSinal(int) {
+  g_sair = true;
+}
+
+void CarregaConfiguracoes(ent::OpcoesProto* proto) {
+  try {
+    arq::LeArquivoAsciiProto(arq::TIPO_CONFIGURACOES, "configuracoes.asciiproto", proto);
+    LOG(INFO) << "Carregando opcoes de arquivo.";
+  } catch (...) {
+    proto->CopyFrom(ent::OpcoesProto::default_instance());
+    LOG(INFO) << "Carregando opcoes padroes.";
+  }
+}
+
+#if !USAR_GLOG
+// Sem glog, faz o parsing das flags na mao.
+std::string ValorFlag(int argc, char** argv, const std::string& nome) {
+  const std::string prefixo = absl::StrCat("--", nome, "=");
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (absl::StartsWith(arg, prefixo)) {
+      return arg.substr(prefixo.size());
+    }
+  }
+  return "";
+}
+#endif
+
+std::string IdRedeMestre(int argc, char** argv) {
+#if USAR_GLOG
+  return absl::GetFlag(FLAGS_mestre);
+#else
+  return ValorFlag(argc, argv, "mestre");
+#endif
+}
+
+std::string ArquivoGravacao(int argc, char** argv) {
+#if USAR_GLOG
+  return absl::GetFlag(FLAGS_gravar_notificacoes);
+#else
+  return ValorFlag(argc, argv, "gravar_notificacoes");
+#endif
+}
+
+std::string ArquivoLogEventos(int argc, char** argv) {
+#if USAR_GLOG
+  return absl::GetFlag(FLAGS_log_eventos);
+#else
+  return ValorFlag(argc, argv, "log_eventos");
+#endif
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  meulog::Inicializa(argc, argv);
+  LOG(INFO) << "Iniciando servidor dedicado";
+  boost::filesystem::path app_dir = boost::dll::program_location().parent_path();
+  arq::Inicializa(app_dir.string());
+
+  ent::OpcoesProto opcoes;
+  CarregaConfiguracoes(&opcoes);
+
+  boost::asio::io_service servico_io;
+  net::Sincronizador sincronizador(&servico_io);
+  ntf::CentralNotificacoes central;
+  // Antes dos outros receptores, para gravar cada notificacao antes dos dados rolados no tratamento dela.
+  std::unique_ptr<ent::GravadorNotificacoes> gravador;
+  if (const std::string arquivo_gravacao = ArquivoGravacao(argc, argv); !arquivo_gravacao.empty()) {
+    try {
+      gravador = std::make_unique<ent::GravadorNotificacoes>(arquivo_gravacao, &central);
+    } catch (const std::logic_error& e) {
+      LOG(ERROR) << e.what();
+      return 1;
+    }
+  }
+  ent::Tabelas tabelas(&central);
+  net::Servidor servidor(&sincronizador, &central);
+  // Texturas e modelos apenas servem os arquivos aos clientes.
+  tex::Texturas texturas(&central);
+  texturas.AlteraSemGrafico(true);
+  m3d::Modelos3d modelos3d(&central);
+  modelos3d.AlteraSemGrafico(true);
+  ent::Tabuleiro tabuleiro(opcoes, tabelas, &texturas, &modelos3d, &central);
+  tabuleiro.AlteraSemGrafico(true);
+  if (gravador != nullptr) {
+    // A reproducao compara os dados na ordem em que foram rolados: nada de carga de entidades em paralelo.
+    tabuleiro.AlteraNumThreadsCarga(1);
+  }
+  servidor.AlteraFiltroInteresse(tabuleiro.MutableInteresseClientes());
+  if (const std::string arquivo_log = ArquivoLogEventos(argc, argv); !arquivo_log.empty()) {
+    try {
+      tabuleiro.MutableLogEventos()->AlteraArquivoSessao(arquivo_log);
+    } catch (const std::logic_error& e) {
+      LOG(ERROR) << e.what();
+      return 1;
+    }
+  }
+
+  if (tabelas.todas().tabela_classes().info_classes().empty()) {
+    LOG(ERROR) << "Erro carregando tabelas, diretorio: " << app_dir.string();
+    return 1;
+  }
+  const std::string id_rede_mestre = IdRedeMestre(argc, argv);
+  if (!id_rede_mestre.empty()) {
+    LOG(INFO) << "Mestre: " << id_rede_mestre;
+    tabuleiro.AlteraIdRedeMestreAutomatico(id_rede_mestre);
+  }
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i][0] == '-') continue;
+    auto n = ntf::NovaNotificacao(ntf::TN_DESERIALIZAR_TABULEIRO);
+    std::string nome(argv[i]);
+    if (!absl::StrContains(nome, "://")) {
+      nome = absl::StrCat("dinamico://", nome);
+    }
+    n->set_endereco(nome);
+    central.AdicionaNotificacao(n.release());
+    LOG(INFO) << "Carregando: " << nome;
+    break;
+  }
+  central.AdicionaNotificacao(ntf::NovaNotificacao(ntf::TN_INICIAR));
+
+  std::signal(SIGINT, TrataSinal);
+  std::signal(SIGTERM, TrataSinal);
+
+  // Simulacao em passos fixos; sem desenho.
+  ent::Escalonador escalonador(std::max(1, static_cast<int>(std::lround(1000.0f / std::max(1.0f, opcoes.fps())))));
+  tabuleiro.AlteraPassoFixoMs(escalonador.PassoMs());
+  while (!g_sair) {
+    for (int passos = escalonador.Passos(ent::Escalonador::Relogio::now()); passos > 0; --passos) {
+      central.AdicionaNotificacao(ntf::NovaNotificacao(ntf::TN_TEMPORIZADOR, central.ArenaCiclo()));
+      central.Notifica();
+    }
+    std::this_thread::sleep_until(escalonador.ProximoPrazo());
+  }
+
+  LOG(INFO) << "Finalizando servidor dedicado. Escalonador: " << escalonador.ResumoEstatisticas();
+  ntf::Notificacao n;
+  n.set_tipo(ntf::TN_SERIALIZAR_TABULEIRO);
+  n.set_endereco("ultimo_tabuleiro_automatico.binproto");
+  tabuleiro.TrataNotificacao(n);
+  central.AdicionaNotificacao(ntf::NovaNotificacao(ntf::TN_SAIR));
+  central.Notifica();
+  tabuleiro.MutableSalvamento()->EsperaTermino();
+  return 0;
+}
@@ -13,9 +13,11 @@
 #endif
 //#define VLOG_NIVEL 1
 #include "log/log.h"
+#include "log/perfil.h"
 
 #include "arq/arquivo.h"
 #include "ent/entidade.pb.h"
+#include "ent/escalonador.h"
 #include "gltab/gl.h"
 #include "ntf/notificacao.pb.h"
 #include "tex/lodepng.h"
@@ -25,42 +27,19 @@ namespace tex {
 
 namespace {
 
-/** Realiza a leitura da imagem de um caminho, preenchendo dados com conteudo do arquivo no caminho.
+/** Realiza a leitura da imagem de um caminho, retornando o conteudo do arquivo no caminho (mapeado, sem copia).
 * Caso local, a textura sera local ao jogador. Caso contrario, eh uma textura global (da aplicacao).
 * @throws std::exception em caso de erro na leitura.
 */
-void LeImagem(bool global, const std::string& arquivo, std::vector<unsigned char>* dados) {
-  boost::filesystem::path caminho(arquivo);
-  std::string dados_str;
+std::unique_ptr<arq::ArquivoMapeado> LeImagem(arq::tipo_e tipo, const std::string& nome) {
   try {
-    arq::LeArquivo(global ? arq::TIPO_TEXTURA : arq::TIPO_TEXTURA_LOCAL, caminho.filename().string(), &dados_str);
-  } catch (const std::exception&) {
-    if (global) {
-      // Fallback de texturas baixadas.
-      try {
-        VLOG(1) << "Tentando fallback de " << arquivo << ", global";
-        arq::LeArquivo(arq::TIPO_TEXTURA_BAIXADA, caminho.filename().string(), &dados_str);
-      } catch (...) {
-        LOG(ERROR) << "Falha lendo arquivo " << arquivo << ", global";
-        throw;
-      }
-    } else {
-      LOG(ERROR) << "Falha lendo arquivo " << arquivo << ", nao global";
-      throw;
-    }
-  }
-  dados->assign(dados_str.begin(), dados_str.end());
-}
-void LeImagem(arq::tipo_e tipo, const std::string& nome, std::vector<unsigned char>* dados) {
-  std::string dados_str;
-  try {
-    arq::LeArquivo(tipo, nome, &dados_str);
+    return arq::MapeiaArquivo(tipo, nome);
   } catch (const std::exception&) {
     if (tipo == arq::TIPO_TEXTURA) {
       // Fallback de texturas baixadas.
       try {
         VLOG(1) << "Tentando fallback de " << nome << ", global";
-        arq::LeArquivo(arq::TIPO_TEXTURA_BAIXADA, nome, &dados_str);
+        return arq::MapeiaArquivo(arq::TIPO_TEXTURA_BAIXADA, nome);
       } catch (...) {
         LOG(ERROR) << "Falha lendo arquivo " << nome << ", global";
         throw;
@@ -70,18 +49,22 @@ void LeImagem(arq::tipo_e tipo, const std::string& nome, std::vector<unsigned ch
       throw;
     }
   }
-  dados->assign(dados_str.begin(), dados_str.end());
+}
+std::unique_ptr<arq::ArquivoMapeado> LeImagem(bool global, const std::string& arquivo) {
+  boost::filesystem::path caminho(arquivo);
+  return LeImagem(global ? arq::TIPO_TEXTURA : arq::TIPO_TEXTURA_LOCAL, caminho.filename().string());
 }
 
 /** Decodifica os dados crus de info_textura, devolvendo altura, largura e os bits decodificados. */
 void DecodificaImagem(
-    const std::string& dados_entrada, unsigned int* plargura, unsigned int* paltura, std::vector<unsigned char>* bits,
+    std::string_view dados_entrada, unsigned int* plargura, unsigned int* paltura, std::vector<unsigned char>* bits,
     bool inverte_y = false, bool inverte_x = false) {
-  std::vector<unsigned char> dados_crus(dados_entrada.begin(), dados_entrada.end());
+  PERFIL_ZONA("tex::DecodificaImagem");
   std::vector<unsigned char> dados;
   lodepng::State estado;
   unsigned int largura = 0, altura = 0;
-  unsigned int error = lodepng::decode(dados, largura, altura, estado, dados_crus);
+  unsigned int error = lodepng::decode(
+      dados, largura, altura, estado, reinterpret_cast<const unsigned char*>(dados_entrada.data()), dados_entrada.size());
   *plargura = largura;
   *paltura = altura;
   if (error != 0) {
@@ -125,8 +108,7 @@ void DecodificaImagem(
     }
   }
 
-  bits->clear();
-  bits->insert(bits->begin(), dados.begin(), dados.end());
+  *bits = std::move(dados);
 }
 
 /** Retorna o formato OpenGL de uma imagem, por exemplo: GL_BGRA. */
@@ -199,11 +181,8 @@ class Texturas::InfoTexturaInterna {
     VLOG(1) << "Relendo textura global, id: '" << imagem_.id() << "'.";
     ent::InfoTextura info_lido;
     try {
-      std::vector<unsigned char> lido;
-      LeImagem(true  /*global*/, imagem_.id(), &lido);
-      imagem_.mutable_bits_crus()->resize(lido.size());
-      imagem_.mutable_bits_crus()->assign((char*)lido.data(), (char*)(lido.data() + lido.size()));
-      //imagem_.mutable_bits_crus()->insert(imagem_.bits_crus().begin(), lido.begin(), lido.end());
+      auto lido = LeImagem(true  /*global*/, imagem_.id());
+      imagem_.mutable_bits_crus()->assign(lido->Visao());
       if (FormatoImagem() == -1) {
         throw std::logic_error("formato invalido");
       }
@@ -378,10 +357,20 @@ void Texturas::DescarregaTexturas(const ntf::Notificacao& notificacao) {
 bool Texturas::TrataNotificacao(const ntf::Notificacao& notificacao) {
   switch (notificacao.tipo()) {
     case ntf::TN_CARREGAR_TEXTURA: {
+      if (sem_grafico_) return true;
+      if (escalonador_ != nullptr) {
+        escalonador_->AdicionaTarefa([this, n = notificacao]() { CarregaTexturas(n); return true; });
+        return true;
+      }
       CarregaTexturas(notificacao);
       return true;
     }
     case ntf::TN_DESCARREGAR_TEXTURA: {
+      if (sem_grafico_) return true;
+      if (escalonador_ != nullptr) {
+        escalonador_->AdicionaTarefa([this, n = notificacao]() { DescarregaTexturas(n); return true; });
+        return true;
+      }
       DescarregaTexturas(notificacao);
       return true;
     }
@@ -393,16 +382,14 @@ bool Texturas::TrataNotificacao(const ntf::Notificacao& notificacao) {
       // Notificacao local: envia os ids de texturas locais para o servidor.
       auto n = ntf::NovaNotificacao(ntf::TN_REQUISITAR_TEXTURAS);
       // Percorre arquivos globais.
-      std::vector<std::string> globais(arq::ConteudoDiretorio(arq::TIPO_TEXTURA));
-      for (const std::string& id : globais ) {
+      for (const std::string& id : *arq::ConteudoDiretorioCompartilhado(arq::TIPO_TEXTURA)) {
         if (id.size() < 4 || id.find(".png") == std::string::npos) {
           continue;
         }
         n->add_info_textura()->set_id(id);
       }
       // Percorre arquivos baixados.
-      std::vector<std::string> baixadas(arq::ConteudoDiretorio(arq::TIPO_TEXTURA_BAIXADA));
-      for (const std::string& id : baixadas) {
+      for (const std::string& id : *arq::ConteudoDiretorioCompartilhado(arq::TIPO_TEXTURA_BAIXADA)) {
         n->add_info_textura()->set_id(id);
       }
       n->set_id_rede(notificacao.id_rede());
@@ -420,11 +407,11 @@ bool Texturas::TrataNotificacao(const ntf::Notificacao& notificacao) {
       VLOG(1) << "Recebendo de cliente TN_REQUISITAR_TEXTURAS: " << notificacao.DebugString();
       std::unordered_set<std::string> ids;
       // Percorre arquivos globais.
-      std::vector<std::string> globais(arq::ConteudoDiretorio(arq::TIPO_TEXTURA));
-      ids.insert(globais.begin(), globais.end());
+      arq::Listagem globais = arq::ConteudoDiretorioCompartilhado(arq::TIPO_TEXTURA);
+      ids.insert(globais->begin(), globais->end());
       // Percorre arquivos baixados.
-      std::vector<std::string> baixadas(arq::ConteudoDiretorio(arq::TIPO_TEXTURA_BAIXADA));
-      ids.insert(baixadas.begin(), baixadas.end());
+      arq::Listagem baixadas = arq::ConteudoDiretorioCompartilhado(arq::TIPO_TEXTURA_BAIXADA);
+      ids.insert(baixadas->begin(), baixadas->end());
       std::set<std::string> ids_cliente;
       std::vector<std::string> ids_faltantes;
       for (const auto& info : notificacao.info_textura()) {
@@ -448,9 +435,7 @@ bool Texturas::TrataNotificacao(const ntf::Notificacao& notificacao) {
       auto n = ntf::NovaNotificacao(ntf::TN_ENVIAR_TEXTURAS);
       for (const auto& id : ids_faltantes) {
         auto* info = n->add_info_textura();
-        std::vector<unsigned char> dados;
-        LeImagem(true  /*global*/, id, &dados);
-        info->mutable_bits_crus()->append(dados.begin(), dados.end());
+        info->mutable_bits_crus()->assign(LeImagem(true  /*global*/, id)->Visao());
         info->set_id(id);
       }
       n->set_id_rede(notificacao.id_rede());
@@ -465,7 +450,11 @@ bool Texturas::TrataNotificacao(const ntf::Notificacao& notificacao) {
       }
       VLOG(1) << "Recebendo TN_ENVIAR_TEXTURAS do servidor";
       for (const auto& info : notificacao.info_textura()) {
-        // Salva bits crus em texturas_baixadas com id da textura.
+        // Salva bits crus em texturas_baixadas com id da textura, se ainda nao tiver exatamente este conteudo.
+        if (arq::ConteudoIgual(arq::TIPO_TEXTURA_BAIXADA, info.id(), info.bits_crus())) {
+          VLOG(1) << "Textura " << info.id() << " ja baixada com o mesmo conteudo";
+          continue;
+        }
         arq::EscreveArquivo(arq::TIPO_TEXTURA_BAIXADA, info.id(), info.bits_crus());
       }
       Recarrega(true  /*rele*/);
@@ -527,6 +516,7 @@ const Texturas::InfoTexturaInterna* Texturas::InfoInterna(const std::string& id)
 }
 
 void Texturas::CarregaTextura(const ent::InfoTextura& info_textura_const) {
+  PERFIL_ZONA("Texturas::CarregaTextura");
   ent::InfoTextura info_textura(info_textura_const);
   if (info_textura.id().find(".cube") != std::string::npos) {
     info_textura.set_textura_cubo(true);
@@ -547,11 +537,9 @@ void Texturas::CarregaTextura(const ent::InfoTextura& info_textura_const) {
       VLOG(1) << "Carregando textura global, id: '" << info_textura.id() << "'.";
       try {
         ent::InfoTextura info_lido;
-        std::vector<unsigned char> lido;
-        LeImagem(true  /*global*/, info_textura.id(), &lido);
+        auto lido = LeImagem(true  /*global*/, info_textura.id());
         info_lido.set_id(info_textura.id());
-        info_lido.mutable_bits_crus()->resize(lido.size());
-        info_lido.mutable_bits_crus()->assign((char*)lido.data(), (char*)(lido.data() + lido.size()));
+        info_lido.mutable_bits_crus()->assign(lido->Visao());
         if (FormatoImagem() == -1) {
           throw std::logic_error("formato invalido");
         }
@@ -581,12 +569,10 @@ void Texturas::CarregaTextura(const ent::InfoTextura& info_textura_const) {
         std::string prefixo = info_textura.id();
         prefixo.replace(prefixo.find(".cube"), 5, "");
         for (const auto& dados_textura : dados_texturas) {
-          std::vector<unsigned char> lido;
-          LeImagem(true  /*global*/, prefixo + dados_textura.sufixo, &lido);
+          auto lido = LeImagem(true  /*global*/, prefixo + dados_textura.sufixo);
           info_lido.set_id(info_textura.id());
           info_lido.set_textura_cubo(true);
-          dados_textura.bits_crus->resize(lido.size());
-          dados_textura.bits_crus->assign((char*)lido.data(), (char*)(lido.data() + lido.size()));
+          dados_textura.bits_crus->assign(lido->Visao());
           if (FormatoImagem() == -1) {
             throw std::logic_error("formato invalido");
           }
@@ -620,28 +606,25 @@ void Texturas::DescarregaTextura(const ent::InfoTextura& info_textura) {
 // static
 void Texturas::LeDecodificaImagem(
     bool global, const std::string& caminho, ent::InfoTextura* info_textura, unsigned int* largura, unsigned int* altura) {
-  std::vector<unsigned char> dados_arquivo;
-  LeImagem(global, caminho, &dados_arquivo);
-  if (dados_arquivo.size() <= 0) {
+  auto arquivo = LeImagem(global, caminho);
+  if (arquivo->tamanho() <= 0) {
     throw std::logic_error(std::string("Erro lendo imagem: ") + caminho);
   }
-  info_textura->clear_bits_crus();
-  info_textura->mutable_bits_crus()->append(dados_arquivo.begin(), dados_arquivo.end());
+  info_textura->mutable_bits_crus()->assign(arquivo->Visao());
+  // Decodifica direto dos bytes mapeados.
   std::vector<unsigned char> nao_usado;
-  DecodificaImagem(info_textura->bits_crus(), largura, altura, &nao_usado);
+  DecodificaImagem(arquivo->Visao(), largura, altura, &nao_usado);
 }
 
 void Texturas::LeDecodificaImagemTipo(
     arq::tipo_e tipo, const std::string& nome, ent::InfoTextura* info_textura, unsigned int* largura, unsigned int* altura) {
-  std::vector<unsigned char> dados_arquivo;
-  LeImagem(tipo, nome, &dados_arquivo);
-  if (dados_arquivo.size() <= 0) {
+  auto arquivo = LeImagem(tipo, nome);
+  if (arquivo->tamanho() <= 0) {
     throw std::logic_error(std::string("Erro lendo imagem: ") + nome);
   }
-  info_textura->clear_bits_crus();
-  info_textura->mutable_bits_crus()->append(dados_arquivo.begin(), dados_arquivo.end());
+  info_textura->mutable_bits_crus()->assign(arquivo->Visao());
   std::vector<unsigned char> nao_usado;
-  DecodificaImagem(info_textura->bits_crus(), largura, altura, &nao_usado);
+  DecodificaImagem(arquivo->Visao(), largura, altura, &nao_usado);
 }
 
 }  // namespace tex
@@ -8,6 +8,10 @@
 
 #define DIR_TEXTURAS "texturas"
 
+namespace ent {
+class Escalonador;
+}  // namespace ent
+
 namespace tex {
 
 /** Gerencia carregamento de texturas atraves de notificacoes. */
@@ -31,6 +35,15 @@ class Texturas : public ent::Texturas, public ntf::Receptor {
   void CarregaTexturas(const ntf::Notificacao& notificacao);
   void DescarregaTexturas(const ntf::Notificacao& notificacao);
 
+  /** Sem grafico (servidor dedicado), nao ha contexto OpenGL: as texturas nao sao carregadas, apenas servidas aos
+  * clientes que as requisitam.
+  */
+  void AlteraSemGrafico(bool sem_grafico) { sem_grafico_ = sem_grafico; }
+  /** Com escalonador, cargas e descargas viram tarefas de fundo, feitas em ordem dentro do orcamento de cada ciclo, em
+  * vez de travar o ciclo que as pediu. Ate a carga, a textura eh invalida. Nao possui o escalonador.
+  */
+  void AlteraEscalonador(ent::Escalonador* escalonador) { escalonador_ = escalonador; }
+
   /** Le e decodifica uma imagem, preenchendo os bits crus de info_textura e retornando as dimensoes.
   * @throw std::logic_error caso a leitura da imagem falhe.
   */
@@ -62,6 +75,8 @@ class Texturas : public ent::Texturas, public ntf::Receptor {
   ntf::CentralNotificacoes* central_;
   // Mapeia id da textura para sua informacao interna.
   std::unordered_map<std::string, InfoTexturaInterna*> texturas_;
+  bool sem_grafico_ = false;
+  ent::Escalonador* escalonador_ = nullptr;
 };
 
 }  // namespace tex